@@ -0,0 +1,408 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       action_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "action_manager.h"
+#include "gpio_manager.h"
+#include "pwm_manager.h"
+#include "param_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* GPIO action handler */
+Action_Manager action;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Gpio handler */
+extern Gpio_Manager gpio;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Action_Init
+ *  - This function loads the schedules and the SNTP server from NvM and starts SNTP
+ *  - Schedules are armed when the clock gets synchronized
+ */
+void Action_Manager::Action_Init()
+{
+  wheel.Tmr_WheelInit(Action_Expired);
+  tick_ms = millis();
+  fired = 0;
+  time_valid = false;
+
+  eeprom.Nvm_SchedulesRead(schedules);
+  eeprom.Nvm_NtpServerRead(ntp_server);
+
+  for(uint8_t idx = 0; idx < NVM_SCHEDULES_MAX; idx++)
+  {
+    schedule_handle[idx] = TMR_WHEEL_INVALID;
+  }
+
+  Action_TimeConfig();
+}
+
+
+/*
+ * Action_Process
+ *  - This function advances the timer wheel by the ticks elapsed since the last call and
+ *    re-arms the schedules when the clock was set or stepped
+ *  - This function should be called periodically (every ACTION_TICK_MS) in the loop
+ */
+void Action_Manager::Action_Process()
+{
+  uint32_t ticks = (millis() - tick_ms) / ACTION_TICK_MS;
+
+  if(0 != ticks)
+  {
+    tick_ms += ticks * ACTION_TICK_MS;
+    fired += wheel.Tmr_WheelAdvance(ticks);
+  }
+
+  Action_TimeCheck();
+}
+
+
+/*
+ * Action_TimeConfig
+ *  - This function (re)starts SNTP with the configured server and time zone
+ *  - Daylight saving time is not applied - time zone offset has to be changed
+ */
+void Action_Manager::Action_TimeConfig()
+{
+  const char *server = ('\0' != ntp_server[0]) ? ntp_server : ACTION_NTP_SERVER;
+  int32_t tz_offset_min = (int32_t)param.Param_Get(Param_ID_TzOffset);
+
+  configTime(tz_offset_min * 60, 0, server);
+
+  /* Local time of the schedules has changed */
+  time_valid = false;
+
+  LOG_INFO(Log_Module_Action, "SNTP: %s, time zone: UTC%+d min", server, tz_offset_min);
+}
+
+
+/*
+ * Action_SetNtpServer
+ *  - This function stores the SNTP server (host name or IP, empty - default) and restarts SNTP
+ */
+bool Action_Manager::Action_SetNtpServer(const char *server)
+{
+  uint16_t len = strlen(server);
+
+  if((len > NVM_NTP_SERVER_MAX_SIZE) || !eeprom.Nvm_NtpServerWrite(server, len))
+  {
+    return false;
+  }
+
+  eeprom.Nvm_NtpServerRead(ntp_server);
+  Action_TimeConfig();
+  return true;
+}
+
+
+/*
+ * Action_After
+ *  - This function sets the output level after the delay (ex. auto-off), the delay is
+ *    rounded up to the wheel tick
+ *  - It returns the handle for Action_Cancel() or TMR_WHEEL_INVALID on error
+ */
+uint32_t Action_Manager::Action_After(uint8_t pin_id, uint8_t level, uint32_t delay_ms)
+{
+  uint32_t ticks = (delay_ms + ACTION_TICK_MS - 1) / ACTION_TICK_MS;
+
+  if((pin_id >= GPIO_REMOTE_USED) || (delay_ms > ACTION_DELAY_MAX_MS))
+  {
+    return TMR_WHEEL_INVALID;
+  }
+
+  return wheel.Tmr_WheelAdd((0 == ticks) ? 1 : ticks, ACTION_DATA(pin_id, level));
+}
+
+
+/*
+ * Action_Pulse
+ *  - This function switches the output ON now and OFF after length_ms
+ *  - It returns the handle of the OFF action or TMR_WHEEL_INVALID on error (output unchanged)
+ */
+uint32_t Action_Manager::Action_Pulse(uint8_t pin_id, uint32_t length_ms)
+{
+  uint32_t handle = Action_After(pin_id, 0, length_ms);
+
+  if(TMR_WHEEL_INVALID != handle)
+  {
+    gpio.Gpio_Set(pin_id, true);
+  }
+
+  return handle;
+}
+
+
+/*
+ * Action_Cancel
+ *  - This function cancels the pending action (false - it has been done already)
+ */
+bool Action_Manager::Action_Cancel(uint32_t handle)
+{
+  return wheel.Tmr_WheelCancel(handle);
+}
+
+
+/*
+ * Action_ScheduleAdd
+ *  - This function stores new daily schedule - level is set every day at minute (local time)
+ *  - It returns the schedule index or -1 when there is no free entry or NvM write failed
+ */
+int8_t Action_Manager::Action_ScheduleAdd(uint8_t pin_id, uint16_t minute, uint8_t level)
+{
+  if((pin_id >= GPIO_REMOTE_USED) || (minute >= ACTION_DAY_MIN))
+  {
+    return -1;
+  }
+
+  for(uint8_t idx = 0; idx < NVM_SCHEDULES_MAX; idx++)
+  {
+    if(0 == schedules[idx].used)
+    {
+      schedules[idx].used = 1;
+      schedules[idx].pin_id = pin_id;
+      schedules[idx].level = level;
+      schedules[idx].reserved = 0;
+      schedules[idx].minute = minute;
+
+      if(!eeprom.Nvm_SchedulesWrite(schedules))
+      {
+        schedules[idx].used = 0;
+        return -1;
+      }
+
+      Action_ScheduleArm(idx, false);
+      return (int8_t)idx;
+    }
+  }
+
+  return -1;
+}
+
+
+/*
+ * Action_ScheduleDel
+ *  - This function removes the daily schedule
+ */
+bool Action_Manager::Action_ScheduleDel(uint8_t idx)
+{
+  if((idx >= NVM_SCHEDULES_MAX) || (0 == schedules[idx].used))
+  {
+    return false;
+  }
+
+  (void)wheel.Tmr_WheelCancel(schedule_handle[idx]);
+  schedule_handle[idx] = TMR_WHEEL_INVALID;
+  schedules[idx].used = 0;
+
+  return eeprom.Nvm_SchedulesWrite(schedules);
+}
+
+
+/*
+ * Action_ParseTime
+ *  - This function converts "HH:MM" to the minute of the day
+ */
+bool Action_Manager::Action_ParseTime(const char *hhmm, uint16_t &minute)
+{
+  unsigned int hour;
+  unsigned int min;
+  char end;
+
+  if((2 != sscanf(hhmm, "%u:%u%c", &hour, &min, &end)) || (hour > 23) || (min > 59))
+  {
+    return false;
+  }
+
+  minute = (uint16_t)((hour * 60) + min);
+  return true;
+}
+
+
+/*
+ * Action_IsTimeValid
+ *  - This function returns true if the clock has been synchronized by SNTP
+ */
+bool Action_Manager::Action_IsTimeValid()
+{
+  return time_valid;
+}
+
+
+/*
+ * Action_Dump
+ *  - This function appends the clock state, pending actions and schedules to out
+ */
+void Action_Manager::Action_Dump(String &out)
+{
+  char line[96];
+  time_t now = time(nullptr);
+  struct tm local;
+
+  if(time_valid)
+  {
+    localtime_r(&now, &local);
+    snprintf(line, sizeof(line), "ACTION -> Time: %04d-%02d-%02d %02d:%02d:%02d (UTC%+d min)\r\n",
+             local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec,
+             (int32_t)param.Param_Get(Param_ID_TzOffset));
+  }
+  else
+  {
+    snprintf(line, sizeof(line), "ACTION -> Time: not synchronized\r\n");
+  }
+  out += line;
+
+  snprintf(line, sizeof(line), "ACTION -> SNTP: %s\r\n", ('\0' != ntp_server[0]) ? ntp_server : ACTION_NTP_SERVER);
+  out += line;
+
+  snprintf(line, sizeof(line), "ACTION -> Pending: %u/%u (max %u), done: %u, tick: %u ms\r\n",
+           wheel.Tmr_WheelGetPending(), TMR_WHEEL_NODES_MAX, wheel.Tmr_WheelGetPendingMax(), fired, ACTION_TICK_MS);
+  out += line;
+
+  for(uint8_t idx = 0; idx < NVM_SCHEDULES_MAX; idx++)
+  {
+    const Nvm_Schedule_T *s = &schedules[idx];
+
+    if(0 == s->used)
+    {
+      continue;
+    }
+
+    snprintf(line, sizeof(line), "ACTION -> Schedule %u: GPIO %u level %u at %02u:%02u%s\r\n", idx + 1,
+             GpioPin[s->pin_id], s->level, s->minute / 60, s->minute % 60,
+             wheel.Tmr_WheelIsPending(schedule_handle[idx]) ? "" : " (waiting for time)");
+    out += line;
+  }
+}
+
+
+/*
+ * Action_Expired
+ *  - Timer wheel callback - applies the action, daily schedule is armed for the next day
+ */
+void Action_Manager::Action_Expired(uint16_t data)
+{
+  if(0 != (data & ACTION_DATA_SCHEDULE))
+  {
+    uint8_t idx = (uint8_t)(data & 0xFF);
+
+    action.schedule_handle[idx] = TMR_WHEEL_INVALID;
+    gpio.Gpio_SetLevel(action.schedules[idx].pin_id, action.schedules[idx].level, 0);
+    action.Action_ScheduleArm(idx, true);
+  }
+  else
+  {
+    gpio.Gpio_SetLevel((uint8_t)((data >> 8) & 0x7F), (uint8_t)(data & 0xFF), 0);
+  }
+}
+
+
+/*
+ * Action_TimeCheck
+ *  - This function re-arms all schedules when the clock gets valid or steps against millis()
+ *    (SNTP update) - drift of the wheel is corrected this way too
+ */
+void Action_Manager::Action_TimeCheck()
+{
+  time_t now = time(nullptr);
+  uint32_t now_ms = millis();
+
+  if(now < ACTION_TIME_VALID)
+  {
+    time_valid = false;
+    return;
+  }
+
+  int32_t step_s = (int32_t)(now - (time_ref + (time_t)((now_ms - time_ref_ms) / 1000)));
+
+  if(time_valid && (abs(step_s) <= ACTION_TIME_JUMP_S))
+  {
+    return;
+  }
+
+  if(time_valid)
+  {
+    LOG_WARN(Log_Module_Action, "Clock stepped by %d s, schedules re-armed", step_s);
+  }
+  else
+  {
+    LOG_INFO(Log_Module_Action, "Clock synchronized, schedules armed");
+  }
+
+  time_valid = true;
+  time_ref = now;
+  time_ref_ms = now_ms;
+  Action_ScheduleArmAll();
+}
+
+
+/*
+ * Action_ScheduleArm
+ *  - This function starts the timer of the schedule for its next occurrence
+ *  - refire - called by the fired schedule, occurrence within the guard is the current one
+ */
+void Action_Manager::Action_ScheduleArm(uint8_t idx, bool refire)
+{
+  if(!time_valid || (0 == schedules[idx].used))
+  {
+    return;
+  }
+
+  int32_t delay_s = ((int32_t)schedules[idx].minute * 60) - Action_LocalSecOfDay();
+
+  while(delay_s <= (refire ? ACTION_REARM_GUARD_S : 0))
+  {
+    delay_s += ACTION_DAY_S;
+  }
+
+  schedule_handle[idx] = wheel.Tmr_WheelAdd(((uint32_t)delay_s * 1000) / ACTION_TICK_MS, ACTION_DATA_SCHEDULE | idx);
+}
+
+
+/*
+ * Action_ScheduleArmAll
+ *  - This function arms all schedules again (clock or time zone has changed)
+ */
+void Action_Manager::Action_ScheduleArmAll()
+{
+  for(uint8_t idx = 0; idx < NVM_SCHEDULES_MAX; idx++)
+  {
+    (void)wheel.Tmr_WheelCancel(schedule_handle[idx]);
+    schedule_handle[idx] = TMR_WHEEL_INVALID;
+    Action_ScheduleArm(idx, false);
+  }
+}
+
+
+/*
+ * Action_LocalSecOfDay
+ *  - This function returns the local time as seconds since midnight
+ */
+int32_t Action_Manager::Action_LocalSecOfDay()
+{
+  time_t now = time(nullptr);
+  struct tm local;
+
+  localtime_r(&now, &local);
+  return (local.tm_hour * 3600) + (local.tm_min * 60) + local.tm_sec;
+}
+
+/* EOF */
@@ -0,0 +1,90 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       action_manager.h
+ */
+#ifndef _ACTION_MANAGER_H_
+#define _ACTION_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <time.h>
+#include "tmr_wheel.h"
+#include "nvm_manager.h"
+#include "sched_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Wheel tick - resolution of the delayed actions */
+#define ACTION_TICK_MS              (SCHED_ACTION_PERIOD_MS)
+#define ACTION_DELAY_MAX_MS         ((uint32_t)TMR_WHEEL_DELAY_MAX * ACTION_TICK_MS)
+
+/* Default SNTP server (used when none is stored) and time zone - runtime value is kept by Param_Manager */
+#define ACTION_NTP_SERVER           "pool.ntp.org"
+#define ACTION_TZ_OFFSET_MIN        (0)
+
+/* Clock before 2020-01-01 has not been synchronized yet */
+#define ACTION_TIME_VALID           ((time_t)1577836800)
+
+/* Clock step (SNTP sync, drift correction) which re-arms the schedules */
+#define ACTION_TIME_JUMP_S          (2)
+
+/* Schedule fired that much early is not fired again the same day */
+#define ACTION_REARM_GUARD_S        (60)
+
+#define ACTION_DAY_S                ((int32_t)86400)
+#define ACTION_DAY_MIN              ((uint16_t)1440)
+
+/* Timer data - delayed action (pin id and level) or schedule index */
+#define ACTION_DATA_SCHEDULE        ((uint16_t)0x8000)
+#define ACTION_DATA(pin_id, level)  ((uint16_t)(((pin_id) << 8) | (level)))
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Action_Manager
+{
+  public:
+    void Action_Init();
+    void Action_Process();
+    void Action_TimeConfig();
+    bool Action_SetNtpServer(const char *server);
+
+    uint32_t Action_After(uint8_t pin_id, uint8_t level, uint32_t delay_ms);
+    uint32_t Action_Pulse(uint8_t pin_id, uint32_t length_ms);
+    bool Action_Cancel(uint32_t handle);
+
+    int8_t Action_ScheduleAdd(uint8_t pin_id, uint16_t minute, uint8_t level);
+    bool Action_ScheduleDel(uint8_t idx);
+    bool Action_ParseTime(const char *hhmm, uint16_t &minute);
+
+    bool Action_IsTimeValid();
+    void Action_Dump(String &out);
+
+  private:
+    Tmr_Wheel wheel;
+    Nvm_Schedule_T schedules[NVM_SCHEDULES_MAX];
+    uint32_t schedule_handle[NVM_SCHEDULES_MAX];
+
+    /* SNTP keeps the pointer - buffer must stay valid */
+    char ntp_server[NVM_NTP_SERVER_MAX_SIZE + 1];
+
+    uint32_t tick_ms;
+    uint32_t fired;
+    bool time_valid;
+    time_t time_ref;
+    uint32_t time_ref_ms;
+
+    static void Action_Expired(uint16_t data);
+    void Action_TimeCheck();
+    void Action_ScheduleArm(uint8_t idx, bool refire);
+    void Action_ScheduleArmAll();
+    int32_t Action_LocalSecOfDay();
+};
+
+#endif /* _ACTION_MANAGER_H_ */
+
+/* EOF */
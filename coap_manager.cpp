@@ -0,0 +1,307 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       coap_manager.cpp
+ *
+ *  CoAP endpoint for polling collectors (UDP, messages and resources in coap_packet.cpp):
+ *    - GET coap://<node>/sensors and /gpio, JSON (default) or binary record (Accept: 42)
+ *    - one datagram per request and response - no connection, no HTTP header, no login
+ *    - resources are serialized once per sample and output change, the request is answered
+ *      from the snapshot
+ *    - discovery: GET coap://224.0.1.187/.well-known/core, every node answers after a random delay
+ *    - port is a parameter (0 - off), the group is joined again after every WiFi reconnect
+ *    - node CPU time per request in "coap" and /metrics (as the HTTP server),
+ *      benchmark against the HTTP path: tools/coap_bench (measured on the host stand-in only so far)
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "coap_manager.h"
+#include "param_manager.h"
+#include "action_manager.h"
+#include "pwm_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* CoAP handler */
+Coap_Manager coap;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Gpio handler */
+extern Gpio_Manager gpio;
+
+/* PWM handler */
+extern Pwm_Manager pwm;
+
+/* GPIO action handler */
+extern Action_Manager action;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Coap_Init
+ *  - This function resets the snapshot and statistics and applies the port
+ */
+void Coap_Manager::Coap_Init()
+{
+  Coap_SnapshotInit(&snapshot);
+
+  for(uint8_t pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++)
+  {
+    gpio_levels[pin_id] = gpio.Gpio_Get(pin_id) ? pwm.Pwm_GetTarget(pin_id) : 0;
+  }
+  Coap_SnapshotGpio(&snapshot, GpioPin, gpio_levels, GPIO_REMOTE_USED);
+
+  joined = false;
+  delayed = false;
+  sample_seq = 0;
+  msg_id = (uint16_t)random(0x10000);
+  requests = 0;
+  discovery = 0;
+  errors = 0;
+  dropped = 0;
+  busy_us = 0;
+
+  Coap_Config();
+}
+
+
+/*
+ * Coap_Config
+ *  - This function (re)opens the socket on the port parameter (0 - off)
+ */
+void Coap_Manager::Coap_Config()
+{
+  port = (uint16_t)param.Param_Get(Param_ID_CoapPort);
+
+  udp.stop();
+  joined = false;
+  delayed = false;
+}
+
+
+/*
+ * Coap_Process
+ *  - This function joins the group, answers up to COAP_RX_BURST_MAX requests and sends the delayed
+ *    multicast answer
+ *  - This function should be called periodically in the loop
+ */
+void Coap_Manager::Coap_Process()
+{
+  if(0 == port)
+  {
+    return;
+  }
+
+  if(!WiFi.isConnected())
+  {
+    if(joined)
+    {
+      udp.stop();
+      joined = false;
+      delayed = false;
+    }
+    return;
+  }
+
+  if(!joined)
+  {
+    IPAddress group(COAP_MULTICAST_GROUP);
+
+    if(!udp.beginMulticast(WiFi.localIP(), group, port))
+    {
+      return;
+    }
+
+    joined = true;
+    LOG_INFO(Log_Module_Coap, "Listening on port %u", port);
+  }
+
+  Coap_UpdateGpio();
+
+  for(uint8_t count = 0; (count < COAP_RX_BURST_MAX) && (udp.parsePacket() > 0); count++)
+  {
+    Coap_Handle();
+  }
+
+  if(delayed && ((uint32_t)(millis() - delayed_start_ms) >= delayed_wait_ms))
+  {
+    delayed = false;
+    Coap_Send(delayed_ip, delayed_port, delayed_buf, delayed_len);
+  }
+}
+
+
+/*
+ * Coap_OnSample
+ *  - This function serializes the new sensor sample into the snapshot (samples with NaN are skipped)
+ *  - Called after every measurement (Sensor_UpdateValues)
+ */
+void Coap_Manager::Coap_OnSample(const Sensor::Sensor_Values_T &values)
+{
+  Mqtt_Sample_T sample;
+
+  if(0 == port)
+  {
+    return;
+  }
+
+  if((values.temperature != values.temperature) || (values.humidity != values.humidity) ||
+     (values.pressure != values.pressure))
+  {
+    return;
+  }
+
+  sample.seq = sample_seq++;
+  sample.time_ms = millis();
+  sample.epoch = action.Action_IsTimeValid() ? (uint32_t)time(nullptr) : 0;
+  sample.temperature_cdeg = (int16_t)lroundf(values.temperature * 100.0F);
+  sample.humidity_cpct = (uint16_t)lroundf(values.humidity * 100.0F);
+  sample.pressure_pa = (uint32_t)lroundf(values.pressure * 100.0F);
+  sample.light = (uint16_t)values.light;
+
+  Coap_SnapshotSensors(&snapshot, &sample);
+}
+
+
+/*
+ * Coap_Dump
+ *  - This function appends the endpoint state, requests and node time per request to out
+ */
+void Coap_Manager::Coap_Dump(String &out)
+{
+  char line[160];
+  uint32_t per_request_us = (0 != requests) ? (busy_us / requests) : 0;
+
+  snprintf(line, sizeof(line), "COAP -> Port: %u (%s), snapshot: %u B JSON, %u B binary\r\n",
+           port, (0 == port) ? "off" : (joined ? "listening" : "waiting for WiFi"),
+           snapshot.sensors_json_len, snapshot.sensors_bin_len);
+  out += line;
+
+  snprintf(line, sizeof(line), "COAP -> Requests: %u (discovery: %u), errors: %u, dropped: %u, busy: %u us/request\r\n",
+           requests, discovery, errors, dropped, per_request_us);
+  out += line;
+}
+
+
+/*
+ * Coap_Metrics
+ *  - This function appends the endpoint metrics (Prometheus text format) to out
+ */
+void Coap_Manager::Coap_Metrics(String &out)
+{
+  out += "ibeacon_coap_requests_total " + String(requests) + "\n";
+  out += "ibeacon_coap_discovery_total " + String(discovery) + "\n";
+  out += "ibeacon_coap_errors_total " + String(errors) + "\n";
+  out += "ibeacon_coap_dropped_total " + String(dropped) + "\n";
+  out += "ibeacon_coap_busy_us_total " + String(busy_us) + "\n";
+}
+
+
+/*
+ * Coap_GetSnapshot
+ *  - This function returns the serialized resources (the HTTP /sensors page sends the same JSON)
+ */
+const Coap_Snapshot_T &Coap_Manager::Coap_GetSnapshot()
+{
+  return snapshot;
+}
+
+
+/*
+ * Coap_UpdateGpio
+ *  - This function serializes the output levels when one of them changed
+ */
+void Coap_Manager::Coap_UpdateGpio()
+{
+  bool changed = false;
+
+  for(uint8_t pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++)
+  {
+    uint8_t target = gpio.Gpio_Get(pin_id) ? pwm.Pwm_GetTarget(pin_id) : 0;
+
+    changed = changed || (target != gpio_levels[pin_id]);
+    gpio_levels[pin_id] = target;
+  }
+
+  if(changed)
+  {
+    Coap_SnapshotGpio(&snapshot, GpioPin, gpio_levels, GPIO_REMOTE_USED);
+  }
+}
+
+
+/*
+ * Coap_Handle
+ *  - This function answers the received datagram, the answer to a multicast request is delayed
+ */
+void Coap_Manager::Coap_Handle()
+{
+  uint32_t start_us = micros();
+  uint8_t rx_buf[COAP_RX_MAX_SIZE];
+  uint8_t tx_buf[COAP_TX_MAX_SIZE];
+  Coap_Message_T req;
+  IPAddress destination = udp.destinationIP();
+  bool multicast = (0xE0 == (destination[0] & 0xF0));
+  int len = udp.available();
+  size_t tx_len;
+
+  if((len > (int)sizeof(rx_buf)) || (udp.read(rx_buf, len) != len) || !Coap_Parse(rx_buf, len, &req))
+  {
+    dropped++;
+    return;
+  }
+
+  tx_len = Coap_Respond(&snapshot, &req, multicast, msg_id, tx_buf, sizeof(tx_buf));
+
+  if(0 != tx_len)
+  {
+    requests++;
+    msg_id++;
+    errors += (COAP_CODE_CONTENT != tx_buf[1]) ? 1 : 0;
+
+    if(multicast)
+    {
+      /* Discovery requests of the collector are repeated - one answer is pending at a time */
+      discovery++;
+      if(!delayed)
+      {
+        delayed = true;
+        delayed_ip = udp.remoteIP();
+        delayed_port = udp.remotePort();
+        delayed_start_ms = millis();
+        delayed_wait_ms = (uint32_t)random(COAP_LEISURE_MS);
+        delayed_len = (uint8_t)tx_len;
+        memcpy(delayed_buf, tx_buf, tx_len);
+      }
+    }
+    else
+    {
+      Coap_Send(udp.remoteIP(), udp.remotePort(), tx_buf, tx_len);
+    }
+  }
+
+  busy_us += micros() - start_us;
+}
+
+
+/*
+ * Coap_Send
+ *  - This function sends the datagram to the requester
+ */
+void Coap_Manager::Coap_Send(IPAddress ip, uint16_t remote_port, const uint8_t *buf, size_t len)
+{
+  if(!udp.beginPacket(ip, remote_port) || (udp.write(buf, len) != len) || !udp.endPacket())
+  {
+    LOG_DEBUG(Log_Module_Coap, "Response to %s not sent", ip.toString().c_str());
+  }
+}
+
+/* EOF */
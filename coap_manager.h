@@ -0,0 +1,73 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       coap_manager.h
+ */
+#ifndef _COAP_MANAGER_H_
+#define _COAP_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "coap_packet.h"
+#include "gpio_manager.h"
+#include "snsr_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Datagrams handled in one call of Coap_Process() */
+#define COAP_RX_BURST_MAX           (4)
+
+/* Multicast answer is delayed by a random time up to the leisure - nodes of the group do not answer at once */
+#define COAP_LEISURE_MS             (500)
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Coap_Manager
+{
+  public:
+    void Coap_Init();
+    void Coap_Config();
+    void Coap_Process();
+    void Coap_OnSample(const Sensor::Sensor_Values_T &values);
+    void Coap_Dump(String &out);
+    void Coap_Metrics(String &out);
+    const Coap_Snapshot_T &Coap_GetSnapshot();
+
+  private:
+    WiFiUDP udp;
+    uint16_t port;
+    bool joined;
+    Coap_Snapshot_T snapshot;
+    uint8_t gpio_levels[GPIO_REMOTE_USED];
+    uint32_t sample_seq;
+    uint16_t msg_id;
+
+    /* Multicast response waiting for its leisure delay */
+    bool delayed;
+    IPAddress delayed_ip;
+    uint16_t delayed_port;
+    uint32_t delayed_start_ms;
+    uint32_t delayed_wait_ms;
+    uint8_t delayed_len;
+    uint8_t delayed_buf[COAP_TX_MAX_SIZE];
+
+    uint32_t requests;
+    uint32_t discovery;
+    uint32_t errors;
+    uint32_t dropped;
+    uint32_t busy_us;
+
+    void Coap_UpdateGpio();
+    void Coap_Handle();
+    void Coap_Send(IPAddress ip, uint16_t remote_port, const uint8_t *buf, size_t len);
+};
+
+#endif /* _COAP_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,545 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       coap_packet.cpp
+ *
+ *  CoAP (RFC 7252) messages and the read-only resources of the node:
+ *    - /sensors  last sample, JSON (as the MQTT samples) or 24 byte binary record
+ *    - /gpio     output levels 0..255, JSON {"<pin>":<level>} or binary record
+ *    - /.well-known/core  resource list (CoRE link format) - multicast discovery
+ *    - resources are serialized when the value changes (snapshot), a request only copies
+ *      the snapshot behind the header - no formatting per request
+ *    - confirmable requests get a piggybacked ACK, multicast requests are never answered
+ *      with an error
+ *
+ *  Binary records (content format 42, little endian):
+ *    /sensors  u8 version (1), u8 flags (bit 0 - time valid), u32 seq, u32 up_ms, u32 time,
+ *              i16 temperature 0.01 degC, u16 humidity 0.01 %, u32 pressure Pa, u16 light
+ *    /gpio     u8 version (1), u8 count, count x (u8 pin, u8 level)
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/coap_bench
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <string.h>
+#include "coap_packet.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define COAP_VERSION                (1)
+#define COAP_PAYLOAD_MARKER         (0xFF)
+#define COAP_RECORD_VERSION         (1)
+
+/* Options */
+#define COAP_OPTION_URI_HOST        (3)
+#define COAP_OPTION_URI_PORT        (7)
+#define COAP_OPTION_URI_PATH        (11)
+#define COAP_OPTION_CONTENT_FORMAT  (12)
+#define COAP_OPTION_URI_QUERY       (15)
+#define COAP_OPTION_ACCEPT          (17)
+
+/* Option delta and length nibbles with extended bytes */
+#define COAP_NIBBLE_EXT8            (13)
+#define COAP_NIBBLE_EXT16           (14)
+#define COAP_NIBBLE_RESERVED        (15)
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static const char coap_core_links[] =
+  "</sensors>;rt=\"ibeacon.sensors\";ct=\"50 42\",</gpio>;rt=\"ibeacon.gpio\";ct=\"50 42\"";
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static bool Coap_GetNibble(const uint8_t *buf, size_t len, size_t *pos, uint8_t nibble, uint32_t *value);
+static size_t Coap_PutOption(uint8_t *buf, size_t size, size_t pos, uint16_t *last, uint16_t number,
+                             const uint8_t *value, size_t len);
+static size_t Coap_PutUint(uint8_t *buf, size_t size, size_t pos, uint16_t *last, uint16_t number, uint32_t value);
+static void Coap_Put16(uint8_t *buf, uint16_t value);
+static void Coap_Put32(uint8_t *buf, uint32_t value);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Coap_Parse
+ *  - This function parses the header, token, the options used by the resources and the payload
+ *  - Unknown critical options set bad_option, returns false for malformed messages
+ */
+bool Coap_Parse(const uint8_t *buf, size_t len, Coap_Message_T *msg)
+{
+  uint16_t number = 0;
+  size_t path_len = 0;
+  bool path_overflow = false;
+  size_t pos;
+
+  if((len < 4) || ((buf[0] >> 6) != COAP_VERSION) || ((buf[0] & 0x0F) > COAP_TOKEN_MAX_SIZE))
+  {
+    return false;
+  }
+
+  msg->type = (buf[0] >> 4) & 0x03;
+  msg->token_len = buf[0] & 0x0F;
+  msg->code = buf[1];
+  msg->msg_id = (uint16_t)((buf[2] << 8) | buf[3]);
+  msg->path[0] = '\0';
+  msg->accept = COAP_FORMAT_NONE;
+  msg->content_format = COAP_FORMAT_NONE;
+  msg->bad_option = false;
+  msg->payload = NULL;
+  msg->payload_len = 0;
+
+  pos = 4 + msg->token_len;
+  if(pos > len)
+  {
+    return false;
+  }
+  memcpy(msg->token, &buf[4], msg->token_len);
+
+  while(pos < len)
+  {
+    uint32_t delta;
+    uint32_t opt_len;
+    uint8_t header = buf[pos++];
+
+    if(COAP_PAYLOAD_MARKER == header)
+    {
+      /* Marker followed by no payload is a format error */
+      if(pos == len)
+      {
+        return false;
+      }
+      msg->payload = &buf[pos];
+      msg->payload_len = len - pos;
+      break;
+    }
+
+    if(!Coap_GetNibble(buf, len, &pos, header >> 4, &delta) ||
+       !Coap_GetNibble(buf, len, &pos, header & 0x0F, &opt_len) ||
+       ((pos + opt_len) > len) || ((number + delta) > 0xFFFF))
+    {
+      return false;
+    }
+
+    number = (uint16_t)(number + delta);
+
+    switch(number)
+    {
+      case COAP_OPTION_URI_PATH:
+      {
+        if((path_len + 1 + opt_len) >= sizeof(msg->path))
+        {
+          path_overflow = true;
+          break;
+        }
+
+        if(0 != path_len)
+        {
+          msg->path[path_len++] = '/';
+        }
+        memcpy(&msg->path[path_len], &buf[pos], opt_len);
+        path_len += opt_len;
+        msg->path[path_len] = '\0';
+        break;
+      }
+
+      case COAP_OPTION_CONTENT_FORMAT:
+      case COAP_OPTION_ACCEPT:
+      {
+        uint32_t value = 0;
+
+        for(uint32_t idx = 0; (idx < opt_len) && (idx < 2); idx++)
+        {
+          value = (value << 8) | buf[pos + idx];
+        }
+
+        if(COAP_OPTION_ACCEPT == number)
+        {
+          msg->accept = (int16_t)value;
+        }
+        else
+        {
+          msg->content_format = (int16_t)value;
+        }
+        break;
+      }
+
+      /* Host and port address this node, queries are ignored */
+      case COAP_OPTION_URI_HOST:
+      case COAP_OPTION_URI_PORT:
+      case COAP_OPTION_URI_QUERY:
+      {
+        break;
+      }
+
+      default:
+      {
+        /* Odd option numbers are critical */
+        msg->bad_option = msg->bad_option || (0 != (number & 0x01));
+        break;
+      }
+    }
+
+    pos += opt_len;
+  }
+
+  /* Too long path is not a resource of this node */
+  if(path_overflow)
+  {
+    strcpy(msg->path, "?");
+  }
+  return true;
+}
+
+
+/*
+ * Coap_EncodeRequest
+ *  - This function encodes a request without payload, path segments are split at '/'
+ *  - accept - COAP_FORMAT_NONE leaves the option out, returns 0 when it does not fit
+ */
+size_t Coap_EncodeRequest(uint8_t *buf, size_t size, uint8_t type, uint16_t msg_id, const uint8_t *token,
+                          uint8_t token_len, const char *path, int16_t accept)
+{
+  uint16_t last = 0;
+  size_t pos = 4 + token_len;
+
+  if((token_len > COAP_TOKEN_MAX_SIZE) || (size < pos))
+  {
+    return 0;
+  }
+
+  buf[0] = (uint8_t)((COAP_VERSION << 6) | ((type & 0x03) << 4) | token_len);
+  buf[1] = COAP_CODE_GET;
+  buf[2] = (uint8_t)(msg_id >> 8);
+  buf[3] = (uint8_t)msg_id;
+  memcpy(&buf[4], token, token_len);
+
+  while(('\0' != *path) && (0 != pos))
+  {
+    size_t seg_len = strcspn(path, "/");
+
+    if(0 != seg_len)
+    {
+      pos = Coap_PutOption(buf, size, pos, &last, COAP_OPTION_URI_PATH, (const uint8_t *)path, seg_len);
+    }
+    path += seg_len + (('/' == path[seg_len]) ? 1 : 0);
+  }
+
+  if((0 != pos) && (accept >= 0))
+  {
+    pos = Coap_PutUint(buf, size, pos, &last, COAP_OPTION_ACCEPT, (uint32_t)accept);
+  }
+  return pos;
+}
+
+
+/*
+ * Coap_SnapshotInit
+ *  - This function empties the snapshot (/sensors answers 5.03 till the first sample)
+ */
+void Coap_SnapshotInit(Coap_Snapshot_T *snapshot)
+{
+  snapshot->sensors_json_len = 0;
+  snapshot->sensors_bin_len = 0;
+  snapshot->gpio_json_len = 0;
+  snapshot->gpio_bin_len = 0;
+}
+
+
+/*
+ * Coap_SnapshotSensors
+ *  - This function serializes the sample in both formats
+ */
+void Coap_SnapshotSensors(Coap_Snapshot_T *snapshot, const Mqtt_Sample_T *sample)
+{
+  uint8_t *bin = snapshot->sensors_bin;
+
+  snapshot->sensors_json_len = (uint8_t)Mqtt_SampleFormat((char *)snapshot->sensors_json,
+                                                          sizeof(snapshot->sensors_json), sample);
+
+  bin[0] = COAP_RECORD_VERSION;
+  bin[1] = (0 != sample->epoch) ? 0x01 : 0x00;
+  Coap_Put32(&bin[2], sample->seq);
+  Coap_Put32(&bin[6], sample->time_ms);
+  Coap_Put32(&bin[10], sample->epoch);
+  Coap_Put16(&bin[14], (uint16_t)sample->temperature_cdeg);
+  Coap_Put16(&bin[16], sample->humidity_cpct);
+  Coap_Put32(&bin[18], sample->pressure_pa);
+  Coap_Put16(&bin[22], sample->light);
+  snapshot->sensors_bin_len = 24;
+}
+
+
+/*
+ * Coap_SnapshotGpio
+ *  - This function serializes the output levels in both formats (up to COAP_GPIO_MAX outputs)
+ */
+void Coap_SnapshotGpio(Coap_Snapshot_T *snapshot, const uint8_t *pins, const uint8_t *levels, uint8_t count)
+{
+  char *json = (char *)snapshot->gpio_json;
+  size_t pos = 1;
+
+  count = (count > COAP_GPIO_MAX) ? COAP_GPIO_MAX : count;
+
+  json[0] = '{';
+  snapshot->gpio_bin[0] = COAP_RECORD_VERSION;
+  snapshot->gpio_bin[1] = count;
+
+  for(uint8_t idx = 0; idx < count; idx++)
+  {
+    pos += (size_t)snprintf(&json[pos], sizeof(snapshot->gpio_json) - pos, "%s\"%u\":%u",
+                            (0 != idx) ? "," : "", pins[idx], levels[idx]);
+    snapshot->gpio_bin[2 + (2 * idx)] = pins[idx];
+    snapshot->gpio_bin[3 + (2 * idx)] = levels[idx];
+  }
+
+  json[pos++] = '}';
+  snapshot->gpio_json_len = (uint8_t)pos;
+  snapshot->gpio_bin_len = (uint8_t)(2 + (2 * count));
+}
+
+
+/*
+ * Coap_Respond
+ *  - This function encodes the response to the request into buf (0 - no response)
+ *  - Confirmable request gets ACK with its message ID, others NON with msg_id,
+ *    empty confirmable message (ping) gets RST
+ */
+size_t Coap_Respond(const Coap_Snapshot_T *snapshot, const Coap_Message_T *req, bool multicast, uint16_t msg_id,
+                    uint8_t *buf, size_t size)
+{
+  const uint8_t *payload = NULL;
+  size_t payload_len = 0;
+  int16_t format = req->accept;
+  uint8_t code = COAP_CODE_CONTENT;
+  uint8_t type = Coap_Type_Non;
+  uint16_t last = 0;
+  size_t pos;
+
+  if((Coap_Type_Ack == req->type) || (Coap_Type_Rst == req->type) || ((req->code >> 5) != 0))
+  {
+    return 0;
+  }
+
+  if(COAP_CODE_EMPTY == req->code)
+  {
+    if((Coap_Type_Con != req->type) || multicast || (size < 4))
+    {
+      return 0;
+    }
+
+    buf[0] = (uint8_t)((COAP_VERSION << 6) | (Coap_Type_Rst << 4));
+    buf[1] = COAP_CODE_EMPTY;
+    buf[2] = (uint8_t)(req->msg_id >> 8);
+    buf[3] = (uint8_t)req->msg_id;
+    return 4;
+  }
+
+  if(0 == strcmp(req->path, ".well-known/core"))
+  {
+    format = COAP_FORMAT_LINK;
+    code = ((COAP_FORMAT_NONE == req->accept) || (COAP_FORMAT_LINK == req->accept)) ? code : COAP_CODE_NOT_ACCEPTABLE;
+    payload = (const uint8_t *)coap_core_links;
+    payload_len = sizeof(coap_core_links) - 1;
+  }
+  else if((0 == strcmp(req->path, "sensors")) || (0 == strcmp(req->path, "gpio")))
+  {
+    bool sensors = ('s' == req->path[0]);
+
+    format = (COAP_FORMAT_NONE == req->accept) ? COAP_FORMAT_JSON : req->accept;
+
+    if(COAP_FORMAT_JSON == format)
+    {
+      payload = sensors ? snapshot->sensors_json : snapshot->gpio_json;
+      payload_len = sensors ? snapshot->sensors_json_len : snapshot->gpio_json_len;
+    }
+    else if(COAP_FORMAT_BINARY == format)
+    {
+      payload = sensors ? snapshot->sensors_bin : snapshot->gpio_bin;
+      payload_len = sensors ? snapshot->sensors_bin_len : snapshot->gpio_bin_len;
+    }
+    else
+    {
+      code = COAP_CODE_NOT_ACCEPTABLE;
+    }
+
+    code = ((COAP_CODE_CONTENT == code) && (0 == payload_len)) ? COAP_CODE_UNAVAILABLE : code;
+  }
+  else
+  {
+    code = COAP_CODE_NOT_FOUND;
+  }
+
+  if(req->bad_option)
+  {
+    code = COAP_CODE_BAD_OPTION;
+  }
+  else if((COAP_CODE_NOT_FOUND != code) && (COAP_CODE_GET != req->code))
+  {
+    code = COAP_CODE_NOT_ALLOWED;
+  }
+
+  /* Other nodes of the group answer too - errors are not sent */
+  if(multicast && (COAP_CODE_CONTENT != code))
+  {
+    return 0;
+  }
+
+  if(Coap_Type_Con == req->type)
+  {
+    type = Coap_Type_Ack;
+    msg_id = req->msg_id;
+  }
+
+  pos = 4 + req->token_len;
+  if(size < pos)
+  {
+    return 0;
+  }
+
+  buf[0] = (uint8_t)((COAP_VERSION << 6) | (type << 4) | req->token_len);
+  buf[1] = code;
+  buf[2] = (uint8_t)(msg_id >> 8);
+  buf[3] = (uint8_t)msg_id;
+  memcpy(&buf[4], req->token, req->token_len);
+
+  if(COAP_CODE_CONTENT != code)
+  {
+    return pos;
+  }
+
+  pos = Coap_PutUint(buf, size, pos, &last, COAP_OPTION_CONTENT_FORMAT, (uint32_t)format);
+  if((0 == pos) || ((pos + 1 + payload_len) > size))
+  {
+    return 0;
+  }
+
+  buf[pos++] = COAP_PAYLOAD_MARKER;
+  memcpy(&buf[pos], payload, payload_len);
+  return pos + payload_len;
+}
+
+
+/*
+ * Coap_GetNibble
+ *  - This function decodes the option delta or length with its extended bytes
+ */
+static bool Coap_GetNibble(const uint8_t *buf, size_t len, size_t *pos, uint8_t nibble, uint32_t *value)
+{
+  if(COAP_NIBBLE_RESERVED == nibble)
+  {
+    return false;
+  }
+
+  if(COAP_NIBBLE_EXT8 == nibble)
+  {
+    if(*pos >= len)
+    {
+      return false;
+    }
+    *value = 13U + buf[(*pos)++];
+  }
+  else if(COAP_NIBBLE_EXT16 == nibble)
+  {
+    if((*pos + 2) > len)
+    {
+      return false;
+    }
+    *value = 269U + (((uint32_t)buf[*pos] << 8) | buf[*pos + 1]);
+    *pos += 2;
+  }
+  else
+  {
+    *value = nibble;
+  }
+  return true;
+}
+
+
+/*
+ * Coap_PutOption
+ *  - This function appends the option (numbers in ascending order), returns the new position
+ *    (0 - does not fit)
+ */
+static size_t Coap_PutOption(uint8_t *buf, size_t size, size_t pos, uint16_t *last, uint16_t number,
+                             const uint8_t *value, size_t len)
+{
+  uint16_t delta = (uint16_t)(number - *last);
+  size_t ext = ((delta >= 269) ? 2 : ((delta >= 13) ? 1 : 0)) + ((len >= 269) ? 2 : ((len >= 13) ? 1 : 0));
+  uint8_t delta_nibble = (delta >= 269) ? COAP_NIBBLE_EXT16 : ((delta >= 13) ? COAP_NIBBLE_EXT8 : (uint8_t)delta);
+  uint8_t len_nibble = (len >= 269) ? COAP_NIBBLE_EXT16 : ((len >= 13) ? COAP_NIBBLE_EXT8 : (uint8_t)len);
+
+  if((0 == pos) || (len > 0xFFFF) || ((pos + 1 + ext + len) > size))
+  {
+    return 0;
+  }
+
+  buf[pos++] = (uint8_t)((delta_nibble << 4) | len_nibble);
+
+  if(COAP_NIBBLE_EXT16 == delta_nibble)
+  {
+    buf[pos++] = (uint8_t)((delta - 269) >> 8);
+    buf[pos++] = (uint8_t)(delta - 269);
+  }
+  else if(COAP_NIBBLE_EXT8 == delta_nibble)
+  {
+    buf[pos++] = (uint8_t)(delta - 13);
+  }
+
+  if(COAP_NIBBLE_EXT16 == len_nibble)
+  {
+    buf[pos++] = (uint8_t)((len - 269) >> 8);
+    buf[pos++] = (uint8_t)(len - 269);
+  }
+  else if(COAP_NIBBLE_EXT8 == len_nibble)
+  {
+    buf[pos++] = (uint8_t)(len - 13);
+  }
+
+  memcpy(&buf[pos], value, len);
+  *last = number;
+  return pos + len;
+}
+
+
+/*
+ * Coap_PutUint
+ *  - This function appends the option with the shortest unsigned integer value (0 - no bytes)
+ */
+static size_t Coap_PutUint(uint8_t *buf, size_t size, size_t pos, uint16_t *last, uint16_t number, uint32_t value)
+{
+  uint8_t bytes[4];
+  size_t len = 0;
+
+  for(int shift = 24; shift >= 0; shift -= 8)
+  {
+    if((0 != len) || (0 != ((value >> shift) & 0xFF)))
+    {
+      bytes[len++] = (uint8_t)(value >> shift);
+    }
+  }
+
+  return Coap_PutOption(buf, size, pos, last, number, bytes, len);
+}
+
+
+static void Coap_Put16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = (uint8_t)value;
+  buf[1] = (uint8_t)(value >> 8);
+}
+
+
+static void Coap_Put32(uint8_t *buf, uint32_t value)
+{
+  Coap_Put16(&buf[0], (uint16_t)value);
+  Coap_Put16(&buf[2], (uint16_t)(value >> 16));
+}
+
+/* EOF */
@@ -0,0 +1,119 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       coap_packet.h
+ */
+#ifndef _COAP_PACKET_H_
+#define _COAP_PACKET_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+#include "mqtt_packet.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Default port and "All CoAP Nodes" IPv4 group (RFC 7252) */
+#define COAP_PORT                   (5683)
+#define COAP_MULTICAST_GROUP        {224, 0, 1, 187}
+
+/* Longest request handled, longer datagrams are dropped */
+#define COAP_RX_MAX_SIZE            (128)
+
+/* Longest response - header, token, options and the largest snapshot */
+#define COAP_TX_MAX_SIZE            (COAP_SNAPSHOT_MAX_SIZE + 24)
+
+/* Pre-serialized resource */
+#define COAP_SNAPSHOT_MAX_SIZE      (MQTT_SAMPLE_JSON_MAX_SIZE)
+
+/* Uri-Path segments joined by '/' */
+#define COAP_PATH_MAX_SIZE          (32)
+#define COAP_TOKEN_MAX_SIZE         (8)
+
+/* Outputs in the /gpio snapshot */
+#define COAP_GPIO_MAX               (4)
+
+/* Codes - class.detail */
+#define COAP_CODE(class_, detail)   ((uint8_t)(((class_) << 5) | (detail)))
+#define COAP_CODE_EMPTY             COAP_CODE(0, 0)
+#define COAP_CODE_GET               COAP_CODE(0, 1)
+#define COAP_CODE_CONTENT           COAP_CODE(2, 5)
+#define COAP_CODE_BAD_REQUEST       COAP_CODE(4, 0)
+#define COAP_CODE_BAD_OPTION        COAP_CODE(4, 2)
+#define COAP_CODE_NOT_FOUND         COAP_CODE(4, 4)
+#define COAP_CODE_NOT_ALLOWED       COAP_CODE(4, 5)
+#define COAP_CODE_NOT_ACCEPTABLE    COAP_CODE(4, 6)
+#define COAP_CODE_UNAVAILABLE       COAP_CODE(5, 3)
+
+/* Content formats */
+#define COAP_FORMAT_NONE            (-1)
+#define COAP_FORMAT_TEXT            (0)
+#define COAP_FORMAT_LINK            (40)
+#define COAP_FORMAT_BINARY          (42)
+#define COAP_FORMAT_JSON            (50)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef enum Coap_Type_Tag
+{
+  Coap_Type_Con = 0,
+  Coap_Type_Non,
+  Coap_Type_Ack,
+  Coap_Type_Rst
+
+}Coap_Type_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Parsed message - payload points into the received datagram */
+typedef struct Coap_Message_Tag
+{
+  uint8_t type;
+  uint8_t code;
+  uint16_t msg_id;
+  uint8_t token_len;
+  uint8_t token[COAP_TOKEN_MAX_SIZE];
+  char path[COAP_PATH_MAX_SIZE];
+  int16_t accept;
+  int16_t content_format;
+  bool bad_option;
+  const uint8_t *payload;
+  size_t payload_len;
+
+}Coap_Message_T;
+
+/* Resources answered without formatting - updated on every sample and output change */
+typedef struct Coap_Snapshot_Tag
+{
+  uint8_t sensors_json[COAP_SNAPSHOT_MAX_SIZE];
+  uint8_t sensors_bin[24];
+  uint8_t gpio_json[COAP_SNAPSHOT_MAX_SIZE];
+  uint8_t gpio_bin[2 + (2 * COAP_GPIO_MAX)];
+  uint8_t sensors_json_len;
+  uint8_t sensors_bin_len;
+  uint8_t gpio_json_len;
+  uint8_t gpio_bin_len;
+
+}Coap_Snapshot_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+bool Coap_Parse(const uint8_t *buf, size_t len, Coap_Message_T *msg);
+size_t Coap_EncodeRequest(uint8_t *buf, size_t size, uint8_t type, uint16_t msg_id, const uint8_t *token,
+                          uint8_t token_len, const char *path, int16_t accept);
+
+void Coap_SnapshotInit(Coap_Snapshot_T *snapshot);
+void Coap_SnapshotSensors(Coap_Snapshot_T *snapshot, const Mqtt_Sample_T *sample);
+void Coap_SnapshotGpio(Coap_Snapshot_T *snapshot, const uint8_t *pins, const uint8_t *levels, uint8_t count);
+size_t Coap_Respond(const Coap_Snapshot_T *snapshot, const Coap_Message_T *req, bool multicast, uint16_t msg_id,
+                    uint8_t *buf, size_t size);
+
+#endif /* _COAP_PACKET_H_ */
+
+/* EOF */
@@ -0,0 +1,652 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       console_manager.cpp
+ *
+ *  TCP console (telnet or nc):
+ *    - command lines go to the serial command interpreter (Serial_Execute), the reply
+ *      is written back to the session instead of the UART
+ *    - login with the website (user) credentials kept in the NvM, after a failed attempt
+ *      the login input of all sessions is not read for CONSOLE_AUTH_DELAY_MS (doubled for every
+ *      failure in a row up to CONSOLE_AUTH_DELAY_MAX_MS), the session is closed after
+ *      CONSOLE_AUTH_ATTEMPTS failures or when the login is not done within CONSOLE_LOGIN_TIMEOUT_MS
+ *    - log lines are mirrored to every logged in session
+ *    - every session has its own output ring, bytes are moved to the socket only as far as
+ *      the TCP window allows - a slow client loses output (counted), the loop never waits
+ *    - interactive commands (credentials, scan) and the UART stream are refused
+ *    - telnet is plain text, the console is meant for the local network only
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "console_manager.h"
+#include "param_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define CONSOLE_OUT_BUFFER_MASK     (CONSOLE_OUT_BUFFER_SIZE - 1)
+
+/* Telnet commands (RFC 854) and the echo option (RFC 857) */
+#define CONSOLE_TELNET_SE           (240)
+#define CONSOLE_TELNET_SB           (250)
+#define CONSOLE_TELNET_WILL         (251)
+#define CONSOLE_TELNET_WONT         (252)
+#define CONSOLE_TELNET_DO           (253)
+#define CONSOLE_TELNET_DONT         (254)
+#define CONSOLE_TELNET_IAC          (255)
+#define CONSOLE_TELNET_ECHO         (1)
+
+static_assert(0 == (CONSOLE_OUT_BUFFER_SIZE & CONSOLE_OUT_BUFFER_MASK), "Console buffer size must be power of 2");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Console handler */
+Console_Manager console;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Serial handler */
+extern Serial_Event serial_e;
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static void Console_LogMirror(const char *text, uint16_t len);
+
+/* ==================================================================== */
+/* ========================= session functions ======================== */
+/* ==================================================================== */
+
+/*
+ * Console_SessionOpen
+ *  - This function takes the accepted client and asks for the username
+ */
+void Console_Session::Console_SessionOpen(WiFiClient &new_client)
+{
+  client = new_client;
+  client.setNoDelay(true);
+
+  state = Console_State_Username;
+  telnet = Console_Telnet_Data;
+  line_len = 0;
+  line_overflow = false;
+  last_char = '\0';
+  username[0] = '\0';
+  auth_failures = 0;
+  open_ms = millis();
+  last_rx_ms = millis();
+  dropped = 0;
+  out_head = 0;
+  out_tail = 0;
+
+  printf("iBeacon-%06x console\r\nUsername: ", ESP.getChipId());
+}
+
+
+/*
+ * Console_SessionClose
+ *  - This function sends what fits in the TCP window and closes the connection
+ */
+void Console_Session::Console_SessionClose()
+{
+  (void)Console_SessionDrain();
+  client.stop();
+  state = Console_State_Free;
+}
+
+
+/*
+ * Console_SessionDrain
+ *  - This function moves the output ring to the socket as far as the TCP window allows
+ *  - Returns true when the ring is empty
+ */
+bool Console_Session::Console_SessionDrain()
+{
+  while(out_tail != out_head)
+  {
+    size_t chunk = (out_head > out_tail) ? (out_head - out_tail) : (CONSOLE_OUT_BUFFER_SIZE - out_tail);
+    size_t room = client.availableForWrite();
+    size_t sent;
+
+    if(0 == room)
+    {
+      return false;
+    }
+
+    sent = client.write(&out_buffer[out_tail], (chunk < room) ? chunk : room);
+    if(0 == sent)
+    {
+      return false;
+    }
+
+    out_tail = (out_tail + sent) & CONSOLE_OUT_BUFFER_MASK;
+  }
+  return true;
+}
+
+
+/*
+ * write
+ *  - Print interface used by the command handlers and the log mirror
+ */
+size_t Console_Session::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+
+/*
+ * write
+ *  - This function sends directly while nothing is queued, the rest goes to the ring,
+ *    bytes which do not fit in the ring are dropped
+ *  - Always reports the whole buffer as written, so Print does not stop in the middle
+ */
+size_t Console_Session::write(const uint8_t *buffer, size_t size)
+{
+  size_t done = 0;
+
+  if(Console_State_Free == state)
+  {
+    return size;
+  }
+
+  if(Console_SessionDrain())
+  {
+    size_t room = client.availableForWrite();
+
+    if(0 != room)
+    {
+      done = client.write(buffer, (size < room) ? size : room);
+    }
+  }
+
+  while(done < size)
+  {
+    uint16_t next = (out_head + 1) & CONSOLE_OUT_BUFFER_MASK;
+
+    if(next == out_tail)
+    {
+      dropped += size - done;
+      break;
+    }
+
+    out_buffer[out_head] = buffer[done++];
+    out_head = next;
+  }
+
+  return size;
+}
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Console_Init
+ *  - This function starts mirroring the log and opens the listener on the console port
+ */
+void Console_Manager::Console_Init()
+{
+  for(uint8_t idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+  {
+    sessions[idx].state = Console_State_Free;
+  }
+
+  logins = 0;
+  auth_failures = 0;
+  refused = 0;
+  auth_streak = 0;
+  auth_fail_ms = millis();
+  auth_hold_until_ms = millis();
+  started = true;
+
+  logger.Log_SetMirror(Console_LogMirror);
+  Console_Apply();
+}
+
+
+/*
+ * Console_Apply
+ *  - This function closes all sessions and reopens the listener on the console port (0 - disabled)
+ */
+void Console_Manager::Console_Apply()
+{
+  if(!started)
+  {
+    return;
+  }
+
+  for(uint8_t idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+  {
+    if(Console_State_Free != sessions[idx].state)
+    {
+      sessions[idx].print("Console restarted\r\n");
+      sessions[idx].Console_SessionClose();
+    }
+  }
+
+  if(listening)
+  {
+    listener.stop();
+    listening = false;
+  }
+
+  port = (uint16_t)param.Param_Get(Param_ID_ConsolePort);
+
+  if(0 == port)
+  {
+    LOG_INFO(Log_Module_Console, "Disabled");
+    return;
+  }
+
+  listener.begin(port);
+  listener.setNoDelay(true);
+  listening = true;
+
+  LOG_INFO(Log_Module_Console, "Listening on port %u", port);
+}
+
+
+/*
+ * Console_Process
+ *  - This function accepts new clients, sends the queued output and runs the received lines
+ *  - This function should be called periodically in the loop
+ */
+void Console_Manager::Console_Process()
+{
+  uint32_t now_ms = millis();
+
+  if(!listening)
+  {
+    return;
+  }
+
+  Console_Accept();
+
+  for(uint8_t idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+  {
+    Console_Session &s = sessions[idx];
+
+    if(Console_State_Free == s.state)
+    {
+      continue;
+    }
+
+    if(!s.client.connected())
+    {
+      s.Console_SessionClose();
+      LOG_INFO(Log_Module_Console, "Session %u closed by the client", idx + 1);
+      continue;
+    }
+
+    (void)s.Console_SessionDrain();
+
+    /* Clients that do not log in do not hold the session slot */
+    if((Console_State_Ready != s.state) && ((uint32_t)(now_ms - s.open_ms) >= CONSOLE_LOGIN_TIMEOUT_MS))
+    {
+      s.print("\r\nLogin timeout\r\n");
+      s.Console_SessionClose();
+      LOG_INFO(Log_Module_Console, "Session %u login timeout", idx + 1);
+      continue;
+    }
+
+    if((uint32_t)(now_ms - s.last_rx_ms) >= CONSOLE_IDLE_TIMEOUT_MS)
+    {
+      s.print("Idle timeout\r\n");
+      s.Console_SessionClose();
+      LOG_INFO(Log_Module_Console, "Session %u idle timeout", idx + 1);
+      continue;
+    }
+
+    /* Login input is left in the socket till the delay after a failed login ends */
+    if((Console_State_Ready != s.state) && ((int32_t)(now_ms - auth_hold_until_ms) < 0))
+    {
+      continue;
+    }
+
+    Console_Receive(s);
+  }
+}
+
+
+/*
+ * Console_Log
+ *  - This function copies the log line to every logged in session
+ */
+void Console_Manager::Console_Log(const char *text, uint16_t len)
+{
+  for(uint8_t idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+  {
+    if(Console_State_Ready == sessions[idx].state)
+    {
+      (void)sessions[idx].write((const uint8_t *)text, len);
+    }
+  }
+}
+
+
+/*
+ * Console_Dump
+ *  - This function appends the listener state and the open sessions to out
+ */
+void Console_Manager::Console_Dump(String &out)
+{
+  static const char *const state_name[] = {"free", "username", "password", "ready"};
+  char line[128];
+
+  if(listening)
+  {
+    snprintf(line, sizeof(line), "CONSOLE -> Port: %u, logins: %u, failed: %u, refused: %u\r\n",
+             port, logins, auth_failures, refused);
+  }
+  else
+  {
+    snprintf(line, sizeof(line), "CONSOLE -> Disabled\r\n");
+  }
+  out += line;
+
+  for(uint8_t idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+  {
+    Console_Session &s = sessions[idx];
+
+    if(Console_State_Free == s.state)
+    {
+      continue;
+    }
+
+    snprintf(line, sizeof(line), "CONSOLE -> Session %u: %s, user: %s, %s, idle: %u s, dropped: %u B\r\n",
+             idx + 1, s.client.remoteIP().toString().c_str(),
+             (Console_State_Ready == s.state) ? s.username : "-",
+             state_name[s.state], (uint32_t)(millis() - s.last_rx_ms) / 1000, s.dropped);
+    out += line;
+  }
+}
+
+
+/*
+ * Console_Metrics
+ *  - This function appends the console metrics (Prometheus text format) to out
+ */
+void Console_Manager::Console_Metrics(String &out)
+{
+  uint32_t active = 0;
+  uint32_t dropped = 0;
+
+  for(uint8_t idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+  {
+    if(Console_State_Free != sessions[idx].state)
+    {
+      active++;
+      dropped += sessions[idx].dropped;
+    }
+  }
+
+  out += "ibeacon_console_sessions " + String(active) + "\n";
+  out += "ibeacon_console_logins_total " + String(logins) + "\n";
+  out += "ibeacon_console_auth_failures_total " + String(auth_failures) + "\n";
+  out += "ibeacon_console_refused_total " + String(refused) + "\n";
+  out += "ibeacon_console_dropped_bytes " + String(dropped) + "\n";
+}
+
+
+/*
+ * Console_Accept
+ *  - This function takes the waiting clients, a client over CONSOLE_SESSIONS_MAX is refused
+ */
+void Console_Manager::Console_Accept()
+{
+  while(listener.hasClient())
+  {
+    WiFiClient new_client = listener.available();
+    uint8_t idx;
+
+    for(idx = 0; idx < CONSOLE_SESSIONS_MAX; idx++)
+    {
+      if(Console_State_Free == sessions[idx].state)
+      {
+        break;
+      }
+    }
+
+    if(CONSOLE_SESSIONS_MAX == idx)
+    {
+      new_client.print("Too many sessions\r\n");
+      new_client.stop();
+      refused++;
+      LOG_WARN(Log_Module_Console, "Client refused, %u sessions open", CONSOLE_SESSIONS_MAX);
+      continue;
+    }
+
+    sessions[idx].Console_SessionOpen(new_client);
+    LOG_INFO(Log_Module_Console, "Session %u opened from %s", idx + 1,
+             new_client.remoteIP().toString().c_str());
+  }
+}
+
+
+/*
+ * Console_Receive
+ *  - This function reads up to CONSOLE_RX_CHUNK_MAX bytes, removes the telnet commands
+ *    and collects the line (CR, LF or CRLF ends it)
+ */
+void Console_Manager::Console_Receive(Console_Session &s)
+{
+  uint8_t count = 0;
+
+  while((count++ < CONSOLE_RX_CHUNK_MAX) && (s.client.available() > 0) &&
+        (Console_State_Free != s.state))
+  {
+    uint8_t c = (uint8_t)s.client.read();
+
+    s.last_rx_ms = millis();
+
+    switch(s.telnet)
+    {
+      case Console_Telnet_Iac:
+      {
+        if((c >= CONSOLE_TELNET_WILL) && (c <= CONSOLE_TELNET_DONT))
+        {
+          s.telnet = Console_Telnet_Option;
+        }
+        else
+        {
+          s.telnet = (CONSOLE_TELNET_SB == c) ? Console_Telnet_Sub : Console_Telnet_Data;
+        }
+        continue;
+      }
+
+      case Console_Telnet_Option:
+      {
+        s.telnet = Console_Telnet_Data;
+        continue;
+      }
+
+      case Console_Telnet_Sub:
+      {
+        s.telnet = (CONSOLE_TELNET_IAC == c) ? Console_Telnet_SubIac : Console_Telnet_Sub;
+        continue;
+      }
+
+      case Console_Telnet_SubIac:
+      {
+        s.telnet = (CONSOLE_TELNET_SE == c) ? Console_Telnet_Data : Console_Telnet_Sub;
+        continue;
+      }
+
+      default:
+      {
+        break;
+      }
+    }
+
+    if(CONSOLE_TELNET_IAC == c)
+    {
+      s.telnet = Console_Telnet_Iac;
+    }
+    else if(('\r' == c) || (('\n' == c) && ('\r' != s.last_char)))
+    {
+      s.line[s.line_len] = '\0';
+      Console_Line(s);
+      s.line_len = 0;
+      s.line_overflow = false;
+    }
+    else if(('\b' == c) || (0x7F == c))
+    {
+      if(0 != s.line_len)
+      {
+        s.line_len--;
+      }
+    }
+    else if((c >= ' ') && (c < 0x7F))
+    {
+      if(s.line_len < SERIAL_LINE_MAX_SIZE)
+      {
+        s.line[s.line_len++] = (char)c;
+      }
+      else
+      {
+        s.line_overflow = true;
+      }
+    }
+
+    s.last_char = (char)c;
+  }
+}
+
+
+/*
+ * Console_Line
+ *  - This function handles the received line according to the session state
+ */
+void Console_Manager::Console_Line(Console_Session &s)
+{
+  static const uint8_t echo_off[] = {CONSOLE_TELNET_IAC, CONSOLE_TELNET_WILL, CONSOLE_TELNET_ECHO};
+  static const uint8_t echo_on[] = {CONSOLE_TELNET_IAC, CONSOLE_TELNET_WONT, CONSOLE_TELNET_ECHO};
+  uint8_t idx = &s - sessions;
+  uint32_t delay_ms;
+
+  switch(s.state)
+  {
+    case Console_State_Username:
+    {
+      strncpy(s.username, s.line, EEPROM_CREDENTIAL_MAX_SIZE);
+      s.username[EEPROM_CREDENTIAL_MAX_SIZE] = '\0';
+      s.state = Console_State_Password;
+
+      /* Client stops the local echo while the password is typed */
+      s.print("Password: ");
+      (void)s.write(echo_off, sizeof(echo_off));
+      break;
+    }
+
+    case Console_State_Password:
+    {
+      (void)s.write(echo_on, sizeof(echo_on));
+      s.print("\r\n");
+
+      if(!s.line_overflow && Console_CheckCredentials(s.username, s.line))
+      {
+        s.state = Console_State_Ready;
+        logins++;
+        auth_streak = 0;
+        LOG_INFO(Log_Module_Console, "Session %u: %s logged in", idx + 1, s.username);
+        s.print("Type \"help\" for the commands, \"exit\" to close the session\r\n> ");
+        break;
+      }
+
+      s.auth_failures++;
+      auth_failures++;
+
+      if((uint32_t)(millis() - auth_fail_ms) >= CONSOLE_AUTH_FORGET_MS)
+      {
+        auth_streak = 0;
+      }
+      delay_ms = (uint32_t)CONSOLE_AUTH_DELAY_MS << ((auth_streak < 6) ? auth_streak : 6);
+      delay_ms = (delay_ms > CONSOLE_AUTH_DELAY_MAX_MS) ? CONSOLE_AUTH_DELAY_MAX_MS : delay_ms;
+      auth_streak = (auth_streak < 0xFF) ? (auth_streak + 1) : auth_streak;
+      auth_fail_ms = millis();
+      auth_hold_until_ms = auth_fail_ms + delay_ms;
+
+      LOG_WARN(Log_Module_Console, "Session %u: login failed (%u of %u), next login in %u ms", idx + 1,
+               s.auth_failures, CONSOLE_AUTH_ATTEMPTS, delay_ms);
+
+      if(s.auth_failures >= CONSOLE_AUTH_ATTEMPTS)
+      {
+        s.print("Login incorrect\r\n");
+        s.Console_SessionClose();
+        break;
+      }
+
+      s.state = Console_State_Username;
+      s.print("Login incorrect\r\nUsername: ");
+      break;
+    }
+
+    case Console_State_Ready:
+    {
+      if(s.line_overflow)
+      {
+        s.printf("CLI -> Line too long (max %u chars)\r\n", SERIAL_LINE_MAX_SIZE);
+      }
+      else if((0 == strcmp(s.line, "exit")) || (0 == strcmp(s.line, "quit")))
+      {
+        s.Console_SessionClose();
+        LOG_INFO(Log_Module_Console, "Session %u: %s logged out", idx + 1, s.username);
+        break;
+      }
+      else if('\0' != s.line[0])
+      {
+        serial_e.Serial_Execute(s.line, s);
+      }
+
+      s.print("> ");
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+}
+
+
+/*
+ * Console_CheckCredentials
+ *  - This function compares the login with the website (user) credentials stored in the NvM
+ *  - Login is refused while no credentials are stored
+ */
+bool Console_Manager::Console_CheckCredentials(const char *username, const char *password)
+{
+  String nvm_username;
+  String nvm_password;
+
+  eeprom.Nvm_CredentialsRead(Nvm_Credentials_User, nvm_username, nvm_password);
+
+  if(0 == nvm_username.length())
+  {
+    return false;
+  }
+
+  return (nvm_username == username) && (nvm_password == password);
+}
+
+
+/*
+ * Console_LogMirror
+ *  - This function passes the log line to the console (registered in Log_Manager)
+ */
+static void Console_LogMirror(const char *text, uint16_t len)
+{
+  console.Console_Log(text, len);
+}
+
+/* EOF */
@@ -0,0 +1,141 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       console_manager.h
+ */
+#ifndef _CONSOLE_MANAGER_H_
+#define _CONSOLE_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "nvm_manager.h"
+#include "serial_event.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Default value - runtime value is kept by Param_Manager (0 - console disabled) */
+#define CONSOLE_PORT                (23)
+
+/* Concurrent sessions - the next client is refused */
+#define CONSOLE_SESSIONS_MAX        (3)
+
+/* Output kept per session when the client reads slower than the output is produced */
+#define CONSOLE_OUT_BUFFER_SIZE     (1024)
+
+/* Received bytes handled per session in one call of Console_Process() */
+#define CONSOLE_RX_CHUNK_MAX        (64)
+
+/* Login - failed attempts before the session is closed, delay after a failed attempt */
+#define CONSOLE_AUTH_ATTEMPTS       (3)
+#define CONSOLE_AUTH_DELAY_MS       (2000)
+
+/* Delay doubles with every failure in a row (all sessions), the streak is forgotten after the time */
+#define CONSOLE_AUTH_DELAY_MAX_MS   (16000)
+#define CONSOLE_AUTH_FORGET_MS      (600000)
+
+/* Session is closed without input for this time */
+#define CONSOLE_IDLE_TIMEOUT_MS     (600000)
+
+/* Session is closed when the login is not completed within this time after connect */
+#define CONSOLE_LOGIN_TIMEOUT_MS    (30000)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef enum Console_State_Tag
+{
+  Console_State_Free = 0,
+  Console_State_Username,
+  Console_State_Password,
+  Console_State_Ready
+
+}Console_State_T;
+
+/* Telnet command (IAC) filtering */
+typedef enum Console_Telnet_Tag
+{
+  Console_Telnet_Data = 0,
+  Console_Telnet_Iac,
+  Console_Telnet_Option,
+  Console_Telnet_Sub,
+  Console_Telnet_SubIac
+
+}Console_Telnet_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+/*
+ * Console session - command output is written through Print, bytes the TCP window
+ * cannot take are kept in the ring and the rest is dropped (loop never waits)
+ */
+class Console_Session : public Print
+{
+  public:
+    WiFiClient client;
+    Console_State_T state;
+    Console_Telnet_T telnet;
+    char line[SERIAL_LINE_MAX_SIZE + 1];
+    uint8_t line_len;
+    bool line_overflow;
+    char last_char;
+    char username[EEPROM_CREDENTIAL_MAX_SIZE + 1];
+    uint8_t auth_failures;
+    uint32_t open_ms;
+    uint32_t last_rx_ms;
+    uint32_t dropped;
+
+    void Console_SessionOpen(WiFiClient &new_client);
+    void Console_SessionClose();
+    bool Console_SessionDrain();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+  private:
+    uint8_t out_buffer[CONSOLE_OUT_BUFFER_SIZE];
+    uint16_t out_head;
+    uint16_t out_tail;
+};
+
+class Console_Manager
+{
+  public:
+    Console_Manager() : listener(CONSOLE_PORT) {}
+
+    void Console_Init();
+    void Console_Apply();
+    void Console_Process();
+    void Console_Log(const char *text, uint16_t len);
+    void Console_Dump(String &out);
+    void Console_Metrics(String &out);
+
+  private:
+    WiFiServer listener;
+    uint16_t port;
+    bool started;
+    bool listening;
+    Console_Session sessions[CONSOLE_SESSIONS_MAX];
+    uint32_t logins;
+    uint32_t auth_failures;
+    uint32_t refused;
+
+    /* Login delay is kept here - a client cannot skip it by reconnecting */
+    uint8_t auth_streak;
+    uint32_t auth_fail_ms;
+    uint32_t auth_hold_until_ms;
+
+    void Console_Accept();
+    void Console_Receive(Console_Session &s);
+    void Console_Line(Console_Session &s);
+    bool Console_CheckCredentials(const char *username, const char *password);
+};
+
+#endif /* _CONSOLE_MANAGER_H_ */
+
+/* EOF */
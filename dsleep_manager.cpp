@@ -0,0 +1,215 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       dsleep_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "dsleep_manager.h"
+#include "snsr_manager.h"
+#include "param_manager.h"
+#include "wifi_manager.h"
+#include "prov_manager.h"
+#include "mqtt_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Deep sleep handler */
+Dsleep_Manager dsleep;
+
+/* RTC memory handler */
+extern Rtc_Manager rtc;
+
+/* Sensor handler */
+extern Sensor sensor;
+
+/* Sensor values structure handler */
+extern Sensor::Sensor_Values_T sens_val;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* WiFi handler */
+extern WiFi_Manager wifi;
+
+/* Provisioning handler */
+extern Prov_Manager prov;
+
+/* MQTT handler */
+extern Mqtt_Manager mqtt;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Dsleep_IsEnabled
+ *  - This function returns true if the node works in the deep sleep telemetry mode
+ */
+bool Dsleep_Manager::Dsleep_IsEnabled()
+{
+  return (0 != param.Param_Get(Param_ID_DsleepPeriod));
+}
+
+
+/*
+ * Dsleep_Start
+ *  - This function starts the wake cycle - takes single sample and connects (link only, no server)
+ *  - Samples are kept in RTC memory until they are published
+ */
+void Dsleep_Manager::Dsleep_Start()
+{
+  Rtc_Dsleep_Stats_T &stats = rtc.Rtc_DsleepStats();
+
+  stats.cycles++;
+  LOG_INFO(Log_Module_Dsleep, "Cycle %u, previous awake: %u ms, backlog: %u",
+                              stats.cycles, stats.last_awake_ms, rtc.Rtc_SampleCount());
+
+  Dsleep_Sample();
+
+  wifi.WiFi_SetLinkOnly();
+  wifi.WiFi_Connect();
+}
+
+
+/*
+ * Dsleep_Process
+ *  - This function publishes the backlog when the link is up and goes to sleep when it is
+ *    empty or the link did not come up in time
+ *  - The node stays awake while the provisioning portal is running
+ *  - This function should be called periodically in the loop
+ */
+void Dsleep_Manager::Dsleep_Process()
+{
+  Rtc_Sample_T sample;
+  bool connected = wifi.WiFi_IsConnected();
+
+  if(connected && rtc.Rtc_SamplePeek(sample))
+  {
+    if(!Dsleep_Publish(sample))
+    {
+      return;
+    }
+
+    rtc.Rtc_SampleDrop();
+    rtc.Rtc_DsleepStats().published++;
+    rtc.Rtc_Save();
+  }
+
+  if(prov.Prov_IsActive())
+  {
+    return;
+  }
+
+  if((connected && (0 == rtc.Rtc_SampleCount())) || (millis() >= param.Param_Get(Param_ID_DsleepWait)))
+  {
+    Dsleep_Sleep();
+  }
+}
+
+
+/*
+ * Dsleep_DebugPrint
+ *  - This function prints the duty cycle statistics on console
+ */
+void Dsleep_Manager::Dsleep_DebugPrint(Print &out)
+{
+  const Rtc_Dsleep_Stats_T &stats = rtc.Rtc_DsleepStats();
+
+  out.printf("DSLEEP -> Period: %u s (0 - disabled), max awake: %u ms\r\n",
+             param.Param_Get(Param_ID_DsleepPeriod), param.Param_Get(Param_ID_DsleepWait));
+  out.printf("DSLEEP -> Cycles: %u, last awake: %u ms, average awake: %u ms\r\n", stats.cycles,
+             stats.last_awake_ms, (0 != stats.cycles) ? (stats.total_awake_ms / stats.cycles) : 0);
+  out.printf("DSLEEP -> Samples: %u, published: %u, dropped: %u, backlog: %u\r\n",
+             stats.samples, stats.published, stats.dropped, rtc.Rtc_SampleCount());
+}
+
+
+/*
+ * Dsleep_Sample
+ *  - This function takes single BME280 (forced mode) and light sample and stores it in RTC memory
+ */
+void Dsleep_Manager::Dsleep_Sample()
+{
+  Rtc_Dsleep_Stats_T &stats = rtc.Rtc_DsleepStats();
+  Rtc_Sample_T sample;
+
+  sensor.Sensor_SetForcedMode();
+
+  if(!sensor.Sensor_Init())
+  {
+    return;
+  }
+
+  sensor.Sensor_UpdateValues();
+
+  /* NaN check - broken measurement is not stored */
+  if((sens_val.temperature != sens_val.temperature) || (sens_val.humidity != sens_val.humidity) ||
+     (sens_val.pressure != sens_val.pressure))
+  {
+    LOG_ERROR(Log_Module_Dsleep, "Sample ERROR");
+    return;
+  }
+
+  memset(&sample, 0, sizeof(sample));
+  sample.seq = stats.samples++;
+  sample.time_ms = rtc.Rtc_GetTimeMs();
+  sample.temperature_cdeg = (int16_t)lroundf(sens_val.temperature * 100.0F);
+  sample.humidity_cpct = (uint16_t)lroundf(sens_val.humidity * 100.0F);
+  sample.pressure_pa = (uint32_t)lroundf(sens_val.pressure * 100.0F);
+  sample.light = (uint16_t)sens_val.light;
+
+  rtc.Rtc_SamplePush(sample);
+}
+
+
+/*
+ * Dsleep_Publish
+ *  - This function publishes single sample (false - try again later)
+ *  - Sample leaves the RTC memory after the MQTT broker acknowledged it (at once without broker)
+ */
+bool Dsleep_Manager::Dsleep_Publish(const Rtc_Sample_T &sample)
+{
+  uint16_t temp_abs = (uint16_t)abs(sample.temperature_cdeg);
+
+  if(!mqtt.Mqtt_Deliver(sample))
+  {
+    return false;
+  }
+
+  LOG_INFO(Log_Module_Dsleep, "Sample %u at %u ms: TEMP %s%u.%02u, HUMI %u.%02u, PRES %u, LIGHT %u",
+                              sample.seq, sample.time_ms,
+                              (sample.temperature_cdeg < 0) ? "-" : "", temp_abs / 100, temp_abs % 100,
+                              sample.humidity_cpct / 100, sample.humidity_cpct % 100,
+                              sample.pressure_pa, sample.light);
+  return true;
+}
+
+
+/*
+ * Dsleep_Sleep
+ *  - This function records the awake time and enters the deep sleep (it does not return)
+ *  - Awake time is counted from the start of the sketch (boot ROM time is not included)
+ */
+void Dsleep_Manager::Dsleep_Sleep()
+{
+  Rtc_Dsleep_Stats_T &stats = rtc.Rtc_DsleepStats();
+  uint32_t period_ms = param.Param_Get(Param_ID_DsleepPeriod) * 1000;
+
+  stats.last_awake_ms = millis();
+  stats.total_awake_ms += stats.last_awake_ms;
+
+  LOG_INFO(Log_Module_Dsleep, "Awake %u ms, sleeping %u s (backlog: %u)",
+                              stats.last_awake_ms, period_ms / 1000, rtc.Rtc_SampleCount());
+  mqtt.Mqtt_Stop();
+  logger.Log_Flush();
+
+  rtc.Rtc_PrepareSleep(period_ms);
+  ESP.deepSleep((uint64_t)period_ms * 1000);
+}
+
+/* EOF */
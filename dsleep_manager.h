@@ -0,0 +1,45 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       dsleep_manager.h
+ */
+#ifndef _DSLEEP_MANAGER_H_
+#define _DSLEEP_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "rtc_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/*
+ * Default values - runtime values are kept by Param_Manager
+ *  - deep sleep period 0 disables the telemetry mode (normal operation)
+ *  - GPIO16 has to be connected to RST to wake up from the deep sleep
+ */
+#define DSLEEP_PERIOD_S             (0)
+#define DSLEEP_WAIT_MS              (10000)
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Dsleep_Manager
+{
+  public:
+    bool Dsleep_IsEnabled();
+    void Dsleep_Start();
+    void Dsleep_Process();
+    void Dsleep_DebugPrint(Print &out = Serial);
+
+  private:
+    void Dsleep_Sample();
+    bool Dsleep_Publish(const Rtc_Sample_T &sample);
+    void Dsleep_Sleep();
+};
+
+#endif /* _DSLEEP_MANAGER_H_ */
+
+/* EOF */
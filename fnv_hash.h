@@ -0,0 +1,55 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       fnv_hash.h
+ *
+ *  32 bit FNV-1a hash of names (serial commands, parameters)
+ *    - Fnv_Hash() is constexpr - tables are hashed at compile time
+ *    - Fnv_HashLen() hashes a name which is not '\0' terminated (token of the received line)
+ */
+#ifndef _FNV_HASH_H_
+#define _FNV_HASH_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define FNV_OFFSET              ((uint32_t)2166136261UL)
+#define FNV_PRIME               ((uint32_t)16777619UL)
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+/*
+ * Fnv_Hash
+ *  - FNV-1a hash of the '\0' terminated name, evaluated at compile time for constant names
+ */
+constexpr uint32_t Fnv_Hash(const char *s, uint32_t hash = FNV_OFFSET)
+{
+  return ('\0' == *s) ? hash : Fnv_Hash(s + 1, (hash ^ (uint8_t)*s) * FNV_PRIME);
+}
+
+
+/*
+ * Fnv_HashLen
+ *  - FNV-1a hash of the first len chars of the name
+ */
+inline uint32_t Fnv_HashLen(const char *s, size_t len)
+{
+  uint32_t hash = FNV_OFFSET;
+
+  for(size_t idx = 0; idx < len; idx++)
+  {
+    hash = (hash ^ (uint8_t)s[idx]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+#endif /* _FNV_HASH_H_ */
+
+/* EOF */
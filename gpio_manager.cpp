@@ -8,6 +8,10 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "gpio_manager.h"
+#include "rtc_manager.h"
+#include "param_manager.h"
+#include "pwm_manager.h"
+#include "log_manager.h"
 
 /* ==================================================================== */
 /* ======================== global variables ========================== */
@@ -15,45 +19,149 @@
 /* Gpio handler */
 Gpio_Manager gpio;
 
+/* RTC memory handler */
+extern Rtc_Manager rtc;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* PWM handler */
+extern Pwm_Manager pwm;
+
 /* ==================================================================== */
 /* ============================ functions ============================= */
 /* ==================================================================== */
 
 /*
  * This function initializes GPIOs
+ *  - Output state from before the reset is restored from RTC memory
+ *  - It has to be called as early as possible (RTC data must be loaded already)
+ *  - After cold boot pins are left untouched until Gpio_InitDefaults()
  */
 void Gpio_Manager::Gpio_Init()
+{
+  restored = rtc.Rtc_GpioGet(state);
+
+  if(restored)
+  {
+    Gpio_Apply();
+  }
+}
+
+
+/*
+ * This function initializes GPIOs with the power-on default after cold boot
+ *  - It has to be called after parameters are loaded
+ */
+void Gpio_Manager::Gpio_InitDefaults()
+{
+  if(restored)
+  {
+    LOG_INFO(Log_Module_Gpio, "State restored: 0x%02X", state);
+    return;
+  }
+
+  state = (uint8_t)param.Param_Get(Param_ID_GpioPowerOn);
+  rtc.Rtc_GpioSet(state);
+  Gpio_Apply();
+}
+
+
+/*
+ * This function switches the output fully ON or OFF
+ */
+void Gpio_Manager::Gpio_Set(uint8_t pin_id, bool on)
+{
+  Gpio_SetLevel(pin_id, on ? PWM_LEVEL_MAX : 0, 0);
+}
+
+
+/*
+ * This function sets the output brightness (fade_ms - time of the transition)
+ *  - ON/OFF state is stored in RTC memory (dimmed output is restored fully ON)
+ */
+void Gpio_Manager::Gpio_SetLevel(uint8_t pin_id, uint8_t level, uint32_t fade_ms)
+{
+  if(pin_id >= GPIO_REMOTE_USED)
+  {
+    return;
+  }
+
+  if(0 != level)
+  {
+    state |= (1 << pin_id);
+  }
+  else
+  {
+    state &= ~(1 << pin_id);
+  }
+
+  pwm.Pwm_SetLevel(pin_id, level, fade_ms);
+  rtc.Rtc_GpioSet(state);
+}
+
+
+/*
+ * This function returns the output state
+ */
+bool Gpio_Manager::Gpio_Get(uint8_t pin_id)
+{
+  return (pin_id < GPIO_REMOTE_USED) && (0 != (state & (1 << pin_id)));
+}
+
+
+/*
+ * This function finds the output of the GPIO number (false - not a remote accessed GPIO)
+ */
+bool Gpio_Manager::Gpio_FindPin(uint32_t pin, uint8_t &pin_id)
+{
+  for(pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++)
+  {
+    if(GpioPin[pin_id] == pin)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/*
+ * This function drives all outputs with the current state
+ *  - Level is written before the pin becomes an output - no glitch
+ */
+void Gpio_Manager::Gpio_Apply()
 {
   for(uint8_t pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++) 
   { 
+    pwm.Pwm_SetLevel(pin_id, Gpio_Get(pin_id) ? PWM_LEVEL_MAX : 0, 0);
+
     /* Set used GPIO's as output */
     pinMode(GpioPin[pin_id], OUTPUT);
   }  
 }
 
+
 /*
  * This prints current GPIO's state
  */
-void Gpio_Manager::Gpio_DebugPrint()
+void Gpio_Manager::Gpio_DebugPrint(Print &out)
 {
-  int pin_state;
-  
   for(uint8_t pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++)
   {
-    Serial.printf("GPIO -> "); 
-    Serial.print(GpioPin[pin_id]); 
-    Serial.printf(": "); 
-
-    /* Read pin state */
-    pin_state = digitalRead(GpioPin[pin_id]);
-    
-    if(0 == pin_state)
+    out.printf("GPIO -> "); 
+    out.print(GpioPin[pin_id]); 
+    out.printf(": "); 
+
+    /* Dimmed output cannot be read back - brightness is printed */
+    if(!Gpio_Get(pin_id))
     {
-      Serial.printf("OFF\r\n"); 
+      out.printf("OFF\r\n"); 
     }
     else
     {
-      Serial.printf("ON\r\n"); 
+      out.printf("ON (level %u/%u)\r\n", pwm.Pwm_GetLevel(pin_id), PWM_LEVEL_MAX); 
     }
   }
 }
@@ -17,6 +17,9 @@
 /* Define how many GPIOs are remote accessed */
 #define GPIO_REMOTE_USED  (2)
 
+/* Default power-on state (bit n is GpioPin[n]) - runtime value is kept by Param_Manager */
+#define GPIO_POWER_ON_STATE  (0x00)
+
 /* ==================================================================== */
 /* ======================== global variables ========================== */
 /* ==================================================================== */
@@ -30,7 +33,18 @@ class Gpio_Manager
 {
   public:
     void Gpio_Init();
-    void Gpio_DebugPrint();
+    void Gpio_InitDefaults();
+    void Gpio_Set(uint8_t pin_id, bool on);
+    void Gpio_SetLevel(uint8_t pin_id, uint8_t level, uint32_t fade_ms);
+    bool Gpio_Get(uint8_t pin_id);
+    bool Gpio_FindPin(uint32_t pin, uint8_t &pin_id);
+    void Gpio_DebugPrint(Print &out = Serial);
+
+  private:
+    uint8_t state;
+    bool restored;
+
+    void Gpio_Apply();
 };
 
 #endif /* _GPIO_H_ */
@@ -9,15 +9,107 @@
  *      - Serial Baud Rate
  *      - Full logging implemented
  *      - "ap_login", "user_login", "reboot", "raw_eeprom", "sensors" commands
+ *      - "ap_login <n>", "ap_list", "scan" access point list commands
+ *      - "params", "get <name>", "set <name> <value>" runtime parameter commands
+ *      - "tasks" command - CPU share, worst case latency and overruns of scheduler tasks
+ *      - Table driven dispatch without heap allocation, "help" lists commands and arguments
+ *      - Line editing (backspace, Ctrl+U), history recalled with arrow up/down ("history"),
+ *        echo enabled by "serial_echo" parameter
+ *      
+ *    - Logging
+ *      - Log calls never wait for the UART - lines are buffered in RAM ring and drained as far as
+ *        the TX FIFO has free space, lost lines are counted ("log" command, "/metrics")
+ *      - Levels error, warn, info, debug - global level parameter, per module at runtime
+ *        ("log <module|all> <level>"), levels above LOG_LEVEL_COMPILE removed at build time
+ *      - Format strings kept in flash, module prefix added by the logger
+ *      - Remote syslog (RFC 5424 over UDP or TCP) - server set with "syslog <host>" (stored in NvM)
+ *      
+ *    - TCP console (telnet, "console_port" parameter, 0 - disabled)
+ *      - Same command set as the serial CLI (interactive credential commands, "scan" and
+ *        "stream" serial only), login with the website credentials, log lines mirrored
+ *      - Up to 3 sessions, per session output buffer - slow clients lose output, loop never waits
+ *      - Failed login delays the next attempt, session closed after 3 failures ("console" command)
+ *      
+ *    - MQTT client (broker set with "mqtt_broker <host>", stored in NvM, "mqtt" command)
+ *      - Samples published as JSON batches with QoS 1 to ibeacon/<chip id>/samples, output levels
+ *        to ibeacon/<chip id>/gpio/<n> (retained), status with last will
+ *      - Commands ibeacon/<chip id>/gpio/<n>/set (1/0) and .../gpio/<n>/level/set (0..255)
+ *      - Store-and-forward queue of 64 samples while the broker is not reachable, one batch in
+ *        flight - slow links get larger batches; deep sleep backlog leaves RTC memory after PUBACK
+ *      - Host simulator tools/mqtt_sim runs the same packet and queue code against a local broker
+ *      
+ *    - Line protocol push to an InfluxDB-compatible /write endpoint ("influx_url <url>", "influx" command)
+ *      - Samples appended to a fixed 1 KiB buffer, sent when full or after the flush age over one
+ *        keep-alive connection, second buffer fills meanwhile
+ *      - Failed requests retried with doubling delay (1s .. 60s), rejected batches (HTTP 4xx) dropped
+ *      - Samples/s and bytes per sample in "influx", host stand-in server tools/influx_sim
+ *      
+ *    - CoAP endpoint for polling collectors (UDP port 5683, "coap" command)
+ *      - GET /sensors and /gpio, JSON or 24 byte binary record (Accept: 42), answered from a
+ *        snapshot serialized once per sample - no connection, no HTTP header
+ *      - Discovery: GET /.well-known/core to the group 224.0.1.187, nodes answer after a random delay
+ *      - Same JSON over HTTP at /sensors, node time per request of both in /metrics,
+ *        benchmark tool tools/coap_bench (on-device CoAP vs HTTP figures not measured yet)
+ *      
+ *    - Binary telemetry stream for bench capture ("stream on", "stream off")
+ *      - UART switched to the stream baudrate, one COBS framed packet per period - sequence number,
+ *        time (us), channel IDs and fixed-point values, CRC16
+ *      - Light ADC every period, BME280 result every 40ms, frames dropped (never blocks) when UART is busy
+ *      - Host decoder tools/telem_decode writes CSV or column files
+ *      
+ *    - Cooperative scheduler
+ *      - Periodic and one shot tasks with priorities and deadlines run from the loop
+ *      - Connection timers, sensor sampling and all loop polling are scheduler tasks
+ *      - Loop profiler - log2 histogram of iteration times and phase breakdown of the slowest
+ *        iterations ("prof" command, "/prof"), removed by building with PROF_ENABLED 0
+ *      
+ *    - Power management
+ *      - Modem sleep or light sleep (wake on network or serial) till the next task is due
+ *      - Polling of HTTP and serial bounded by configurable latency
+ *      - Average current estimate and wake counts ("power" command, "/metrics")
+ *      - Deep sleep telemetry mode - wake, single BME280 forced sample, connect (no web server),
+ *        publish and sleep; unsent samples and awake time kept in RTC memory ("dsleep" command)
  *      
  *    - Implemented WiFi AP connection
+ *      - Non-blocking, event driven connection state machine
+ *      - Boot timing (link up, first sample, first HTTP response) - "boot" command
+ *      - Fast reconnect - last BSSID, channel and IP lease cached in RTC memory ("rtc" command)
+ *      - List of up to 4 APs, the strongest known one is selected (with hysteresis)
+ *      - Roaming scan when RSSI drops below threshold
+ *      - Provisioning portal (SoftAP "iBeacon-<chip id>", captive DNS, "/provision") when no AP
+ *        is configured or cannot connect for configurable time, closed when the link is up
  *      - AP_SSID and AP_PASSWORD are encrypted and stored in EEPROM
  *      - change AP credentials during the runtime using "ap_login" command
+ *        (applied live, rollback to the previous AP when the new one fails)
  *      - change USER credentials during the runtime using "user_login" command
+ *        (applied live without reboot)
+ *      - Credentials kept in single versioned configuration record protected by CRC32
+ *      - Record rotated over wear-leveled flash slots (power loss safe)
+ *      
+ *    - Link recovery
+ *      - Reconnect retries with exponential backoff and jitter when cannot connect or lost WiFi connection
+ *      - Radio reset every configurable number of retries
+ *      - Reboot only after configurable outage ceiling (sensors keep running in the meantime)
+ *      - Outage durations and recovery counts available on "/metrics"
+ *      
+ *    - GPIO outputs (D4, D5)
+ *      - State kept in RTC memory and restored at the start of setup() after reset
+ *      - Configurable power-on state for cold boot
+ *      - Dimming - timer1 PWM (1kHz) with compile time CIE gamma table, fades done in the ISR
+ *        (website slider, "dim <gpio> <level> [fade_ms]" command)
+ *      - Delayed actions ("after <gpio> <level> <delay_ms>", "pulse <gpio> <length_ms>", "cancel <handle>")
+ *        kept in hierarchical timer wheel (1024 pending actions, O(1) insert and cancel, 100ms tick)
+ *      - Daily schedules in local time ("sched_add <gpio> <HH:MM> <level>", "sched_del <n>", "sched"),
+ *        up to 16 stored in NvM, also available over HTTP ("/schedule")
+ *      - Clock from SNTP, server configurable with "ntp <host>" (default pool.ntp.org)
+ *      - Sensor rules with hysteresis and time window, work without network (up to 8 in NvM)
+ *        ex. "rule_add hum > 70 off 60 then 14", "rule_del <n>", "rules", HTTP "/rules"
+ *        only rules of the channels changed by the last sample are evaluated
  *      
- *    - Reboot support
- *      - Reboot after configurable timeout when cannot connect to the AP
- *      - Reboot after configurable timeout when lost WiFi connection and cannot restore it
+ *    - Digital inputs (D6, D7 - switch or contact to GND)
+ *      - Pin change interrupts timestamp edges into lock-free ring, debounced in the loop
+ *      - Toggle output on press (wall switch) or output follows the input (door contact)
+ *      - States on the website, "inputs" command, "/inputs" and "/metrics"
  *      
  *    - Login website to secure remote access
  *      - USERNAME and USER_PASSWORD are encrypted and stored in EEPROM
@@ -29,10 +121,29 @@
  *      
  *    - Implemented OTA (Over The Air) Update
  *      
- *    - Configurable parameters:
- *      - Serial Baud Rate: 115200
+ *    - Configurable parameters (runtime, stored in NvM - defaults below):
+ *      - Serial Baud Rate: 115200, echo: 0 (off)
+ *      - Log level: 2 - info (0 - error, 1 - warn, 3 - debug)
+ *      - Syslog: 0 - off (1 - UDP, 2 - TCP), port: 514
+ *      - Telemetry stream: 921600 baud, period: 10ms
+ *      - TCP console port: 23 (0 - disabled)
+ *      - MQTT broker port: 1883, keepalive: 60s
+ *      - Line protocol flush age: 10s
+ *      - CoAP port: 5683 (0 - disabled)
  *      - Establishing connection timeout: 16000ms
- *      - Trying reconnect timeout: 20000ms
+ *      - First reconnect retry: 2000ms, max retry delay: 300000ms
+ *      - Radio reset every 4 retries, reboot after 3600000ms outage (0 - never)
+ *      - Roaming threshold: -75dBm (0 - disabled), hysteresis: 8dB
+ *      - Provisioning portal after 120000ms outage (0 - only without configured AP)
+ *      - Power mode: 0 - off (1 - modem sleep, 2 - light sleep), latency bound: 100ms
+ *      - Deep sleep period: 0s (disabled), max awake time: 10000ms
+ *      - GPIO power-on state: 0x00 (bit 0 - D4, bit 1 - D5)
+ *      - Time zone offset: 0min (daylight saving time is not applied)
+ *      - Input debounce: 20ms, input actions: 0 - none (1/2 - toggle D4/D5, 3/4 - D4/D5 follows)
+ *      - Sensor measurement period: 2000ms
+ *      - Fast connect timeout: 1500ms (0 - disabled), IP lease reuse: 3600000ms
+ *      - BME280 mode, oversampling, filter and standby
+ *      - available over serial ("get", "set") and HTTP ("/param")
  */
  
 /* ==================================================================== */
@@ -47,22 +158,49 @@
 #include "server_manager.h"
 #include "snsr_manager.h"
 #include "update_manager.h"
+#include "param_manager.h"
+#include "rtc_manager.h"
+#include "prov_manager.h"
+#include "sched_manager.h"
+#include "prof_manager.h"
+#include "pwr_manager.h"
+#include "dsleep_manager.h"
+#include "action_manager.h"
+#include "rule_manager.h"
+#include "input_manager.h"
+#include "log_manager.h"
+#include "telem_manager.h"
+#include "console_manager.h"
+#include "mqtt_manager.h"
+#include "influx_manager.h"
+#include "coap_manager.h"
 
 /* ==================================================================== */
 /* ======================== global variables ========================== */
 /* ==================================================================== */
-/* Establish connection timer related objects */
-Ticker timer_establish_connection;
-Ticker timer_reconnect;
-Ticker timer_new_measure;
-
-/* Other handlers */
+/* Handlers */
 extern Nvm_Manager eeprom;
 extern WiFi_Manager wifi;
 extern Gpio_Manager gpio;
 extern Serial_Event serial_e;
 extern Server_Manager server;
 extern Sensor sensor;
+extern Param_Manager param;
+extern Rtc_Manager rtc;
+extern Prov_Manager prov;
+extern Sched_Manager sched;
+extern Prof_Manager prof;
+extern Pwr_Manager pwr;
+extern Dsleep_Manager dsleep;
+extern Action_Manager action;
+extern Rule_Manager rule_engine;
+extern Input_Manager input;
+extern Log_Manager logger;
+extern Telem_Manager telem;
+extern Console_Manager console;
+extern Mqtt_Manager mqtt;
+extern Influx_Manager influx;
+extern Coap_Manager coap;
 
 /* ==================================================================== */
 /* ==================== function prototypes =========================== */
@@ -70,6 +208,21 @@ extern Sensor sensor;
 inline void establish_connection_timeout_wrapper();
 inline void reconnect_failed_timeout_wrapper();
 inline void new_measure_timeout_wrapper();
+inline void ap_rollback_timeout_wrapper();
+inline void wifi_task_wrapper();
+inline void server_task_wrapper();
+inline void prov_task_wrapper();
+inline void serial_task_wrapper();
+inline void rtc_task_wrapper();
+inline void dsleep_task_wrapper();
+inline void action_task_wrapper();
+inline void input_task_wrapper();
+inline void log_task_wrapper();
+inline void telem_task_wrapper();
+inline void console_task_wrapper();
+inline void mqtt_task_wrapper();
+inline void influx_task_wrapper();
+inline void coap_task_wrapper();
 
 /* ==================================================================== */
 /* ============================ functions ============================= */
@@ -81,26 +234,83 @@ inline void new_measure_timeout_wrapper();
  */
 void setup()
 {  
+  /* Lines logged before the log task starts are kept in the ring */
+  logger.Log_Init();
+  
+  /* Restore outputs first - before anything slow runs */
+  sched.Sched_Init();
+  rtc.Rtc_Init();
+  gpio.Gpio_Init();
+  
   Serial.printf("\r\n _)  __ )                                   \r\n");
   Serial.printf("  |  __ \\    _ \\   _` |   __|   _ \\   __ \\  \r\n");
   Serial.printf("  |  |   |   __/  (   |  (     (   |  |   |\r\n");
   Serial.printf(" _| ____/  \\___| \\__,_| \\___| \\___/  _|  _| \r\n");
   
-  Serial.printf("\r\nREBOOT -> OK\r\n");
+  Serial.printf("\r\n");
+  LOG_INFO(Log_Module_System, "Reboot OK");
   
   eeprom.Nvm_Init();
-  gpio.Gpio_Init();
+  param.Param_Init();
+  serial_e.Serial_SetBaudrate(param.Param_Get(Param_ID_SerialBaudrate));
+  logger.Log_Config();
+  gpio.Gpio_InitDefaults();
+  
+  if(dsleep.Dsleep_IsEnabled())
+  {
+    /* Deep sleep telemetry - sample, connect (no server), publish and sleep again */
+    dsleep.Dsleep_Start();
+    mqtt.Mqtt_Init(false);
+    
+    prof.Prof_Reset();
+    sched.Sched_StartPeriodic(Sched_Task_Log, SCHED_LOG_PERIOD_MS, log_task_wrapper);
+    sched.Sched_StartPeriodic(Sched_Task_WiFi, SCHED_WIFI_PERIOD_MS, wifi_task_wrapper);
+    sched.Sched_StartPeriodic(Sched_Task_Dsleep, SCHED_DSLEEP_PERIOD_MS, dsleep_task_wrapper);
+    sched.Sched_StartPeriodic(Sched_Task_Prov, SCHED_PROV_PERIOD_MS, prov_task_wrapper);
+    sched.Sched_StartPeriodic(Sched_Task_Serial, SCHED_SERIAL_PERIOD_MS, serial_task_wrapper);
+    sched.Sched_StartPeriodic(Sched_Task_Mqtt, SCHED_MQTT_PERIOD_MS, mqtt_task_wrapper);
+    return;
+  }
+  
+  rule_engine.Rule_Init();
+  input.Input_Init();
+  mqtt.Mqtt_Init(true);
+  influx.Influx_Init();
+  coap.Coap_Init();
   (void)sensor.Sensor_Init();
+  
+  /* Schedules are armed when SNTP sets the clock */
+  action.Action_Init();
+
+  /* Listener accepts clients once the link is up */
+  console.Console_Init();
 
   /* Start measuring timer and update status on the website */
-  Start_sensor_measurement_tmr(TMR_SENSOR_MEASUREMENT_PERIOD_MS);
+  Start_sensor_measurement_tmr(param.Param_Get(Param_ID_SensorPeriod));
   server.Server_Update_SensorsState("ERROR", "ERROR", "ERROR", "ERROR");
   
   /* Initialize timers */
-  Start_est_connection_tmr(TMR_ESTABLISH_CONNECTION_TIMEOUT_MS);
+  Start_est_connection_tmr(param.Param_Get(Param_ID_EstConnTimeout));
   
+  /* Connecting continues in the background - server is started when the link comes up */
   wifi.WiFi_Connect();
-  Serial.printf("WIFI -> Setup complete\r\n");
+  LOG_INFO(Log_Module_Wifi, "Setup complete");
+  
+  /* Loop tasks - profiling starts with the first iteration */
+  prof.Prof_Reset();
+  sched.Sched_StartPeriodic(Sched_Task_Log, SCHED_LOG_PERIOD_MS, log_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_WiFi, SCHED_WIFI_PERIOD_MS, wifi_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Server, SCHED_SERVER_PERIOD_MS, server_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Prov, SCHED_PROV_PERIOD_MS, prov_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Serial, SCHED_SERIAL_PERIOD_MS, serial_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Rtc, SCHED_RTC_PERIOD_MS, rtc_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Action, SCHED_ACTION_PERIOD_MS, action_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Input, SCHED_INPUT_PERIOD_MS, input_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Console, SCHED_CONSOLE_PERIOD_MS, console_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Mqtt, SCHED_MQTT_PERIOD_MS, mqtt_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Influx, SCHED_INFLUX_PERIOD_MS, influx_task_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Coap, SCHED_COAP_PERIOD_MS, coap_task_wrapper);
+  pwr.Pwr_Init();
 }
 
 
@@ -110,46 +320,119 @@ void setup()
  */
 void loop()
 { 
-  if(WIFI_IS_DISCONNECTED())
+  /* All the work is done by the scheduler tasks */
+  PROF_LOOP_BEGIN();
+  sched.Sched_Run();
+  
+  /* Sleep till the next task when the power saving is enabled */
+  PROF_LOOP_IDLE();
+  pwr.Pwr_Idle();
+  PROF_LOOP_END();
+}
+
+/****************************************************/
+/*              LOOP TASK RELATED FUNCTIONS         */
+/****************************************************/
+
+
+/*  
+ *   wifi_task_wrapper()
+ *    - Connection state machine - driven by WiFi events
+ */
+inline void wifi_task_wrapper()
+{
+  wifi.WiFi_Process();
+}
+
+
+/*  
+ *   server_task_wrapper()
+ *    - Handles server requests when the link or the provisioning portal is up
+ */
+inline void server_task_wrapper()
+{
+  if(wifi.WiFi_IsConnected() || prov.Prov_IsActive())
   {
-    if(false == wifi.WiFi_get_connection_lost_flag())
-    {
-       /*  If reach here 
-        *   -> WiFi status is NOT connected
-        *   -> connection lost flag is false - set it !
-        */
-      Serial.printf("WIFI -> Connection ERROR\r\n");
-
-      /* Start "try reconnect" timer */
-      Start_reconnect_tmr(TMR_RECONNECT_TIMEOUT_MS);
-      wifi.WiFi_set_connection_lost_flag();
-    }
+    server.Server_HandleClient();
   }
-  else
+}
+
+
+/*  
+ *   prov_task_wrapper()
+ *    - Answers captive DNS requests of the provisioning portal
+ *    - Deep sleep mode has no server task - it is started only for the portal
+ */
+inline void prov_task_wrapper()
+{
+  prov.Prov_Process();
+
+  if(prov.Prov_IsActive() && !sched.Sched_IsActive(Sched_Task_Server))
   {
-    if(false != wifi.WiFi_get_connection_lost_flag())
-    {
-       /*  If reach here 
-        *   -> WiFi status is connected
-        *   -> connection lost flag is true - clear it !
-        */
-      Serial.printf("WIFI -> Connected after error\r\n");
-      
-      /* Restore Server */
-      wifi.WiFi_Restore();
-      
-      /* Disable and reset "try reconnect" timer */
-      Stop_reconnect_tmr();
-      wifi.WiFi_clear_connection_lost_flag();      
-    }
-    
-    /* Handle server requests */
-    server.Server_HandleClient();
+    sched.Sched_StartPeriodic(Sched_Task_Server, SCHED_SERVER_PERIOD_MS, server_task_wrapper);
   }
-  
+}
+
+
+/*  
+ *   serial_task_wrapper()
+ *    - Handles command line input
+ */
+inline void serial_task_wrapper()
+{
   serial_e.Serial_RxEvent();
 }
 
+
+/*  
+ *   rtc_task_wrapper()
+ *    - Refreshes the clock kept in RTC memory
+ */
+inline void rtc_task_wrapper()
+{
+  rtc.Rtc_Process();
+}
+
+
+/*  
+ *   dsleep_task_wrapper()
+ *    - Publishes the samples and enters the deep sleep (telemetry mode only)
+ */
+inline void dsleep_task_wrapper()
+{
+  dsleep.Dsleep_Process();
+}
+
+
+/*  
+ *   action_task_wrapper()
+ *    - Timer wheel tick - delayed GPIO actions and daily schedules
+ */
+inline void action_task_wrapper()
+{
+  action.Action_Process();
+}
+
+
+/*  
+ *   input_task_wrapper()
+ *    - Debounces input edges queued by the interrupts
+ */
+inline void input_task_wrapper()
+{
+  input.Input_Process();
+}
+
+
+/*  
+ *   log_task_wrapper()
+ *    - Drains buffered log lines to the UART and to the syslog server
+ */
+inline void log_task_wrapper()
+{
+  logger.Log_Process();
+}
+
 /****************************************************/
 /*         RECONNECT TIMER RELATED FUNCTIONS        */
 /****************************************************/
@@ -157,27 +440,27 @@ void loop()
 
 /*
  *  Start_reconnect_tmr
- *    - This function starts timer_reconnect timer
+ *    - This function starts periodic reconnect task
  */
-void Start_reconnect_tmr(uint16_t tmout)
+void Start_reconnect_tmr(uint32_t tmout)
 {
-  timer_reconnect.attach_ms(tmout, reconnect_failed_timeout_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Reconnect, tmout, reconnect_failed_timeout_wrapper);
 }
 
 
 /*
  *  Stop_reconnect_tmr
- *    - This function stops timer_reconnect timer
+ *    - This function stops reconnect task
  */
 void Stop_reconnect_tmr()
 {
-  timer_reconnect.detach();
+  sched.Sched_Stop(Sched_Task_Reconnect);
 }
 
 
 /*  
  *   reconnect_failed_timeout_wrapper()
- *    - This wrapper is called on timer_reconnect timers timeout event
+ *    - This wrapper is called on reconnect task timeout event
  */
 inline void reconnect_failed_timeout_wrapper()
 {
@@ -191,17 +474,17 @@ inline void reconnect_failed_timeout_wrapper()
 
 /*
  *  Start_est_connection_tmr
- *    - This function starts timer_establish_connection timer
+ *    - This function starts one shot establish connection task
  */
-void Start_est_connection_tmr(uint16_t tmout)
+void Start_est_connection_tmr(uint32_t tmout)
 {
-  timer_establish_connection.once_ms(tmout, establish_connection_timeout_wrapper);
+  sched.Sched_StartOnce(Sched_Task_EstConnection, tmout, establish_connection_timeout_wrapper);
 }
 
 
 /*  
  *   establish_connection_timeout_wrapper()
- *    - This wrapper is called on timer_establish_connection timers timeout event
+ *    - This wrapper is called on establish connection task timeout event
  */
 inline void establish_connection_timeout_wrapper()
 {
@@ -213,22 +496,129 @@ inline void establish_connection_timeout_wrapper()
 /****************************************************/
 
 /*
- *  Start_sensor_new_measurement
- *    - This function starts timer_establish_connection timer
+ *  Start_sensor_measurement_tmr
+ *    - This function starts periodic sensor measurement task
  */
-void Start_sensor_measurement_tmr(uint16_t tmout)
+void Start_sensor_measurement_tmr(uint32_t tmout)
 {
-  timer_new_measure.attach_ms(tmout, new_measure_timeout_wrapper);
+  sched.Sched_StartPeriodic(Sched_Task_Sensor, tmout, new_measure_timeout_wrapper);
 }
 
 
 /*  
  *   new_measure_timeout_wrapper()
- *    - This wrapper is called on timer_new_measure timeout event
+ *    - This wrapper is called on sensor measurement task event
+ *    - Runs in the loop context - I2C transfers are not done from the timer callback anymore
  */
 inline void new_measure_timeout_wrapper()
 {
   sensor.Sensor_UpdateValues();
 }
 
+/****************************************************/
+/*        AP ROLLBACK TIMER RELATED FUNCTIONS       */
+/****************************************************/
+
+/*
+ *  Start_ap_rollback_tmr
+ *    - This function starts one shot AP rollback task
+ */
+void Start_ap_rollback_tmr(uint32_t tmout)
+{
+  sched.Sched_StartOnce(Sched_Task_ApRollback, tmout, ap_rollback_timeout_wrapper);
+}
+
+
+/*
+ *  Stop_ap_rollback_tmr
+ *    - This function stops AP rollback task
+ */
+void Stop_ap_rollback_tmr()
+{
+  sched.Sched_Stop(Sched_Task_ApRollback);
+}
+
+
+/*  
+ *   ap_rollback_timeout_wrapper()
+ *    - This wrapper is called on AP rollback task timeout event
+ */
+inline void ap_rollback_timeout_wrapper()
+{
+  wifi.WiFi_ap_rollback_timeout_event();
+}
+
+/****************************************************/
+/*      TELEMETRY STREAM TIMER RELATED FUNCTIONS    */
+/****************************************************/
+
+/*
+ *  Start_telem_tmr
+ *    - This function starts periodic telemetry stream task
+ */
+void Start_telem_tmr(uint32_t tmout)
+{
+  sched.Sched_StartPeriodic(Sched_Task_Telem, tmout, telem_task_wrapper);
+}
+
+
+/*
+ *  Stop_telem_tmr
+ *    - This function stops telemetry stream task
+ */
+void Stop_telem_tmr()
+{
+  sched.Sched_Stop(Sched_Task_Telem);
+}
+
+
+/*  
+ *   telem_task_wrapper()
+ *    - Samples the sensors and sends one binary frame
+ */
+inline void telem_task_wrapper()
+{
+  telem.Telem_Process();
+}
+
+
+/*  
+ *   console_task_wrapper()
+ *    - Accepts TCP console clients and runs their command lines
+ */
+inline void console_task_wrapper()
+{
+  console.Console_Process();
+}
+
+
+/*  
+ *   mqtt_task_wrapper()
+ *    - Keeps the broker connection, publishes the queued samples and output changes
+ */
+inline void mqtt_task_wrapper()
+{
+  mqtt.Mqtt_Process();
+}
+
+
+/*  
+ *   influx_task_wrapper()
+ *    - Sends the line protocol buffer when it is due and receives the response
+ */
+inline void influx_task_wrapper()
+{
+  influx.Influx_Process();
+}
+
+
+/*  
+ *   coap_task_wrapper()
+ *    - Answers the CoAP requests from the resource snapshot
+ */
+inline void coap_task_wrapper()
+{
+  coap.Coap_Process();
+}
+
 /* EOF */
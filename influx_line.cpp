@@ -0,0 +1,317 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       influx_line.cpp
+ *
+ *  InfluxDB line protocol over HTTP/1.1:
+ *    - samples are formatted into a fixed buffer as lines (no float printf), the buffer is the
+ *      body of one POST to the /write endpoint
+ *    - request header is formatted separately, the body is sent from the buffer as it is
+ *    - response receiver is fed byte by byte, it keeps only the status code, the body length
+ *      and whether the server closes the connection
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/influx_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "influx_line.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define INFLUX_URL_SCHEME           "http://"
+#define INFLUX_DEFAULT_PATH         "/write"
+#define INFLUX_PRECISION            "precision=ms"
+
+/* Receiver states */
+#define INFLUX_RX_STATUS            (0)
+#define INFLUX_RX_HEADER            (1)
+#define INFLUX_RX_BODY              (2)
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static bool Influx_HasPrefix(const char *line, const char *prefix);
+static Influx_Feed_T Influx_ResponseLine(Influx_Response_T *resp);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Influx_ParseUrl
+ *  - This function splits http://host[:port][/path[?query]] (default port 8086, path /write)
+ *  - Returns false for other schemes or too long parts
+ */
+bool Influx_ParseUrl(const char *url, Influx_Url_T *out)
+{
+  const char *host = url + strlen(INFLUX_URL_SCHEME);
+  size_t host_len;
+  const char *path;
+  unsigned long port = INFLUX_DEFAULT_PORT;
+  int len;
+
+  if(0 != strncmp(url, INFLUX_URL_SCHEME, strlen(INFLUX_URL_SCHEME)))
+  {
+    return false;
+  }
+
+  host_len = strcspn(host, ":/?");
+  if((0 == host_len) || (host_len >= sizeof(out->host)))
+  {
+    return false;
+  }
+
+  path = &host[host_len];
+  if(':' == *path)
+  {
+    char *end;
+
+    port = strtoul(path + 1, &end, 10);
+    if((end == (path + 1)) || (0 == port) || (port > 65535))
+    {
+      return false;
+    }
+    path = end;
+  }
+
+  if(('\0' != *path) && ('/' != *path))
+  {
+    return false;
+  }
+
+  memcpy(out->host, host, host_len);
+  out->host[host_len] = '\0';
+  out->port = (uint16_t)port;
+
+  /* Timestamps are sent in milliseconds - samples taken within one second are separate points */
+  len = snprintf(out->path, sizeof(out->path), "%s%s" INFLUX_PRECISION,
+                 ('\0' != *path) ? path : INFLUX_DEFAULT_PATH, (NULL != strchr(path, '?')) ? "&" : "?");
+
+  return (len > 0) && ((size_t)len < sizeof(out->path));
+}
+
+
+/*
+ * Influx_LineFormat
+ *  - This function formats the sample as one line (0 - does not fit), series is the measurement
+ *    with tags, the timestamp (epoch s and ms) is left out when the clock is not set (server time is used)
+ *    ex. ibeacon,node=0a1b2c temp=21.53,hum=40.12,pres=1013.25,light=512i,seq=7i 1700000000250
+ */
+size_t Influx_LineFormat(char *buf, size_t size, const char *series, const Mqtt_Sample_T *sample, uint16_t epoch_ms)
+{
+  unsigned temp_abs = (unsigned)((sample->temperature_cdeg < 0) ? -sample->temperature_cdeg : sample->temperature_cdeg);
+  char epoch[20] = "";
+  int len;
+
+  if(0 != sample->epoch)
+  {
+    snprintf(epoch, sizeof(epoch), " %lu%03u", (unsigned long)sample->epoch, (unsigned)(epoch_ms % 1000));
+  }
+
+  len = snprintf(buf, size, "%s temp=%s%u.%02u,hum=%u.%02u,pres=%lu.%02lu,light=%ui,seq=%lui%s\n",
+                 series, (sample->temperature_cdeg < 0) ? "-" : "", temp_abs / 100, temp_abs % 100,
+                 sample->humidity_cpct / 100, sample->humidity_cpct % 100,
+                 (unsigned long)(sample->pressure_pa / 100), (unsigned long)(sample->pressure_pa % 100),
+                 sample->light, (unsigned long)sample->seq, epoch);
+
+  return ((len < 0) || ((size_t)len >= size)) ? 0 : (size_t)len;
+}
+
+
+/*
+ * Influx_BufferInit
+ *  - This function empties the buffer
+ */
+void Influx_BufferInit(Influx_Buffer_T *buffer)
+{
+  buffer->len = 0;
+  buffer->count = 0;
+  buffer->first_ms = 0;
+}
+
+
+/*
+ * Influx_BufferAppend
+ *  - This function appends one formatted line, returns false when it does not fit
+ */
+bool Influx_BufferAppend(Influx_Buffer_T *buffer, const char *line, size_t len, uint32_t now_ms)
+{
+  if((0 == len) || ((buffer->len + len) > sizeof(buffer->data)))
+  {
+    return false;
+  }
+
+  if(0 == buffer->count)
+  {
+    buffer->first_ms = now_ms;
+  }
+
+  memcpy(&buffer->data[buffer->len], line, len);
+  buffer->len += (uint16_t)len;
+  buffer->count++;
+  return true;
+}
+
+
+/*
+ * Influx_BufferDue
+ *  - This function returns true when the buffer should be sent - filled up to INFLUX_FLUSH_SIZE
+ *    or its oldest line waits age_ms
+ */
+bool Influx_BufferDue(const Influx_Buffer_T *buffer, uint32_t now_ms, uint32_t age_ms)
+{
+  return (0 != buffer->count) &&
+         ((buffer->len >= INFLUX_FLUSH_SIZE) || ((uint32_t)(now_ms - buffer->first_ms) >= age_ms));
+}
+
+
+/*
+ * Influx_RequestFormat
+ *  - This function formats the POST header for body_len bytes (0 - does not fit)
+ *  - Connection is kept open (HTTP/1.1 default)
+ */
+size_t Influx_RequestFormat(char *buf, size_t size, const Influx_Url_T *url, size_t body_len)
+{
+  int len = snprintf(buf, size,
+                     "POST %s HTTP/1.1\r\n"
+                     "Host: %s:%u\r\n"
+                     "User-Agent: iBeacon\r\n"
+                     "Content-Type: text/plain; charset=utf-8\r\n"
+                     "Content-Length: %lu\r\n"
+                     "\r\n",
+                     url->path, url->host, url->port, (unsigned long)body_len);
+
+  return ((len < 0) || ((size_t)len >= size)) ? 0 : (size_t)len;
+}
+
+
+/*
+ * Influx_ResponseReset
+ *  - This function prepares the receiver for the next response
+ */
+void Influx_ResponseReset(Influx_Response_T *resp)
+{
+  resp->state = INFLUX_RX_STATUS;
+  resp->status = 0;
+  resp->close = false;
+  resp->has_length = false;
+  resp->length = 0;
+  resp->line_len = 0;
+}
+
+
+/*
+ * Influx_ResponseFeed
+ *  - This function processes one received byte
+ *  - Influx_Feed_Done - response is complete (close - server closes the connection or the body
+ *    length is unknown, the connection has to be closed), Influx_Feed_Error - not HTTP
+ */
+Influx_Feed_T Influx_ResponseFeed(Influx_Response_T *resp, uint8_t byte)
+{
+  if(INFLUX_RX_BODY == resp->state)
+  {
+    return (0 == --resp->length) ? Influx_Feed_Done : Influx_Feed_More;
+  }
+
+  if('\n' == byte)
+  {
+    /* Too long lines are truncated - only the beginning is checked */
+    resp->line[resp->line_len] = '\0';
+    if((0 != resp->line_len) && ('\r' == resp->line[resp->line_len - 1]))
+    {
+      resp->line[resp->line_len - 1] = '\0';
+    }
+    resp->line_len = 0;
+    return Influx_ResponseLine(resp);
+  }
+
+  if(resp->line_len < (sizeof(resp->line) - 1))
+  {
+    resp->line[resp->line_len++] = (char)byte;
+  }
+  return Influx_Feed_More;
+}
+
+
+/*
+ * Influx_ResponseLine
+ *  - This function handles the status line and the header lines
+ */
+static Influx_Feed_T Influx_ResponseLine(Influx_Response_T *resp)
+{
+  if(INFLUX_RX_STATUS == resp->state)
+  {
+    /* HTTP/1.x nnn */
+    if(!Influx_HasPrefix(resp->line, "HTTP/1.") || (strlen(resp->line) < 12) || (' ' != resp->line[8]))
+    {
+      return Influx_Feed_Error;
+    }
+
+    resp->status = (uint16_t)strtoul(&resp->line[9], NULL, 10);
+    resp->close = ('0' == resp->line[7]);
+    resp->state = INFLUX_RX_HEADER;
+    return Influx_Feed_More;
+  }
+
+  if('\0' != resp->line[0])
+  {
+    if(Influx_HasPrefix(resp->line, "Content-Length:"))
+    {
+      resp->length = strtoul(&resp->line[15], NULL, 10);
+      resp->has_length = true;
+    }
+    else if(Influx_HasPrefix(resp->line, "Connection:"))
+    {
+      resp->close = (NULL != strstr(&resp->line[11], "close")) ||
+                    ((NULL == strstr(&resp->line[11], "keep-alive")) && resp->close);
+    }
+    return Influx_Feed_More;
+  }
+
+  /* End of the header - 204 has no body, chunked or unknown length ends with the connection */
+  if((204 == resp->status) || (304 == resp->status) || (resp->has_length && (0 == resp->length)))
+  {
+    return Influx_Feed_Done;
+  }
+
+  if(!resp->has_length)
+  {
+    resp->close = true;
+    return Influx_Feed_Done;
+  }
+
+  resp->state = INFLUX_RX_BODY;
+  return Influx_Feed_More;
+}
+
+
+/*
+ * Influx_HasPrefix
+ *  - This function compares the beginning of the line, case insensitive (header names)
+ */
+static bool Influx_HasPrefix(const char *line, const char *prefix)
+{
+  for(; '\0' != *prefix; line++, prefix++)
+  {
+    char chr = *line;
+
+    if((chr >= 'A') && (chr <= 'Z'))
+    {
+      chr = (char)(chr - 'A' + 'a');
+    }
+
+    if(chr != (((*prefix >= 'A') && (*prefix <= 'Z')) ? (char)(*prefix - 'A' + 'a') : *prefix))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* EOF */
@@ -0,0 +1,99 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       influx_line.h
+ */
+#ifndef _INFLUX_LINE_H_
+#define _INFLUX_LINE_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+#include "mqtt_packet.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Body of one /write request - with the HTTP header it fits in one TCP segment */
+#define INFLUX_BUFFER_SIZE          (1024)
+
+/* Buffer is flushed when it is filled up to this size (or by age) */
+#define INFLUX_FLUSH_SIZE           (INFLUX_BUFFER_SIZE - INFLUX_LINE_MAX_SIZE)
+
+/* One sample in line protocol */
+#define INFLUX_LINE_MAX_SIZE        (160)
+
+/* HTTP request header */
+#define INFLUX_HEADER_MAX_SIZE      (320)
+
+/* Endpoint: http://host[:port]/path?query */
+#define INFLUX_DEFAULT_PORT         (8086)
+#define INFLUX_HOST_MAX_SIZE        (64)
+#define INFLUX_PATH_MAX_SIZE        (144)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Result of one received byte of the response */
+typedef enum Influx_Feed_Tag
+{
+  Influx_Feed_More = 0,
+  Influx_Feed_Done,
+  Influx_Feed_Error
+
+}Influx_Feed_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Parsed endpoint, "precision=ms" is added to the query */
+typedef struct Influx_Url_Tag
+{
+  char host[INFLUX_HOST_MAX_SIZE];
+  uint16_t port;
+  char path[INFLUX_PATH_MAX_SIZE];
+
+}Influx_Url_T;
+
+/* Lines of one request - samples are appended while the other buffer is sent */
+typedef struct Influx_Buffer_Tag
+{
+  char data[INFLUX_BUFFER_SIZE];
+  uint16_t len;
+  uint16_t count;
+  uint32_t first_ms;
+
+}Influx_Buffer_T;
+
+/* Incremental HTTP response receiver - only the status and the length of the body are kept */
+typedef struct Influx_Response_Tag
+{
+  uint8_t state;
+  uint16_t status;
+  bool close;
+  bool has_length;
+  uint32_t length;
+  uint8_t line_len;
+  char line[48];
+
+}Influx_Response_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+bool Influx_ParseUrl(const char *url, Influx_Url_T *out);
+size_t Influx_LineFormat(char *buf, size_t size, const char *series, const Mqtt_Sample_T *sample, uint16_t epoch_ms);
+
+void Influx_BufferInit(Influx_Buffer_T *buffer);
+bool Influx_BufferAppend(Influx_Buffer_T *buffer, const char *line, size_t len, uint32_t now_ms);
+bool Influx_BufferDue(const Influx_Buffer_T *buffer, uint32_t now_ms, uint32_t age_ms);
+
+size_t Influx_RequestFormat(char *buf, size_t size, const Influx_Url_T *url, size_t body_len);
+void Influx_ResponseReset(Influx_Response_T *resp);
+Influx_Feed_T Influx_ResponseFeed(Influx_Response_T *resp, uint8_t byte);
+
+#endif /* _INFLUX_LINE_H_ */
+
+/* EOF */
@@ -0,0 +1,461 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       influx_manager.cpp
+ *
+ *  Time-series database writer (InfluxDB line protocol, /write endpoint, lines in influx_line.cpp):
+ *    - endpoint set with "influx_url http://host[:port]/write?db=<name>" (stored in NvM),
+ *      flush age is a parameter
+ *    - samples are appended as lines to a fixed buffer (no allocation on the sampling path),
+ *      the buffer is sent when it is full or its oldest line waits the flush age
+ *    - one request at a time over a single keep-alive connection, samples arriving meanwhile
+ *      go to the second buffer; when both are full the newest samples are dropped
+ *    - failed request (connection, timeout, HTTP 5xx/408/429) is sent again after a doubling
+ *      delay, other HTTP 4xx drops the batch (the server would reject it again)
+ *    - timestamps in milliseconds once the clock is set - a batch sent twice overwrites the same points,
+ *      samples taken within one second stay separate points
+ *    - normal mode only (deep sleep mode samples are published by MQTT)
+ *    - host test against a local stand-in server: tools/influx_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <sys/time.h>
+#include "influx_manager.h"
+#include "param_manager.h"
+#include "action_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Influx handler */
+Influx_Manager influx;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* GPIO action handler */
+extern Action_Manager action;
+
+static const char *const influx_state_name[] = {"off", "idle", "waiting for response"};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Influx_Init
+ *  - This function resets the buffers and statistics and applies the stored endpoint
+ */
+void Influx_Manager::Influx_Init()
+{
+  Influx_BufferInit(&buffers[0]);
+  Influx_BufferInit(&buffers[1]);
+
+  state = Influx_State_Off;
+  fill = 0;
+  pending = false;
+  sample_seq = 0;
+  start_ms = 0;
+  last_status = 0;
+  samples = 0;
+  body_bytes = 0;
+  wire_bytes = 0;
+  requests = 0;
+  retries = 0;
+  rejected = 0;
+  dropped = 0;
+  connects = 0;
+
+  snprintf(series, sizeof(series), INFLUX_MEASUREMENT "%06x", ESP.getChipId());
+  Influx_Config();
+}
+
+
+/*
+ * Influx_Config
+ *  - This function (re)connects with the stored endpoint and parameters (empty URL - off)
+ *  - Buffered samples are kept, the pending batch is sent at once
+ */
+void Influx_Manager::Influx_Config()
+{
+  eeprom.Nvm_InfluxUrlRead(url_text);
+  flush_age_ms = param.Param_Get(Param_ID_InfluxFlush) * 1000;
+
+  client.stop();
+  state = Influx_State_Off;
+
+  if('\0' == url_text[0])
+  {
+    return;
+  }
+
+  if(!Influx_ParseUrl(url_text, &url))
+  {
+    LOG_WARN(Log_Module_Influx, "URL %s not supported", url_text);
+    return;
+  }
+
+  Net_ConnInit(&host_conn, url.host, url.port);
+
+  state = Influx_State_Idle;
+  attempt = 0;
+  retry_start_ms = millis();
+  retry_delay_ms = 0;
+}
+
+
+/*
+ * Influx_Process
+ *  - This function flushes the buffer by size or age, sends the pending batch and receives the response
+ *  - This function should be called periodically in the loop
+ */
+void Influx_Manager::Influx_Process()
+{
+  uint32_t now_ms = millis();
+
+  if(Influx_State_Off == state)
+  {
+    return;
+  }
+
+  if(!pending && Influx_BufferDue(&buffers[fill], now_ms, flush_age_ms))
+  {
+    pending = true;
+    fill ^= 1;
+    attempt = 0;
+    retry_delay_ms = 0;
+  }
+
+  if(!WiFi.isConnected())
+  {
+    if(Influx_State_Response == state)
+    {
+      Influx_Retry("Link down");
+    }
+    return;
+  }
+
+  if(Influx_State_Response == state)
+  {
+    Influx_Receive();
+
+    if((Influx_State_Response == state) && ((uint32_t)(now_ms - request_ms) >= INFLUX_RESPONSE_TIMEOUT_MS))
+    {
+      Influx_Retry("No response");
+    }
+    return;
+  }
+
+  if(pending && ((uint32_t)(now_ms - retry_start_ms) >= retry_delay_ms))
+  {
+    Influx_Send();
+  }
+}
+
+
+/*
+ * Influx_OnSample
+ *  - This function appends the new sensor sample as one line (samples with NaN are skipped)
+ *  - Called after every measurement (Sensor_UpdateValues)
+ */
+void Influx_Manager::Influx_OnSample(const Sensor::Sensor_Values_T &values)
+{
+  Mqtt_Sample_T sample;
+  char line[INFLUX_LINE_MAX_SIZE];
+  struct timeval now;
+  size_t len;
+  uint32_t now_ms = millis();
+
+  if(Influx_State_Off == state)
+  {
+    return;
+  }
+
+  if((values.temperature != values.temperature) || (values.humidity != values.humidity) ||
+     (values.pressure != values.pressure))
+  {
+    return;
+  }
+
+  sample.seq = sample_seq++;
+  sample.time_ms = now_ms;
+  gettimeofday(&now, nullptr);
+  sample.epoch = action.Action_IsTimeValid() ? (uint32_t)now.tv_sec : 0;
+  sample.temperature_cdeg = (int16_t)lroundf(values.temperature * 100.0F);
+  sample.humidity_cpct = (uint16_t)lroundf(values.humidity * 100.0F);
+  sample.pressure_pa = (uint32_t)lroundf(values.pressure * 100.0F);
+  sample.light = (uint16_t)values.light;
+
+  len = Influx_LineFormat(line, sizeof(line), series, &sample, (uint16_t)(now.tv_usec / 1000));
+
+  if(Influx_BufferAppend(&buffers[fill], line, len, now_ms))
+  {
+    return;
+  }
+
+  /* Buffer is full - it becomes pending unless the other one is still being sent */
+  if(!pending)
+  {
+    pending = true;
+    fill ^= 1;
+    attempt = 0;
+    retry_delay_ms = 0;
+
+    if(Influx_BufferAppend(&buffers[fill], line, len, now_ms))
+    {
+      return;
+    }
+  }
+
+  dropped++;
+  LOG_DEBUG(Log_Module_Influx, "Buffers full, sample dropped");
+}
+
+
+/*
+ * Influx_SetUrl
+ *  - This function stores the write URL (empty - disabled) and reconnects
+ */
+bool Influx_Manager::Influx_SetUrl(const char *new_url)
+{
+  Influx_Url_T parsed;
+  uint16_t len = strlen(new_url);
+
+  if((len > NVM_INFLUX_URL_MAX_SIZE) || ((0 != len) && !Influx_ParseUrl(new_url, &parsed)) ||
+     !eeprom.Nvm_InfluxUrlWrite(new_url, len))
+  {
+    return false;
+  }
+
+  Influx_Config();
+  return true;
+}
+
+
+/*
+ * Influx_Dump
+ *  - This function appends the endpoint, the buffers and the write rate to out
+ */
+void Influx_Manager::Influx_Dump(String &out)
+{
+  char line[192];
+  uint32_t elapsed_ms = millis() - start_ms;
+  uint32_t rate_c = ((0 != samples) && (0 != elapsed_ms)) ? (uint32_t)(((uint64_t)samples * 100000) / elapsed_ms) : 0;
+  uint32_t body_d = (0 != samples) ? ((body_bytes * 10) / samples) : 0;
+  uint32_t wire_d = (0 != samples) ? ((wire_bytes * 10) / samples) : 0;
+
+  snprintf(line, sizeof(line), "INFLUX -> URL: %s (%s), flush: %u B or %u s, last HTTP status: %u\r\n",
+           ('\0' != url_text[0]) ? url_text : "-", influx_state_name[state], INFLUX_FLUSH_SIZE,
+           flush_age_ms / 1000, last_status);
+  out += line;
+
+  snprintf(line, sizeof(line), "INFLUX -> Buffered: %u + %u samples, written: %u in %u requests, retries: %u, rejected: %u, dropped: %u, connects: %u\r\n",
+           buffers[fill].count, pending ? buffers[fill ^ 1].count : 0, samples, requests, retries, rejected,
+           dropped, connects);
+  out += line;
+
+  snprintf(line, sizeof(line), "INFLUX -> Rate: %u.%02u samples/s, %u.%u bytes/sample (%u.%u with HTTP header)\r\n",
+           rate_c / 100, rate_c % 100, body_d / 10, body_d % 10, wire_d / 10, wire_d % 10);
+  out += line;
+}
+
+
+/*
+ * Influx_Metrics
+ *  - This function appends the writer metrics (Prometheus text format) to out
+ */
+void Influx_Manager::Influx_Metrics(String &out)
+{
+  out += "ibeacon_influx_buffered " + String(buffers[fill].count + (pending ? buffers[fill ^ 1].count : 0)) + "\n";
+  out += "ibeacon_influx_samples_total " + String(samples) + "\n";
+  out += "ibeacon_influx_body_bytes_total " + String(body_bytes) + "\n";
+  out += "ibeacon_influx_wire_bytes_total " + String(wire_bytes) + "\n";
+  out += "ibeacon_influx_requests_total " + String(requests) + "\n";
+  out += "ibeacon_influx_retries_total " + String(retries) + "\n";
+  out += "ibeacon_influx_rejected_total " + String(rejected) + "\n";
+  out += "ibeacon_influx_dropped_total " + String(dropped) + "\n";
+  out += "ibeacon_influx_connects_total " + String(connects) + "\n";
+}
+
+
+/*
+ * Influx_Connect
+ *  - This function resolves the host and opens the connection (kept open between requests, net_conn.cpp)
+ *  - It returns Net_Conn_Pending while the host lookup runs
+ */
+Net_Conn_Result_T Influx_Manager::Influx_Connect()
+{
+  Net_Conn_Result_T result = Net_ConnOpen(&host_conn, client);
+
+  if(Net_Conn_NotResolved == result)
+  {
+    LOG_WARN(Log_Module_Influx, "Host %s not resolved", url.host);
+  }
+  else if(Net_Conn_NotConnected == result)
+  {
+    LOG_WARN(Log_Module_Influx, "Host %s:%u not connected", url.host, url.port);
+  }
+  else if(Net_Conn_Ready == result)
+  {
+    connects++;
+  }
+  return result;
+}
+
+
+/*
+ * Influx_Send
+ *  - This function sends the pending batch when the whole request fits in the socket
+ */
+void Influx_Manager::Influx_Send()
+{
+  Influx_Buffer_T &buffer = buffers[fill ^ 1];
+  char header[INFLUX_HEADER_MAX_SIZE];
+  size_t header_len;
+
+  if(!client.connected())
+  {
+    Net_Conn_Result_T result = Influx_Connect();
+
+    /* Running lookup is polled on the next call */
+    if(Net_Conn_Pending == result)
+    {
+      return;
+    }
+    if(Net_Conn_Ready != result)
+    {
+      Influx_Retry(nullptr);
+      return;
+    }
+  }
+
+  header_len = Influx_RequestFormat(header, sizeof(header), &url, buffer.len);
+
+  if((size_t)client.availableForWrite() < (header_len + buffer.len))
+  {
+    return;
+  }
+
+  if((client.write((const uint8_t *)header, header_len) != header_len) ||
+     (client.write((const uint8_t *)buffer.data, buffer.len) != buffer.len))
+  {
+    Influx_Retry("Request not sent");
+    return;
+  }
+
+  Influx_ResponseReset(&response);
+  state = Influx_State_Response;
+  request_len = (uint16_t)(header_len + buffer.len);
+  request_ms = millis();
+  requests++;
+}
+
+
+/*
+ * Influx_Receive
+ *  - This function passes up to INFLUX_RX_CHUNK_MAX received bytes to the response receiver
+ */
+void Influx_Manager::Influx_Receive()
+{
+  for(uint8_t count = 0; (count < INFLUX_RX_CHUNK_MAX) && (client.available() > 0); count++)
+  {
+    Influx_Feed_T result = Influx_ResponseFeed(&response, (uint8_t)client.read());
+
+    if(Influx_Feed_Error == result)
+    {
+      Influx_Retry("Malformed response");
+      return;
+    }
+
+    if(Influx_Feed_Done == result)
+    {
+      Influx_Response();
+      return;
+    }
+  }
+
+  if((0 == client.available()) && !client.connected())
+  {
+    Influx_Retry("Connection lost");
+  }
+}
+
+
+/*
+ * Influx_Response
+ *  - This function completes the pending batch (written or rejected) or schedules the retry
+ */
+void Influx_Manager::Influx_Response()
+{
+  Influx_Buffer_T &buffer = buffers[fill ^ 1];
+  uint16_t status = response.status;
+
+  state = Influx_State_Idle;
+  last_status = status;
+
+  if(response.close)
+  {
+    client.stop();
+  }
+
+  if((status >= 200) && (status < 300))
+  {
+    if(0 == samples)
+    {
+      start_ms = buffer.first_ms;
+    }
+    samples += buffer.count;
+    body_bytes += buffer.len;
+    wire_bytes += request_len;
+  }
+  else if((status >= 400) && (status < 500) && (408 != status) && (429 != status))
+  {
+    LOG_WARN(Log_Module_Influx, "Batch rejected (HTTP %u), %u samples dropped", status, buffer.count);
+    rejected += buffer.count;
+  }
+  else
+  {
+    char reason[24];
+
+    snprintf(reason, sizeof(reason), "HTTP %u", status);
+    Influx_Retry(reason);
+    return;
+  }
+
+  Influx_BufferInit(&buffer);
+  pending = false;
+}
+
+
+/*
+ * Influx_Retry
+ *  - This function closes the connection, the pending batch is sent again after the backoff delay
+ */
+void Influx_Manager::Influx_Retry(const char *reason)
+{
+  retry_delay_ms = INFLUX_RETRY_MIN_MS << ((attempt < 6) ? attempt : 6);
+  retry_delay_ms = (retry_delay_ms > INFLUX_RETRY_MAX_MS) ? INFLUX_RETRY_MAX_MS : retry_delay_ms;
+
+  /* Nodes restarted by the same outage do not retry at once */
+  retry_delay_ms += (uint32_t)random(retry_delay_ms / 4 + 1);
+
+  if(nullptr != reason)
+  {
+    LOG_WARN(Log_Module_Influx, "%s, retry in %u ms", reason, retry_delay_ms);
+  }
+
+  client.stop();
+
+  state = Influx_State_Idle;
+  retry_start_ms = millis();
+  attempt = (attempt < 0xFF) ? (attempt + 1) : attempt;
+  retries++;
+}
+
+/* EOF */
@@ -0,0 +1,108 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       influx_manager.h
+ */
+#ifndef _INFLUX_MANAGER_H_
+#define _INFLUX_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "influx_line.h"
+#include "net_conn.h"
+#include "nvm_manager.h"
+#include "snsr_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Default value - runtime value is kept by Param_Manager */
+#define INFLUX_FLUSH_AGE_S          (10)
+
+/* Retry delay doubles after every failed request */
+#define INFLUX_RETRY_MIN_MS         (1000)
+#define INFLUX_RETRY_MAX_MS         (60000)
+
+/* Connection is closed when the response does not come in time */
+#define INFLUX_RESPONSE_TIMEOUT_MS  (10000)
+
+/* Received bytes handled in one call of Influx_Process() */
+#define INFLUX_RX_CHUNK_MAX         (128)
+
+/* Measurement and tags of every line - tag is followed by the chip ID */
+#define INFLUX_MEASUREMENT          "ibeacon,node="
+#define INFLUX_SERIES_MAX_SIZE      (32)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef enum Influx_State_Tag
+{
+  Influx_State_Off = 0,
+  Influx_State_Idle,
+  Influx_State_Response
+
+}Influx_State_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Influx_Manager
+{
+  public:
+    void Influx_Init();
+    void Influx_Config();
+    void Influx_Process();
+    void Influx_OnSample(const Sensor::Sensor_Values_T &values);
+    bool Influx_SetUrl(const char *new_url);
+    void Influx_Dump(String &out);
+    void Influx_Metrics(String &out);
+
+  private:
+    WiFiClient client;
+    Influx_State_T state;
+    char url_text[NVM_INFLUX_URL_MAX_SIZE + 1];
+    Influx_Url_T url;
+    Net_Conn_T host_conn;
+    char series[INFLUX_SERIES_MAX_SIZE];
+    uint32_t flush_age_ms;
+
+    /* Samples are appended to buffers[fill], the other buffer is sent while pending */
+    Influx_Buffer_T buffers[2];
+    uint8_t fill;
+    bool pending;
+    uint16_t request_len;
+    uint32_t request_ms;
+    Influx_Response_T response;
+
+    /* Backoff of the pending buffer */
+    uint8_t attempt;
+    uint32_t retry_start_ms;
+    uint32_t retry_delay_ms;
+
+    uint32_t sample_seq;
+    uint32_t start_ms;
+    uint16_t last_status;
+
+    uint32_t samples;
+    uint32_t body_bytes;
+    uint32_t wire_bytes;
+    uint32_t requests;
+    uint32_t retries;
+    uint32_t rejected;
+    uint32_t dropped;
+    uint32_t connects;
+
+    Net_Conn_Result_T Influx_Connect();
+    void Influx_Send();
+    void Influx_Receive();
+    void Influx_Response();
+    void Influx_Retry(const char *reason);
+};
+
+#endif /* _INFLUX_MANAGER_H_ */
+
+/* EOF */
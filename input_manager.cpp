@@ -0,0 +1,282 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       input_manager.cpp
+ *
+ *  Digital inputs:
+ *    - pin change interrupt only timestamps the edge into the lock-free ring
+ *      (single producer - ISR, single consumer - loop), nothing else runs in the ISR
+ *    - debouncing is done in the loop - input is stable when no edge came for the debounce time
+ *    - ring overflow is counted and the input state is read again from the pin
+ *    - light sleep (pwr_mode 2) suspends the CPU - edges are captured only while awake
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "input_manager.h"
+#include "param_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define INPUT_QUEUE_MASK            (INPUT_QUEUE_SIZE - 1)
+
+/* Edge data has to be written before the index is published (compiler barrier, single core) */
+#define INPUT_BARRIER()             __asm__ __volatile__("" ::: "memory")
+
+static_assert(0 == (INPUT_QUEUE_SIZE & INPUT_QUEUE_MASK), "Input queue size must be power of 2");
+static_assert(INPUT_QUEUE_SIZE <= 0x10000, "Input queue index is 16 bits wide");
+static_assert(Param_ID_Input2Action == (Param_ID_Input1Action + INPUT_USED - 1), "Action parameter is required for every input");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Input handler */
+Input_Manager input;
+
+/* Gpio handler */
+extern Gpio_Manager gpio;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Edge ring - head is written by the ISR only, tail by the loop only */
+static Input_Edge_T input_queue[INPUT_QUEUE_SIZE];
+static volatile uint16_t input_head = 0;
+static volatile uint16_t input_tail = 0;
+
+/* ISR statistics */
+static volatile uint32_t input_overflows = 0;
+static volatile uint32_t input_isr_max_cycles = 0;
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static void IRAM_ATTR Input_Isr(void *arg);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Input_Init
+ *  - This function configures inputs with pull-ups and attaches the pin change interrupts
+ *  - Current level is taken as the stable state (no event at startup)
+ */
+void Input_Manager::Input_Init()
+{
+  memset(inputs, 0, sizeof(inputs));
+  edges = 0;
+  overflows_seen = 0;
+  queue_max = 0;
+
+  for(uint8_t id = 0; id < INPUT_USED; id++)
+  {
+    pinMode(InputPin[id], INPUT_PULLUP);
+
+    inputs[id].raw = (LOW == digitalRead(InputPin[id]));
+    inputs[id].stable = inputs[id].raw;
+
+    attachInterruptArg(digitalPinToInterrupt(InputPin[id]), Input_Isr, (void *)(uintptr_t)id, CHANGE);
+  }
+}
+
+
+/*
+ * Input_Process
+ *  - This function drains the edge ring and raises the events of inputs stable for the debounce time
+ *  - This function should be called periodically in the loop
+ */
+void Input_Manager::Input_Process()
+{
+  uint16_t tail = input_tail;
+  uint16_t head = input_head;
+  uint32_t now_us;
+  uint32_t debounce_us = param.Param_Get(Param_ID_InputDebounce) * 1000;
+
+  INPUT_BARRIER();
+
+  uint16_t depth = (uint16_t)((head - tail) & INPUT_QUEUE_MASK);
+
+  if(depth > queue_max)
+  {
+    queue_max = depth;
+  }
+
+  while(tail != head)
+  {
+    const Input_Edge_T *edge = &input_queue[tail];
+
+    if(edge->input_id < INPUT_USED)
+    {
+      inputs[edge->input_id].raw = (LOW == edge->level);
+      inputs[edge->input_id].last_edge_us = edge->time_us;
+    }
+
+    edges++;
+    tail = (tail + 1) & INPUT_QUEUE_MASK;
+  }
+
+  INPUT_BARRIER();
+  input_tail = tail;
+
+  now_us = micros();
+
+  /* Lost edges - the last level is not known, debouncing starts again from the pin level */
+  if(overflows_seen != input_overflows)
+  {
+    overflows_seen = input_overflows;
+
+    for(uint8_t id = 0; id < INPUT_USED; id++)
+    {
+      inputs[id].raw = (LOW == digitalRead(InputPin[id]));
+      inputs[id].last_edge_us = now_us;
+    }
+  }
+
+  for(uint8_t id = 0; id < INPUT_USED; id++)
+  {
+    Input_State_T *st = &inputs[id];
+
+    if((st->raw != st->stable) && ((uint32_t)(now_us - st->last_edge_us) >= debounce_us))
+    {
+      st->stable = st->raw;
+      Input_Event(id, st->stable);
+    }
+  }
+}
+
+
+/*
+ * Input_Get
+ *  - This function returns the debounced state (true - closed)
+ */
+bool Input_Manager::Input_Get(uint8_t input_id)
+{
+  return (input_id < INPUT_USED) && inputs[input_id].stable;
+}
+
+
+/*
+ * Input_GetEvents
+ *  - This function returns the number of debounced presses and releases
+ */
+uint32_t Input_Manager::Input_GetEvents(uint8_t input_id)
+{
+  return (input_id < INPUT_USED) ? (inputs[input_id].presses + inputs[input_id].releases) : 0;
+}
+
+
+/*
+ * Input_Dump
+ *  - This function appends the input states and the edge statistics to out
+ */
+void Input_Manager::Input_Dump(String &out)
+{
+  char line[96];
+
+  for(uint8_t id = 0; id < INPUT_USED; id++)
+  {
+    const Input_State_T *st = &inputs[id];
+
+    snprintf(line, sizeof(line), "INPUT -> %u: %s for %u ms, presses: %u, releases: %u, action: %u\r\n",
+             InputPin[id], st->stable ? "closed" : "open", (uint32_t)(millis() - st->changed_ms),
+             st->presses, st->releases, param.Param_Get((Param_ID_T)(Param_ID_Input1Action + id)));
+    out += line;
+  }
+
+  snprintf(line, sizeof(line), "INPUT -> Edges: %u, queue max: %u/%u, overflows: %u, ISR max: %u us\r\n",
+           edges, queue_max, INPUT_QUEUE_SIZE - 1, input_overflows,
+           input_isr_max_cycles / ESP.getCpuFreqMHz());
+  out += line;
+}
+
+
+/*
+ * Input_Metrics
+ *  - This function appends the input metrics (Prometheus text format) to out
+ */
+void Input_Manager::Input_Metrics(String &out)
+{
+  for(uint8_t id = 0; id < INPUT_USED; id++)
+  {
+    out += "ibeacon_input_active{pin=\"" + String(InputPin[id]) + "\"} " + String(inputs[id].stable ? 1 : 0) + "\n";
+    out += "ibeacon_input_events_total{pin=\"" + String(InputPin[id]) + "\"} " + String(Input_GetEvents(id)) + "\n";
+  }
+
+  out += "ibeacon_input_edges_total " + String(edges) + "\n";
+  out += "ibeacon_input_overflows_total " + String(input_overflows) + "\n";
+  out += "ibeacon_input_isr_max_us " + String(input_isr_max_cycles / ESP.getCpuFreqMHz()) + "\n";
+}
+
+
+/*
+ * Input_Event
+ *  - This function handles the debounced change - statistics and the configured output action
+ */
+void Input_Manager::Input_Event(uint8_t input_id, bool active)
+{
+  Input_State_T *st = &inputs[input_id];
+  uint32_t act = param.Param_Get((Param_ID_T)(Param_ID_Input1Action + input_id));
+
+  st->changed_ms = millis();
+
+  if(active)
+  {
+    st->presses++;
+  }
+  else
+  {
+    st->releases++;
+  }
+
+  LOG_INFO(Log_Module_Input, "%u: %s", InputPin[input_id], active ? "closed" : "open");
+
+  if((act >= INPUT_ACTION_TOGGLE(0)) && (act < INPUT_ACTION_FOLLOW(0)) && active)
+  {
+    uint8_t pin_id = act - INPUT_ACTION_TOGGLE(0);
+    gpio.Gpio_Set(pin_id, !gpio.Gpio_Get(pin_id));
+  }
+  else if((act >= INPUT_ACTION_FOLLOW(0)) && (act <= INPUT_ACTION_MAX))
+  {
+    gpio.Gpio_Set(act - INPUT_ACTION_FOLLOW(0), active);
+  }
+}
+
+
+/*
+ * Input_Isr
+ *  - Pin change interrupt - stores the time and the level of the edge (drops it when the ring is full)
+ */
+static void IRAM_ATTR Input_Isr(void *arg)
+{
+  uint32_t start = ESP.getCycleCount();
+  uint8_t id = (uint8_t)(uintptr_t)arg;
+  uint16_t head = input_head;
+  uint16_t next = (head + 1) & INPUT_QUEUE_MASK;
+
+  if(next == input_tail)
+  {
+    input_overflows++;
+  }
+  else
+  {
+    input_queue[head].time_us = micros();
+    input_queue[head].input_id = id;
+    input_queue[head].level = (uint8_t)((GPI >> InputPin[id]) & 1);
+
+    INPUT_BARRIER();
+    input_head = next;
+  }
+
+  uint32_t cycles = ESP.getCycleCount() - start;
+
+  if(cycles > input_isr_max_cycles)
+  {
+    input_isr_max_cycles = cycles;
+  }
+}
+
+/* EOF */
@@ -0,0 +1,92 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       input_manager.h
+ */
+#ifndef _INPUT_MANAGER_H_
+#define _INPUT_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "gpio_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Define how many digital inputs are used */
+#define INPUT_USED                  (2)
+
+/* Edge queue - must hold all edges of one loop period (1kHz on every input, 100ms latency bound) */
+#define INPUT_QUEUE_SIZE            (256)
+
+/* Default values - runtime values are kept by Param_Manager */
+#define INPUT_DEBOUNCE_MS           (20)
+#define INPUT_ACTION                (INPUT_ACTION_NONE)
+
+/*
+ * Input action - done by the debounced event
+ *  - INPUT_ACTION_TOGGLE(n) toggles output n on every press (wall switch)
+ *  - INPUT_ACTION_FOLLOW(n) output n follows the input (door contact)
+ */
+#define INPUT_ACTION_NONE           (0)
+#define INPUT_ACTION_TOGGLE(n)      (1 + (n))
+#define INPUT_ACTION_FOLLOW(n)      (1 + GPIO_REMOTE_USED + (n))
+#define INPUT_ACTION_MAX            (2 * GPIO_REMOTE_USED)
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Inputs - switch or contact to GND (internal pull-up), active when closed */
+const uint8_t InputPin[INPUT_USED] = {D6, D7};
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Edge recorded by the interrupt */
+typedef struct Input_Edge_Tag
+{
+  uint32_t time_us;
+  uint8_t input_id;
+  uint8_t level;
+
+}Input_Edge_T;
+
+/* Debounce state of the input */
+typedef struct Input_State_Tag
+{
+  bool raw;
+  bool stable;
+  uint32_t last_edge_us;
+  uint32_t changed_ms;
+  uint32_t presses;
+  uint32_t releases;
+
+}Input_State_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Input_Manager
+{
+  public:
+    void Input_Init();
+    void Input_Process();
+    bool Input_Get(uint8_t input_id);
+    uint32_t Input_GetEvents(uint8_t input_id);
+    void Input_Dump(String &out);
+    void Input_Metrics(String &out);
+
+  private:
+    Input_State_T inputs[INPUT_USED];
+    uint32_t edges;
+    uint32_t overflows_seen;
+    uint16_t queue_max;
+
+    void Input_Event(uint8_t input_id, bool active);
+};
+
+#endif /* _INPUT_MANAGER_H_ */
+
+/* EOF */
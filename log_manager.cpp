@@ -0,0 +1,535 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       log_manager.cpp
+ *
+ *  Logging:
+ *    - lines are formatted into the ring buffer and drained to the UART by the scheduler
+ *      task only as far as the TX FIFO has free space - a log call never waits for the UART
+ *    - line which does not fit in the ring is dropped and counted
+ *    - module prefix is kept once in the table below instead of every format string
+ *    - the same lines are sent to the syslog server (RFC 5424 over UDP or TCP), the syslog
+ *      reader never holds the ring - it loses the oldest lines when it lags
+ *    - every line is also passed to the mirror callback (TCP console)
+ *    - writer and readers run in the loop context only (single core), log calls from
+ *      the interrupts are not allowed
+ *
+ *  Ring record: [length][level][text with CRLF]
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "log_manager.h"
+#include "param_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define LOG_BUFFER_MASK             (LOG_BUFFER_SIZE - 1)
+#define LOG_RECORD_HEADER_SIZE      (2)
+
+/* Syslog header "<pri>1 - host app - - - " */
+#define LOG_SYSLOG_HEADER_MAX_SIZE  (48)
+
+static_assert(0 == (LOG_BUFFER_SIZE & LOG_BUFFER_MASK), "Log buffer size must be power of 2");
+static_assert(LOG_LINE_MAX_SIZE <= 0xFF, "Log line length is stored in one byte");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Log handler */
+Log_Manager logger;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Ring of the formatted lines */
+static char log_buffer[LOG_BUFFER_SIZE];
+
+/* Module prefixes - Log_Module_T order */
+static const char *const log_prefix[Log_Module_Last] =
+{
+  "SYSTEM", "EEPROM", "PARAM", "RTC", "WIFI", "PROV", "SERVER", "OTA",
+  "SENSOR", "GPIO", "ACTION", "RULE", "INPUT", "PWR", "DSLEEP", "LOG",
+  "TELEM", "CONSOLE", "MQTT", "INFLUX", "COAP"
+};
+
+/* Names used by "log <module> <level>" command */
+static const char *const log_module_name[Log_Module_Last] =
+{
+  "system", "nvm", "param", "rtc", "wifi", "prov", "server", "ota",
+  "sensor", "gpio", "action", "rule", "input", "power", "dsleep", "log",
+  "telem", "console", "mqtt", "influx", "coap"
+};
+
+static const char *const log_level_name[] = {"error", "warn", "info", "debug"};
+
+/* Syslog severity of the log levels (RFC 5424) */
+static const uint8_t log_severity[] = {3, 4, 6, 7};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Log_Init
+ *  - This function clears the ring and enables the default level of all modules
+ *  - It should be called at the very beginning of setup(), lines are kept in the ring
+ *    until the log task starts
+ */
+void Log_Manager::Log_Init()
+{
+  memset(levels, LOG_LEVEL, sizeof(levels));
+
+  head = 0;
+  uart_tail = 0;
+  uart_pos = 0;
+  syslog_tail = 0;
+
+  lines = 0;
+  dropped = 0;
+  syslog_sent = 0;
+  syslog_dropped = 0;
+
+  uart_enabled = true;
+  mirror = nullptr;
+  syslog_server[0] = '\0';
+  syslog_proto = Log_Syslog_Off;
+  syslog_port = LOG_SYSLOG_PORT;
+  Net_ConnInit(&syslog_conn, syslog_server, syslog_port);
+  syslog_active = false;
+
+  snprintf(hostname, sizeof(hostname), "iBeacon-%06x", ESP.getChipId());
+}
+
+
+/*
+ * Log_Config
+ *  - This function applies the log level and the syslog parameters (after Param_Init)
+ */
+void Log_Manager::Log_Config()
+{
+  (void)Log_SetLevel("all", (uint8_t)param.Param_Get(Param_ID_LogLevel));
+  Log_SyslogConfig();
+}
+
+
+/*
+ * Log_SyslogConfig
+ *  - This function (re)starts the syslog sink with the stored server and parameters
+ */
+void Log_Manager::Log_SyslogConfig()
+{
+  eeprom.Nvm_SyslogServerRead(syslog_server);
+  syslog_proto = (Log_Syslog_T)param.Param_Get(Param_ID_SyslogProto);
+  syslog_port = (uint16_t)param.Param_Get(Param_ID_SyslogPort);
+
+  syslog_tcp.stop();
+  Net_ConnInit(&syslog_conn, syslog_server, syslog_port);
+  syslog_active = false;
+  syslog_retry_ms = millis() - LOG_SYSLOG_RETRY_MS;
+  syslog_tail = head;
+}
+
+
+/*
+ * Log_Process
+ *  - This function moves the buffered lines to the UART and to the syslog server
+ *  - This function should be called periodically in the loop
+ */
+void Log_Manager::Log_Process()
+{
+  Log_DrainUart(false);
+  Log_DrainSyslog();
+}
+
+
+/*
+ * Log_Flush
+ *  - This function writes all buffered lines to the UART and waits till they are sent
+ *  - Used before reboot and deep sleep
+ */
+void Log_Manager::Log_Flush()
+{
+  Log_DrainUart(true);
+  Serial.flush();
+}
+
+
+/*
+ * Log_SetUart
+ *  - This function enables or disables the UART output (UART used by the binary telemetry stream)
+ *  - Lines logged while disabled are sent to the syslog only
+ */
+void Log_Manager::Log_SetUart(bool enabled)
+{
+  uart_enabled = enabled;
+  uart_tail = head;
+  uart_pos = 0;
+}
+
+
+/*
+ * Log_SetMirror
+ *  - This function registers the receiver of a copy of every line (nullptr - none)
+ *  - Used by the TCP console, the copy is made also when the ring is full
+ */
+void Log_Manager::Log_SetMirror(Log_Mirror_T callback)
+{
+  mirror = callback;
+}
+
+
+/*
+ * Log_Write
+ *  - This function formats the line (module prefix, fmt placed in the flash) into the ring
+ *  - Line is dropped when the ring is full
+ */
+void Log_Manager::Log_Write(Log_Module_T module, uint8_t level, PGM_P fmt, ...)
+{
+  char record[LOG_RECORD_HEADER_SIZE + LOG_LINE_MAX_SIZE];
+  char *text = &record[LOG_RECORD_HEADER_SIZE];
+  uint16_t size;
+  uint16_t first;
+  va_list args;
+  int len;
+  int msg_len;
+
+  len = snprintf(text, LOG_LINE_MAX_SIZE, "%s -> ", log_prefix[module]);
+
+  va_start(args, fmt);
+  msg_len = vsnprintf_P(text + len, LOG_LINE_MAX_SIZE - 2 - len, fmt, args);
+  va_end(args);
+
+  /* Truncated line still ends with CRLF */
+  len += (msg_len < 0) ? 0 : msg_len;
+  if(len > (LOG_LINE_MAX_SIZE - 3))
+  {
+    len = LOG_LINE_MAX_SIZE - 3;
+  }
+  text[len++] = '\r';
+  text[len++] = '\n';
+
+  record[0] = (char)len;
+  record[1] = (char)level;
+  size = len + LOG_RECORD_HEADER_SIZE;
+  lines++;
+
+  if(nullptr != mirror)
+  {
+    mirror(text, len);
+  }
+
+  if(size > (LOG_BUFFER_SIZE - 1 - Log_Used(uart_tail)))
+  {
+    dropped++;
+    return;
+  }
+
+  /* Syslog reader loses its oldest lines instead of blocking the UART */
+  while(size > (LOG_BUFFER_SIZE - 1 - Log_Used(syslog_tail)))
+  {
+    syslog_tail = (syslog_tail + LOG_RECORD_HEADER_SIZE + (uint8_t)log_buffer[syslog_tail]) & LOG_BUFFER_MASK;
+    syslog_dropped++;
+  }
+
+  first = LOG_BUFFER_SIZE - head;
+  if(first >= size)
+  {
+    memcpy(&log_buffer[head], record, size);
+  }
+  else
+  {
+    memcpy(&log_buffer[head], record, first);
+    memcpy(log_buffer, &record[first], size - first);
+  }
+
+  head = (head + size) & LOG_BUFFER_MASK;
+
+  /* Sink not ready - line is not kept for the syslog */
+  if(!syslog_active)
+  {
+    syslog_tail = head;
+  }
+
+  if(!uart_enabled)
+  {
+    uart_tail = head;
+  }
+}
+
+
+/*
+ * Log_SetLevel
+ *  - This function changes the runtime level of the module ("all" - every module)
+ */
+bool Log_Manager::Log_SetLevel(const char *module, uint8_t level)
+{
+  bool found = false;
+
+  if(level > LOG_LEVEL_DEBUG)
+  {
+    return false;
+  }
+
+  for(uint8_t idx = 0; idx < Log_Module_Last; idx++)
+  {
+    if((0 == strcmp(module, "all")) || (0 == strcmp(module, log_module_name[idx])))
+    {
+      levels[idx] = level;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+
+/*
+ * Log_SetSyslogServer
+ *  - This function stores the syslog server (host name or IP, empty - disabled) and restarts the sink
+ */
+bool Log_Manager::Log_SetSyslogServer(const char *server)
+{
+  uint16_t len = strlen(server);
+
+  if((len > NVM_SYSLOG_SERVER_MAX_SIZE) || !eeprom.Nvm_SyslogServerWrite(server, len))
+  {
+    return false;
+  }
+
+  Log_SyslogConfig();
+  return true;
+}
+
+
+/*
+ * Log_Dump
+ *  - This function appends the levels of the modules and the sink statistics to out
+ */
+void Log_Manager::Log_Dump(String &out)
+{
+  char line[96];
+  static const char *const proto_name[] = {"off", "udp", "tcp"};
+
+  for(uint8_t idx = 0; idx < Log_Module_Last; idx++)
+  {
+    snprintf(line, sizeof(line), "LOG -> %-7s %s\r\n", log_module_name[idx], log_level_name[levels[idx]]);
+    out += line;
+  }
+
+  snprintf(line, sizeof(line), "LOG -> Lines: %u, dropped: %u, buffered: %u/%u bytes (compiled up to %s)\r\n",
+           lines, dropped, Log_Used(uart_tail), LOG_BUFFER_SIZE, log_level_name[LOG_LEVEL_COMPILE]);
+  out += line;
+
+  snprintf(line, sizeof(line), "LOG -> Syslog: %s %s:%u, sent: %u, dropped: %u\r\n", proto_name[syslog_proto],
+           ('\0' != syslog_server[0]) ? syslog_server : "-", syslog_port, syslog_sent, syslog_dropped);
+  out += line;
+}
+
+
+/*
+ * Log_Metrics
+ *  - This function appends the log metrics (Prometheus text format) to out
+ */
+void Log_Manager::Log_Metrics(String &out)
+{
+  out += "ibeacon_log_lines_total " + String(lines) + "\n";
+  out += "ibeacon_log_dropped_total " + String(dropped) + "\n";
+  out += "ibeacon_log_syslog_sent_total " + String(syslog_sent) + "\n";
+  out += "ibeacon_log_syslog_dropped_total " + String(syslog_dropped) + "\n";
+}
+
+
+/*
+ * Log_Used
+ *  - This function returns the number of ring bytes not yet taken by the reader
+ */
+uint16_t Log_Manager::Log_Used(uint16_t tail)
+{
+  return (head - tail) & LOG_BUFFER_MASK;
+}
+
+
+/*
+ * Log_Copy
+ *  - This function copies len bytes of the ring starting at from (wraps around the end)
+ */
+void Log_Manager::Log_Copy(char *dst, uint16_t from, uint16_t len)
+{
+  uint16_t first = LOG_BUFFER_SIZE - from;
+
+  if(first >= len)
+  {
+    memcpy(dst, &log_buffer[from], len);
+  }
+  else
+  {
+    memcpy(dst, &log_buffer[from], first);
+    memcpy(&dst[first], log_buffer, len - first);
+  }
+}
+
+
+/*
+ * Log_DrainUart
+ *  - This function writes the buffered lines to the UART
+ *  - blocking - false: only what fits in the TX FIFO, the rest of the line is written next time
+ */
+void Log_Manager::Log_DrainUart(bool blocking)
+{
+  char chunk[LOG_LINE_MAX_SIZE];
+
+  while(uart_tail != head)
+  {
+    uint16_t len = (uint8_t)log_buffer[uart_tail];
+    uint16_t count = len - uart_pos;
+
+    if(!blocking)
+    {
+      uint16_t room = Serial.availableForWrite();
+
+      if(0 == room)
+      {
+        break;
+      }
+
+      if(count > room)
+      {
+        count = room;
+      }
+    }
+
+    Log_Copy(chunk, (uart_tail + LOG_RECORD_HEADER_SIZE + uart_pos) & LOG_BUFFER_MASK, count);
+    Serial.write((const uint8_t *)chunk, count);
+    uart_pos += count;
+
+    if(uart_pos < len)
+    {
+      break;
+    }
+
+    uart_tail = (uart_tail + LOG_RECORD_HEADER_SIZE + len) & LOG_BUFFER_MASK;
+    uart_pos = 0;
+  }
+}
+
+
+/*
+ * Log_DrainSyslog
+ *  - This function sends up to LOG_SYSLOG_LINES_MAX lines to the syslog server
+ *  - Lines logged while the server is not reachable are not sent
+ */
+void Log_Manager::Log_DrainSyslog()
+{
+  char text[LOG_LINE_MAX_SIZE];
+
+  syslog_active = Log_SyslogReady();
+
+  if(!syslog_active)
+  {
+    syslog_tail = head;
+    return;
+  }
+
+  for(uint8_t cnt = 0; (cnt < LOG_SYSLOG_LINES_MAX) && (syslog_tail != head); cnt++)
+  {
+    uint16_t len = (uint8_t)log_buffer[syslog_tail];
+    uint8_t level = (uint8_t)log_buffer[(syslog_tail + 1) & LOG_BUFFER_MASK];
+
+    /* CRLF is not sent */
+    Log_Copy(text, (syslog_tail + LOG_RECORD_HEADER_SIZE) & LOG_BUFFER_MASK, len - 2);
+
+    if(!Log_SyslogSend(level, text, len - 2))
+    {
+      break;
+    }
+
+    syslog_tail = (syslog_tail + LOG_RECORD_HEADER_SIZE + len) & LOG_BUFFER_MASK;
+    syslog_sent++;
+  }
+}
+
+
+/*
+ * Log_SyslogReady
+ *  - This function resolves the syslog server and opens the TCP connection when needed (net_conn.cpp)
+ *  - Running lookup is polled on every call, failed attempt is repeated after LOG_SYSLOG_RETRY_MS
+ */
+bool Log_Manager::Log_SyslogReady()
+{
+  Net_Conn_Result_T result;
+
+  if((Log_Syslog_Off == syslog_proto) || ('\0' == syslog_server[0]) || !WiFi.isConnected())
+  {
+    Net_ConnInit(&syslog_conn, syslog_server, syslog_port);
+    return false;
+  }
+
+  if((Log_Syslog_Udp == syslog_proto) ? syslog_conn.resolved : syslog_tcp.connected())
+  {
+    return true;
+  }
+
+  if((Net_Conn_Lookup_Idle == syslog_conn.lookup) && ((uint32_t)(millis() - syslog_retry_ms) < LOG_SYSLOG_RETRY_MS))
+  {
+    return false;
+  }
+
+  result = (Log_Syslog_Tcp == syslog_proto) ? Net_ConnOpen(&syslog_conn, syslog_tcp) : Net_ConnResolve(&syslog_conn);
+
+  if(Net_Conn_NotResolved == result)
+  {
+    syslog_retry_ms = millis();
+    LOG_WARN(Log_Module_Log, "Syslog server %s not resolved", syslog_server);
+  }
+  else if(Net_Conn_NotConnected == result)
+  {
+    syslog_retry_ms = millis();
+    LOG_WARN(Log_Module_Log, "Syslog server %s:%u not connected", syslog_server, syslog_port);
+  }
+  return (Net_Conn_Ready == result);
+}
+
+
+/*
+ * Log_SyslogSend
+ *  - This function sends one line as RFC 5424 message (UDP datagram or TCP with octet counting)
+ *  - TCP line is kept for the next call when the socket has no room for it
+ */
+bool Log_Manager::Log_SyslogSend(uint8_t level, const char *text, uint16_t len)
+{
+  char msg[LOG_SYSLOG_HEADER_MAX_SIZE + LOG_LINE_MAX_SIZE];
+  char frame[8];
+  int hdr_len;
+  int frame_len;
+
+  hdr_len = snprintf(msg, LOG_SYSLOG_HEADER_MAX_SIZE, "<%u>1 - %s iBeacon - - - ",
+                     (LOG_SYSLOG_FACILITY * 8) + log_severity[level & LOG_LEVEL_DEBUG], hostname);
+  memcpy(&msg[hdr_len], text, len);
+  len += hdr_len;
+
+  if(Log_Syslog_Udp == syslog_proto)
+  {
+    return syslog_udp.beginPacket(syslog_conn.ip, syslog_port) &&
+           (len == syslog_udp.write((const uint8_t *)msg, len)) &&
+           syslog_udp.endPacket();
+  }
+
+  frame_len = snprintf(frame, sizeof(frame), "%u ", len);
+
+  if(syslog_tcp.availableForWrite() < (frame_len + len))
+  {
+    return false;
+  }
+
+  syslog_tcp.write((const uint8_t *)frame, frame_len);
+  syslog_tcp.write((const uint8_t *)msg, len);
+  return true;
+}
+
+/* EOF */
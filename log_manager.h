@@ -0,0 +1,198 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       log_manager.h
+ */
+#ifndef _LOG_MANAGER_H_
+#define _LOG_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "nvm_manager.h"
+#include "net_conn.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Log levels - errors are always logged */
+#define LOG_LEVEL_ERROR             (0)
+#define LOG_LEVEL_WARN              (1)
+#define LOG_LEVEL_INFO              (2)
+#define LOG_LEVEL_DEBUG             (3)
+
+/* Calls of the levels above are removed at compile time */
+#ifndef LOG_LEVEL_COMPILE
+#define LOG_LEVEL_COMPILE           (LOG_LEVEL_INFO)
+#endif
+
+/* Default values - runtime values are kept by Param_Manager */
+#define LOG_LEVEL                   (LOG_LEVEL_INFO)
+#define LOG_SYSLOG_PROTO            (Log_Syslog_Off)
+#define LOG_SYSLOG_PORT             (514)
+
+/* Ring of the formatted lines - must hold the burst logged between two drains of the UART */
+#define LOG_BUFFER_SIZE             (2048)
+
+/* Longest line with the module prefix and CRLF - longer lines are truncated */
+#define LOG_LINE_MAX_SIZE           (128)
+
+/* Lines sent to the syslog server in one call of Log_Process() */
+#define LOG_SYSLOG_LINES_MAX        (4)
+
+/* Delay between syslog server resolve or connect attempts */
+#define LOG_SYSLOG_RETRY_MS         (30000)
+
+/* Syslog facility local0 */
+#define LOG_SYSLOG_FACILITY         (16)
+
+/*
+ * Logging macros - format string is placed in the flash, arguments are not evaluated
+ * when the level of the module is disabled
+ *  ex. LOG_INFO(Log_Module_Wifi, "Connected after %u ms", time_ms);
+ */
+#define LOG_WRITE(module, level, fmt, ...)  do                                                          \
+                                            {                                                           \
+                                              if(logger.Log_IsEnabled(module, level))                   \
+                                              {                                                         \
+                                                logger.Log_Write(module, level, PSTR(fmt), ##__VA_ARGS__); \
+                                              }                                                         \
+                                            }while(0)
+
+#define LOG_ERROR(module, fmt, ...)         LOG_WRITE(module, LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+#if (LOG_LEVEL_COMPILE >= LOG_LEVEL_WARN)
+#define LOG_WARN(module, fmt, ...)          LOG_WRITE(module, LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(module, fmt, ...)          do {}while(0)
+#endif
+
+#if (LOG_LEVEL_COMPILE >= LOG_LEVEL_INFO)
+#define LOG_INFO(module, fmt, ...)          LOG_WRITE(module, LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(module, fmt, ...)          do {}while(0)
+#endif
+
+#if (LOG_LEVEL_COMPILE >= LOG_LEVEL_DEBUG)
+#define LOG_DEBUG(module, fmt, ...)         LOG_WRITE(module, LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(module, fmt, ...)         do {}while(0)
+#endif
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Modules - prefix table in log_manager.cpp has to follow this order */
+typedef enum Log_Module_Tag
+{
+  Log_Module_System = 0,
+  Log_Module_Nvm,
+  Log_Module_Param,
+  Log_Module_Rtc,
+  Log_Module_Wifi,
+  Log_Module_Prov,
+  Log_Module_Server,
+  Log_Module_Ota,
+  Log_Module_Sensor,
+  Log_Module_Gpio,
+  Log_Module_Action,
+  Log_Module_Rule,
+  Log_Module_Input,
+  Log_Module_Power,
+  Log_Module_Dsleep,
+  Log_Module_Log,
+  Log_Module_Telem,
+  Log_Module_Console,
+  Log_Module_Mqtt,
+  Log_Module_Influx,
+  Log_Module_Coap,
+  Log_Module_Last
+
+}Log_Module_T;
+
+/* Syslog transport */
+typedef enum Log_Syslog_Tag
+{
+  Log_Syslog_Off = 0,
+  Log_Syslog_Udp,
+  Log_Syslog_Tcp
+
+}Log_Syslog_T;
+
+/* Copy of every formatted line (text with CRLF) - called in the loop context, must not log */
+typedef void (*Log_Mirror_T)(const char *text, uint16_t len);
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Log_Manager
+{
+  public:
+    void Log_Init();
+    void Log_Config();
+    void Log_SyslogConfig();
+    void Log_Process();
+    void Log_Flush();
+    void Log_SetUart(bool enabled);
+    void Log_SetMirror(Log_Mirror_T callback);
+    void Log_Write(Log_Module_T module, uint8_t level, PGM_P fmt, ...) __attribute__((format(printf, 4, 5)));
+    bool Log_SetLevel(const char *module, uint8_t level);
+    bool Log_SetSyslogServer(const char *server);
+    void Log_Dump(String &out);
+    void Log_Metrics(String &out);
+
+    /*
+     * Log_IsEnabled
+     *  - This function checks the runtime level of the module (inlined into every call site)
+     */
+    inline bool Log_IsEnabled(Log_Module_T module, uint8_t level)
+    {
+      return (level <= levels[module]);
+    }
+
+  private:
+    uint8_t levels[Log_Module_Last];
+
+    /* Ring indexes - the syslog reader is moved forward by the writer when it lags */
+    uint16_t head;
+    uint16_t uart_tail;
+    uint16_t uart_pos;
+    uint16_t syslog_tail;
+
+    uint32_t lines;
+    uint32_t dropped;
+    uint32_t syslog_sent;
+    uint32_t syslog_dropped;
+
+    char syslog_server[NVM_SYSLOG_SERVER_MAX_SIZE + 1];
+    char hostname[16];
+    Log_Syslog_T syslog_proto;
+    uint16_t syslog_port;
+    Net_Conn_T syslog_conn;
+    bool uart_enabled;
+    Log_Mirror_T mirror;
+    bool syslog_active;
+    uint32_t syslog_retry_ms;
+    WiFiUDP syslog_udp;
+    WiFiClient syslog_tcp;
+
+    uint16_t Log_Used(uint16_t tail);
+    void Log_Copy(char *dst, uint16_t from, uint16_t len);
+    void Log_DrainUart(bool blocking);
+    void Log_DrainSyslog();
+    bool Log_SyslogReady();
+    bool Log_SyslogSend(uint8_t level, const char *text, uint16_t len);
+};
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Log handler */
+extern Log_Manager logger;
+
+#endif /* _LOG_MANAGER_H_ */
+
+/* EOF */
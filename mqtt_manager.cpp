@@ -0,0 +1,730 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       mqtt_manager.cpp
+ *
+ *  MQTT client (MQTT 3.1.1, packets in mqtt_packet.cpp):
+ *    - broker set with "mqtt_broker <host>" (stored in NvM), port and keepalive are parameters
+ *    - topics under ibeacon/<chip id>:
+ *        status              "online" / "offline" (retained, last will)
+ *        samples             JSON array of samples, QoS 1
+ *        gpio/<n>            output level 0..255 (retained, published on every change)
+ *        gpio/<n>/set        command "1"/"0" (ON/OFF) - as the website buttons
+ *        gpio/<n>/level/set  command 0..255 - brightness with the website fade
+ *    - samples are queued in RAM (store-and-forward) and one batch waits for PUBACK at a time,
+ *      samples arriving meanwhile go out in the next batch - a slow link gets fewer, larger
+ *      PUBLISH packets; samples stay queued while the broker is not reachable (the oldest one
+ *      is dropped when the queue is full)
+ *    - deep sleep mode: the RTC memory backlog is the queue, Mqtt_Deliver() reports the sample
+ *      as published after its PUBACK
+ *    - a packet is sent only when the whole of it fits in the socket - the loop never waits
+ *      (except the TCP connect, as the syslog sink)
+ *    - host test against a local broker: tools/mqtt_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "mqtt_manager.h"
+#include "param_manager.h"
+#include "action_manager.h"
+#include "pwm_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define MQTT_GPIO_LEVEL_UNKNOWN     (0xFFFF)
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* MQTT handler */
+Mqtt_Manager mqtt;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Gpio handler */
+extern Gpio_Manager gpio;
+
+/* PWM handler */
+extern Pwm_Manager pwm;
+
+/* GPIO action handler */
+extern Action_Manager action;
+
+static const char *const mqtt_state_name[] = {"off", "disconnected", "connecting", "connected"};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Mqtt_Init
+ *  - This function empties the queue and connects to the stored broker
+ *  - live - samples come from Mqtt_OnSample(), false - deep sleep mode (Mqtt_Deliver())
+ */
+void Mqtt_Manager::Mqtt_Init(bool live)
+{
+  this->live = live;
+
+  Mqtt_QueueInit(&queue);
+  Mqtt_ParserReset(&parser);
+
+  state = Mqtt_State_Off;
+  packet_id = 0;
+  sample_seq = 0;
+  delivered = false;
+  connects = 0;
+  published = 0;
+  batches = 0;
+  commands = 0;
+
+  snprintf(topic_prefix, sizeof(topic_prefix), MQTT_TOPIC_PREFIX "/%06x", ESP.getChipId());
+  Mqtt_Config();
+}
+
+
+/*
+ * Mqtt_Config
+ *  - This function (re)connects with the stored broker and parameters (empty broker - off)
+ */
+void Mqtt_Manager::Mqtt_Config()
+{
+  eeprom.Nvm_MqttBrokerRead(broker);
+  port = (uint16_t)param.Param_Get(Param_ID_MqttPort);
+  keepalive_s = (uint16_t)param.Param_Get(Param_ID_MqttKeepalive);
+
+  Mqtt_Close(nullptr);
+  Net_ConnInit(&broker_conn, broker, port);
+
+  state = ('\0' == broker[0]) ? Mqtt_State_Off : Mqtt_State_Idle;
+  state_ms = millis() - MQTT_RETRY_MS;
+}
+
+
+/*
+ * Mqtt_Process
+ *  - This function keeps the connection, receives the commands and publishes the queue
+ *  - This function should be called periodically in the loop
+ */
+void Mqtt_Manager::Mqtt_Process()
+{
+  uint32_t now_ms = millis();
+  uint32_t half_keepalive_ms = (uint32_t)keepalive_s * 500;
+
+  if(Mqtt_State_Off == state)
+  {
+    return;
+  }
+
+  if(!WiFi.isConnected())
+  {
+    if(Mqtt_State_Idle != state)
+    {
+      Mqtt_Close("Link down");
+    }
+    return;
+  }
+
+  if(Mqtt_State_Idle == state)
+  {
+    /* Running lookup is polled on every call, new attempt waits for the retry time */
+    if((Net_Conn_Lookup_Idle != broker_conn.lookup) || ((uint32_t)(now_ms - state_ms) >= MQTT_RETRY_MS))
+    {
+      state_ms = now_ms;
+      (void)Mqtt_Connect();
+    }
+    return;
+  }
+
+  if(!client.connected())
+  {
+    Mqtt_Close("Connection lost");
+    return;
+  }
+
+  Mqtt_Receive();
+
+  if(Mqtt_State_Connack == state)
+  {
+    if((uint32_t)(now_ms - state_ms) >= MQTT_ACK_TIMEOUT_MS)
+    {
+      Mqtt_Close("No CONNACK");
+    }
+    return;
+  }
+
+  if(Mqtt_State_Ready != state)
+  {
+    return;
+  }
+
+  if((inflight && ((uint32_t)(now_ms - inflight_ms) >= MQTT_ACK_TIMEOUT_MS)) ||
+     (ping_pending && ((uint32_t)(now_ms - ping_ms) >= MQTT_ACK_TIMEOUT_MS)))
+  {
+    Mqtt_Close("Broker not responding");
+    return;
+  }
+
+  /* Broker closes the connection without a packet within 1.5 x keepalive */
+  if(!ping_pending && (((uint32_t)(now_ms - tx_ms) >= half_keepalive_ms) ||
+                       ((uint32_t)(now_ms - rx_ms) >= half_keepalive_ms)))
+  {
+    if(Mqtt_Send(Mqtt_EncodeEmpty(tx_buffer, sizeof(tx_buffer), Mqtt_Packet_Pingreq)))
+    {
+      ping_pending = true;
+      ping_ms = now_ms;
+    }
+  }
+
+  Mqtt_PublishGpio();
+
+  if(!inflight)
+  {
+    Mqtt_PublishBatch();
+  }
+}
+
+
+/*
+ * Mqtt_Stop
+ *  - This function reports "offline" and disconnects (before the deep sleep)
+ */
+void Mqtt_Manager::Mqtt_Stop()
+{
+  if(Mqtt_State_Ready == state)
+  {
+    (void)Mqtt_PublishText("/status", "offline", true);
+    (void)Mqtt_Send(Mqtt_EncodeEmpty(tx_buffer, sizeof(tx_buffer), Mqtt_Packet_Disconnect));
+  }
+
+  Mqtt_Close(nullptr);
+}
+
+
+/*
+ * Mqtt_OnSample
+ *  - This function queues the new sensor sample (samples with NaN are skipped)
+ *  - Called after every measurement (Sensor_UpdateValues)
+ */
+void Mqtt_Manager::Mqtt_OnSample(const Sensor::Sensor_Values_T &values)
+{
+  Mqtt_Sample_T sample;
+
+  if(!live || (Mqtt_State_Off == state))
+  {
+    return;
+  }
+
+  if((values.temperature != values.temperature) || (values.humidity != values.humidity) ||
+     (values.pressure != values.pressure))
+  {
+    return;
+  }
+
+  sample.seq = sample_seq++;
+  sample.time_ms = millis();
+  sample.epoch = action.Action_IsTimeValid() ? (uint32_t)time(nullptr) : 0;
+  sample.temperature_cdeg = (int16_t)lroundf(values.temperature * 100.0F);
+  sample.humidity_cpct = (uint16_t)lroundf(values.humidity * 100.0F);
+  sample.pressure_pa = (uint32_t)lroundf(values.pressure * 100.0F);
+  sample.light = (uint16_t)values.light;
+
+  if(!Mqtt_QueuePush(&queue, &sample))
+  {
+    LOG_DEBUG(Log_Module_Mqtt, "Queue full, oldest sample dropped");
+  }
+}
+
+
+/*
+ * Mqtt_Deliver
+ *  - This function publishes the deep sleep sample (false - not acknowledged yet, try again later)
+ *  - Without the broker the sample is reported as published at once
+ */
+bool Mqtt_Manager::Mqtt_Deliver(const Rtc_Sample_T &sample)
+{
+  Mqtt_Sample_T mqtt_sample;
+
+  if(Mqtt_State_Off == state)
+  {
+    return true;
+  }
+
+  if(delivered && (delivered_seq == sample.seq))
+  {
+    delivered = false;
+    return true;
+  }
+
+  if((0 == queue.count) && !inflight)
+  {
+    mqtt_sample.seq = sample.seq;
+    mqtt_sample.time_ms = sample.time_ms;
+    mqtt_sample.epoch = 0;
+    mqtt_sample.temperature_cdeg = sample.temperature_cdeg;
+    mqtt_sample.humidity_cpct = sample.humidity_cpct;
+    mqtt_sample.pressure_pa = sample.pressure_pa;
+    mqtt_sample.light = sample.light;
+    (void)Mqtt_QueuePush(&queue, &mqtt_sample);
+  }
+  return false;
+}
+
+
+/*
+ * Mqtt_SetBroker
+ *  - This function stores the broker (host name or IP, empty - disabled) and reconnects
+ */
+bool Mqtt_Manager::Mqtt_SetBroker(const char *new_broker)
+{
+  uint16_t len = strlen(new_broker);
+
+  if((len > NVM_MQTT_BROKER_MAX_SIZE) || !eeprom.Nvm_MqttBrokerWrite(new_broker, len))
+  {
+    return false;
+  }
+
+  Mqtt_Config();
+  return true;
+}
+
+
+/*
+ * Mqtt_Dump
+ *  - This function appends the connection state and the queue statistics to out
+ */
+void Mqtt_Manager::Mqtt_Dump(String &out)
+{
+  char line[160];
+
+  snprintf(line, sizeof(line), "MQTT -> Broker: %s:%u (%s), keepalive: %u s, topics: %s/#\r\n",
+           ('\0' != broker[0]) ? broker : "-", port, mqtt_state_name[state], keepalive_s, topic_prefix);
+  out += line;
+
+  snprintf(line, sizeof(line), "MQTT -> Queue: %u/%u, dropped: %u, published: %u in %u batches, commands: %u, connects: %u\r\n",
+           queue.count, MQTT_QUEUE_SIZE, queue.dropped, published, batches, commands, connects);
+  out += line;
+}
+
+
+/*
+ * Mqtt_Metrics
+ *  - This function appends the MQTT metrics (Prometheus text format) to out
+ */
+void Mqtt_Manager::Mqtt_Metrics(String &out)
+{
+  out += "ibeacon_mqtt_connected " + String((Mqtt_State_Ready == state) ? 1 : 0) + "\n";
+  out += "ibeacon_mqtt_connects_total " + String(connects) + "\n";
+  out += "ibeacon_mqtt_queue_depth " + String(queue.count) + "\n";
+  out += "ibeacon_mqtt_queue_dropped_total " + String(queue.dropped) + "\n";
+  out += "ibeacon_mqtt_published_total " + String(published) + "\n";
+  out += "ibeacon_mqtt_batches_total " + String(batches) + "\n";
+  out += "ibeacon_mqtt_commands_total " + String(commands) + "\n";
+}
+
+
+/*
+ * Mqtt_Connect
+ *  - This function resolves the broker, opens the connection and sends CONNECT (net_conn.cpp)
+ *  - It returns false also while the broker lookup runs
+ */
+bool Mqtt_Manager::Mqtt_Connect()
+{
+  Net_Conn_Result_T result = Net_ConnOpen(&broker_conn, client);
+  Mqtt_Connect_T conn;
+  char client_id[16];
+  char will_topic[MQTT_TOPIC_MAX_SIZE];
+
+  if(Net_Conn_NotResolved == result)
+  {
+    LOG_WARN(Log_Module_Mqtt, "Broker %s not resolved", broker);
+  }
+  else if(Net_Conn_NotConnected == result)
+  {
+    LOG_WARN(Log_Module_Mqtt, "Broker %s:%u not connected", broker, port);
+  }
+
+  if(Net_Conn_Ready != result)
+  {
+    return false;
+  }
+
+  snprintf(client_id, sizeof(client_id), "iBeacon-%06x", ESP.getChipId());
+  Mqtt_Topic(will_topic, "/status");
+
+  conn.client_id = client_id;
+  conn.username = nullptr;
+  conn.password = nullptr;
+  conn.will_topic = will_topic;
+  conn.will_payload = "offline";
+  conn.will_retain = true;
+  conn.keepalive_s = keepalive_s;
+
+  Mqtt_ParserReset(&parser);
+
+  if(!Mqtt_Send(Mqtt_EncodeConnect(tx_buffer, sizeof(tx_buffer), &conn)))
+  {
+    Mqtt_Close("CONNECT not sent");
+    return false;
+  }
+
+  state = Mqtt_State_Connack;
+  state_ms = millis();
+  return true;
+}
+
+
+/*
+ * Mqtt_Close
+ *  - This function closes the connection, the batch waiting for PUBACK is sent again after reconnect
+ */
+void Mqtt_Manager::Mqtt_Close(const char *reason)
+{
+  if((nullptr != reason) && (Mqtt_State_Ready == state))
+  {
+    LOG_WARN(Log_Module_Mqtt, "%s, queued samples: %u", reason, queue.count);
+  }
+  else if(nullptr != reason)
+  {
+    LOG_WARN(Log_Module_Mqtt, "%s", reason);
+  }
+
+  client.stop();
+
+  if(Mqtt_State_Off != state)
+  {
+    state = Mqtt_State_Idle;
+  }
+  state_ms = millis();
+  inflight = false;
+  ping_pending = false;
+}
+
+
+/*
+ * Mqtt_Send
+ *  - This function sends len bytes of tx_buffer when the whole packet fits in the socket
+ *  - Returns false when nothing was sent (0 - packet did not fit in tx_buffer)
+ */
+bool Mqtt_Manager::Mqtt_Send(size_t len)
+{
+  if((0 == len) || ((size_t)client.availableForWrite() < len))
+  {
+    return false;
+  }
+
+  if(client.write(tx_buffer, len) != len)
+  {
+    return false;
+  }
+
+  tx_ms = millis();
+  return true;
+}
+
+
+/*
+ * Mqtt_NextPacketId
+ *  - This function returns the next packet identifier, 0 is not allowed by MQTT 3.1.1 and skipped
+ */
+uint16_t Mqtt_Manager::Mqtt_NextPacketId()
+{
+  packet_id = (0xFFFF == packet_id) ? 1 : (packet_id + 1);
+  return packet_id;
+}
+
+
+/*
+ * Mqtt_Receive
+ *  - This function passes up to MQTT_RX_CHUNK_MAX received bytes to the parser
+ */
+void Mqtt_Manager::Mqtt_Receive()
+{
+  for(uint8_t count = 0; (count < MQTT_RX_CHUNK_MAX) && (client.available() > 0); count++)
+  {
+    Mqtt_Feed_T result = Mqtt_ParserFeed(&parser, (uint8_t)client.read());
+
+    if(Mqtt_Feed_Error == result)
+    {
+      Mqtt_Close("Malformed packet");
+      return;
+    }
+
+    if(Mqtt_Feed_Packet == result)
+    {
+      rx_ms = millis();
+      Mqtt_Packet();
+
+      if(Mqtt_State_Idle == state)
+      {
+        return;
+      }
+    }
+  }
+}
+
+
+/*
+ * Mqtt_Packet
+ *  - This function handles the received packet
+ */
+void Mqtt_Manager::Mqtt_Packet()
+{
+  Mqtt_Message_T msg;
+  uint16_t ack_id;
+  uint8_t return_code = 0xFF;
+
+  switch(parser.header >> 4)
+  {
+    case Mqtt_Packet_Connack:
+    {
+      if(!Mqtt_DecodeConnack(&parser, &return_code) || (0 != return_code))
+      {
+        LOG_WARN(Log_Module_Mqtt, "Broker refused the connection (code %u)", return_code);
+        Mqtt_Close(nullptr);
+        break;
+      }
+
+      char topic[MQTT_TOPIC_MAX_SIZE];
+
+      state = Mqtt_State_Ready;
+      connects++;
+      rx_ms = millis();
+
+      Mqtt_Topic(topic, "/gpio/+/set");
+      (void)Mqtt_Send(Mqtt_EncodeSubscribe(tx_buffer, sizeof(tx_buffer), Mqtt_NextPacketId(), topic, 0));
+      Mqtt_Topic(topic, "/gpio/+/level/set");
+      (void)Mqtt_Send(Mqtt_EncodeSubscribe(tx_buffer, sizeof(tx_buffer), Mqtt_NextPacketId(), topic, 0));
+      (void)Mqtt_PublishText("/status", "online", true);
+
+      /* Every output state is published again */
+      for(uint8_t pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++)
+      {
+        gpio_levels[pin_id] = MQTT_GPIO_LEVEL_UNKNOWN;
+      }
+
+      LOG_INFO(Log_Module_Mqtt, "Connected to %s:%u, queued samples: %u", broker, port, queue.count);
+      break;
+    }
+
+    case Mqtt_Packet_Puback:
+    {
+      if(!inflight || !Mqtt_DecodeAck(&parser, &ack_id) || (ack_id != inflight_id))
+      {
+        break;
+      }
+
+      /* Samples dropped from the full queue meanwhile are not in the front any more */
+      for(const Mqtt_Sample_T *sample = Mqtt_QueuePeek(&queue, 0);
+          (nullptr != sample) && ((int32_t)(sample->seq - inflight_last_seq) <= 0);
+          sample = Mqtt_QueuePeek(&queue, 0))
+      {
+        Mqtt_QueueDrop(&queue, 1);
+        published++;
+      }
+
+      batches++;
+      inflight = false;
+      delivered = true;
+      delivered_seq = inflight_last_seq;
+      break;
+    }
+
+    case Mqtt_Packet_Pingresp:
+    {
+      ping_pending = false;
+      break;
+    }
+
+    case Mqtt_Packet_Publish:
+    {
+      if(!Mqtt_DecodePublish(&parser, &msg))
+      {
+        break;
+      }
+
+      Mqtt_Command(msg);
+
+      if(1 == msg.qos)
+      {
+        (void)Mqtt_Send(Mqtt_EncodeAck(tx_buffer, sizeof(tx_buffer), Mqtt_Packet_Puback, msg.packet_id));
+      }
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+}
+
+
+/*
+ * Mqtt_Command
+ *  - This function applies gpio/<n>/set ("1"/"0", "ON"/"OFF") and gpio/<n>/level/set (0..255)
+ */
+void Mqtt_Manager::Mqtt_Command(const Mqtt_Message_T &msg)
+{
+  char topic[MQTT_TOPIC_MAX_SIZE];
+  char payload[8];
+  size_t prefix_len = strlen(topic_prefix);
+  char *end;
+  uint32_t pin;
+  uint8_t pin_id;
+
+  if((msg.topic_len >= sizeof(topic)) || (msg.payload_len >= sizeof(payload)))
+  {
+    return;
+  }
+
+  memcpy(topic, msg.topic, msg.topic_len);
+  topic[msg.topic_len] = '\0';
+  memcpy(payload, msg.payload, msg.payload_len);
+  payload[msg.payload_len] = '\0';
+
+  if((0 != strncmp(topic, topic_prefix, prefix_len)) || (0 != strncmp(&topic[prefix_len], "/gpio/", 6)))
+  {
+    return;
+  }
+
+  pin = strtoul(&topic[prefix_len + 6], &end, 10);
+
+  if(!gpio.Gpio_FindPin(pin, pin_id))
+  {
+    LOG_WARN(Log_Module_Mqtt, "Command for unknown GPIO %u", pin);
+    return;
+  }
+
+  commands++;
+
+  if(0 == strcmp(end, "/set"))
+  {
+    if((0 == strcmp(payload, "1")) || (0 == strcasecmp(payload, "ON")))
+    {
+      LOG_INFO(Log_Module_Gpio, "%d: ON", GpioPin[pin_id]);
+      gpio.Gpio_Set(pin_id, true);
+    }
+    else if((0 == strcmp(payload, "0")) || (0 == strcasecmp(payload, "OFF")))
+    {
+      LOG_INFO(Log_Module_Gpio, "%d: OFF", GpioPin[pin_id]);
+      gpio.Gpio_Set(pin_id, false);
+    }
+    else
+    {
+      LOG_WARN(Log_Module_Gpio, "Unknown request");
+    }
+  }
+  else if(0 == strcmp(end, "/level/set"))
+  {
+    uint32_t level = strtoul(payload, &end, 10);
+
+    if((end == payload) || ('\0' != *end) || (level > PWM_LEVEL_MAX))
+    {
+      LOG_WARN(Log_Module_Gpio, "Unknown request");
+      return;
+    }
+
+    LOG_INFO(Log_Module_Gpio, "%d: level %u", GpioPin[pin_id], level);
+    gpio.Gpio_SetLevel(pin_id, (uint8_t)level, PWM_WEB_FADE_MS);
+  }
+}
+
+
+/*
+ * Mqtt_PublishBatch
+ *  - This function sends the front of the queue (up to MQTT_BATCH_MAX samples) with QoS 1
+ *  - Batch is formatted again on the next call when the socket has no room for it
+ */
+void Mqtt_Manager::Mqtt_PublishBatch()
+{
+  char topic[MQTT_TOPIC_MAX_SIZE];
+  size_t headroom;
+  size_t len;
+  uint8_t count;
+
+  if(0 == queue.count)
+  {
+    return;
+  }
+
+  Mqtt_Topic(topic, "/samples");
+  headroom = MQTT_PUBLISH_HEADROOM(strlen(topic));
+
+  count = Mqtt_BatchFormat(&queue, MQTT_BATCH_MAX, (char *)&tx_buffer[headroom], sizeof(tx_buffer) - headroom, &len);
+  if(0 == count)
+  {
+    return;
+  }
+
+  if(!Mqtt_Send(Mqtt_EncodePublish(tx_buffer, sizeof(tx_buffer), topic, &tx_buffer[headroom], len, 1, false, false, Mqtt_NextPacketId())))
+  {
+    return;
+  }
+
+  inflight = true;
+  inflight_id = packet_id;
+  inflight_last_seq = Mqtt_QueuePeek(&queue, count - 1)->seq;
+  inflight_ms = millis();
+}
+
+
+/*
+ * Mqtt_PublishGpio
+ *  - This function publishes the output level (retained) when it differs from the last published one
+ */
+void Mqtt_Manager::Mqtt_PublishGpio()
+{
+  char suffix[16];
+  char level[8];
+
+  for(uint8_t pin_id = 0; pin_id < GPIO_REMOTE_USED; pin_id++)
+  {
+    uint8_t target = gpio.Gpio_Get(pin_id) ? pwm.Pwm_GetTarget(pin_id) : 0;
+
+    if(target == gpio_levels[pin_id])
+    {
+      continue;
+    }
+
+    snprintf(suffix, sizeof(suffix), "/gpio/%u", GpioPin[pin_id]);
+    snprintf(level, sizeof(level), "%u", target);
+
+    if(Mqtt_PublishText(suffix, level, true))
+    {
+      gpio_levels[pin_id] = target;
+    }
+  }
+}
+
+
+/*
+ * Mqtt_PublishText
+ *  - This function publishes the text under the device prefix with QoS 0
+ */
+bool Mqtt_Manager::Mqtt_PublishText(const char *suffix, const char *text, bool retain)
+{
+  char topic[MQTT_TOPIC_MAX_SIZE];
+
+  Mqtt_Topic(topic, suffix);
+  return Mqtt_Send(Mqtt_EncodePublish(tx_buffer, sizeof(tx_buffer), topic, (const uint8_t *)text, strlen(text),
+                                      0, retain, false, 0));
+}
+
+
+/*
+ * Mqtt_Topic
+ *  - This function builds the topic from the device prefix and the suffix
+ */
+void Mqtt_Manager::Mqtt_Topic(char *topic, const char *suffix)
+{
+  snprintf(topic, MQTT_TOPIC_MAX_SIZE, "%s%s", topic_prefix, suffix);
+}
+
+/* EOF */
@@ -0,0 +1,125 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       mqtt_manager.h
+ */
+#ifndef _MQTT_MANAGER_H_
+#define _MQTT_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "mqtt_packet.h"
+#include "net_conn.h"
+#include "nvm_manager.h"
+#include "rtc_manager.h"
+#include "snsr_manager.h"
+#include "gpio_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Default values - runtime values are kept by Param_Manager */
+#define MQTT_PORT                   (1883)
+#define MQTT_KEEPALIVE_S            (60)
+
+/* Delay between broker resolve or connect attempts */
+#define MQTT_RETRY_MS               (10000)
+
+/* Connection is closed when CONNACK or PUBACK of the batch does not come in time */
+#define MQTT_ACK_TIMEOUT_MS         (10000)
+
+/* Largest packet sent - one TCP segment */
+#define MQTT_TX_MAX_SIZE            (1460)
+
+/* Received bytes handled in one call of Mqtt_Process() */
+#define MQTT_RX_CHUNK_MAX           (128)
+
+/* Topics - prefix is followed by the chip ID */
+#define MQTT_TOPIC_PREFIX           "ibeacon"
+#define MQTT_TOPIC_MAX_SIZE         (48)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef enum Mqtt_State_Tag
+{
+  Mqtt_State_Off = 0,
+  Mqtt_State_Idle,
+  Mqtt_State_Connack,
+  Mqtt_State_Ready
+
+}Mqtt_State_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Mqtt_Manager
+{
+  public:
+    void Mqtt_Init(bool live);
+    void Mqtt_Config();
+    void Mqtt_Process();
+    void Mqtt_Stop();
+    void Mqtt_OnSample(const Sensor::Sensor_Values_T &values);
+    bool Mqtt_Deliver(const Rtc_Sample_T &sample);
+    bool Mqtt_SetBroker(const char *broker);
+    void Mqtt_Dump(String &out);
+    void Mqtt_Metrics(String &out);
+
+  private:
+    WiFiClient client;
+    Mqtt_State_T state;
+    bool live;
+    char broker[NVM_MQTT_BROKER_MAX_SIZE + 1];
+    Net_Conn_T broker_conn;
+    char topic_prefix[MQTT_TOPIC_MAX_SIZE];
+    uint16_t port;
+    uint16_t keepalive_s;
+    uint32_t state_ms;
+    uint32_t tx_ms;
+    uint32_t rx_ms;
+    uint32_t ping_ms;
+    bool ping_pending;
+
+    /* Batch waiting for PUBACK - samples up to last_seq leave the queue */
+    uint16_t packet_id;
+    uint16_t inflight_id;
+    uint32_t inflight_last_seq;
+    uint32_t inflight_ms;
+    bool inflight;
+
+    /* Deep sleep mode - sample handed over by Mqtt_Deliver() was acknowledged */
+    uint32_t delivered_seq;
+    bool delivered;
+
+    uint32_t sample_seq;
+    uint16_t gpio_levels[GPIO_REMOTE_USED];
+
+    Mqtt_Queue_T queue;
+    Mqtt_Parser_T parser;
+    uint8_t tx_buffer[MQTT_TX_MAX_SIZE];
+
+    uint32_t connects;
+    uint32_t published;
+    uint32_t batches;
+    uint32_t commands;
+
+    bool Mqtt_Connect();
+    void Mqtt_Close(const char *reason);
+    bool Mqtt_Send(size_t len);
+    uint16_t Mqtt_NextPacketId();
+    void Mqtt_Receive();
+    void Mqtt_Packet();
+    void Mqtt_Command(const Mqtt_Message_T &msg);
+    void Mqtt_PublishBatch();
+    void Mqtt_PublishGpio();
+    bool Mqtt_PublishText(const char *suffix, const char *text, bool retain);
+    void Mqtt_Topic(char *topic, const char *suffix);
+};
+
+#endif /* _MQTT_MANAGER_H_ */
+
+/* EOF */
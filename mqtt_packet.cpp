@@ -0,0 +1,575 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       mqtt_packet.cpp
+ *
+ *  MQTT 3.1.1 packets and the sample queue:
+ *    - encoders write the whole packet into the given buffer (0 - it does not fit), so the
+ *      caller can check the free socket space before sending anything
+ *    - receiver is fed byte by byte, the body of the longer packets is skipped
+ *    - queue keeps the newest MQTT_QUEUE_SIZE samples, a batch is taken from its front and
+ *      dropped only after the broker acknowledged it (at least once delivery, seq identifies
+ *      the duplicates)
+ *    - samples are formatted from the fixed point values (no float printf)
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/mqtt_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <string.h>
+#include "mqtt_packet.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Remaining length takes up to 4 bytes, 7 bits each */
+#define MQTT_LENGTH_BYTES_MAX       (4)
+#define MQTT_LENGTH_MAX             (268435455UL)
+
+/* Fixed header flags */
+#define MQTT_FLAG_DUP               (0x08)
+#define MQTT_FLAG_RETAIN            (0x01)
+#define MQTT_FLAG_SUBSCRIBE         (0x02)
+
+/* CONNECT flags */
+#define MQTT_CONNECT_USERNAME       (0x80)
+#define MQTT_CONNECT_PASSWORD       (0x40)
+#define MQTT_CONNECT_WILL_RETAIN    (0x20)
+#define MQTT_CONNECT_WILL           (0x04)
+#define MQTT_CONNECT_CLEAN          (0x02)
+
+/* Protocol name and level 4 (3.1.1) */
+#define MQTT_PROTOCOL_LEVEL         (4)
+
+/* Receiver states */
+#define MQTT_RX_HEADER              (0)
+#define MQTT_RX_LENGTH              (1)
+#define MQTT_RX_BODY                (2)
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static size_t Mqtt_PutHeader(uint8_t *buf, size_t size, uint8_t header, size_t remaining);
+static size_t Mqtt_PutString(uint8_t *buf, size_t pos, const char *str, uint16_t len);
+static uint16_t Mqtt_StrLen(const char *str);
+static uint16_t Mqtt_Get16(const uint8_t *buf);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Mqtt_EncodeConnect
+ *  - This function encodes CONNECT with clean session, optional credentials and last will (QoS 0)
+ */
+size_t Mqtt_EncodeConnect(uint8_t *buf, size_t size, const Mqtt_Connect_T *conn)
+{
+  uint16_t id_len = Mqtt_StrLen(conn->client_id);
+  uint16_t user_len = Mqtt_StrLen(conn->username);
+  uint16_t pass_len = Mqtt_StrLen(conn->password);
+  uint16_t will_topic_len = Mqtt_StrLen(conn->will_topic);
+  uint16_t will_len = Mqtt_StrLen(conn->will_payload);
+  uint8_t flags = MQTT_CONNECT_CLEAN;
+  size_t remaining = 10 + 2 + id_len;
+  size_t pos;
+
+  if(0 != will_topic_len)
+  {
+    flags |= MQTT_CONNECT_WILL | (conn->will_retain ? MQTT_CONNECT_WILL_RETAIN : 0);
+    remaining += 2 + will_topic_len + 2 + will_len;
+  }
+
+  if(0 != user_len)
+  {
+    flags |= MQTT_CONNECT_USERNAME;
+    remaining += 2 + user_len;
+
+    if(0 != pass_len)
+    {
+      flags |= MQTT_CONNECT_PASSWORD;
+      remaining += 2 + pass_len;
+    }
+  }
+
+  pos = Mqtt_PutHeader(buf, size, (uint8_t)(Mqtt_Packet_Connect << 4), remaining);
+  if(0 == pos)
+  {
+    return 0;
+  }
+
+  pos = Mqtt_PutString(buf, pos, "MQTT", 4);
+  buf[pos++] = MQTT_PROTOCOL_LEVEL;
+  buf[pos++] = flags;
+  buf[pos++] = (uint8_t)(conn->keepalive_s >> 8);
+  buf[pos++] = (uint8_t)conn->keepalive_s;
+  pos = Mqtt_PutString(buf, pos, conn->client_id, id_len);
+
+  if(0 != (flags & MQTT_CONNECT_WILL))
+  {
+    pos = Mqtt_PutString(buf, pos, conn->will_topic, will_topic_len);
+    pos = Mqtt_PutString(buf, pos, conn->will_payload, will_len);
+  }
+
+  if(0 != (flags & MQTT_CONNECT_USERNAME))
+  {
+    pos = Mqtt_PutString(buf, pos, conn->username, user_len);
+  }
+
+  if(0 != (flags & MQTT_CONNECT_PASSWORD))
+  {
+    pos = Mqtt_PutString(buf, pos, conn->password, pass_len);
+  }
+  return pos;
+}
+
+
+/*
+ * Mqtt_EncodePublish
+ *  - This function encodes PUBLISH (packet_id is used with QoS 1 only)
+ *  - payload can point into buf behind MQTT_PUBLISH_HEADROOM(topic length) bytes
+ */
+size_t Mqtt_EncodePublish(uint8_t *buf, size_t size, const char *topic, const uint8_t *payload, size_t len,
+                          uint8_t qos, bool retain, bool dup, uint16_t packet_id)
+{
+  uint16_t topic_len = Mqtt_StrLen(topic);
+  uint8_t header = (uint8_t)(Mqtt_Packet_Publish << 4) | (uint8_t)((qos & 0x03) << 1);
+  size_t remaining = 2 + topic_len + ((0 != qos) ? 2 : 0) + len;
+  size_t pos;
+
+  header |= (retain ? MQTT_FLAG_RETAIN : 0) | ((dup && (0 != qos)) ? MQTT_FLAG_DUP : 0);
+
+  pos = Mqtt_PutHeader(buf, size, header, remaining);
+  if(0 == pos)
+  {
+    return 0;
+  }
+
+  pos = Mqtt_PutString(buf, pos, topic, topic_len);
+
+  if(0 != qos)
+  {
+    buf[pos++] = (uint8_t)(packet_id >> 8);
+    buf[pos++] = (uint8_t)packet_id;
+  }
+
+  /* Payload may be formatted in buf behind the header space (memmove) */
+  if(0 != len)
+  {
+    memmove(&buf[pos], payload, len);
+  }
+  return pos + len;
+}
+
+
+/*
+ * Mqtt_EncodeSubscribe
+ *  - This function encodes SUBSCRIBE of single topic filter
+ */
+size_t Mqtt_EncodeSubscribe(uint8_t *buf, size_t size, uint16_t packet_id, const char *topic, uint8_t qos)
+{
+  uint16_t topic_len = Mqtt_StrLen(topic);
+  size_t pos;
+
+  pos = Mqtt_PutHeader(buf, size, (uint8_t)(Mqtt_Packet_Subscribe << 4) | MQTT_FLAG_SUBSCRIBE, 2 + 2 + topic_len + 1);
+  if(0 == pos)
+  {
+    return 0;
+  }
+
+  buf[pos++] = (uint8_t)(packet_id >> 8);
+  buf[pos++] = (uint8_t)packet_id;
+  pos = Mqtt_PutString(buf, pos, topic, topic_len);
+  buf[pos++] = qos & 0x03;
+  return pos;
+}
+
+
+/*
+ * Mqtt_EncodeAck
+ *  - This function encodes the packet carrying only the packet ID (PUBACK)
+ */
+size_t Mqtt_EncodeAck(uint8_t *buf, size_t size, Mqtt_Packet_T type, uint16_t packet_id)
+{
+  size_t pos = Mqtt_PutHeader(buf, size, (uint8_t)(type << 4), 2);
+
+  if(0 == pos)
+  {
+    return 0;
+  }
+
+  buf[pos++] = (uint8_t)(packet_id >> 8);
+  buf[pos++] = (uint8_t)packet_id;
+  return pos;
+}
+
+
+/*
+ * Mqtt_EncodeEmpty
+ *  - This function encodes the packet without body (PINGREQ, DISCONNECT)
+ */
+size_t Mqtt_EncodeEmpty(uint8_t *buf, size_t size, Mqtt_Packet_T type)
+{
+  return Mqtt_PutHeader(buf, size, (uint8_t)(type << 4), 0);
+}
+
+
+/*
+ * Mqtt_ParserReset
+ *  - This function prepares the receiver for the first byte of the next packet
+ */
+void Mqtt_ParserReset(Mqtt_Parser_T *parser)
+{
+  parser->state = MQTT_RX_HEADER;
+  parser->header = 0;
+  parser->shift = 0;
+  parser->overflow = false;
+  parser->remaining = 0;
+  parser->length = 0;
+}
+
+
+/*
+ * Mqtt_ParserFeed
+ *  - This function takes one received byte
+ *  - Mqtt_Feed_Packet - packet is complete (overflow - body was longer than MQTT_RX_MAX_SIZE),
+ *    Mqtt_Feed_Error - malformed length, the connection has to be closed
+ */
+Mqtt_Feed_T Mqtt_ParserFeed(Mqtt_Parser_T *parser, uint8_t byte)
+{
+  switch(parser->state)
+  {
+    case MQTT_RX_HEADER:
+    {
+      Mqtt_ParserReset(parser);
+      parser->header = byte;
+      parser->state = MQTT_RX_LENGTH;
+      return Mqtt_Feed_More;
+    }
+
+    case MQTT_RX_LENGTH:
+    {
+      parser->remaining |= (uint32_t)(byte & 0x7F) << parser->shift;
+      parser->shift += 7;
+
+      if(0 != (byte & 0x80))
+      {
+        if(parser->shift >= (7 * MQTT_LENGTH_BYTES_MAX))
+        {
+          parser->state = MQTT_RX_HEADER;
+          return Mqtt_Feed_Error;
+        }
+        return Mqtt_Feed_More;
+      }
+
+      parser->state = MQTT_RX_BODY;
+      parser->overflow = (parser->remaining > MQTT_RX_MAX_SIZE);
+      break;
+    }
+
+    default:
+    {
+      if(parser->length < MQTT_RX_MAX_SIZE)
+      {
+        parser->body[parser->length] = byte;
+      }
+      parser->length++;
+      break;
+    }
+  }
+
+  if(parser->length < parser->remaining)
+  {
+    return Mqtt_Feed_More;
+  }
+
+  parser->state = MQTT_RX_HEADER;
+  return Mqtt_Feed_Packet;
+}
+
+
+/*
+ * Mqtt_DecodeConnack
+ *  - This function reads the return code of CONNACK (0 - accepted)
+ */
+bool Mqtt_DecodeConnack(const Mqtt_Parser_T *parser, uint8_t *return_code)
+{
+  if(((parser->header >> 4) != Mqtt_Packet_Connack) || (2 != parser->remaining))
+  {
+    return false;
+  }
+
+  *return_code = parser->body[1];
+  return true;
+}
+
+
+/*
+ * Mqtt_DecodeAck
+ *  - This function reads the packet ID of PUBACK or SUBACK
+ */
+bool Mqtt_DecodeAck(const Mqtt_Parser_T *parser, uint16_t *packet_id)
+{
+  if((parser->remaining < 2) || parser->overflow)
+  {
+    return false;
+  }
+
+  *packet_id = Mqtt_Get16(parser->body);
+  return true;
+}
+
+
+/*
+ * Mqtt_DecodePublish
+ *  - This function splits received PUBLISH to the topic and the payload
+ */
+bool Mqtt_DecodePublish(const Mqtt_Parser_T *parser, Mqtt_Message_T *msg)
+{
+  size_t pos = 2;
+
+  if(((parser->header >> 4) != Mqtt_Packet_Publish) || parser->overflow || (parser->remaining < 2))
+  {
+    return false;
+  }
+
+  msg->qos = (parser->header >> 1) & 0x03;
+  msg->retain = (0 != (parser->header & MQTT_FLAG_RETAIN));
+  msg->topic_len = Mqtt_Get16(parser->body);
+  msg->topic = (const char *)&parser->body[pos];
+  pos += msg->topic_len;
+  msg->packet_id = 0;
+
+  if(0 != msg->qos)
+  {
+    if((pos + 2) > parser->remaining)
+    {
+      return false;
+    }
+    msg->packet_id = Mqtt_Get16(&parser->body[pos]);
+    pos += 2;
+  }
+
+  if(pos > parser->remaining)
+  {
+    return false;
+  }
+
+  msg->payload = &parser->body[pos];
+  msg->payload_len = parser->remaining - pos;
+  return true;
+}
+
+
+/*
+ * Mqtt_QueueInit
+ *  - This function empties the queue
+ */
+void Mqtt_QueueInit(Mqtt_Queue_T *queue)
+{
+  queue->first = 0;
+  queue->count = 0;
+  queue->dropped = 0;
+}
+
+
+/*
+ * Mqtt_QueuePush
+ *  - This function appends the sample, the oldest one is dropped when the queue is full
+ *  - Returns false when a sample was dropped
+ */
+bool Mqtt_QueuePush(Mqtt_Queue_T *queue, const Mqtt_Sample_T *sample)
+{
+  bool kept = true;
+
+  if(MQTT_QUEUE_SIZE == queue->count)
+  {
+    queue->first = (queue->first + 1) % MQTT_QUEUE_SIZE;
+    queue->count--;
+    queue->dropped++;
+    kept = false;
+  }
+
+  queue->samples[(queue->first + queue->count) % MQTT_QUEUE_SIZE] = *sample;
+  queue->count++;
+  return kept;
+}
+
+
+/*
+ * Mqtt_QueuePeek
+ *  - This function returns the sample idx places from the front (nullptr - not queued)
+ */
+const Mqtt_Sample_T *Mqtt_QueuePeek(const Mqtt_Queue_T *queue, uint16_t idx)
+{
+  if(idx >= queue->count)
+  {
+    return nullptr;
+  }
+  return &queue->samples[(queue->first + idx) % MQTT_QUEUE_SIZE];
+}
+
+
+/*
+ * Mqtt_QueueDrop
+ *  - This function removes count samples from the front
+ */
+void Mqtt_QueueDrop(Mqtt_Queue_T *queue, uint16_t count)
+{
+  if(count > queue->count)
+  {
+    count = queue->count;
+  }
+
+  queue->first = (queue->first + count) % MQTT_QUEUE_SIZE;
+  queue->count -= count;
+}
+
+
+/*
+ * Mqtt_SampleFormat
+ *  - This function formats the sample as JSON object (0 - does not fit)
+ *    ex. {"seq":7,"up_ms":14020,"time":1700000000,"temp":21.53,"hum":40.12,"pres":1013.25,"light":512}
+ */
+size_t Mqtt_SampleFormat(char *buf, size_t size, const Mqtt_Sample_T *sample)
+{
+  unsigned temp_abs = (unsigned)((sample->temperature_cdeg < 0) ? -sample->temperature_cdeg : sample->temperature_cdeg);
+  char epoch[24] = "";
+  int len;
+
+  if(0 != sample->epoch)
+  {
+    snprintf(epoch, sizeof(epoch), ",\"time\":%lu", (unsigned long)sample->epoch);
+  }
+
+  len = snprintf(buf, size, "{\"seq\":%lu,\"up_ms\":%lu%s,\"temp\":%s%u.%02u,\"hum\":%u.%02u,\"pres\":%lu.%02lu,\"light\":%u}",
+                 (unsigned long)sample->seq, (unsigned long)sample->time_ms, epoch,
+                 (sample->temperature_cdeg < 0) ? "-" : "", temp_abs / 100, temp_abs % 100,
+                 sample->humidity_cpct / 100, sample->humidity_cpct % 100,
+                 (unsigned long)(sample->pressure_pa / 100), (unsigned long)(sample->pressure_pa % 100),
+                 sample->light);
+
+  return ((len < 0) || ((size_t)len >= size)) ? 0 : (size_t)len;
+}
+
+
+/*
+ * Mqtt_BatchFormat
+ *  - This function formats up to max samples from the front of the queue as JSON array
+ *  - Returns the number of samples in the batch (0 - queue is empty), len is the payload length
+ */
+uint8_t Mqtt_BatchFormat(const Mqtt_Queue_T *queue, uint8_t max, char *buf, size_t size, size_t *len)
+{
+  uint8_t count = 0;
+  size_t pos = 1;
+
+  if(size < (MQTT_SAMPLE_JSON_MAX_SIZE + 2))
+  {
+    return 0;
+  }
+
+  buf[0] = '[';
+
+  while((count < max) && (count < queue->count))
+  {
+    size_t room = size - pos - 1;
+    size_t sample_len;
+
+    if(0 != count)
+    {
+      if(room < 2)
+      {
+        break;
+      }
+      buf[pos] = ',';
+      room--;
+    }
+
+    sample_len = Mqtt_SampleFormat(&buf[pos + ((0 != count) ? 1 : 0)], room, Mqtt_QueuePeek(queue, count));
+    if(0 == sample_len)
+    {
+      break;
+    }
+
+    pos += sample_len + ((0 != count) ? 1 : 0);
+    count++;
+  }
+
+  buf[pos++] = ']';
+  *len = pos;
+  return count;
+}
+
+
+/*
+ * Mqtt_PutHeader
+ *  - This function writes the fixed header, returns the body position (0 - packet does not fit)
+ */
+static size_t Mqtt_PutHeader(uint8_t *buf, size_t size, uint8_t header, size_t remaining)
+{
+  size_t length_bytes = 1;
+  size_t pos = 0;
+
+  for(size_t rest = remaining >> 7; 0 != rest; rest >>= 7)
+  {
+    length_bytes++;
+  }
+
+  if((remaining > MQTT_LENGTH_MAX) || (size < (1 + length_bytes + remaining)))
+  {
+    return 0;
+  }
+
+  buf[pos++] = header;
+
+  do
+  {
+    uint8_t byte = remaining & 0x7F;
+
+    remaining >>= 7;
+    buf[pos++] = byte | ((0 != remaining) ? 0x80 : 0);
+  }while(0 != remaining);
+
+  return pos;
+}
+
+
+/*
+ * Mqtt_PutString
+ *  - This function writes the string with its 16 bit length, returns the next position
+ */
+static size_t Mqtt_PutString(uint8_t *buf, size_t pos, const char *str, uint16_t len)
+{
+  buf[pos++] = (uint8_t)(len >> 8);
+  buf[pos++] = (uint8_t)len;
+
+  if(0 != len)
+  {
+    memcpy(&buf[pos], str, len);
+  }
+  return pos + len;
+}
+
+
+/*
+ * Mqtt_StrLen
+ *  - This function returns the length of the string (nullptr - 0)
+ */
+static uint16_t Mqtt_StrLen(const char *str)
+{
+  return (nullptr == str) ? 0 : (uint16_t)strlen(str);
+}
+
+
+/*
+ * Mqtt_Get16
+ *  - This function loads 16 bit big endian value
+ */
+static uint16_t Mqtt_Get16(const uint8_t *buf)
+{
+  return (uint16_t)((buf[0] << 8) | buf[1]);
+}
+
+/* EOF */
@@ -0,0 +1,158 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       mqtt_packet.h
+ */
+#ifndef _MQTT_PACKET_H_
+#define _MQTT_PACKET_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Received packets with longer body are skipped (commands are short) */
+#ifndef MQTT_RX_MAX_SIZE
+#define MQTT_RX_MAX_SIZE            (256)
+#endif
+
+/* Samples kept while the broker is not reachable - the oldest sample is dropped when full */
+#define MQTT_QUEUE_SIZE             (64)
+
+/* Samples sent in one PUBLISH */
+#define MQTT_BATCH_MAX              (12)
+
+/* Largest PUBLISH header - payload formatted at this offset of the packet buffer is moved in place */
+#define MQTT_PUBLISH_HEADROOM(topic_len)  (1 + 4 + 2 + (topic_len) + 2)
+
+/* One sample as JSON object */
+#define MQTT_SAMPLE_JSON_MAX_SIZE   (112)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Control packet types (MQTT 3.1.1) */
+typedef enum Mqtt_Packet_Tag
+{
+  Mqtt_Packet_Connect = 1,
+  Mqtt_Packet_Connack,
+  Mqtt_Packet_Publish,
+  Mqtt_Packet_Puback,
+  Mqtt_Packet_Pubrec,
+  Mqtt_Packet_Pubrel,
+  Mqtt_Packet_Pubcomp,
+  Mqtt_Packet_Subscribe,
+  Mqtt_Packet_Suback,
+  Mqtt_Packet_Unsubscribe,
+  Mqtt_Packet_Unsuback,
+  Mqtt_Packet_Pingreq,
+  Mqtt_Packet_Pingresp,
+  Mqtt_Packet_Disconnect
+
+}Mqtt_Packet_T;
+
+/* Result of one received byte */
+typedef enum Mqtt_Feed_Tag
+{
+  Mqtt_Feed_More = 0,
+  Mqtt_Feed_Packet,
+  Mqtt_Feed_Error
+
+}Mqtt_Feed_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* CONNECT fields - nullptr (or empty) strings are left out */
+typedef struct Mqtt_Connect_Tag
+{
+  const char *client_id;
+  const char *username;
+  const char *password;
+  const char *will_topic;
+  const char *will_payload;
+  bool will_retain;
+  uint16_t keepalive_s;
+
+}Mqtt_Connect_T;
+
+/* Received PUBLISH - topic and payload point into the parser body */
+typedef struct Mqtt_Message_Tag
+{
+  const char *topic;
+  uint16_t topic_len;
+  const uint8_t *payload;
+  size_t payload_len;
+  uint8_t qos;
+  bool retain;
+  uint16_t packet_id;
+
+}Mqtt_Message_T;
+
+/* Incremental receiver - bytes are fed as they come from the socket */
+typedef struct Mqtt_Parser_Tag
+{
+  uint8_t state;
+  uint8_t header;
+  uint8_t shift;
+  bool overflow;
+  uint32_t remaining;
+  uint32_t length;
+  uint8_t body[MQTT_RX_MAX_SIZE];
+
+}Mqtt_Parser_T;
+
+/* Sensor sample in fixed point */
+typedef struct Mqtt_Sample_Tag
+{
+  uint32_t seq;
+  uint32_t time_ms;
+  uint32_t epoch;             /* 0 - clock not set */
+  int16_t temperature_cdeg;   /* 0.01 degC */
+  uint16_t humidity_cpct;     /* 0.01 % */
+  uint32_t pressure_pa;
+  uint16_t light;
+
+}Mqtt_Sample_T;
+
+/* Store-and-forward queue */
+typedef struct Mqtt_Queue_Tag
+{
+  Mqtt_Sample_T samples[MQTT_QUEUE_SIZE];
+  uint16_t first;
+  uint16_t count;
+  uint32_t dropped;
+
+}Mqtt_Queue_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+size_t Mqtt_EncodeConnect(uint8_t *buf, size_t size, const Mqtt_Connect_T *conn);
+size_t Mqtt_EncodePublish(uint8_t *buf, size_t size, const char *topic, const uint8_t *payload, size_t len,
+                          uint8_t qos, bool retain, bool dup, uint16_t packet_id);
+size_t Mqtt_EncodeSubscribe(uint8_t *buf, size_t size, uint16_t packet_id, const char *topic, uint8_t qos);
+size_t Mqtt_EncodeAck(uint8_t *buf, size_t size, Mqtt_Packet_T type, uint16_t packet_id);
+size_t Mqtt_EncodeEmpty(uint8_t *buf, size_t size, Mqtt_Packet_T type);
+
+void Mqtt_ParserReset(Mqtt_Parser_T *parser);
+Mqtt_Feed_T Mqtt_ParserFeed(Mqtt_Parser_T *parser, uint8_t byte);
+bool Mqtt_DecodeConnack(const Mqtt_Parser_T *parser, uint8_t *return_code);
+bool Mqtt_DecodeAck(const Mqtt_Parser_T *parser, uint16_t *packet_id);
+bool Mqtt_DecodePublish(const Mqtt_Parser_T *parser, Mqtt_Message_T *msg);
+
+void Mqtt_QueueInit(Mqtt_Queue_T *queue);
+bool Mqtt_QueuePush(Mqtt_Queue_T *queue, const Mqtt_Sample_T *sample);
+const Mqtt_Sample_T *Mqtt_QueuePeek(const Mqtt_Queue_T *queue, uint16_t idx);
+void Mqtt_QueueDrop(Mqtt_Queue_T *queue, uint16_t count);
+
+size_t Mqtt_SampleFormat(char *buf, size_t size, const Mqtt_Sample_T *sample);
+uint8_t Mqtt_BatchFormat(const Mqtt_Queue_T *queue, uint8_t max, char *buf, size_t size, size_t *len);
+
+#endif /* _MQTT_PACKET_H_ */
+
+/* EOF */
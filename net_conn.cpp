@@ -0,0 +1,150 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       net_conn.cpp
+ *
+ *  Server endpoint shared by the syslog, MQTT and time-series writers:
+ *    - host name is looked up asynchronously (lwIP DNS), the caller polls until the answer comes
+ *    - resolved address is cached, a failed connect drops it so the next attempt looks it up again
+ *    - connect is bounded by NET_CONN_CONNECT_TIMEOUT_MS (WiFi.hostByName() and the default
+ *      WiFiClient timeout could stall the loop for seconds on every retry)
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <lwip/dns.h>
+#include "net_conn.h"
+
+/* ==================================================================== */
+/* ================== local function definitions  ===================== */
+/* ==================================================================== */
+
+/*
+ * Net_ConnFound
+ *  - This function stores the lookup answer (lwIP callback, ipaddr is NULL on failure)
+ *  - Answer for a host name configured before is ignored
+ */
+static void Net_ConnFound(const char *name, const ip_addr_t *ipaddr, void *callback_arg)
+{
+  Net_Conn_T *conn = (Net_Conn_T *)callback_arg;
+
+  if((Net_Conn_Lookup_Pending != conn->lookup) || (0 != strcmp(name, conn->host)))
+  {
+    return;
+  }
+
+  if(nullptr != ipaddr)
+  {
+    conn->ip = IPAddress(ipaddr);
+    conn->lookup = Net_Conn_Lookup_Done;
+  }
+  else
+  {
+    conn->lookup = Net_Conn_Lookup_Failed;
+  }
+}
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Net_ConnInit
+ *  - This function sets the endpoint, the cached address is dropped
+ */
+void Net_ConnInit(Net_Conn_T *conn, const char *host, uint16_t port)
+{
+  conn->host = host;
+  conn->port = port;
+  conn->resolved = false;
+  conn->lookup = Net_Conn_Lookup_Idle;
+  conn->lookup_ms = 0;
+}
+
+
+/*
+ * Net_ConnResolve
+ *  - This function starts the host name lookup or checks the running one (never blocks)
+ *  - It returns Net_Conn_Ready when the address is known, Net_Conn_Pending while the lookup runs
+ */
+Net_Conn_Result_T Net_ConnResolve(Net_Conn_T *conn)
+{
+  ip_addr_t addr;
+  err_t err;
+
+  if(conn->resolved)
+  {
+    return Net_Conn_Ready;
+  }
+
+  switch(conn->lookup)
+  {
+    case Net_Conn_Lookup_Idle:
+      conn->lookup = Net_Conn_Lookup_Pending;
+      conn->lookup_ms = millis();
+
+      /* Address literals and cached names are answered at once */
+      err = dns_gethostbyname(conn->host, &addr, Net_ConnFound, conn);
+
+      if(ERR_OK == err)
+      {
+        conn->ip = IPAddress(&addr);
+        conn->lookup = Net_Conn_Lookup_Idle;
+        conn->resolved = true;
+        return Net_Conn_Ready;
+      }
+      if(ERR_INPROGRESS != err)
+      {
+        conn->lookup = Net_Conn_Lookup_Idle;
+        return Net_Conn_NotResolved;
+      }
+      return Net_Conn_Pending;
+
+    case Net_Conn_Lookup_Done:
+      conn->lookup = Net_Conn_Lookup_Idle;
+      conn->resolved = true;
+      return Net_Conn_Ready;
+
+    case Net_Conn_Lookup_Failed:
+      conn->lookup = Net_Conn_Lookup_Idle;
+      return Net_Conn_NotResolved;
+
+    default:
+      if((uint32_t)(millis() - conn->lookup_ms) >= NET_CONN_DNS_TIMEOUT_MS)
+      {
+        conn->lookup = Net_Conn_Lookup_Idle;
+        return Net_Conn_NotResolved;
+      }
+      return Net_Conn_Pending;
+  }
+}
+
+
+/*
+ * Net_ConnOpen
+ *  - This function resolves the host and opens the TCP connection once the address is known
+ *  - Failed connect drops the cached address (server may have moved)
+ */
+Net_Conn_Result_T Net_ConnOpen(Net_Conn_T *conn, WiFiClient &client)
+{
+  Net_Conn_Result_T result = Net_ConnResolve(conn);
+
+  if(Net_Conn_Ready != result)
+  {
+    return result;
+  }
+
+  client.setTimeout(NET_CONN_CONNECT_TIMEOUT_MS);
+
+  if(!client.connect(conn->ip, conn->port))
+  {
+    conn->resolved = false;
+    return Net_Conn_NotConnected;
+  }
+  client.setNoDelay(true);
+
+  return Net_Conn_Ready;
+}
+
+/* EOF */
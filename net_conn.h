@@ -0,0 +1,71 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       net_conn.h
+ */
+#ifndef _NET_CONN_H_
+#define _NET_CONN_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Host name lookup without an answer within the time is treated as failed */
+#define NET_CONN_DNS_TIMEOUT_MS         (5000)
+
+/* WiFiClient has no asynchronous connect - one attempt blocks the loop at most this long */
+#define NET_CONN_CONNECT_TIMEOUT_MS     (500)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Result of one resolve/open step */
+typedef enum Net_Conn_Result_Tag
+{
+  Net_Conn_Pending = 0,
+  Net_Conn_Ready,
+  Net_Conn_NotResolved,
+  Net_Conn_NotConnected
+
+}Net_Conn_Result_T;
+
+/* Host name lookup state (written by the lwIP callback) */
+typedef enum Net_Conn_Lookup_Tag
+{
+  Net_Conn_Lookup_Idle = 0,
+  Net_Conn_Lookup_Pending,
+  Net_Conn_Lookup_Done,
+  Net_Conn_Lookup_Failed
+
+}Net_Conn_Lookup_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Server endpoint - host buffer is owned by the caller and must outlive the structure */
+typedef struct Net_Conn_Tag
+{
+  const char *host;
+  uint16_t port;
+  IPAddress ip;
+  bool resolved;
+  volatile Net_Conn_Lookup_T lookup;
+  uint32_t lookup_ms;
+
+}Net_Conn_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+void Net_ConnInit(Net_Conn_T *conn, const char *host, uint16_t port);
+Net_Conn_Result_T Net_ConnResolve(Net_Conn_T *conn);
+Net_Conn_Result_T Net_ConnOpen(Net_Conn_T *conn, WiFiClient &client);
+
+#endif /* _NET_CONN_H_ */
+
+/* EOF */
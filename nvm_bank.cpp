@@ -0,0 +1,339 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       nvm_bank.cpp
+ *
+ *  Wear-leveled record storage:
+ *    - NVM_BANK_COUNT flash sectors are split into NVM_SLOT_SIZE_BYTE slots
+ *      (other geometry can be given to mount storage written by older firmware)
+ *    - every write goes to the next blank slot, the sector is erased only when
+ *      the rotation enters it, so the previous record always survives an erase
+ *    - slot header is written after the payload and is protected by CRC32,
+ *      a write torn by power loss is simply ignored on the next mount
+ *    - the valid slot with the newest sequence number wins at boot
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/nvm_bank_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <string.h>
+#include "nvm_bank.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define NVM_CRC32_POLY              ((uint32_t)0xEDB88320)
+
+/* Chunk used to calculate CRC of the slot without loading it at once */
+#define NVM_BANK_CHUNK_SIZE_BYTE    (64)
+
+#define NVM_BANK_WORD_ALIGN(x)      (((x) + 3) & ~3)
+
+/* Sequence comparison safe against counter wrap */
+#define NVM_SEQ_IS_NEWER(a, b)      ((int32_t)((a) - (b)) > 0)
+
+/* CRC covers header fields placed after magic (except crc itself) and the payload */
+#define NVM_SLOT_HEADER_CRC_OFFSET  (sizeof(uint32_t))
+#define NVM_SLOT_HEADER_CRC_SIZE    (sizeof(Nvm_Slot_Header_T) - (2 * sizeof(uint32_t)))
+
+static_assert(16 == sizeof(Nvm_Slot_Header_T), "Slot header must be word aligned without padding");
+static_assert(0 == (NVM_BANK_SECTOR_SIZE_BYTE % NVM_SLOT_SIZE_BYTE), "Slot size must divide the sector");
+static_assert(0 == (NVM_BANK_SECTOR_SIZE_BYTE % NVM_SLOT_LEGACY_SIZE_BYTE), "Slot size must divide the sector");
+static_assert(0 == (NVM_BANK_SECTOR_SIZE_BYTE % NVM_SLOT_LEGACY_V1_SIZE_BYTE), "Slot size must divide the sector");
+static_assert(NVM_BANK_COUNT >= 2, "At least two banks are required to survive power loss during erase");
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Nvm_Crc32
+ *  - This function calculates CRC32 (IEEE 802.3, reflected) of the given buffer
+ *  - Pass the previous result as crc to continue calculation over several buffers
+ */
+uint32_t Nvm_Crc32(const uint8_t *data, size_t len, uint32_t crc)
+{
+  crc = ~crc;
+
+  while(len--)
+  {
+    crc ^= *data++;
+
+    for(uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (NVM_CRC32_POLY & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+
+/*
+ * Nvm_BankInit
+ *  - This function connects flash primitives and the first bank address
+ *  - Banks have to be placed in consecutive sectors
+ *  - Slot size (has to divide the sector) and magic select the storage geometry
+ */
+void Nvm_Bank::Nvm_BankInit(const Nvm_Flash_Ops_T *flash_ops, uint32_t start_addr, uint16_t size, uint32_t magic)
+{
+  ops = flash_ops;
+  base_addr = start_addr;
+  slot_size = size;
+  slots_per_bank = NVM_BANK_SECTOR_SIZE_BYTE / size;
+  slots_total = slots_per_bank * NVM_BANK_COUNT;
+  slot_magic = magic;
+  active_slot = NVM_SLOT_NONE;
+  sequence = 0;
+  erase_cnt = 0;
+}
+
+
+/*
+ * Nvm_BankSlotAddr
+ *  - This function returns flash address of the given slot
+ */
+uint32_t Nvm_Bank::Nvm_BankSlotAddr(uint16_t slot)
+{
+  return base_addr + ((uint32_t)slot * slot_size);
+}
+
+
+/*
+ * Nvm_BankSlotIsBlank
+ *  - This function checks if the whole slot is erased (0xFF) and can be written
+ */
+bool Nvm_Bank::Nvm_BankSlotIsBlank(uint16_t slot)
+{
+  uint32_t chunk[NVM_BANK_CHUNK_SIZE_BYTE / 4];
+  uint32_t addr = Nvm_BankSlotAddr(slot);
+
+  for(uint16_t offset = 0; offset < slot_size; offset += NVM_BANK_CHUNK_SIZE_BYTE)
+  {
+    if(!ops->read(addr + offset, chunk, NVM_BANK_CHUNK_SIZE_BYTE))
+    {
+      return false;
+    }
+
+    for(uint8_t idx = 0; idx < (NVM_BANK_CHUNK_SIZE_BYTE / 4); idx++)
+    {
+      if(0xFFFFFFFF != chunk[idx])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+/*
+ * Nvm_BankSlotRead
+ *  - This function reads and validates slot header and payload CRC
+ *  - Payload is copied to the record only if record is not NULL and slot is valid
+ */
+bool Nvm_Bank::Nvm_BankSlotRead(uint16_t slot, Nvm_Slot_Header_T *header, uint32_t *record, uint16_t size)
+{
+  uint32_t chunk[NVM_BANK_CHUNK_SIZE_BYTE / 4];
+  uint32_t addr = Nvm_BankSlotAddr(slot);
+  uint32_t crc;
+  uint16_t len;
+
+  if(!ops->read(addr, (uint32_t *)header, sizeof(Nvm_Slot_Header_T)))
+  {
+    return false;
+  }
+
+  if((slot_magic != header->magic) || (header->length > size) || (header->length > NVM_SLOT_PAYLOAD_SIZE(slot_size)))
+  {
+    return false;
+  }
+
+  crc = Nvm_Crc32((const uint8_t *)header + NVM_SLOT_HEADER_CRC_OFFSET, NVM_SLOT_HEADER_CRC_SIZE);
+  addr += sizeof(Nvm_Slot_Header_T);
+
+  for(uint16_t offset = 0; offset < header->length; offset += NVM_BANK_CHUNK_SIZE_BYTE)
+  {
+    len = header->length - offset;
+
+    if(len > NVM_BANK_CHUNK_SIZE_BYTE)
+    {
+      len = NVM_BANK_CHUNK_SIZE_BYTE;
+    }
+
+    if(!ops->read(addr + offset, chunk, NVM_BANK_WORD_ALIGN(len)))
+    {
+      return false;
+    }
+    crc = Nvm_Crc32((const uint8_t *)chunk, len, crc);
+  }
+
+  if(crc != header->crc)
+  {
+    return false;
+  }
+
+  if(NULL != record)
+  {
+    memset(record, 0, size);
+    return ops->read(addr, record, NVM_BANK_WORD_ALIGN(header->length));
+  }
+  return true;
+}
+
+
+/*
+ * Nvm_BankMount
+ *  - This function finds the newest valid slot and loads its payload into the record
+ *  - Record has to be 4-byte aligned and padded to the word size
+ *  - It returns false if no valid slot exists (blank or corrupted storage)
+ */
+bool Nvm_Bank::Nvm_BankMount(uint32_t *record, uint16_t size)
+{
+  Nvm_Slot_Header_T header;
+
+  active_slot = NVM_SLOT_NONE;
+  sequence = 0;
+
+  for(uint16_t slot = 0; slot < slots_total; slot++)
+  {
+    if(Nvm_BankSlotRead(slot, &header, NULL, size))
+    {
+      if((NVM_SLOT_NONE == active_slot) || NVM_SEQ_IS_NEWER(header.sequence, sequence))
+      {
+        active_slot = slot;
+        sequence = header.sequence;
+      }
+    }
+  }
+
+  if(NVM_SLOT_NONE == active_slot)
+  {
+    return false;
+  }
+  return Nvm_BankSlotRead(active_slot, &header, record, size);
+}
+
+
+/*
+ * Nvm_BankWrite
+ *  - This function writes the record into the next blank slot
+ *  - Sector is erased only when the rotation enters a new bank
+ *  - Payload is written first, header (commit marker) as the last step
+ */
+bool Nvm_Bank::Nvm_BankWrite(const uint32_t *record, uint16_t size)
+{
+  Nvm_Slot_Header_T header;
+  uint16_t slot;
+  bool slot_found = false;
+
+  if(size > NVM_SLOT_PAYLOAD_SIZE(slot_size))
+  {
+    return false;
+  }
+
+  slot = (NVM_SLOT_NONE == active_slot) ? 0 : ((active_slot + 1) % slots_total);
+
+  /* Skip slots damaged by interrupted writes, erase bank when entering it */
+  for(uint16_t attempt = 0; attempt <= slots_total; attempt++)
+  {
+    /* Never erase the bank holding the newest valid record */
+    if((0 == (slot % slots_per_bank)) &&
+       ((NVM_SLOT_NONE == active_slot) || ((slot / slots_per_bank) != (active_slot / slots_per_bank))))
+    {
+      if(!ops->erase_sector(Nvm_BankSlotAddr(slot)))
+      {
+        return false;
+      }
+      erase_cnt++;
+    }
+
+    if(Nvm_BankSlotIsBlank(slot))
+    {
+      slot_found = true;
+      break;
+    }
+    slot = (slot + 1) % slots_total;
+  }
+
+  if(!slot_found)
+  {
+    return false;
+  }
+
+  header.magic = slot_magic;
+  header.sequence = sequence + 1;
+  header.length = size;
+  header.reserved = 0xFFFF;
+  header.crc = Nvm_Crc32((const uint8_t *)&header + NVM_SLOT_HEADER_CRC_OFFSET, NVM_SLOT_HEADER_CRC_SIZE);
+  header.crc = Nvm_Crc32((const uint8_t *)record, size, header.crc);
+
+  if(!ops->write(Nvm_BankSlotAddr(slot) + sizeof(Nvm_Slot_Header_T), record, NVM_BANK_WORD_ALIGN(size)))
+  {
+    return false;
+  }
+
+  if(!ops->write(Nvm_BankSlotAddr(slot), (const uint32_t *)&header, sizeof(Nvm_Slot_Header_T)))
+  {
+    return false;
+  }
+
+  active_slot = slot;
+  sequence = header.sequence;
+  return true;
+}
+
+
+/*
+ * Nvm_BankResume
+ *  - This function continues after a record kept in the given bank by other geometry (migration)
+ *  - Next write goes to the other bank, so the migrated record survives the erase
+ */
+void Nvm_Bank::Nvm_BankResume(uint8_t bank_idx, uint32_t seq)
+{
+  active_slot = (uint16_t)((bank_idx * slots_per_bank) + slots_per_bank - 1);
+  sequence = seq;
+}
+
+
+/*
+ * Nvm_BankGetActiveSlot
+ *  - This function returns slot holding the newest record (NVM_SLOT_NONE if empty)
+ */
+uint16_t Nvm_Bank::Nvm_BankGetActiveSlot()
+{
+  return active_slot;
+}
+
+
+/*
+ * Nvm_BankGetActiveBank
+ *  - This function returns bank holding the newest record (NVM_BANK_COUNT if empty)
+ */
+uint8_t Nvm_Bank::Nvm_BankGetActiveBank()
+{
+  return (NVM_SLOT_NONE == active_slot) ? NVM_BANK_COUNT : (uint8_t)(active_slot / slots_per_bank);
+}
+
+
+/*
+ * Nvm_BankGetSequence
+ *  - This function returns sequence number of the newest record
+ */
+uint32_t Nvm_Bank::Nvm_BankGetSequence()
+{
+  return sequence;
+}
+
+
+/*
+ * Nvm_BankGetEraseCount
+ *  - This function returns number of sector erases performed since boot
+ */
+uint32_t Nvm_Bank::Nvm_BankGetEraseCount()
+{
+  return erase_cnt;
+}
+
+/* EOF */
@@ -0,0 +1,103 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       nvm_bank.h
+ */
+#ifndef _NVM_BANK_H_
+#define _NVM_BANK_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Flash geometry - every bank occupies exactly one erasable sector */
+#define NVM_BANK_SECTOR_SIZE_BYTE   (4096)
+#define NVM_BANK_COUNT              (2)
+
+/* Every record is written to the next blank slot (no erase needed) */
+#define NVM_SLOT_SIZE_BYTE          (2048)
+#define NVM_SLOTS_PER_BANK          (NVM_BANK_SECTOR_SIZE_BYTE / NVM_SLOT_SIZE_BYTE)
+#define NVM_SLOTS_TOTAL             (NVM_SLOTS_PER_BANK * NVM_BANK_COUNT)
+
+#define NVM_SLOT_MAGIC              ((uint32_t)0x534C5433)  /* "SLT3" */
+#define NVM_SLOT_NONE               ((uint16_t)0xFFFF)
+
+/* Geometries used before the config record outgrew 1024 and 512 byte slots - mounted only to migrate */
+#define NVM_SLOT_LEGACY_SIZE_BYTE   (1024)
+#define NVM_SLOT_LEGACY_MAGIC       ((uint32_t)0x534C5432)  /* "SLT2" */
+
+#define NVM_SLOT_LEGACY_V1_SIZE_BYTE  (512)
+#define NVM_SLOT_LEGACY_V1_MAGIC      ((uint32_t)0x534C4F54)  /* "SLOT" */
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Header placed at the beginning of every slot - written as the last step (commit marker) */
+typedef struct Nvm_Slot_Header_Tag
+{
+  uint32_t magic;
+  uint32_t sequence;
+  uint16_t length;
+  uint16_t reserved;
+  uint32_t crc;
+
+}Nvm_Slot_Header_T;
+
+#define NVM_SLOT_PAYLOAD_MAX_BYTE   (NVM_SLOT_SIZE_BYTE - sizeof(Nvm_Slot_Header_T))
+#define NVM_SLOT_PAYLOAD_SIZE(s)    ((s) - sizeof(Nvm_Slot_Header_T))
+
+/* Flash access primitives - addresses are absolute, data and size 4-byte aligned */
+typedef struct Nvm_Flash_Ops_Tag
+{
+  bool (*erase_sector)(uint32_t addr);
+  bool (*write)(uint32_t addr, const uint32_t *data, uint32_t size);
+  bool (*read)(uint32_t addr, uint32_t *data, uint32_t size);
+
+}Nvm_Flash_Ops_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+uint32_t Nvm_Crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Nvm_Bank
+{
+  public:
+    void Nvm_BankInit(const Nvm_Flash_Ops_T *flash_ops, uint32_t start_addr,
+                      uint16_t size = NVM_SLOT_SIZE_BYTE, uint32_t magic = NVM_SLOT_MAGIC);
+    bool Nvm_BankMount(uint32_t *record, uint16_t size);
+    bool Nvm_BankWrite(const uint32_t *record, uint16_t size);
+    void Nvm_BankResume(uint8_t bank_idx, uint32_t seq);
+
+    uint16_t Nvm_BankGetActiveSlot();
+    uint8_t Nvm_BankGetActiveBank();
+    uint32_t Nvm_BankGetSequence();
+    uint32_t Nvm_BankGetEraseCount();
+
+  private:
+    const Nvm_Flash_Ops_T *ops;
+    uint32_t base_addr;
+    uint16_t slot_size;
+    uint16_t slots_per_bank;
+    uint16_t slots_total;
+    uint32_t slot_magic;
+    uint16_t active_slot;
+    uint32_t sequence;
+    uint32_t erase_cnt;
+
+    uint32_t Nvm_BankSlotAddr(uint16_t slot);
+    bool Nvm_BankSlotIsBlank(uint16_t slot);
+    bool Nvm_BankSlotRead(uint16_t slot, Nvm_Slot_Header_T *header, uint32_t *record, uint16_t size);
+};
+
+#endif /* _NVM_BANK_H_ */
+
+/* EOF */
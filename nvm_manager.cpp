@@ -8,15 +8,19 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "nvm_manager.h"
+#include "log_manager.h"
 
 /* ==================================================================== */
 /* ============================= defines ============================== */
 /* ==================================================================== */
 #define EEPROM_FILL_VAL           ((uint8_t)0xFF)
 #define EEPROM_SEP_VAL            ((uint8_t)0xFE)
-#define EEPROM_QUANTITY_OF_SEP    ((uint8_t)0x02)
 #define EEPROM_LAST_ASCII_OK_VAL  ((uint8_t)0x7E)
 
+/* Legacy (separator based) credentials layout - used only for migration */
+#define EEPROM_LEGACY_AP_CREDENTIALS_START_ADDR    (0x00)
+#define EEPROM_LEGACY_USER_CREDENTIALS_START_ADDR  (0x80)
+
 #define EEPROM_ENCRYPT_BYTE(x)    ((x * 2) - 13)
 #define EEPROM_DECRYPT_BYTE(x)    ((char)((x + 13) / 2))
 
@@ -24,12 +28,121 @@
 #define EEPROM_RAW_READ(x)        ((char)(x))
 #define EEPROM_RAW_WRITE(x)       (x)
 
+/* Configuration payload - everything behind the header */
+#define NVM_CONFIG_PAYLOAD_PTR(cfg)   ((const uint8_t *)(cfg) + sizeof(Nvm_Config_Header_T))
+#define NVM_CONFIG_PAYLOAD_SIZE       (sizeof(Nvm_Config_T) - sizeof(Nvm_Config_Header_T))
+
+/* Whole record kept in the EEPROM emulation sector when the build has no FS partition for the banks */
+#define NVM_EEPROM_RECORD_SIZE_BYTE   (sizeof(Nvm_Config_T))
+
+static_assert(sizeof(Nvm_Config_T) <= NVM_SLOT_PAYLOAD_MAX_BYTE, "NVM config record does not fit in the bank slot");
+static_assert(NVM_EEPROM_RECORD_SIZE_BYTE <= SPI_FLASH_SEC_SIZE, "NVM config record does not fit in the EEPROM sector");
+
 /* ==================================================================== */
 /* ======================== global variables ========================== */
 /* ==================================================================== */
 /* EEPROM handler */
 Nvm_Manager eeprom;
 
+/* Flash primitives used by the configuration banks */
+static bool Nvm_FlashErase(uint32_t addr);
+static bool Nvm_FlashWrite(uint32_t addr, const uint32_t *data, uint32_t size);
+static bool Nvm_FlashRead(uint32_t addr, uint32_t *data, uint32_t size);
+
+static const Nvm_Flash_Ops_T nvm_flash_ops = {Nvm_FlashErase, Nvm_FlashWrite, Nvm_FlashRead};
+
+/* Slot geometries written by older firmware - the newest first */
+typedef struct Nvm_Legacy_Geometry_Tag
+{
+  uint16_t size;
+  uint32_t magic;
+  
+}Nvm_Legacy_Geometry_T;
+
+static const Nvm_Legacy_Geometry_T nvm_legacy_geometry[] =
+{
+  {NVM_SLOT_LEGACY_SIZE_BYTE,     NVM_SLOT_LEGACY_MAGIC    },
+  {NVM_SLOT_LEGACY_V1_SIZE_BYTE,  NVM_SLOT_LEGACY_V1_MAGIC }
+};
+
+/* ==================================================================== */
+/* ================== local function definitions  ===================== */
+/* ==================================================================== */
+
+/*
+ * Nvm_FlashErase
+ *  - This function erases flash sector placed at the given address
+ */
+static bool Nvm_FlashErase(uint32_t addr)
+{
+  return ESP.flashEraseSector(addr / SPI_FLASH_SEC_SIZE);
+}
+
+
+/*
+ * Nvm_FlashWrite
+ *  - This function writes word aligned data to the (erased) flash
+ */
+static bool Nvm_FlashWrite(uint32_t addr, const uint32_t *data, uint32_t size)
+{
+  return ESP.flashWrite(addr, (uint32_t *)data, size);
+}
+
+
+/*
+ * Nvm_FlashRead
+ *  - This function reads word aligned data from the flash
+ */
+static bool Nvm_FlashRead(uint32_t addr, uint32_t *data, uint32_t size)
+{
+  return ESP.flashRead(addr, data, size);
+}
+
+
+/*
+ * Nvm_EncryptField
+ *  - This function validates and encrypts src string into the dst field
+ *  - It returns false when the string is too long or contains characters out of range
+ */
+static bool Nvm_EncryptField(char *dst, const char *src, uint16_t len, uint16_t max_len)
+{
+  bool success_status = true;
+  
+  if(len > max_len)
+  {
+    success_status = false;
+  }
+  else
+  {
+    for(uint16_t idx = 0; idx < len; idx++)
+    {
+      if(((uint8_t)src[idx] > EEPROM_LAST_ASCII_OK_VAL) || ('\0' == src[idx]))
+      {
+        success_status = false;
+        break;
+      }
+      dst[idx] = EEPROM_ENCRYPT_BYTE(src[idx]);
+    }
+    dst[len] = '\0';
+  }
+  return success_status;
+}
+
+
+/*
+ * Nvm_DecryptField
+ *  - This function decrypts '\0' terminated field into the String buffer
+ */
+static void Nvm_DecryptField(const char *src, String &buf, uint16_t max_len)
+{
+  buf = "";
+  
+  for(uint16_t idx = 0; (idx < max_len) && ('\0' != src[idx]); idx++)
+  {
+    buf += EEPROM_DECRYPT_BYTE((uint8_t)src[idx]);
+  }
+}
+
 /* ==================================================================== */
 /* ============================ functions ============================= */
 /* ==================================================================== */
@@ -38,6 +151,8 @@ Nvm_Manager eeprom;
  * Nvm_ReadValue_Till_Sepatator
  *  - This function reads EEPROM data from start_idx to the separator EEPROM_SEP_VAL
  *    and store it in the eep_data_buf
+ *  - Used only to migrate the legacy layout into the configuration record
+ *  - EEPROM has to be started by the caller
  *     
  *  - note:
  *    separator should be placed between each data field (ex. somedataSEPnextdataSEPotherdataSEPfill)
@@ -73,135 +188,565 @@ void Nvm_Manager::Nvm_ReadValue_Till_Sepatator(uint16_t start_idx, String &eep_d
 
 /*
  * Nvm_Init
- *  - This function should be called before EEPROM usage
+ *  - This function should be called before NvM usage
+ *  - It loads the newest valid configuration record once, the RAM copy is used afterwards
+ *  - Records stored by older firmware in the EEPROM area are migrated on the first boot
+ *  - Without the FS partition the record is kept in the EEPROM area (not power loss safe)
  */
 void Nvm_Manager::Nvm_Init()
 {
-  EEPROM.begin(EEPROM_ALLOCATED_SIZE_BYTE);
-  delay(100);
+  bank_available = NVM_FLASH_BANK_AVAILABLE();
+  bank.Nvm_BankInit(&nvm_flash_ops, NVM_FLASH_BANK_START_ADDR);
+
+  if(!bank_available)
+  {
+    LOG_WARN(Log_Module_Nvm, "No FS partition for config banks: EEPROM area used, commit is not power loss safe");
+  }
+
+  if(bank_available && bank.Nvm_BankMount(config_words, sizeof(Nvm_Config_T)) && Nvm_ConfigValidate())
+  {
+    LOG_INFO(Log_Module_Nvm, "Config v%u loaded (slot: %u, seq: %u)", config.header.version, bank.Nvm_BankGetActiveSlot(), bank.Nvm_BankGetSequence());
+  }
+  else if(bank_available && Nvm_BankLegacyMigrate())
+  {
+    (void)Nvm_ConfigCommit();
+  }
+  else
+  {
+    if(Nvm_EepromMigrate())
+    {
+      LOG_INFO(Log_Module_Nvm, bank_available ? "Config migrated to banks" : "Config loaded from EEPROM area");
+      (void)Nvm_ConfigCommit();
+    }
+    else
+    {
+      Nvm_ConfigDefaults();
+      LOG_ERROR(Log_Module_Nvm, "Config CORRUPTED: defaults loaded");
+    }
+  }
+}
+
+
+/*
+ * Nvm_ConfigValidate
+ *  - This function validates the RAM copy of the configuration record
+ *  - It returns true only if magic, version, length and CRC are valid
+ *  - Records written by older versions are upgraded (appended fields are zero filled)
+ */
+bool Nvm_Manager::Nvm_ConfigValidate()
+{
+  bool success_status = false;
+  uint16_t length = config.header.length;
+
+  if((NVM_CONFIG_MAGIC == config.header.magic) &&
+     (config.header.version <= NVM_CONFIG_VERSION) &&
+     (length <= NVM_CONFIG_PAYLOAD_SIZE))
+  {
+    success_status = (Nvm_Crc32(NVM_CONFIG_PAYLOAD_PTR(&config), length) == config.header.crc);
+  }
+
+  if(success_status && (NVM_CONFIG_VERSION != config.header.version))
+  {
+    LOG_INFO(Log_Module_Nvm, "Config upgraded v%u -> v%u", config.header.version, NVM_CONFIG_VERSION);
+    
+    memset((uint8_t *)NVM_CONFIG_PAYLOAD_PTR(&config) + length, 0, NVM_CONFIG_PAYLOAD_SIZE - length);
+    config.header.version = NVM_CONFIG_VERSION;
+    config.header.length = NVM_CONFIG_PAYLOAD_SIZE;
+    config.header.crc = Nvm_Crc32(NVM_CONFIG_PAYLOAD_PTR(&config), NVM_CONFIG_PAYLOAD_SIZE);
+  }
+  return success_status;
+}
+
+
+/*
+ * Nvm_BankLegacyMigrate
+ *  - This function loads configuration kept by older firmware in the banks with legacy slot geometry
+ *  - Bank handler is reinitialized with the current geometry afterwards, the first commit goes
+ *    to the bank not holding the legacy record (it stays untouched until the commit is done)
+ */
+bool Nvm_Manager::Nvm_BankLegacyMigrate()
+{
+  bool migrated = false;
+  uint8_t legacy_bank = NVM_BANK_COUNT;
+  uint32_t legacy_seq = 0;
+
+  for(uint8_t idx = 0; (idx < (sizeof(nvm_legacy_geometry) / sizeof(nvm_legacy_geometry[0]))) && !migrated; idx++)
+  {
+    bank.Nvm_BankInit(&nvm_flash_ops, NVM_FLASH_BANK_START_ADDR, nvm_legacy_geometry[idx].size, nvm_legacy_geometry[idx].magic);
+    migrated = bank.Nvm_BankMount(config_words, sizeof(Nvm_Config_T)) && Nvm_ConfigValidate();
+
+    if(migrated)
+    {
+      legacy_bank = bank.Nvm_BankGetActiveBank();
+      legacy_seq = bank.Nvm_BankGetSequence();
+      LOG_INFO(Log_Module_Nvm, "Config migrated from %u byte slots", nvm_legacy_geometry[idx].size);
+    }
+  }
+
+  bank.Nvm_BankInit(&nvm_flash_ops, NVM_FLASH_BANK_START_ADDR);
+
+  if(migrated)
+  {
+    bank.Nvm_BankResume(legacy_bank, legacy_seq);
+  }
+  return migrated;
+}
+
+
+/*
+ * Nvm_EepromMigrate
+ *  - This function loads configuration kept by older firmware in the EEPROM emulation area
+ *    (CRC protected record first, separator based layout as the last resort)
+ *  - Without the banks the whole record is read back from the area (see Nvm_EepromCommit)
+ *  - EEPROM RAM mirror is released afterwards
+ */
+bool Nvm_Manager::Nvm_EepromMigrate()
+{
+  bool migrated;
+  uint16_t area_size = bank_available ? EEPROM_ALLOCATED_SIZE_BYTE : NVM_EEPROM_RECORD_SIZE_BYTE;
+
+  EEPROM.begin(area_size);
+
+  /* Record grew over the legacy EEPROM area - copy only what the older firmware could store there */
+  memset(&config, 0, sizeof(config));
+  for(uint16_t idx = 0; (idx < sizeof(config)) && ((NVM_CONFIG_START_ADDR + idx) < area_size); idx++)
+  {
+    ((uint8_t *)&config)[idx] = EEPROM.read(NVM_CONFIG_START_ADDR + idx);
+  }
+
+  migrated = Nvm_ConfigValidate();
+
+  if(!migrated)
+  {
+    Nvm_ConfigDefaults();
+    migrated = Nvm_LegacyMigrate();
+  }
+
+  EEPROM.end();
+  return migrated;
+}
+
+
+/*
+ * Nvm_ConfigDefaults
+ *  - This function restores default (empty) configuration in RAM
+ */
+void Nvm_Manager::Nvm_ConfigDefaults()
+{
+  memset(&config, 0, sizeof(config));
+  
+  config.header.magic = NVM_CONFIG_MAGIC;
+  config.header.version = NVM_CONFIG_VERSION;
+  config.header.length = NVM_CONFIG_PAYLOAD_SIZE;
+}
+
+
+/*
+ * Nvm_ConfigCommit
+ *  - This function updates the CRC and writes the whole record into the next bank slot
+ *  - Previous record stays untouched, so power loss never corrupts the configuration
+ *  - Builds without the FS partition write the record into the EEPROM area instead
+ */
+bool Nvm_Manager::Nvm_ConfigCommit()
+{
+  config.header.crc = Nvm_Crc32(NVM_CONFIG_PAYLOAD_PTR(&config), NVM_CONFIG_PAYLOAD_SIZE);
+  
+  if(!bank_available)
+  {
+    return Nvm_EepromCommit();
+  }
+  return bank.Nvm_BankWrite(config_words, sizeof(Nvm_Config_T));
+}
+
+
+/*
+ * Nvm_EepromCommit
+ *  - This function writes the whole record into the EEPROM emulation area
+ *  - The sector is erased and rewritten in place - power loss during the commit loses the record
+ */
+bool Nvm_Manager::Nvm_EepromCommit()
+{
+  bool success_status;
+  const uint8_t *raw = (const uint8_t *)&config;
+  
+  EEPROM.begin(NVM_EEPROM_RECORD_SIZE_BYTE);
+  
+  for(uint16_t idx = 0; idx < NVM_EEPROM_RECORD_SIZE_BYTE; idx++)
+  {
+    EEPROM.write(NVM_CONFIG_START_ADDR + idx, raw[idx]);
+  }
+  
+  success_status = EEPROM.commit();
+  EEPROM.end();
+  
+  return success_status;
+}
+
+
+/*
+ * Nvm_LegacyMigrate
+ *  - This function converts credentials stored in the legacy separator based layout
+ *  - It returns true if at least one pair of credentials was migrated
+ */
+bool Nvm_Manager::Nvm_LegacyMigrate()
+{
+  const uint16_t legacy_addr[Nvm_Credentials_Last] = {EEPROM_LEGACY_AP_CREDENTIALS_START_ADDR, EEPROM_LEGACY_USER_CREDENTIALS_START_ADDR};
+  bool migrated = false;
+  
+  for(uint8_t cred_id = 0; cred_id < Nvm_Credentials_Last; cred_id++)
+  {
+    String login = "";
+    String pass = "";
+    
+    if(EEPROM_FILL_VAL == EEPROM.read(legacy_addr[cred_id]))
+    {
+      /* Nothing stored in this area */
+      continue;
+    }
+
+    Nvm_ReadValue_Till_Sepatator(legacy_addr[cred_id], login);
+    Nvm_ReadValue_Till_Sepatator(legacy_addr[cred_id] + login.length() + 1, pass);
+
+    if(Nvm_EncryptField(config.credentials[cred_id].login, login.c_str(), login.length(), EEPROM_LOGIN_MAX_SIZE) &&
+       Nvm_EncryptField(config.credentials[cred_id].pass, pass.c_str(), pass.length(), EEPROM_CREDENTIAL_MAX_SIZE))
+    {
+      migrated = true;
+    }
+    else
+    {
+      memset(&config.credentials[cred_id], 0, sizeof(Nvm_Credentials_T));
+    }
+  }
+  return migrated;
 }
 
 
 /*
  * Nvm_CredentialsWrite
  *  - This function writes EEPROM data with credential values (ssid and pass)
+ *  - Only RAM copy is modified until the whole record is committed at once
  *  - It returns operation status
  *    success - true
  *    no_success - false
  */
-bool Nvm_Manager::Nvm_CredentialsWrite(uint16_t start_addr, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len)
+bool Nvm_Manager::Nvm_CredentialsWrite(Nvm_Credentials_ID_T cred_id, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len)
 {      
-  char credentials[ssid_len + pass_len + EEPROM_QUANTITY_OF_SEP];
-  uint16_t cnt = 0;
+  if(cred_id >= Nvm_Credentials_Last)
+  {
+    LOG_ERROR(Log_Module_Nvm, "Write ERROR");
+    return false;
+  }
+  return Nvm_CredentialsStore(&config.credentials[cred_id], ssid, pass, ssid_len, pass_len);
+}
+
 
-  /* Flag that checks if unicode characters are in appropriate range (int: 126 max) */
-  bool unicode_range_ok = true;
+/*
+ * Nvm_CredentialsStore
+ *  - This function validates and encrypts credentials into the given entry of the RAM copy
+ *    and commits the configuration
+ */
+bool Nvm_Manager::Nvm_CredentialsStore(Nvm_Credentials_T *dst, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len)
+{
+  Nvm_Credentials_T credentials;
   bool success_status = true;
   
-  if(ssid_len + pass_len - EEPROM_QUANTITY_OF_SEP <= EEPROM_CREDENTIAL_MAX_SIZE)
+  if((ssid_len > EEPROM_LOGIN_MAX_SIZE) || (pass_len > EEPROM_CREDENTIAL_MAX_SIZE))
   {
-    while(*ssid != '\0')
-    {
-      if(*ssid > EEPROM_LAST_ASCII_OK_VAL)
-      {
-        unicode_range_ok = false;
-        break;
-      }
-      else
-      {
-        credentials[cnt++] = EEPROM_ENCRYPT_BYTE(*ssid);
-        ssid++;
-      }
-    }
+    success_status = false;
+    LOG_ERROR(Log_Module_Nvm, "Write ERROR");
+  }
+  else if(!Nvm_EncryptField(credentials.login, ssid, ssid_len, EEPROM_LOGIN_MAX_SIZE))
+  {
+    success_status = false;
+    LOG_ERROR(Log_Module_Nvm, "WRITE ERROR: SSID Unicode OOR");
+  }
+  else if(!Nvm_EncryptField(credentials.pass, pass, pass_len, EEPROM_CREDENTIAL_MAX_SIZE))
+  {
+    success_status = false;
+    LOG_ERROR(Log_Module_Nvm, "WRITE ERROR: PASS Unicode OOR");
+  }
+  else
+  {
+    *dst = credentials;
 
-    /* If SSID characters are appropriate unicode values */
-    if(unicode_range_ok)
+    if(Nvm_ConfigCommit())
     {
-      /* Separate SSID and the PASS */
-      credentials[cnt++] = EEPROM_SEP_VAL;
-      
-      while(*pass != '\0')
-      {
-        if(*pass > EEPROM_LAST_ASCII_OK_VAL)
-        {
-          unicode_range_ok = false;
-          break;
-        }
-        else
-        {
-          credentials[cnt++] = EEPROM_ENCRYPT_BYTE(*pass);
-          pass++;
-        }
-      }
-
-      /* If PASS characters are appropriate unicode values */
-      if(unicode_range_ok)
-      {
-  
-        /* Separate PASS and the rest of EEP data */
-        credentials[cnt++] = EEPROM_SEP_VAL;
-        
-        /* Terminate the credential's string */
-        credentials[cnt] = '\0';
-        
-        /* Write credentials to the EEPROM */
-        for(uint16_t idx = start_addr, cnt = 0; idx < start_addr + ssid_len + pass_len + EEPROM_QUANTITY_OF_SEP; idx++, cnt++)
-        {
-          EEPROM.write(idx, credentials[cnt]);
-        }
-
-        EEPROM.end();
-        Serial.printf("EEPROM -> Write OK\r\n");
-      }
-      else
-      {
-        success_status = false;
-        Serial.printf("EEPROM -> WRITE ERROR: PASS Unicode OOR\r\n");
-      }
+      LOG_INFO(Log_Module_Nvm, "Write OK");
     }
     else
     {
       success_status = false;
-      Serial.printf("EEPROM -> WRITE ERROR: SSID Unicode OOR\r\n");
+      LOG_ERROR(Log_Module_Nvm, "Commit ERROR");
     }
   }
-  else
-  {
-    success_status = false;
-    Serial.printf("EEPROM -> Write ERROR\r\n");
-  }
   return success_status;
 }
 
 
 /*
  * Nvm_CredentialsRead
- *  - This function reads credentials from the EEPROM(ssid and password) and stores it in the separate buffers
+ *  - This function reads credentials from the RAM copy (ssid and password) and stores it in the separate buffers
  */
-void Nvm_Manager::Nvm_CredentialsRead(uint16_t start_addr, String &ssid_buf, String &pass_buf)
+void Nvm_Manager::Nvm_CredentialsRead(Nvm_Credentials_ID_T cred_id, String &ssid_buf, String &pass_buf)
 { 
-  /* Get SSID or USER login string */
-  Nvm_ReadValue_Till_Sepatator(start_addr, ssid_buf);
+  if(cred_id < Nvm_Credentials_Last)
+  {
+    Nvm_DecryptField(config.credentials[cred_id].login, ssid_buf, EEPROM_LOGIN_MAX_SIZE);
+    Nvm_DecryptField(config.credentials[cred_id].pass, pass_buf, EEPROM_CREDENTIAL_MAX_SIZE);
+  }
+}
+
+
+/*
+ * Nvm_ApEntry
+ *  - This function returns entry of the access point list (entry 0 is the primary AP)
+ */
+Nvm_Credentials_T *Nvm_Manager::Nvm_ApEntry(uint8_t ap_idx)
+{
+  return (0 == ap_idx) ? &config.credentials[Nvm_Credentials_AP] : &config.ap_list[ap_idx - 1];
+}
+
+
+/*
+ * Nvm_ApListWrite
+ *  - This function writes credentials of the access point list entry (empty SSID removes the entry)
+ */
+bool Nvm_Manager::Nvm_ApListWrite(uint8_t ap_idx, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len)
+{
+  if(ap_idx >= NVM_AP_LIST_MAX)
+  {
+    LOG_ERROR(Log_Module_Nvm, "Write ERROR");
+    return false;
+  }
+  return Nvm_CredentialsStore(Nvm_ApEntry(ap_idx), ssid, pass, ssid_len, pass_len);
+}
+
+
+/*
+ * Nvm_ApListRead
+ *  - This function reads credentials of the access point list entry
+ */
+void Nvm_Manager::Nvm_ApListRead(uint8_t ap_idx, String &ssid_buf, String &pass_buf)
+{
+  if(ap_idx < NVM_AP_LIST_MAX)
+  {
+    Nvm_DecryptField(Nvm_ApEntry(ap_idx)->login, ssid_buf, EEPROM_LOGIN_MAX_SIZE);
+    Nvm_DecryptField(Nvm_ApEntry(ap_idx)->pass, pass_buf, EEPROM_CREDENTIAL_MAX_SIZE);
+  }
+}
+
+
+/*
+ * Nvm_ParamsWrite
+ *  - This function replaces all runtime parameter records and commits the configuration
+ *  - Records are split between version 2, 3 and 6 areas of the record
+ */
+bool Nvm_Manager::Nvm_ParamsWrite(const Nvm_Param_Record_T *records)
+{
+  memcpy(config.params, records, sizeof(config.params));
+  memcpy(config.params_ext, &records[NVM_PARAM_RECORDS_V2], sizeof(config.params_ext));
+  memcpy(config.params_ext2, &records[NVM_PARAM_RECORDS_V3], sizeof(config.params_ext2));
+  
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_ParamsRead
+ *  - This function copies all runtime parameter records from the RAM copy
+ */
+void Nvm_Manager::Nvm_ParamsRead(Nvm_Param_Record_T *records)
+{
+  memcpy(records, config.params, sizeof(config.params));
+  memcpy(&records[NVM_PARAM_RECORDS_V2], config.params_ext, sizeof(config.params_ext));
+  memcpy(&records[NVM_PARAM_RECORDS_V3], config.params_ext2, sizeof(config.params_ext2));
+}
+
+
+/*
+ * Nvm_NtpServerWrite
+ *  - This function stores the SNTP server name (not encrypted) and commits the configuration
+ */
+bool Nvm_Manager::Nvm_NtpServerWrite(const char *server, const uint16_t server_len)
+{
+  if(server_len > NVM_NTP_SERVER_MAX_SIZE)
+  {
+    return false;
+  }
+
+  memset(config.ntp_server, 0, sizeof(config.ntp_server));
+  memcpy(config.ntp_server, server, server_len);
+
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_NtpServerRead
+ *  - This function copies the SNTP server name, server_buf has NVM_NTP_SERVER_MAX_SIZE + 1 bytes
+ */
+void Nvm_Manager::Nvm_NtpServerRead(char *server_buf)
+{
+  memcpy(server_buf, config.ntp_server, NVM_NTP_SERVER_MAX_SIZE);
+  server_buf[NVM_NTP_SERVER_MAX_SIZE] = '\0';
+}
+
+
+/*
+ * Nvm_SyslogServerWrite
+ *  - This function stores the syslog server name (not encrypted) and commits the configuration
+ */
+bool Nvm_Manager::Nvm_SyslogServerWrite(const char *server, const uint16_t server_len)
+{
+  if(server_len > NVM_SYSLOG_SERVER_MAX_SIZE)
+  {
+    return false;
+  }
 
-  /* Get PASS string - start_idx is offset of the ssid len and EEPROM_SEP_VAL(+1) */
-  Nvm_ReadValue_Till_Sepatator(start_addr + ssid_buf.length() + 1, pass_buf); 
+  memset(config.syslog_server, 0, sizeof(config.syslog_server));
+  memcpy(config.syslog_server, server, server_len);
+
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_SyslogServerRead
+ *  - This function copies the syslog server name, server_buf has NVM_SYSLOG_SERVER_MAX_SIZE + 1 bytes
+ */
+void Nvm_Manager::Nvm_SyslogServerRead(char *server_buf)
+{
+  memcpy(server_buf, config.syslog_server, NVM_SYSLOG_SERVER_MAX_SIZE);
+  server_buf[NVM_SYSLOG_SERVER_MAX_SIZE] = '\0';
+}
+
+
+/*
+ * Nvm_MqttBrokerWrite
+ *  - This function stores the MQTT broker name (not encrypted) and commits the configuration
+ */
+bool Nvm_Manager::Nvm_MqttBrokerWrite(const char *broker, const uint16_t broker_len)
+{
+  if(broker_len > NVM_MQTT_BROKER_MAX_SIZE)
+  {
+    return false;
+  }
+
+  memset(config.mqtt_broker, 0, sizeof(config.mqtt_broker));
+  memcpy(config.mqtt_broker, broker, broker_len);
+
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_MqttBrokerRead
+ *  - This function copies the MQTT broker name, broker_buf has NVM_MQTT_BROKER_MAX_SIZE + 1 bytes
+ */
+void Nvm_Manager::Nvm_MqttBrokerRead(char *broker_buf)
+{
+  memcpy(broker_buf, config.mqtt_broker, NVM_MQTT_BROKER_MAX_SIZE);
+  broker_buf[NVM_MQTT_BROKER_MAX_SIZE] = '\0';
+}
+
+
+/*
+ * Nvm_InfluxUrlWrite
+ *  - This function stores the time-series database write URL (not encrypted) and commits the configuration
+ */
+bool Nvm_Manager::Nvm_InfluxUrlWrite(const char *url, const uint16_t url_len)
+{
+  if(url_len > NVM_INFLUX_URL_MAX_SIZE)
+  {
+    return false;
+  }
+
+  memset(config.influx_url, 0, sizeof(config.influx_url));
+  memcpy(config.influx_url, url, url_len);
+
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_InfluxUrlRead
+ *  - This function copies the write URL, url_buf has NVM_INFLUX_URL_MAX_SIZE + 1 bytes
+ */
+void Nvm_Manager::Nvm_InfluxUrlRead(char *url_buf)
+{
+  memcpy(url_buf, config.influx_url, NVM_INFLUX_URL_MAX_SIZE);
+  url_buf[NVM_INFLUX_URL_MAX_SIZE] = '\0';
+}
+
+
+/*
+ * Nvm_SchedulesWrite
+ *  - This function replaces all daily GPIO schedules and commits the configuration
+ */
+bool Nvm_Manager::Nvm_SchedulesWrite(const Nvm_Schedule_T *schedules)
+{
+  memcpy(config.schedules, schedules, sizeof(config.schedules));
+
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_SchedulesRead
+ *  - This function copies all daily GPIO schedules from the RAM copy
+ */
+void Nvm_Manager::Nvm_SchedulesRead(Nvm_Schedule_T *schedules)
+{
+  memcpy(schedules, config.schedules, sizeof(config.schedules));
+}
+
+
+/*
+ * Nvm_RulesWrite
+ *  - This function replaces all compiled sensor rules and commits the configuration
+ */
+bool Nvm_Manager::Nvm_RulesWrite(const Nvm_Rule_T *rules)
+{
+  memcpy(config.rules, rules, sizeof(config.rules));
+
+  return Nvm_ConfigCommit();
+}
+
+
+/*
+ * Nvm_RulesRead
+ *  - This function copies all compiled sensor rules from the RAM copy
+ */
+void Nvm_Manager::Nvm_RulesRead(Nvm_Rule_T *rules)
+{
+  memcpy(rules, config.rules, sizeof(config.rules));
 }
 
 
 /*
  * NvM_ReadRawData
- *  - This function reads raw EEPROM data
+ *  - This function prints bank status and raw data of the configuration record
  */
-void Nvm_Manager::NvM_ReadRawData()
+void Nvm_Manager::NvM_ReadRawData(Print &out)
 {
-  Serial.printf("EEPROM -> Read raw data START\r\n");
+  const uint8_t *raw = (const uint8_t *)&config;
+  
+  out.printf("EEPROM -> Read raw data START\r\n");
+  if(bank_available)
+  {
+    out.printf("EEPROM -> Slot: %u/%u, seq: %u, erases since boot: %u\r\n", bank.Nvm_BankGetActiveSlot(), NVM_SLOTS_TOTAL, bank.Nvm_BankGetSequence(), bank.Nvm_BankGetEraseCount());
+  }
+  else
+  {
+    out.printf("EEPROM -> No config banks, record in EEPROM area (%u B)\r\n", (uint16_t)NVM_EEPROM_RECORD_SIZE_BYTE);
+  }
   
-  for(uint16_t cnt = 0; cnt < EEPROM_ALLOCATED_SIZE_BYTE; cnt++)
+  for(uint16_t cnt = 0; cnt < sizeof(Nvm_Config_T); cnt++)
   {
-    Serial.printf("%c\r\n",(char)EEPROM.read(cnt));
+    out.printf("%02X%s", raw[cnt], (15 == (cnt % 16)) ? "\r\n" : " ");
   }
 
-  Serial.printf("EEPROM -> Read raw data END\r\n");
+  out.printf("\r\nEEPROM -> Read raw data END\r\n");
 }
 
 /* EOF */
@@ -11,24 +11,165 @@
 /* ==================================================================== */
 #include <EEPROM.h>
 #include <Arduino.h>
+#include <flash_hal.h>
+#include "nvm_bank.h"
 
 /* ==================================================================== */
 /* ============================= defines ============================== */
 /* ==================================================================== */
+/* Legacy EEPROM emulation area - read only once to migrate older records (builds with FS partition) */
 #define EEPROM_ALLOCATED_SIZE_BYTE          (256)
 
-/* Max size for storing single pair of credentials (2 Pairs of credentials are stored AP and USER) */
-#define EEPROM_CREDENTIAL_MAX_SIZE          (EEPROM_ALLOCATED_SIZE_BYTE / 2)
+/*
+ * Configuration banks occupy the last NVM_BANK_COUNT sectors of the FS partition
+ *  - board has to be configured with a filesystem (ex. "4MB (FS:1MB OTA:~1019KB)")
+ *  - the filesystem itself must not be mounted by the sketch
+ *  - builds without it (FS:none) keep the record in the EEPROM emulation sector instead
+ */
+#define NVM_FLASH_BANK_START_ADDR           (FS_PHYS_ADDR + FS_PHYS_SIZE - (NVM_BANK_COUNT * NVM_BANK_SECTOR_SIZE_BYTE))
+#define NVM_FLASH_BANK_AVAILABLE()          (FS_PHYS_SIZE >= (NVM_BANK_COUNT * NVM_BANK_SECTOR_SIZE_BYTE))
+
+/* Max length of credential fields without '\0' (SSID is limited to 32 chars by 802.11) */
+#define EEPROM_LOGIN_MAX_SIZE               (32)
+#define EEPROM_CREDENTIAL_MAX_SIZE          (64)
+
+/* Configuration record location and identification */
+#define NVM_CONFIG_START_ADDR               (0x00)
+#define NVM_CONFIG_MAGIC                    ((uint32_t)0x69424358)  /* "iBCX" */
+#define NVM_CONFIG_VERSION                  ((uint16_t)8)
+
+/* Runtime parameters - fixed-size records identified by the parameter name hash */
+#define NVM_PARAM_RECORDS_V2                (16)
+#define NVM_PARAM_RECORDS_V3                (32)
+#define NVM_PARAM_RECORDS_MAX               (48)
+#define NVM_PARAM_KEY_EMPTY                 ((uint16_t)0x0000)
+
+/* Access point list - entry 0 is the primary AP (Nvm_Credentials_AP), empty SSID marks unused entry */
+#define NVM_AP_LIST_MAX                     (4)
 
-/* Access Point credentials Start Address */
-#define EEPROM_AP_CREDENTIALS_START_ADDR    (0x00)
+/* SNTP server name without '\0' (empty - default server) */
+#define NVM_NTP_SERVER_MAX_SIZE             (63)
 
-/* User credentials Start Address - for website access */
-#define EEPROM_USER_CREDENTIALS_START_ADDR  (0x80)
+/* Syslog server name without '\0' (empty - syslog disabled) */
+#define NVM_SYSLOG_SERVER_MAX_SIZE          (63)
+
+/* MQTT broker name without '\0' (empty - MQTT disabled) */
+#define NVM_MQTT_BROKER_MAX_SIZE            (63)
+
+/* Time-series database write URL without '\0' (empty - line protocol push disabled) */
+#define NVM_INFLUX_URL_MAX_SIZE             (127)
+
+/* Daily GPIO schedules - entry is unused when used flag is 0 */
+#define NVM_SCHEDULES_MAX                   (16)
+
+/* Sensor rules - entry is unused when op is 0 */
+#define NVM_RULES_MAX                       (8)
 
 #define EEPROM_WRITE_OK                     ((bool)true)
 #define EEPROM_WRITE_ERROR                  ((bool)false)
 
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Credentials stored in the configuration record */
+typedef enum Nvm_Credentials_ID_Tag
+{
+  Nvm_Credentials_AP = 0,
+  Nvm_Credentials_User,
+  Nvm_Credentials_Last
+  
+}Nvm_Credentials_ID_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Single pair of credentials - strings are encrypted and '\0' terminated */
+typedef struct __attribute__((packed)) Nvm_Credentials_Tag
+{
+  char login[EEPROM_LOGIN_MAX_SIZE + 1];
+  char pass[EEPROM_CREDENTIAL_MAX_SIZE + 1];
+  
+}Nvm_Credentials_T;
+
+/* Single runtime parameter record - empty when key is NVM_PARAM_KEY_EMPTY */
+typedef struct __attribute__((packed)) Nvm_Param_Record_Tag
+{
+  uint16_t key;
+  uint8_t type;
+  uint8_t reserved;
+  uint32_t value;
+  
+}Nvm_Param_Record_T;
+
+/* Daily GPIO schedule - level is applied every day at minute (0..1439, local time) */
+typedef struct __attribute__((packed)) Nvm_Schedule_Tag
+{
+  uint8_t used;
+  uint8_t pin_id;
+  uint8_t level;
+  uint8_t reserved;
+  uint16_t minute;
+  
+}Nvm_Schedule_T;
+
+/* Compiled sensor rule - thresholds are scaled channel values (see rule_manager.cpp) */
+typedef struct __attribute__((packed)) Nvm_Rule_Tag
+{
+  uint8_t channel;
+  uint8_t op;
+  uint8_t pin_id;
+  uint8_t level;
+  uint16_t window_s;
+  int16_t on_thr;
+  int16_t off_thr;
+  
+}Nvm_Rule_T;
+
+/* Configuration record header - crc is calculated over the payload only */
+typedef struct __attribute__((packed)) Nvm_Config_Header_Tag
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t crc;
+  
+}Nvm_Config_Header_T;
+
+/* 
+ * Complete configuration record as stored in the flash
+ *  - new fields have to be appended, older records are upgraded by zero filling the tail
+ */
+typedef struct __attribute__((packed)) Nvm_Config_Tag
+{
+  Nvm_Config_Header_T header;
+  Nvm_Credentials_T credentials[Nvm_Credentials_Last];
+  
+  /* Version 2 */
+  Nvm_Param_Record_T params[NVM_PARAM_RECORDS_V2];
+  
+  /* Version 3 */
+  Nvm_Param_Record_T params_ext[NVM_PARAM_RECORDS_V3 - NVM_PARAM_RECORDS_V2];
+  Nvm_Credentials_T ap_list[NVM_AP_LIST_MAX - 1];
+  
+  /* Version 4 */
+  char ntp_server[NVM_NTP_SERVER_MAX_SIZE + 1];
+  Nvm_Schedule_T schedules[NVM_SCHEDULES_MAX];
+  
+  /* Version 5 */
+  Nvm_Rule_T rules[NVM_RULES_MAX];
+  
+  /* Version 6 */
+  Nvm_Param_Record_T params_ext2[NVM_PARAM_RECORDS_MAX - NVM_PARAM_RECORDS_V3];
+  char syslog_server[NVM_SYSLOG_SERVER_MAX_SIZE + 1];
+  
+  /* Version 7 */
+  char mqtt_broker[NVM_MQTT_BROKER_MAX_SIZE + 1];
+  
+  /* Version 8 */
+  char influx_url[NVM_INFLUX_URL_MAX_SIZE + 1];
+  
+}Nvm_Config_T;
+
 /* ==================================================================== */
 /* ============================ classes =============================== */
 /* ==================================================================== */
@@ -36,11 +177,45 @@ class Nvm_Manager
 {
   public:
     void Nvm_Init();
-    bool Nvm_CredentialsWrite(uint16_t start_addr, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len);
-    void Nvm_CredentialsRead(uint16_t start_addr, String &ssid_buf, String &pass_buf);
-    void NvM_ReadRawData();
+    bool Nvm_CredentialsWrite(Nvm_Credentials_ID_T cred_id, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len);
+    void Nvm_CredentialsRead(Nvm_Credentials_ID_T cred_id, String &ssid_buf, String &pass_buf);
+    bool Nvm_ApListWrite(uint8_t ap_idx, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len);
+    void Nvm_ApListRead(uint8_t ap_idx, String &ssid_buf, String &pass_buf);
+    bool Nvm_ParamsWrite(const Nvm_Param_Record_T *records);
+    void Nvm_ParamsRead(Nvm_Param_Record_T *records);
+    bool Nvm_NtpServerWrite(const char *server, const uint16_t server_len);
+    void Nvm_NtpServerRead(char *server_buf);
+    bool Nvm_SyslogServerWrite(const char *server, const uint16_t server_len);
+    void Nvm_SyslogServerRead(char *server_buf);
+    bool Nvm_MqttBrokerWrite(const char *broker, const uint16_t broker_len);
+    void Nvm_MqttBrokerRead(char *broker_buf);
+    bool Nvm_InfluxUrlWrite(const char *url, const uint16_t url_len);
+    void Nvm_InfluxUrlRead(char *url_buf);
+    bool Nvm_SchedulesWrite(const Nvm_Schedule_T *schedules);
+    void Nvm_SchedulesRead(Nvm_Schedule_T *schedules);
+    bool Nvm_RulesWrite(const Nvm_Rule_T *rules);
+    void Nvm_RulesRead(Nvm_Rule_T *rules);
+    void NvM_ReadRawData(Print &out = Serial);
   
   private:
+    /* Word access is required by the flash driver */
+    union
+    {
+      Nvm_Config_T config;
+      uint32_t config_words[(sizeof(Nvm_Config_T) + 3) / 4];
+    };
+    Nvm_Bank bank;
+    bool bank_available;
+    
+    Nvm_Credentials_T *Nvm_ApEntry(uint8_t ap_idx);
+    bool Nvm_CredentialsStore(Nvm_Credentials_T *dst, const char *ssid, const char *pass, const uint16_t ssid_len, const uint16_t pass_len);
+    bool Nvm_BankLegacyMigrate();
+    bool Nvm_ConfigValidate();
+    void Nvm_ConfigDefaults();
+    bool Nvm_ConfigCommit();
+    bool Nvm_EepromCommit();
+    bool Nvm_EepromMigrate();
+    bool Nvm_LegacyMigrate();
     void Nvm_ReadValue_Till_Sepatator(uint16_t start_idx, String &eep_data_buf);
 };
 
@@ -0,0 +1,497 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       param_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "param_manager.h"
+#include "fnv_hash.h"
+#include "tmr_config.h"
+#include "serial_event.h"
+#include "snsr_manager.h"
+#include "pwr_manager.h"
+#include "dsleep_manager.h"
+#include "gpio_manager.h"
+#include "action_manager.h"
+#include "input_manager.h"
+#include "log_manager.h"
+#include "telem_manager.h"
+#include "console_manager.h"
+#include "mqtt_manager.h"
+#include "influx_manager.h"
+#include "coap_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+static_assert(Param_ID_Last <= NVM_PARAM_RECORDS_MAX, "Not enough NVM records for all parameters");
+static_assert(Param_ID_Last <= (PARAM_INDEX_SIZE / 2), "Parameter hash index is too small");
+static_assert(0 == (PARAM_INDEX_SIZE & (PARAM_INDEX_SIZE - 1)), "Parameter hash index size must be power of 2");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Parameter handler */
+Param_Manager param;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Sensor handler */
+extern Sensor sensor;
+
+/* Power handler */
+extern Pwr_Manager pwr;
+
+/* GPIO action handler */
+extern Action_Manager action;
+
+/* Telemetry handler */
+extern Telem_Manager telem;
+
+/* Console handler */
+extern Console_Manager console;
+
+/* MQTT handler */
+extern Mqtt_Manager mqtt;
+
+/* Influx handler */
+extern Influx_Manager influx;
+
+/* CoAP handler */
+extern Coap_Manager coap;
+
+/* Parameter descriptors - defaults are the former compile time settings */
+static const Param_Desc_T param_desc[Param_ID_Last] =
+{
+  /* name             type              default                                  min     max     */
+  {"est_conn_ms",     Param_Type_U32,   TMR_ESTABLISH_CONNECTION_TIMEOUT_MS,     1000,   600000  },
+  {"reconnect_ms",    Param_Type_U32,   TMR_RECONNECT_TIMEOUT_MS,                1000,   600000  },
+  {"sensor_ms",       Param_Type_U32,   TMR_SENSOR_MEASUREMENT_PERIOD_MS,        100,    3600000 },
+  {"ap_rollback_ms",  Param_Type_U32,   TMR_AP_ROLLBACK_TIMEOUT_MS,              1000,   600000  },
+  {"fast_conn_ms",    Param_Type_U32,   TMR_FAST_CONNECT_TIMEOUT_MS,             0,      10000   },
+  {"lease_ms",        Param_Type_U32,   TMR_IP_LEASE_REUSE_MS,                   0,      86400000},
+  {"backoff_max_ms",  Param_Type_U32,   TMR_RECONNECT_BACKOFF_MAX_MS,            1000,   3600000 },
+  {"radio_reset_n",   Param_Type_U32,   TMR_RADIO_RESET_RETRIES,                 0,      100     },
+  {"mcu_reset_ms",    Param_Type_U32,   TMR_MCU_RESET_OUTAGE_MS,                 0,      86400000},
+  {"roam_rssi",       Param_Type_I32,   (uint32_t)WIFI_ROAM_RSSI_DBM,            -100,   0       },
+  {"roam_hyst_db",    Param_Type_U32,   WIFI_ROAM_HYSTERESIS_DB,                 0,      40      },
+  {"portal_ms",       Param_Type_U32,   TMR_PORTAL_START_MS,                     0,      86400000},
+  {"pwr_mode",        Param_Type_U32,   PWR_MODE_DEFAULT,                        0,      2       },
+  {"pwr_latency_ms",  Param_Type_U32,   PWR_LATENCY_MS,                          10,     1000    },
+  {"dsleep_s",        Param_Type_U32,   DSLEEP_PERIOD_S,                         0,      10800   },
+  {"dsleep_wait_ms",  Param_Type_U32,   DSLEEP_WAIT_MS,                          1000,   120000  },
+  {"gpio_power_on",   Param_Type_U32,   GPIO_POWER_ON_STATE,                     0,      ((1 << GPIO_REMOTE_USED) - 1)},
+  {"tz_offset_min",   Param_Type_I32,   (uint32_t)ACTION_TZ_OFFSET_MIN,          -720,   840     },
+  {"in_debounce_ms",  Param_Type_U32,   INPUT_DEBOUNCE_MS,                       1,      1000    },
+  {"in1_action",      Param_Type_U32,   INPUT_ACTION,                            0,      INPUT_ACTION_MAX},
+  {"in2_action",      Param_Type_U32,   INPUT_ACTION,                            0,      INPUT_ACTION_MAX},
+  {"baudrate",        Param_Type_U32,   SERIAL_BAUDRATE,                         9600,   3000000 },
+  {"serial_echo",     Param_Type_Bool,  SERIAL_ECHO,                             0,      1       },
+  {"log_level",       Param_Type_U32,   LOG_LEVEL,                               0,      3       },
+  {"syslog_proto",    Param_Type_U32,   LOG_SYSLOG_PROTO,                        0,      2       },
+  {"syslog_port",     Param_Type_U32,   LOG_SYSLOG_PORT,                         1,      65535   },
+  {"stream_baud",     Param_Type_U32,   TELEM_BAUDRATE,                          9600,   3000000 },
+  {"stream_ms",       Param_Type_U32,   TELEM_PERIOD_MS,                         1,      60000   },
+  {"console_port",    Param_Type_U32,   CONSOLE_PORT,                            0,      65535   },
+  {"mqtt_port",       Param_Type_U32,   MQTT_PORT,                               1,      65535   },
+  {"mqtt_keepalive",  Param_Type_U32,   MQTT_KEEPALIVE_S,                        10,     3600    },
+  {"influx_flush_s",  Param_Type_U32,   INFLUX_FLUSH_AGE_S,                      1,      3600    },
+  {"coap_port",       Param_Type_U32,   COAP_PORT,                               0,      65535   },
+  {"bme_mode",        Param_Type_U32,   Adafruit_BME280::MODE_NORMAL,            0,      3       },
+  {"bme_os_temp",     Param_Type_U32,   Adafruit_BME280::SAMPLING_X2,            0,      5       },
+  {"bme_os_pres",     Param_Type_U32,   Adafruit_BME280::SAMPLING_X16,           0,      5       },
+  {"bme_os_humid",    Param_Type_U32,   Adafruit_BME280::SAMPLING_X1,            0,      5       },
+  {"bme_filter",      Param_Type_U32,   Adafruit_BME280::FILTER_X16,             0,      4       },
+  {"bme_standby",     Param_Type_U32,   Adafruit_BME280::STANDBY_MS_0_5,         0,      7       },
+};
+
+/* ==================================================================== */
+/* ================== local function definitions  ===================== */
+/* ==================================================================== */
+
+/*
+ * Param_Hash
+ *  - This function calculates 16 bit FNV-1a hash of the parameter name
+ *  - Zero is reserved for empty NVM records
+ */
+static uint16_t Param_Hash(const char *name)
+{
+  uint32_t hash = Fnv_Hash(name);
+
+  hash = (hash >> 16) ^ (hash & 0xFFFF);
+
+  return (NVM_PARAM_KEY_EMPTY == hash) ? 1 : (uint16_t)hash;
+}
+
+
+/*
+ * Param_InRange
+ *  - This function checks value against descriptor range
+ */
+static bool Param_InRange(const Param_Desc_T *desc, uint32_t value)
+{
+  bool range_ok;
+
+  if(Param_Type_I32 == desc->type)
+  {
+    range_ok = ((int32_t)value >= desc->min_val) && ((int32_t)value <= desc->max_val);
+  }
+  else
+  {
+    range_ok = (value >= (uint32_t)desc->min_val) && (value <= (uint32_t)desc->max_val);
+  }
+  return range_ok;
+}
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Param_Init
+ *  - This function loads defaults and overrides them with values stored in NvM
+ *  - It should be called after Nvm_Init() and before any module reads parameters
+ */
+void Param_Manager::Param_Init()
+{
+  Nvm_Param_Record_T records[NVM_PARAM_RECORDS_MAX];
+  Param_ID_T id;
+  uint8_t loaded = 0;
+
+  Param_BuildIndex();
+
+  for(uint8_t idx = 0; idx < Param_ID_Last; idx++)
+  {
+    values[idx] = param_desc[idx].def_val;
+  }
+
+  eeprom.Nvm_ParamsRead(records);
+
+  for(uint8_t rec = 0; rec < NVM_PARAM_RECORDS_MAX; rec++)
+  {
+    if(NVM_PARAM_KEY_EMPTY == records[rec].key)
+    {
+      continue;
+    }
+
+    /* Find parameter by the key - records of removed parameters are ignored */
+    for(uint8_t idx = 0; idx < Param_ID_Last; idx++)
+    {
+      id = (Param_ID_T)idx;
+
+      if((Param_Hash(param_desc[id].name) == records[rec].key) &&
+         (param_desc[id].type == records[rec].type) &&
+         Param_InRange(&param_desc[id], records[rec].value))
+      {
+        values[id] = records[rec].value;
+        loaded++;
+        break;
+      }
+    }
+  }
+
+  LOG_INFO(Log_Module_Param, "%u stored values loaded", loaded);
+}
+
+
+/*
+ * Param_BuildIndex
+ *  - This function builds open addressing hash index (name hash -> parameter ID)
+ */
+void Param_Manager::Param_BuildIndex()
+{
+  uint16_t slot;
+
+  memset(index, PARAM_INDEX_EMPTY, sizeof(index));
+
+  for(uint8_t idx = 0; idx < Param_ID_Last; idx++)
+  {
+    slot = Param_Hash(param_desc[idx].name) & (PARAM_INDEX_SIZE - 1);
+
+    while(PARAM_INDEX_EMPTY != index[slot])
+    {
+      slot = (slot + 1) & (PARAM_INDEX_SIZE - 1);
+    }
+    index[slot] = idx;
+  }
+}
+
+
+/*
+ * Param_Find
+ *  - This function looks up parameter ID by its name
+ */
+bool Param_Manager::Param_Find(const char *name, Param_ID_T &id)
+{
+  uint16_t slot = Param_Hash(name) & (PARAM_INDEX_SIZE - 1);
+
+  while(PARAM_INDEX_EMPTY != index[slot])
+  {
+    if(0 == strcmp(param_desc[index[slot]].name, name))
+    {
+      id = (Param_ID_T)index[slot];
+      return true;
+    }
+    slot = (slot + 1) & (PARAM_INDEX_SIZE - 1);
+  }
+  return false;
+}
+
+
+/*
+ * Param_GetDesc
+ *  - This function returns descriptor of the given parameter
+ */
+const Param_Desc_T *Param_Manager::Param_GetDesc(Param_ID_T id)
+{
+  return &param_desc[id];
+}
+
+
+/*
+ * Param_Set
+ *  - This function validates, stores in NvM and applies new parameter value
+ */
+Param_Status_T Param_Manager::Param_Set(Param_ID_T id, uint32_t value)
+{
+  Param_Status_T status = Param_Status_OK;
+  uint32_t old_value;
+
+  if(id >= Param_ID_Last)
+  {
+    status = Param_Status_Unknown;
+  }
+  else if(!Param_InRange(&param_desc[id], value))
+  {
+    status = Param_Status_Range;
+  }
+  else
+  {
+    old_value = values[id];
+    values[id] = value;
+
+    if(!Param_Store())
+    {
+      values[id] = old_value;
+      status = Param_Status_NvmError;
+    }
+    else
+    {
+      Param_Apply(id);
+    }
+  }
+  return status;
+}
+
+
+/*
+ * Param_SetByName
+ *  - This function parses the value according to parameter type and sets it
+ *  - Boolean accepts 1/on/true and 0/off/false only, unparsable value returns Param_Status_Range
+ */
+Param_Status_T Param_Manager::Param_SetByName(const char *name, const char *value)
+{
+  Param_ID_T id;
+  char *end;
+  uint32_t new_value;
+
+  if(!Param_Find(name, id))
+  {
+    return Param_Status_Unknown;
+  }
+
+  if(Param_Type_Bool == param_desc[id].type)
+  {
+    if((0 == strcmp(value, "1")) || (0 == strcmp(value, "on")) || (0 == strcmp(value, "true")))
+    {
+      new_value = 1;
+    }
+    else if((0 == strcmp(value, "0")) || (0 == strcmp(value, "off")) || (0 == strcmp(value, "false")))
+    {
+      new_value = 0;
+    }
+    else
+    {
+      return Param_Status_Range;
+    }
+  }
+  else
+  {
+    new_value = (Param_Type_I32 == param_desc[id].type) ? (uint32_t)strtol(value, &end, 0) : (uint32_t)strtoul(value, &end, 0);
+
+    if((end == value) || ('\0' != *end))
+    {
+      return Param_Status_Range;
+    }
+  }
+  return Param_Set(id, new_value);
+}
+
+
+/*
+ * Param_ToString
+ *  - This function returns parameter value formatted according to its type
+ */
+String Param_Manager::Param_ToString(Param_ID_T id)
+{
+  String value_str;
+
+  if(Param_Type_I32 == param_desc[id].type)
+  {
+    value_str = String((long)(int32_t)values[id]);
+  }
+  else
+  {
+    value_str = String((unsigned long)values[id]);
+  }
+  return value_str;
+}
+
+
+/*
+ * Param_Store
+ *  - This function writes all parameters which differ from defaults to the NvM
+ */
+bool Param_Manager::Param_Store()
+{
+  Nvm_Param_Record_T records[NVM_PARAM_RECORDS_MAX];
+  uint8_t rec = 0;
+
+  memset(records, 0, sizeof(records));
+
+  for(uint8_t idx = 0; idx < Param_ID_Last; idx++)
+  {
+    if(values[idx] != param_desc[idx].def_val)
+    {
+      records[rec].key = Param_Hash(param_desc[idx].name);
+      records[rec].type = param_desc[idx].type;
+      records[rec].value = values[idx];
+      rec++;
+    }
+  }
+  return eeprom.Nvm_ParamsWrite(records);
+}
+
+
+/*
+ * Param_Apply
+ *  - This function applies changed parameter to the running modules
+ *  - Timeouts are used the next time the timer is started
+ */
+void Param_Manager::Param_Apply(Param_ID_T id)
+{
+  switch(id)
+  {
+    case Param_ID_SensorPeriod:
+    {
+      Start_sensor_measurement_tmr(values[id]);
+      break;
+    }
+
+    case Param_ID_BmeMode:
+    case Param_ID_BmeOsTemp:
+    case Param_ID_BmeOsPres:
+    case Param_ID_BmeOsHumid:
+    case Param_ID_BmeFilter:
+    case Param_ID_BmeStandby:
+    {
+      sensor.Sensor_ApplySampling();
+      break;
+    }
+
+    case Param_ID_PowerMode:
+    case Param_ID_PowerLatency:
+    {
+      pwr.Pwr_Apply();
+      break;
+    }
+
+    case Param_ID_TzOffset:
+    {
+      action.Action_TimeConfig();
+      break;
+    }
+
+    case Param_ID_LogLevel:
+    {
+      (void)logger.Log_SetLevel("all", (uint8_t)values[id]);
+      break;
+    }
+
+    case Param_ID_SyslogProto:
+    case Param_ID_SyslogPort:
+    {
+      logger.Log_SyslogConfig();
+      break;
+    }
+
+    case Param_ID_StreamBaudrate:
+    case Param_ID_StreamPeriod:
+    {
+      telem.Telem_Apply();
+      break;
+    }
+
+    case Param_ID_ConsolePort:
+    {
+      console.Console_Apply();
+      break;
+    }
+
+    case Param_ID_MqttPort:
+    case Param_ID_MqttKeepalive:
+    {
+      mqtt.Mqtt_Config();
+      break;
+    }
+
+    case Param_ID_InfluxFlush:
+    {
+      influx.Influx_Config();
+      break;
+    }
+
+    case Param_ID_CoapPort:
+    {
+      coap.Coap_Config();
+      break;
+    }
+
+    case Param_ID_DsleepPeriod:
+    {
+      LOG_INFO(Log_Module_Param, "Deep sleep mode applied after reboot");
+      break;
+    }
+
+    case Param_ID_SerialBaudrate:
+    {
+      LOG_INFO(Log_Module_Param, "Baudrate applied after reboot");
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+}
+
+
+/*
+ * Param_DebugPrint
+ *  - This function prints all parameters on console
+ */
+void Param_Manager::Param_DebugPrint(Print &out)
+{
+  for(uint8_t idx = 0; idx < Param_ID_Last; idx++)
+  {
+    out.printf("PARAM -> %s: %s%s\r\n", param_desc[idx].name, Param_ToString((Param_ID_T)idx).c_str(),
+               (values[idx] == param_desc[idx].def_val) ? " (default)" : "");
+  }
+}
+
+/* EOF */
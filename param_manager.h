@@ -0,0 +1,132 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       param_manager.h
+ */
+#ifndef _PARAM_MANAGER_H_
+#define _PARAM_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "nvm_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Hash index size - power of 2, at least twice the number of parameters */
+#define PARAM_INDEX_SIZE          (128)
+#define PARAM_INDEX_EMPTY         ((uint8_t)0xFF)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Runtime tunable parameters - ID is the index of the RAM table */
+typedef enum Param_ID_Tag
+{
+  Param_ID_EstConnTimeout = 0,
+  Param_ID_ReconnectTimeout,
+  Param_ID_SensorPeriod,
+  Param_ID_ApRollbackTimeout,
+  Param_ID_FastConnTimeout,
+  Param_ID_LeaseReuse,
+  Param_ID_BackoffMax,
+  Param_ID_RadioResetRetries,
+  Param_ID_McuResetOutage,
+  Param_ID_RoamRssi,
+  Param_ID_RoamHysteresis,
+  Param_ID_PortalStart,
+  Param_ID_PowerMode,
+  Param_ID_PowerLatency,
+  Param_ID_DsleepPeriod,
+  Param_ID_DsleepWait,
+  Param_ID_GpioPowerOn,
+  Param_ID_TzOffset,
+  Param_ID_InputDebounce,
+  Param_ID_Input1Action,
+  Param_ID_Input2Action,
+  Param_ID_SerialBaudrate,
+  Param_ID_SerialEcho,
+  Param_ID_LogLevel,
+  Param_ID_SyslogProto,
+  Param_ID_SyslogPort,
+  Param_ID_StreamBaudrate,
+  Param_ID_StreamPeriod,
+  Param_ID_ConsolePort,
+  Param_ID_MqttPort,
+  Param_ID_MqttKeepalive,
+  Param_ID_InfluxFlush,
+  Param_ID_CoapPort,
+  Param_ID_BmeMode,
+  Param_ID_BmeOsTemp,
+  Param_ID_BmeOsPres,
+  Param_ID_BmeOsHumid,
+  Param_ID_BmeFilter,
+  Param_ID_BmeStandby,
+  Param_ID_Last
+
+}Param_ID_T;
+
+/* Type used to parse and print the value - every value is kept as 32 bit word */
+typedef enum Param_Type_Tag
+{
+  Param_Type_U32 = 0,
+  Param_Type_I32,
+  Param_Type_Bool
+
+}Param_Type_T;
+
+/* Status of the set operation */
+typedef enum Param_Status_Tag
+{
+  Param_Status_OK = 0,
+  Param_Status_Unknown,
+  Param_Status_Range,
+  Param_Status_NvmError
+
+}Param_Status_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Parameter descriptor - name, type, default value and allowed range */
+typedef struct Param_Desc_Tag
+{
+  const char *name;
+  Param_Type_T type;
+  uint32_t def_val;
+  int32_t min_val;
+  int32_t max_val;
+
+}Param_Desc_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Param_Manager
+{
+  public:
+    void Param_Init();
+    Param_Status_T Param_Set(Param_ID_T id, uint32_t value);
+    Param_Status_T Param_SetByName(const char *name, const char *value);
+    bool Param_Find(const char *name, Param_ID_T &id);
+    const Param_Desc_T *Param_GetDesc(Param_ID_T id);
+    String Param_ToString(Param_ID_T id);
+    void Param_DebugPrint(Print &out = Serial);
+
+    /* Hot path read - plain RAM table access */
+    inline uint32_t Param_Get(Param_ID_T id) { return values[id]; }
+
+  private:
+    uint32_t values[Param_ID_Last];
+    uint8_t index[PARAM_INDEX_SIZE];
+
+    void Param_BuildIndex();
+    bool Param_Store();
+    void Param_Apply(Param_ID_T id);
+};
+
+#endif /* _PARAM_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,139 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       prof_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "prof_manager.h"
+#include "sched_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Loop profiler handler */
+Prof_Manager prof;
+
+#if PROF_ENABLED
+
+/* Scheduler handler */
+extern Sched_Manager sched;
+
+static const char *prof_phase_name[Prof_Phase_Last] = {"sdk", "select", "task", "account", "sleep"};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Prof_Reset
+ *  - This function clears the histogram and the captured iterations
+ *  - The iteration in progress is measured from now on
+ */
+void Prof_Manager::Prof_Reset()
+{
+  iterations = 0;
+  memset(hist, 0, sizeof(hist));
+  memset(slow, 0, sizeof(slow));
+  memset(cycles, 0, sizeof(cycles));
+  slow_min_cycles = 0;
+  slow_min_idx = 0;
+
+  mark = ESP.getCycleCount();
+  begin = mark;
+}
+
+
+/*
+ * Prof_Dump
+ *  - This function appends the histogram and the slowest iterations (slowest first) to the string
+ */
+void Prof_Manager::Prof_Dump(String &out)
+{
+  uint32_t cpu_mhz = ESP.getCpuFreqMHz();
+  uint8_t order[PROF_SLOW_MAX];
+  char line[96];
+
+  snprintf(line, sizeof(line), "PROF -> Iterations: %u (CPU %u MHz)\r\n", iterations, cpu_mhz);
+  out += line;
+
+  for(uint8_t i = 1; i < PROF_HIST_BUCKETS; i++)
+  {
+    if(0 != hist[i])
+    {
+      /* Bucket limits converted from cycles to us */
+      snprintf(line, sizeof(line), "PROF -> < %10u us: %u\r\n", (uint32_t)(((uint64_t)1 << i) / cpu_mhz), hist[i]);
+      out += line;
+    }
+  }
+
+  /* Small table - insertion sort by the iteration time */
+  for(uint8_t i = 0; i < PROF_SLOW_MAX; i++)
+  {
+    uint8_t j = i;
+
+    while((j > 0) && (slow[order[j - 1]].total_cycles < slow[i].total_cycles))
+    {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+
+  out += "PROF -> Slowest iterations:\r\n";
+
+  for(uint8_t i = 0; i < PROF_SLOW_MAX; i++)
+  {
+    const Prof_Slow_T *s = &slow[order[i]];
+
+    if(0 == s->total_cycles)
+    {
+      break;
+    }
+
+    snprintf(line, sizeof(line), "PROF -> %u us at %u ms, task: %s\r\n", s->total_cycles / cpu_mhz, s->time_ms,
+             (PROF_TASK_NONE == s->task) ? "-" : sched.Sched_GetName((Sched_Task_ID_T)s->task));
+    out += line;
+
+    for(uint8_t p = 0; p < Prof_Phase_Last; p++)
+    {
+      snprintf(line, sizeof(line), "PROF ->   %-8s %u us\r\n", prof_phase_name[p], s->phase_cycles[p] / cpu_mhz);
+      out += line;
+    }
+  }
+}
+
+
+/*
+ * Prof_Capture
+ *  - This function replaces the fastest of the captured iterations with the current one
+ *  - Called only when the current iteration is slower than the fastest captured one
+ */
+void Prof_Manager::Prof_Capture(uint32_t total)
+{
+  Prof_Slow_T *s = &slow[slow_min_idx];
+
+  s->time_ms = millis();
+  s->total_cycles = total;
+  s->task = task;
+  memcpy(s->phase_cycles, cycles, sizeof(cycles));
+
+  /* New threshold - the fastest of the captured iterations */
+  slow_min_idx = 0;
+
+  for(uint8_t i = 1; i < PROF_SLOW_MAX; i++)
+  {
+    if(slow[i].total_cycles < slow[slow_min_idx].total_cycles)
+    {
+      slow_min_idx = i;
+    }
+  }
+
+  slow_min_cycles = slow[slow_min_idx].total_cycles;
+}
+
+#endif /* PROF_ENABLED */
+
+/* EOF */
@@ -0,0 +1,155 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       prof_manager.h
+ */
+#ifndef _PROF_MANAGER_H_
+#define _PROF_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Loop profiler - build with PROF_ENABLED set to 0 to remove it completely */
+#ifndef PROF_ENABLED
+#define PROF_ENABLED                (1)
+#endif
+
+/* Histogram bucket n counts iterations of [2^(n-1), 2^n) CPU cycles */
+#define PROF_HIST_BUCKETS           (33)
+
+/* Number of the slowest iterations kept with the phase breakdown */
+#define PROF_SLOW_MAX               (8)
+
+/* No scheduler task was run in the iteration */
+#define PROF_TASK_NONE              (0xFF)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Phases of single loop iteration - in order of execution */
+typedef enum Prof_Phase_Tag
+{
+  Prof_Phase_Sdk = 0,       /* outside of loop() - SDK, WiFi stack, yield */
+  Prof_Phase_Select,        /* scheduler task selection */
+  Prof_Phase_Task,          /* task callback */
+  Prof_Phase_Account,       /* scheduler accounting */
+  Prof_Phase_Sleep,         /* power saving idle - not counted in the iteration time */
+  Prof_Phase_Last
+
+}Prof_Phase_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Captured slow iteration */
+typedef struct Prof_Slow_Tag
+{
+  uint32_t time_ms;
+  uint32_t total_cycles;
+  uint32_t phase_cycles[Prof_Phase_Last];
+  uint8_t task;
+
+}Prof_Slow_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+#if PROF_ENABLED
+
+class Prof_Manager
+{
+  public:
+    void Prof_Reset();
+    void Prof_Dump(String &out);
+
+    /* Hot path - few cycles per call, kept inline */
+    inline void Prof_LoopBegin()
+    {
+      uint32_t now = ESP.getCycleCount();
+
+      cycles[Prof_Phase_Sdk] = now - mark;
+      cycles[Prof_Phase_Task] = 0;
+      cycles[Prof_Phase_Account] = 0;
+      cycles[Prof_Phase_Sleep] = 0;
+      task = PROF_TASK_NONE;
+      begin = mark;
+      mark = now;
+    }
+
+    inline void Prof_Mark(Prof_Phase_T phase)
+    {
+      uint32_t now = ESP.getCycleCount();
+
+      cycles[phase] = now - mark;
+      mark = now;
+    }
+
+    inline void Prof_Task(uint8_t id)
+    {
+      task = id;
+    }
+
+    inline void Prof_LoopEnd()
+    {
+      Prof_Mark(Prof_Phase_Sleep);
+
+      uint32_t total = (mark - begin) - cycles[Prof_Phase_Sleep];
+
+      hist[32 - __builtin_clz(total | 1)]++;
+      iterations++;
+
+      if(total > slow_min_cycles)
+      {
+        Prof_Capture(total);
+      }
+    }
+
+  private:
+    uint32_t mark;
+    uint32_t begin;
+    uint32_t cycles[Prof_Phase_Last];
+    uint8_t task;
+
+    uint32_t iterations;
+    uint32_t hist[PROF_HIST_BUCKETS];
+    Prof_Slow_T slow[PROF_SLOW_MAX];
+    uint32_t slow_min_cycles;
+    uint8_t slow_min_idx;
+
+    void Prof_Capture(uint32_t total);
+};
+
+extern Prof_Manager prof;
+
+#define PROF_LOOP_BEGIN()           prof.Prof_LoopBegin()
+#define PROF_MARK(phase)            prof.Prof_Mark(phase)
+#define PROF_TASK(id)               prof.Prof_Task(id)
+#define PROF_LOOP_END()             prof.Prof_LoopEnd()
+#define PROF_LOOP_IDLE()            prof.Prof_Mark(Prof_Phase_Account)
+
+#else
+
+/* Profiler compiled out - only the dump answer is kept */
+class Prof_Manager
+{
+  public:
+    inline void Prof_Reset() {}
+    inline void Prof_Dump(String &out) { out += "PROF -> Disabled (PROF_ENABLED 0)\r\n"; }
+};
+
+#define PROF_LOOP_BEGIN()           do {} while(0)
+#define PROF_MARK(phase)            do {} while(0)
+#define PROF_TASK(id)               do {} while(0)
+#define PROF_LOOP_END()             do {} while(0)
+#define PROF_LOOP_IDLE()            do {} while(0)
+
+#endif /* PROF_ENABLED */
+
+#endif /* _PROF_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,102 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       prov_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "prov_manager.h"
+#include "server_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Provisioning handler */
+Prov_Manager prov;
+
+/* Web server handler */
+extern Server_Manager server;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Prov_Start
+ *  - This function brings up the provisioning SoftAP with captive DNS
+ *  - Station keeps trying to connect in the meantime (AP+STA mode)
+ *  - Every DNS name resolves to the node, the web server redirects unknown pages to "/provision"
+ */
+void Prov_Manager::Prov_Start()
+{
+  char ssid[sizeof(PROV_AP_SSID_PREFIX) + 8];
+
+  if(active)
+  {
+    return;
+  }
+
+  snprintf(ssid, sizeof(ssid), PROV_AP_SSID_PREFIX "%06X", ESP.getChipId());
+
+  WiFi.mode(WIFI_AP_STA);
+  WiFi.softAPConfig(PROV_AP_IP, PROV_AP_IP, PROV_AP_MASK);
+  WiFi.softAP(ssid);
+
+  dns.setErrorReplyCode(DNSReplyCode::NoError);
+  dns.start(PROV_DNS_PORT, "*", PROV_AP_IP);
+
+  /* Server listens on all interfaces - also on the SoftAP one */
+  server.Server_Init();
+  active = true;
+
+  LOG_INFO(Log_Module_Prov, "Portal started: %s (http://%s/provision)", ssid, PROV_AP_IP.toString().c_str());
+}
+
+
+/*
+ * Prov_Stop
+ *  - This function shuts the provisioning SoftAP down (station only mode)
+ */
+void Prov_Manager::Prov_Stop()
+{
+  if(!active)
+  {
+    return;
+  }
+
+  dns.stop();
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  active = false;
+
+  LOG_INFO(Log_Module_Prov, "Portal stopped");
+}
+
+
+/*
+ * Prov_Process
+ *  - This function answers captive DNS requests
+ *  - This function should be called periodically in the loop
+ */
+void Prov_Manager::Prov_Process()
+{
+  if(active)
+  {
+    dns.processNextRequest();
+  }
+}
+
+
+/*
+ * Prov_IsActive
+ *  - This function returns true while the provisioning portal is running
+ */
+bool Prov_Manager::Prov_IsActive()
+{
+  return active;
+}
+
+/* EOF */
@@ -0,0 +1,42 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       prov_manager.h
+ */
+#ifndef _PROV_MANAGER_H_
+#define _PROV_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <ESP8266WiFi.h>
+#include <DNSServer.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Provisioning SoftAP - SSID is followed by the chip ID */
+#define PROV_AP_SSID_PREFIX       "iBeacon-"
+#define PROV_AP_IP                IPAddress(192, 168, 4, 1)
+#define PROV_AP_MASK              IPAddress(255, 255, 255, 0)
+#define PROV_DNS_PORT             (53)
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Prov_Manager
+{
+  public:
+    void Prov_Start();
+    void Prov_Stop();
+    void Prov_Process();
+    bool Prov_IsActive();
+
+  private:
+    DNSServer dns;
+    bool active;
+};
+
+#endif /* _PROV_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,328 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       pwm_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "pwm_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Levels are kept in 8.8 fixed point - fade step is added once per PWM period */
+#define PWM_Q8(level)           ((int32_t)(level) << 8)
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Channel state shared with the timer ISR */
+typedef struct Pwm_Channel_Tag
+{
+  uint32_t mask;
+  int32_t level_q8;
+  int32_t target_q8;
+  int32_t step_q8;
+
+}Pwm_Channel_T;
+
+/* ==================================================================== */
+/* ======================== gamma table =============================== */
+/* ==================================================================== */
+/*
+ * Perceptual brightness - CIE 1931 lightness to luminance, generated at compile time
+ *  - level 0..255 is the lightness L* (0..100), duty is the luminance in timer ticks
+ */
+constexpr double Pwm_Cie(double l)
+{
+  return (l <= 8.0) ? (l / 903.3) : (((l + 16.0) / 116.0) * ((l + 16.0) / 116.0) * ((l + 16.0) / 116.0));
+}
+
+constexpr uint16_t Pwm_GammaDuty(uint16_t level)
+{
+  return (uint16_t)((Pwm_Cie((level * 100.0) / PWM_LEVEL_MAX) * PWM_PERIOD_TICKS) + 0.5);
+}
+
+template<uint16_t... I> struct Pwm_Gamma_Table
+{
+  static const uint16_t duty[sizeof...(I)];
+};
+
+template<uint16_t... I> const uint16_t Pwm_Gamma_Table<I...>::duty[sizeof...(I)] = {Pwm_GammaDuty(I)...};
+
+/* Index sequence 0..N-1 (C++11) */
+template<uint16_t N, uint16_t... I> struct Pwm_Gamma_Gen : Pwm_Gamma_Gen<N - 1, N - 1, I...> {};
+template<uint16_t... I> struct Pwm_Gamma_Gen<0, I...> { typedef Pwm_Gamma_Table<I...> type; };
+
+typedef Pwm_Gamma_Gen<PWM_LEVEL_MAX + 1>::type Pwm_Gamma;
+
+static_assert(0 == Pwm_GammaDuty(0), "Gamma table must start with 0");
+static_assert(PWM_PERIOD_TICKS == Pwm_GammaDuty(PWM_LEVEL_MAX), "Gamma table must end with full period");
+static_assert(Pwm_GammaDuty(PWM_LEVEL_MAX / 2) < (PWM_PERIOD_TICKS / 4), "Gamma table is not perceptual");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* PWM handler */
+Pwm_Manager pwm;
+
+/* State shared with the timer ISR */
+static volatile Pwm_Channel_T pwm_ch[GPIO_REMOTE_USED];
+static volatile bool pwm_running = false;
+
+/* Falling edges of the current period - ascending ticks from the period start */
+static uint16_t pwm_edge_ticks[GPIO_REMOTE_USED];
+static uint32_t pwm_edge_mask[GPIO_REMOTE_USED];
+static uint8_t pwm_edge_cnt = 0;
+static uint8_t pwm_edge_idx = 0;
+static uint16_t pwm_edge_time = 0;
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static void IRAM_ATTR Pwm_Isr();
+static void IRAM_ATTR Pwm_PeriodStart();
+static void IRAM_ATTR Pwm_EdgeInsert(uint16_t duty, uint32_t mask);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Pwm_SetLevel
+ *  - This function sets the brightness, fade_ms is the time of linear (perceptual) transition
+ *  - Timer runs only while any output is dimmed or fading, static levels are written directly
+ */
+void Pwm_Manager::Pwm_SetLevel(uint8_t pin_id, uint8_t level, uint32_t fade_ms)
+{
+  uint32_t periods = (fade_ms * PWM_FREQ_HZ) / 1000;
+  bool timer_needed = false;
+
+  if(pin_id >= GPIO_REMOTE_USED)
+  {
+    return;
+  }
+
+  noInterrupts();
+
+  volatile Pwm_Channel_T *c = &pwm_ch[pin_id];
+
+  c->mask = (GpioPin[pin_id] < 16) ? ((uint32_t)1 << GpioPin[pin_id]) : 0;
+  c->target_q8 = PWM_Q8(level);
+
+  if((0 == periods) || (0 == c->mask))
+  {
+    c->level_q8 = c->target_q8;
+    c->step_q8 = 0;
+  }
+  else
+  {
+    int32_t diff = c->target_q8 - c->level_q8;
+
+    /* At least one LSB per period - the fade always ends */
+    c->step_q8 = diff / (int32_t)periods;
+
+    if((0 == c->step_q8) && (0 != diff))
+    {
+      c->step_q8 = (diff > 0) ? 1 : -1;
+    }
+  }
+
+  for(uint8_t ch = 0; ch < GPIO_REMOTE_USED; ch++)
+  {
+    int32_t ch_level = pwm_ch[ch].level_q8;
+
+    timer_needed = timer_needed || (0 != pwm_ch[ch].step_q8) ||
+                   ((0 != pwm_ch[ch].mask) && (ch_level > 0) && (ch_level < PWM_Q8(PWM_LEVEL_MAX)));
+  }
+
+  if(timer_needed && !pwm_running)
+  {
+    pwm_running = true;
+    pwm_edge_cnt = 0;
+    pwm_edge_idx = 0;
+
+    timer1_attachInterrupt(Pwm_Isr);
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+    timer1_write(PWM_MIN_TICKS);
+  }
+
+  interrupts();
+
+  /* Running timer applies the level itself (and stops when nothing is dimmed) */
+  if(!pwm_running)
+  {
+    digitalWrite(GpioPin[pin_id], (0 != level) ? HIGH : LOW);
+  }
+}
+
+
+/*
+ * Pwm_GetLevel
+ *  - This function returns the current brightness (changes during the fade)
+ */
+uint8_t Pwm_Manager::Pwm_GetLevel(uint8_t pin_id)
+{
+  return (pin_id < GPIO_REMOTE_USED) ? (uint8_t)(pwm_ch[pin_id].level_q8 >> 8) : 0;
+}
+
+
+/*
+ * Pwm_GetTarget
+ *  - This function returns the brightness at the end of the fade
+ */
+uint8_t Pwm_Manager::Pwm_GetTarget(uint8_t pin_id)
+{
+  return (pin_id < GPIO_REMOTE_USED) ? (uint8_t)(pwm_ch[pin_id].target_q8 >> 8) : 0;
+}
+
+
+/*
+ * Pwm_IsRunning
+ *  - This function returns true if the timer is running (output dimmed or fading)
+ */
+bool Pwm_Manager::Pwm_IsRunning()
+{
+  return pwm_running;
+}
+
+
+/*
+ * Pwm_Isr
+ *  - Timer1 interrupt - single shot, the next interrupt is the next edge
+ *  - All dimmed outputs rise at the period start and fall at their duty
+ */
+static void IRAM_ATTR Pwm_Isr()
+{
+  if(pwm_edge_idx >= pwm_edge_cnt)
+  {
+    Pwm_PeriodStart();
+    return;
+  }
+
+  GPOC = pwm_edge_mask[pwm_edge_idx];
+  pwm_edge_idx++;
+
+  if(pwm_edge_idx < pwm_edge_cnt)
+  {
+    timer1_write(pwm_edge_ticks[pwm_edge_idx] - pwm_edge_time);
+    pwm_edge_time = pwm_edge_ticks[pwm_edge_idx];
+  }
+  else
+  {
+    timer1_write(PWM_PERIOD_TICKS - pwm_edge_time);
+  }
+}
+
+
+/*
+ * Pwm_PeriodStart
+ *  - This function advances the fades by one step and prepares edges of the new period
+ *  - Timer is stopped when all outputs are fully ON or OFF (outputs are left at that level)
+ */
+static void IRAM_ATTR Pwm_PeriodStart()
+{
+  uint32_t set_mask = 0;
+  uint32_t clr_mask = 0;
+  bool active = false;
+
+  pwm_edge_cnt = 0;
+
+  for(uint8_t ch = 0; ch < GPIO_REMOTE_USED; ch++)
+  {
+    volatile Pwm_Channel_T *c = &pwm_ch[ch];
+
+    if(0 != c->step_q8)
+    {
+      c->level_q8 += c->step_q8;
+
+      if(((c->step_q8 > 0) && (c->level_q8 >= c->target_q8)) ||
+         ((c->step_q8 < 0) && (c->level_q8 <= c->target_q8)))
+      {
+        c->level_q8 = c->target_q8;
+        c->step_q8 = 0;
+      }
+      else
+      {
+        active = true;
+      }
+    }
+
+    uint16_t duty = Pwm_Gamma::duty[c->level_q8 >> 8];
+
+    if(0 == duty)
+    {
+      clr_mask |= c->mask;
+    }
+    else
+    {
+      set_mask |= c->mask;
+
+      if(duty < PWM_PERIOD_TICKS)
+      {
+        Pwm_EdgeInsert(duty, c->mask);
+        active = true;
+      }
+    }
+  }
+
+  GPOS = set_mask;
+  GPOC = clr_mask;
+
+  if(!active)
+  {
+    timer1_disable();
+    pwm_running = false;
+    return;
+  }
+
+  pwm_edge_idx = 0;
+
+  if(0 == pwm_edge_cnt)
+  {
+    /* Fading through full ON/OFF only - nothing to switch in this period */
+    pwm_edge_time = 0;
+    timer1_write(PWM_PERIOD_TICKS);
+  }
+  else
+  {
+    pwm_edge_time = pwm_edge_ticks[0];
+    timer1_write(pwm_edge_ticks[0]);
+  }
+}
+
+
+/*
+ * Pwm_EdgeInsert
+ *  - This function adds the falling edge to the sorted edge list (close edges are merged)
+ */
+static void IRAM_ATTR Pwm_EdgeInsert(uint16_t duty, uint32_t mask)
+{
+  uint8_t idx = pwm_edge_cnt;
+
+  duty = constrain(duty, PWM_MIN_TICKS, PWM_PERIOD_TICKS - PWM_MIN_TICKS);
+
+  for(uint8_t i = 0; i < pwm_edge_cnt; i++)
+  {
+    if(abs((int32_t)pwm_edge_ticks[i] - (int32_t)duty) < PWM_MIN_TICKS)
+    {
+      pwm_edge_mask[i] |= mask;
+      return;
+    }
+  }
+
+  while((idx > 0) && (pwm_edge_ticks[idx - 1] > duty))
+  {
+    pwm_edge_ticks[idx] = pwm_edge_ticks[idx - 1];
+    pwm_edge_mask[idx] = pwm_edge_mask[idx - 1];
+    idx--;
+  }
+
+  pwm_edge_ticks[idx] = duty;
+  pwm_edge_mask[idx] = mask;
+  pwm_edge_cnt++;
+}
+
+/* EOF */
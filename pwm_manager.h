@@ -0,0 +1,49 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       pwm_manager.h
+ */
+#ifndef _PWM_MANAGER_H_
+#define _PWM_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "gpio_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/*
+ * PWM driven by hardware timer1 (80MHz / 16) - analogWrite(), tone() and Servo must not be used
+ *  - only GPIO0..GPIO15 can be dimmed, other pins are switched ON/OFF
+ */
+#define PWM_TIMER_HZ            (5000000)
+#define PWM_FREQ_HZ             (1000)
+#define PWM_PERIOD_TICKS        (PWM_TIMER_HZ / PWM_FREQ_HZ)
+
+/* Shortest pulse and shortest gap between two edges (5us) - closer edges are merged */
+#define PWM_MIN_TICKS           (25)
+
+/* Perceived brightness range */
+#define PWM_LEVEL_MAX           (255)
+
+/* Fade time used by the web UI */
+#define PWM_WEB_FADE_MS         (500)
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Pwm_Manager
+{
+  public:
+    void Pwm_SetLevel(uint8_t pin_id, uint8_t level, uint32_t fade_ms);
+    uint8_t Pwm_GetLevel(uint8_t pin_id);
+    uint8_t Pwm_GetTarget(uint8_t pin_id);
+    bool Pwm_IsRunning();
+};
+
+#endif /* _PWM_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,267 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       pwr_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "pwr_manager.h"
+#include "sched_manager.h"
+#include "param_manager.h"
+#include "prov_manager.h"
+#include "log_manager.h"
+#include "telem_manager.h"
+
+extern "C" {
+#include <user_interface.h>
+#include <gpio.h>
+}
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Polling task - polled with the latency bound period while the power saving is active */
+typedef struct Pwr_Poll_Task_Tag
+{
+  Sched_Task_ID_T id;
+  uint32_t period_ms;
+
+}Pwr_Poll_Task_T;
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Power handler */
+Pwr_Manager pwr;
+
+/* Scheduler handler */
+extern Sched_Manager sched;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Provisioning handler */
+extern Prov_Manager prov;
+
+/* Telemetry handler */
+extern Telem_Manager telem;
+
+static const Pwr_Poll_Task_T pwr_poll_tasks[] =
+{
+  {Sched_Task_WiFi,     SCHED_WIFI_PERIOD_MS   },
+  {Sched_Task_Server,   SCHED_SERVER_PERIOD_MS },
+  {Sched_Task_Prov,     SCHED_PROV_PERIOD_MS   },
+  {Sched_Task_Serial,   SCHED_SERIAL_PERIOD_MS },
+  {Sched_Task_Input,    SCHED_INPUT_PERIOD_MS  },
+  {Sched_Task_Log,      SCHED_LOG_PERIOD_MS    },
+  {Sched_Task_Console,  SCHED_CONSOLE_PERIOD_MS},
+  {Sched_Task_Mqtt,     SCHED_MQTT_PERIOD_MS   },
+  {Sched_Task_Influx,   SCHED_INFLUX_PERIOD_MS },
+  {Sched_Task_Coap,     SCHED_COAP_PERIOD_MS   },
+};
+
+static const char *pwr_mode_name[Pwr_Mode_Last] = {"off", "modem sleep", "light sleep"};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Pwr_Init
+ *  - This function applies the configured power mode (loop tasks have to be started already)
+ */
+void Pwr_Manager::Pwr_Init()
+{
+  active_mode = Pwr_Mode_Off;
+  mode = Pwr_Mode_Off;
+  Pwr_Apply();
+}
+
+
+/*
+ * Pwr_Apply
+ *  - This function applies changed power parameters
+ *  - Polling tasks run with the latency bound period while the power saving is enabled,
+ *    so a pending HTTP request or serial command waits at most the latency bound
+ */
+void Pwr_Manager::Pwr_Apply()
+{
+  Pwr_Mode_T new_mode = (Pwr_Mode_T)param.Param_Get(Param_ID_PowerMode);
+
+  latency_ms = param.Param_Get(Param_ID_PowerLatency);
+
+  for(uint8_t i = 0; i < (sizeof(pwr_poll_tasks) / sizeof(pwr_poll_tasks[0])); i++)
+  {
+    uint32_t period_ms = pwr_poll_tasks[i].period_ms;
+
+    if(Pwr_Mode_Off != new_mode)
+    {
+      period_ms = max(period_ms, latency_ms);
+    }
+
+    sched.Sched_SetPeriod(pwr_poll_tasks[i].id, period_ms);
+  }
+
+  if(new_mode != mode)
+  {
+    /* Average current is reported for the current mode only */
+    mode = new_mode;
+    Pwr_ResetStats();
+
+    LOG_INFO(Log_Module_Power, "Mode: %s, latency bound: %u ms", pwr_mode_name[mode], latency_ms);
+  }
+}
+
+
+/*
+ * Pwr_Idle
+ *  - This function sleeps till the next scheduler task is due (at most the latency bound)
+ *  - The SDK suspends the modem (and the CPU in light sleep) while the loop is in delay()
+ *  - Power saving is suspended while the provisioning portal (SoftAP) or the telemetry stream is running
+ *  - This function should be called in the loop after the scheduler
+ */
+void Pwr_Manager::Pwr_Idle()
+{
+  Pwr_Mode_T wanted = (prov.Prov_IsActive() || telem.Telem_IsActive()) ? Pwr_Mode_Off : mode;
+
+  if(wanted != active_mode)
+  {
+    Pwr_SetActiveMode(wanted);
+  }
+
+  if(Pwr_Mode_Off == active_mode)
+  {
+    return;
+  }
+
+  uint32_t idle_ms = sched.Sched_GetNextDue();
+
+  if(0 == idle_ms)
+  {
+    return;
+  }
+
+  if(idle_ms > latency_ms)
+  {
+    idle_ms = latency_ms;
+    wakes_latency++;
+  }
+  else
+  {
+    wakes_deadline++;
+  }
+
+  uint32_t start_us = micros();
+  delay(idle_ms);
+  sleep_us[active_mode] += (uint32_t)(micros() - start_us);
+}
+
+
+/*
+ * Pwr_GetAvgCurrentUa
+ *  - This function returns the estimated average current since the mode was set
+ *  - Time out of sleep is counted with the active current
+ */
+uint32_t Pwr_Manager::Pwr_GetAvgCurrentUa()
+{
+  uint64_t total_us = (uint64_t)(millis() - stats_start_ms) * 1000;
+  uint64_t active_us = total_us;
+  uint64_t charge = 0;
+
+  if(0 == total_us)
+  {
+    return PWR_CURRENT_ACTIVE_UA;
+  }
+
+  active_us -= min(active_us, sleep_us[Pwr_Mode_Modem] + sleep_us[Pwr_Mode_Light]);
+
+  charge += active_us * PWR_CURRENT_ACTIVE_UA;
+  charge += sleep_us[Pwr_Mode_Modem] * PWR_CURRENT_MODEM_UA;
+  charge += sleep_us[Pwr_Mode_Light] * PWR_CURRENT_LIGHT_UA;
+
+  return (uint32_t)(charge / total_us);
+}
+
+
+/*
+ * Pwr_GetWakes
+ *  - This function returns the number of wake ups since the mode was set
+ */
+uint32_t Pwr_Manager::Pwr_GetWakes()
+{
+  return wakes_deadline + wakes_latency;
+}
+
+
+/*
+ * Pwr_GetSleepTime
+ *  - This function returns the time (ms) spent sleeping since the mode was set
+ */
+uint32_t Pwr_Manager::Pwr_GetSleepTime()
+{
+  return (uint32_t)((sleep_us[Pwr_Mode_Modem] + sleep_us[Pwr_Mode_Light]) / 1000);
+}
+
+
+/*
+ * Pwr_GetMode
+ *  - This function returns the configured power mode
+ */
+Pwr_Mode_T Pwr_Manager::Pwr_GetMode()
+{
+  return mode;
+}
+
+
+/*
+ * Pwr_DebugPrint
+ *  - This function prints the power statistics on console
+ */
+void Pwr_Manager::Pwr_DebugPrint(Print &out)
+{
+  out.printf("PWR -> Mode: %s (%s), latency bound: %u ms\r\n", pwr_mode_name[mode],
+             (active_mode == mode) ? "active" : "suspended by portal", latency_ms);
+  out.printf("PWR -> Time: %u ms, sleeping: %u ms\r\n", (uint32_t)(millis() - stats_start_ms), Pwr_GetSleepTime());
+  out.printf("PWR -> Wakes: %u (next task: %u, latency bound: %u)\r\n",
+             Pwr_GetWakes(), wakes_deadline, wakes_latency);
+  out.printf("PWR -> Average current estimate: %u uA\r\n", Pwr_GetAvgCurrentUa());
+}
+
+
+/*
+ * Pwr_SetActiveMode
+ *  - This function configures the SDK sleep type
+ *  - Modem sleep is the SDK default, it is restored when the power saving is off
+ */
+void Pwr_Manager::Pwr_SetActiveMode(Pwr_Mode_T new_mode)
+{
+  if(Pwr_Mode_Light == new_mode)
+  {
+    gpio_pin_wakeup_enable(GPIO_ID_PIN(PWR_UART_RX_PIN), GPIO_PIN_INTR_LOLEVEL);
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
+  }
+  else
+  {
+    gpio_pin_wakeup_disable();
+    WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+  }
+
+  active_mode = new_mode;
+}
+
+
+/*
+ * Pwr_ResetStats
+ *  - This function restarts the statistics
+ */
+void Pwr_Manager::Pwr_ResetStats()
+{
+  stats_start_ms = millis();
+  wakes_deadline = 0;
+  wakes_latency = 0;
+  memset(sleep_us, 0, sizeof(sleep_us));
+}
+
+/* EOF */
@@ -0,0 +1,76 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       pwr_manager.h
+ */
+#ifndef _PWR_MANAGER_H_
+#define _PWR_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Default values - runtime values are kept by Param_Manager */
+#define PWR_MODE_DEFAULT            (Pwr_Mode_Off)
+#define PWR_LATENCY_MS              (100)
+
+/*
+ * Current estimates (uA) used for the average consumption report - ESP8266 datasheet values
+ *  - light sleep includes the DTIM beacon wake ups
+ */
+#define PWR_CURRENT_ACTIVE_UA       (70000)
+#define PWR_CURRENT_MODEM_UA        (15000)
+#define PWR_CURRENT_LIGHT_UA        (2000)
+
+/* UART RX pin - low level (start bit) wakes the CPU from light sleep */
+#define PWR_UART_RX_PIN             (3)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef enum Pwr_Mode_Tag
+{
+  Pwr_Mode_Off = 0,     /* busy polling */
+  Pwr_Mode_Modem,       /* CPU idles till the next task, radio sleeps between DTIM beacons */
+  Pwr_Mode_Light,       /* CPU and radio suspended till the next task, wake on network or serial */
+  Pwr_Mode_Last
+
+}Pwr_Mode_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Pwr_Manager
+{
+  public:
+    void Pwr_Init();
+    void Pwr_Apply();
+    void Pwr_Idle();
+    uint32_t Pwr_GetAvgCurrentUa();
+    uint32_t Pwr_GetWakes();
+    uint32_t Pwr_GetSleepTime();
+    Pwr_Mode_T Pwr_GetMode();
+    void Pwr_DebugPrint(Print &out = Serial);
+
+  private:
+    Pwr_Mode_T mode;
+    Pwr_Mode_T active_mode;
+    uint32_t latency_ms;
+
+    uint32_t stats_start_ms;
+    uint32_t wakes_deadline;
+    uint32_t wakes_latency;
+    uint64_t sleep_us[Pwr_Mode_Last];
+
+    void Pwr_SetActiveMode(Pwr_Mode_T new_mode);
+    void Pwr_ResetStats();
+};
+
+#endif /* _PWR_MANAGER_H_ */
+
+/* EOF */
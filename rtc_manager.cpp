@@ -0,0 +1,282 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       rtc_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "rtc_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define RTC_DATA_PAYLOAD_PTR(d)     ((const uint8_t *)&(d)->clock_ms)
+#define RTC_DATA_PAYLOAD_SIZE       (sizeof(Rtc_Data_T) - offsetof(Rtc_Data_T, clock_ms))
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* RTC memory handler */
+Rtc_Manager rtc;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Rtc_Init
+ *  - This function loads data from RTC memory (defaults after power on or if corrupted)
+ */
+void Rtc_Manager::Rtc_Init()
+{
+  bool valid = ESP.rtcUserMemoryRead(RTC_USER_MEMORY_OFFSET, (uint32_t *)&data, sizeof(data));
+
+  valid = valid &&
+          (RTC_DATA_MAGIC == data.magic) &&
+          (RTC_DATA_VERSION == data.version) &&
+          (sizeof(Rtc_Data_T) == data.length) &&
+          (Nvm_Crc32(RTC_DATA_PAYLOAD_PTR(&data), RTC_DATA_PAYLOAD_SIZE) == data.crc);
+
+  if(!valid)
+  {
+    LOG_WARN(Log_Module_Rtc, "No valid data: defaults loaded");
+
+    memset(&data, 0, sizeof(data));
+    data.magic = RTC_DATA_MAGIC;
+    data.version = RTC_DATA_VERSION;
+    data.length = sizeof(Rtc_Data_T);
+  }
+
+  /* Time does not stop for the reset - continue from the last stored value */
+  clock_base_ms = data.clock_ms;
+  last_refresh_ms = millis();
+
+  Rtc_Save();
+}
+
+
+/*
+ * Rtc_Process
+ *  - This function refreshes the clock stored in RTC memory
+ *  - This function should be called periodically in the loop
+ */
+void Rtc_Manager::Rtc_Process()
+{
+  if((millis() - last_refresh_ms) >= RTC_REFRESH_PERIOD_MS)
+  {
+    last_refresh_ms = millis();
+    Rtc_Save();
+  }
+}
+
+
+/*
+ * Rtc_Save
+ *  - This function updates the clock and CRC and writes data to RTC memory
+ */
+void Rtc_Manager::Rtc_Save()
+{
+  data.clock_ms = Rtc_GetTimeMs();
+  data.crc = Nvm_Crc32(RTC_DATA_PAYLOAD_PTR(&data), RTC_DATA_PAYLOAD_SIZE);
+
+  (void)ESP.rtcUserMemoryWrite(RTC_USER_MEMORY_OFFSET, (uint32_t *)&data, sizeof(data));
+}
+
+
+/*
+ * Rtc_GetTimeMs
+ *  - This function returns time (ms) accumulated over resets
+ *  - Time spent in reset itself (and up to RTC_REFRESH_PERIOD_MS before it) is not counted
+ */
+uint32_t Rtc_Manager::Rtc_GetTimeMs()
+{
+  return clock_base_ms + millis();
+}
+
+
+/*
+ * Rtc_WiFiCacheGet
+ *  - This function returns the cached association if it belongs to the given SSID
+ *    and the IP lease is not expired
+ */
+bool Rtc_Manager::Rtc_WiFiCacheGet(const String &ssid, Rtc_WiFi_Cache_T &cache)
+{
+  uint32_t ssid_crc = Nvm_Crc32((const uint8_t *)ssid.c_str(), ssid.length());
+
+  if((0 == data.wifi.valid) || (ssid_crc != data.wifi.ssid_crc))
+  {
+    return false;
+  }
+
+  if((int32_t)(data.wifi.lease_expiry_ms - Rtc_GetTimeMs()) <= 0)
+  {
+    LOG_INFO(Log_Module_Rtc, "Cached IP lease expired");
+    Rtc_WiFiCacheInvalidate();
+    return false;
+  }
+
+  cache = data.wifi;
+  return true;
+}
+
+
+/*
+ * Rtc_WiFiCacheSet
+ *  - This function stores the last good association of the given SSID
+ */
+void Rtc_Manager::Rtc_WiFiCacheSet(const String &ssid, const Rtc_WiFi_Cache_T &cache)
+{
+  data.wifi = cache;
+  data.wifi.ssid_crc = Nvm_Crc32((const uint8_t *)ssid.c_str(), ssid.length());
+  data.wifi.valid = 1;
+
+  Rtc_Save();
+}
+
+
+/*
+ * Rtc_WiFiCacheInvalidate
+ *  - This function drops the cached association (full scan and DHCP will be used)
+ */
+void Rtc_Manager::Rtc_WiFiCacheInvalidate()
+{
+  if(0 != data.wifi.valid)
+  {
+    memset(&data.wifi, 0, sizeof(data.wifi));
+    Rtc_Save();
+  }
+}
+
+
+/*
+ * Rtc_SamplePush
+ *  - This function appends the sample to the backlog (the oldest one is dropped when full)
+ */
+void Rtc_Manager::Rtc_SamplePush(const Rtc_Sample_T &sample)
+{
+  if(RTC_SAMPLE_BACKLOG_MAX == data.sample_cnt)
+  {
+    Rtc_SampleDrop();
+    data.dsleep.dropped++;
+  }
+
+  data.samples[(data.sample_head + data.sample_cnt) % RTC_SAMPLE_BACKLOG_MAX] = sample;
+  data.sample_cnt++;
+
+  Rtc_Save();
+}
+
+
+/*
+ * Rtc_SamplePeek
+ *  - This function returns the oldest sample of the backlog (false - backlog is empty)
+ */
+bool Rtc_Manager::Rtc_SamplePeek(Rtc_Sample_T &sample)
+{
+  if(0 == data.sample_cnt)
+  {
+    return false;
+  }
+
+  sample = data.samples[data.sample_head];
+  return true;
+}
+
+
+/*
+ * Rtc_SampleDrop
+ *  - This function removes the oldest sample from the backlog
+ *  - RTC memory is written by Rtc_Save() (or before the sleep)
+ */
+void Rtc_Manager::Rtc_SampleDrop()
+{
+  if(0 != data.sample_cnt)
+  {
+    data.sample_head = (data.sample_head + 1) % RTC_SAMPLE_BACKLOG_MAX;
+    data.sample_cnt--;
+  }
+}
+
+
+/*
+ * Rtc_SampleCount
+ *  - This function returns the number of samples in the backlog
+ */
+uint8_t Rtc_Manager::Rtc_SampleCount()
+{
+  return data.sample_cnt;
+}
+
+
+/*
+ * Rtc_DsleepStats
+ *  - This function returns the deep sleep statistics (written by the next Rtc_Save())
+ */
+Rtc_Dsleep_Stats_T &Rtc_Manager::Rtc_DsleepStats()
+{
+  return data.dsleep;
+}
+
+
+/*
+ * Rtc_PrepareSleep
+ *  - This function stores the data with the clock moved forward by the sleep time
+ *  - It has to be the last RTC write before the deep sleep
+ */
+void Rtc_Manager::Rtc_PrepareSleep(uint32_t sleep_ms)
+{
+  clock_base_ms += sleep_ms;
+  Rtc_Save();
+}
+
+
+/*
+ * Rtc_GpioGet
+ *  - This function returns the stored GPIO output state (false - cold boot, nothing stored)
+ */
+bool Rtc_Manager::Rtc_GpioGet(uint8_t &state)
+{
+  state = data.gpio_state;
+  return (0 != data.gpio_valid);
+}
+
+
+/*
+ * Rtc_GpioSet
+ *  - This function stores the GPIO output state (RTC memory - no flash wear)
+ */
+void Rtc_Manager::Rtc_GpioSet(uint8_t state)
+{
+  data.gpio_state = state;
+  data.gpio_valid = 1;
+
+  Rtc_Save();
+}
+
+
+/*
+ * Rtc_DebugPrint
+ *  - This function prints data kept in RTC memory on console
+ */
+void Rtc_Manager::Rtc_DebugPrint(Print &out)
+{
+  out.printf("RTC -> Clock: %u ms\r\n", Rtc_GetTimeMs());
+
+  if(0 != data.wifi.valid)
+  {
+    out.printf("RTC -> BSSID: %02X:%02X:%02X:%02X:%02X:%02X, channel: %u\r\n",
+               data.wifi.bssid[0], data.wifi.bssid[1], data.wifi.bssid[2],
+               data.wifi.bssid[3], data.wifi.bssid[4], data.wifi.bssid[5], data.wifi.channel);
+    out.printf("RTC -> IP: %s, lease left: %d ms\r\n", IPAddress(data.wifi.ip).toString().c_str(),
+               (int32_t)(data.wifi.lease_expiry_ms - Rtc_GetTimeMs()));
+  }
+  else
+  {
+    out.printf("RTC -> No cached association\r\n");
+  }
+}
+
+/* EOF */
@@ -0,0 +1,141 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       rtc_manager.h
+ */
+#ifndef _RTC_MANAGER_H_
+#define _RTC_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "nvm_bank.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* RTC user memory is addressed in 4 byte blocks - first 128 bytes are used by OTA */
+#define RTC_USER_MEMORY_OFFSET      (32)
+#define RTC_USER_MEMORY_SIZE_BYTE   (384)
+
+#define RTC_DATA_MAGIC              ((uint32_t)0x52544344)  /* "RTCD" */
+#define RTC_DATA_VERSION            ((uint16_t)3)
+
+/* Period of refreshing the clock kept in RTC memory */
+#define RTC_REFRESH_PERIOD_MS       (10000)
+
+/* Unsent samples kept over deep sleep - the oldest one is dropped when full */
+#define RTC_SAMPLE_BACKLOG_MAX      (8)
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Last good WiFi association - used for fast reconnect */
+typedef struct Rtc_WiFi_Cache_Tag
+{
+  uint32_t ssid_crc;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t valid;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t mask;
+  uint32_t dns;
+  uint32_t lease_expiry_ms;
+
+}Rtc_WiFi_Cache_T;
+
+/* Single sensor sample in fixed point */
+typedef struct Rtc_Sample_Tag
+{
+  uint32_t seq;
+  uint32_t time_ms;
+  int16_t temperature_cdeg;   /* 0.01 degC */
+  uint16_t humidity_cpct;     /* 0.01 % */
+  uint32_t pressure_pa;
+  uint16_t light;
+  uint16_t reserved;
+
+}Rtc_Sample_T;
+
+/* Deep sleep duty cycle statistics */
+typedef struct Rtc_Dsleep_Stats_Tag
+{
+  uint32_t cycles;
+  uint32_t samples;
+  uint32_t published;
+  uint32_t dropped;
+  uint32_t last_awake_ms;
+  uint32_t total_awake_ms;
+
+}Rtc_Dsleep_Stats_T;
+
+/* Data kept in RTC memory - survives software reset and deep sleep, lost on power off */
+typedef struct Rtc_Data_Tag
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t crc;
+
+  /* Time (ms) accumulated over resets */
+  uint32_t clock_ms;
+
+  Rtc_WiFi_Cache_T wifi;
+
+  /* Deep sleep telemetry */
+  Rtc_Dsleep_Stats_T dsleep;
+  uint8_t sample_head;
+  uint8_t sample_cnt;
+  uint16_t reserved;
+  Rtc_Sample_T samples[RTC_SAMPLE_BACKLOG_MAX];
+
+  /* Remote accessed GPIO outputs - bit n is GpioPin[n] */
+  uint8_t gpio_valid;
+  uint8_t gpio_state;
+  uint16_t gpio_reserved;
+
+}Rtc_Data_T;
+
+static_assert(0 == (sizeof(Rtc_Data_T) % 4), "RTC data must be 4 byte aligned");
+static_assert(sizeof(Rtc_Data_T) <= RTC_USER_MEMORY_SIZE_BYTE, "RTC data does not fit RTC user memory");
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Rtc_Manager
+{
+  public:
+    void Rtc_Init();
+    void Rtc_Process();
+    void Rtc_Save();
+    uint32_t Rtc_GetTimeMs();
+
+    /* WiFi association cache related methods */
+    bool Rtc_WiFiCacheGet(const String &ssid, Rtc_WiFi_Cache_T &cache);
+    void Rtc_WiFiCacheSet(const String &ssid, const Rtc_WiFi_Cache_T &cache);
+    void Rtc_WiFiCacheInvalidate();
+    void Rtc_DebugPrint(Print &out = Serial);
+
+    /* Deep sleep telemetry related methods */
+    void Rtc_SamplePush(const Rtc_Sample_T &sample);
+    bool Rtc_SamplePeek(Rtc_Sample_T &sample);
+    void Rtc_SampleDrop();
+    uint8_t Rtc_SampleCount();
+    Rtc_Dsleep_Stats_T &Rtc_DsleepStats();
+    void Rtc_PrepareSleep(uint32_t sleep_ms);
+
+    /* GPIO output state related methods */
+    bool Rtc_GpioGet(uint8_t &state);
+    void Rtc_GpioSet(uint8_t state);
+
+  private:
+    Rtc_Data_T data;
+    uint32_t clock_base_ms;
+    uint32_t last_refresh_ms;
+};
+
+#endif /* _RTC_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,498 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       rule_manager.cpp
+ *
+ *  Sensor to GPIO rules:
+ *    - rule text "<channel> <>|<> <on> [off <off>] [for <s>] then <gpio> [level]" is compiled
+ *      to the fixed-size table entry (Nvm_Rule_T) and stored in NvM
+ *      ex. "hum > 70 off 60 then 14" - D5 ON above 70 %, OFF below 60 %
+ *    - values are compared as scaled integers, channel value which did not change since the
+ *      previous sample does not evaluate its rules again
+ *    - "for <s>" - condition has to hold for the time window before the output is switched
+ *    - outputs are switched only on the rule transition, manual control stays until then
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "rule_manager.h"
+#include "gpio_manager.h"
+#include "pwm_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Channel name and fixed point scale of the compiled thresholds */
+typedef struct Rule_Channel_Desc_Tag
+{
+  const char *name;
+  uint8_t scale;
+  uint8_t decimals;
+
+}Rule_Channel_Desc_T;
+
+static_assert(NVM_RULES_MAX <= 8, "Rule masks are 8 bits wide");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Rule engine handler */
+Rule_Manager rule_engine;
+
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Gpio handler */
+extern Gpio_Manager gpio;
+
+/* Temperature in 0.01 degC, humidity in 0.01 %, pressure in 0.1 hPa, light in ADC counts */
+static const Rule_Channel_Desc_T rule_channels[Rule_Channel_Last] =
+{
+  /* name     scale   decimals */
+  {"temp",    100,    2 },
+  {"hum",     100,    2 },
+  {"pres",    10,     1 },
+  {"light",   1,      0 },
+};
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static bool Rule_Scale(const char *text, Rule_Channel_T channel, int16_t &scaled);
+static void Rule_PrintValue(String &out, Rule_Channel_T channel, int16_t scaled);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Rule_Init
+ *  - This function loads the compiled rules from NvM
+ */
+void Rule_Manager::Rule_Init()
+{
+  eeprom.Nvm_RulesRead(rules);
+
+  memset(state, 0, sizeof(state));
+  value_valid = 0;
+  pending = 0;
+  samples = 0;
+  evaluated = 0;
+  skipped = 0;
+  switches = 0;
+
+  Rule_Build();
+}
+
+
+/*
+ * Rule_OnSample
+ *  - This function evaluates the rules depending on the channels changed by the last sample
+ *    and the rules waiting for their time window
+ *  - Invalid (NaN) channel value does not switch any output
+ *  - This function should be called after every sensor measurement
+ */
+void Rule_Manager::Rule_OnSample(const Sensor::Sensor_Values_T &val)
+{
+  const float raw[Rule_Channel_Last] = {val.temperature, val.humidity, val.pressure, (float)val.light};
+  uint8_t used = 0;
+  uint8_t eval = pending;
+
+  for(uint8_t ch = 0; ch < Rule_Channel_Last; ch++)
+  {
+    int32_t scaled = lroundf(raw[ch] * rule_channels[ch].scale);
+
+    used |= channel_rules[ch];
+
+    if(raw[ch] != raw[ch])
+    {
+      value_valid &= ~(1 << ch);
+      continue;
+    }
+
+    scaled = constrain(scaled, INT16_MIN, INT16_MAX);
+
+    if((0 == (value_valid & (1 << ch))) || (scaled != value[ch]))
+    {
+      value[ch] = (int16_t)scaled;
+      value_valid |= (1 << ch);
+      eval |= channel_rules[ch];
+    }
+  }
+
+  samples++;
+
+  for(uint8_t idx = 0; idx < NVM_RULES_MAX; idx++)
+  {
+    if(0 != (eval & (1 << idx)))
+    {
+      Rule_Evaluate(idx);
+      evaluated++;
+    }
+    else if(0 != (used & (1 << idx)))
+    {
+      skipped++;
+    }
+  }
+}
+
+
+/*
+ * Rule_Add
+ *  - This function compiles the rule and stores it in the first free entry
+ *  - It returns the rule index or -1 (syntax error, no free entry or NvM write error)
+ */
+int8_t Rule_Manager::Rule_Add(const char *text)
+{
+  Nvm_Rule_T rule;
+
+  if(!Rule_Compile(text, rule))
+  {
+    return -1;
+  }
+
+  for(uint8_t idx = 0; idx < NVM_RULES_MAX; idx++)
+  {
+    if(Rule_Op_None == rules[idx].op)
+    {
+      rules[idx] = rule;
+
+      if(!eeprom.Nvm_RulesWrite(rules))
+      {
+        rules[idx].op = Rule_Op_None;
+        return -1;
+      }
+
+      memset(&state[idx], 0, sizeof(state[idx]));
+      Rule_Build();
+
+      /* Evaluated with the next sample even if no channel changes */
+      value_valid &= ~(1 << rule.channel);
+      return (int8_t)idx;
+    }
+  }
+
+  return -1;
+}
+
+
+/*
+ * Rule_Del
+ *  - This function removes the rule (output is left in its current state)
+ */
+bool Rule_Manager::Rule_Del(uint8_t idx)
+{
+  if((idx >= NVM_RULES_MAX) || (Rule_Op_None == rules[idx].op))
+  {
+    return false;
+  }
+
+  memset(&rules[idx], 0, sizeof(rules[idx]));
+  pending &= ~(1 << idx);
+  Rule_Build();
+
+  return eeprom.Nvm_RulesWrite(rules);
+}
+
+
+/*
+ * Rule_Dump
+ *  - This function appends all rules with their state and the evaluation statistics to out
+ */
+void Rule_Manager::Rule_Dump(String &out)
+{
+  for(uint8_t idx = 0; idx < NVM_RULES_MAX; idx++)
+  {
+    if(Rule_Op_None == rules[idx].op)
+    {
+      continue;
+    }
+
+    out += "RULE -> " + String(idx + 1) + ": ";
+    Rule_Format(rules[idx], out);
+    out += state[idx].active ? " (ON" : " (OFF";
+    out += (0 != (pending & (1 << idx))) ? ", window running)\r\n" : ")\r\n";
+  }
+
+  out += "RULE -> Samples: " + String(samples) + ", evaluated: " + String(evaluated) +
+         ", skipped (unchanged): " + String(skipped) + ", switches: " + String(switches) + "\r\n";
+}
+
+
+/*
+ * Rule_Compile
+ *  - This function converts the rule text into the table entry
+ */
+bool Rule_Manager::Rule_Compile(const char *text, Nvm_Rule_T &rule)
+{
+  char buf[RULE_TEXT_MAX_SIZE + 1];
+  char *tok;
+  char *end;
+  bool off_given = false;
+  bool then_given = false;
+  int16_t on_thr;
+  int16_t off_thr;
+  uint8_t ch;
+
+  if(strlen(text) > RULE_TEXT_MAX_SIZE)
+  {
+    return false;
+  }
+
+  strcpy(buf, text);
+  memset(&rule, 0, sizeof(rule));
+  rule.level = PWM_LEVEL_MAX;
+
+  /* Channel */
+  tok = strtok(buf, " ");
+
+  for(ch = 0; (NULL != tok) && (ch < Rule_Channel_Last); ch++)
+  {
+    if(0 == strcmp(tok, rule_channels[ch].name))
+    {
+      break;
+    }
+  }
+
+  if((NULL == tok) || (ch >= Rule_Channel_Last))
+  {
+    return false;
+  }
+
+  rule.channel = ch;
+
+  /* Condition */
+  tok = strtok(NULL, " ");
+
+  if((NULL == tok) || (('>' != tok[0]) && ('<' != tok[0])) || ('\0' != tok[1]))
+  {
+    return false;
+  }
+
+  rule.op = ('>' == tok[0]) ? Rule_Op_Above : Rule_Op_Below;
+
+  if(!Rule_Scale(strtok(NULL, " "), (Rule_Channel_T)ch, on_thr))
+  {
+    return false;
+  }
+
+  /* Options and the output */
+  while(!then_given && (NULL != (tok = strtok(NULL, " "))))
+  {
+    if(0 == strcmp(tok, "off"))
+    {
+      off_given = Rule_Scale(strtok(NULL, " "), (Rule_Channel_T)ch, off_thr);
+
+      if(!off_given)
+      {
+        return false;
+      }
+    }
+    else if(0 == strcmp(tok, "for"))
+    {
+      tok = strtok(NULL, " ");
+      unsigned long window_s = (NULL != tok) ? strtoul(tok, &end, 10) : 0;
+
+      if((NULL == tok) || ('\0' != *end) || (window_s > UINT16_MAX))
+      {
+        return false;
+      }
+
+      rule.window_s = (uint16_t)window_s;
+    }
+    else if(0 == strcmp(tok, "then"))
+    {
+      then_given = true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  tok = strtok(NULL, " ");
+
+  if(!then_given || (NULL == tok) || !gpio.Gpio_FindPin(strtoul(tok, &end, 10), rule.pin_id) || ('\0' != *end))
+  {
+    return false;
+  }
+
+  tok = strtok(NULL, " ");
+
+  if(NULL != tok)
+  {
+    unsigned long level = strtoul(tok, &end, 10);
+
+    if(('\0' != *end) || (level > PWM_LEVEL_MAX) || (NULL != strtok(NULL, " ")))
+    {
+      return false;
+    }
+
+    rule.level = (uint8_t)level;
+  }
+
+  /* No hysteresis by default - off threshold must not be on the ON side */
+  rule.on_thr = on_thr;
+  rule.off_thr = off_given ? off_thr : on_thr;
+
+  return (Rule_Op_Above == rule.op) ? (rule.off_thr <= rule.on_thr) : (rule.off_thr >= rule.on_thr);
+}
+
+
+/*
+ * Rule_Format
+ *  - This function appends the rule text of the table entry to out
+ */
+void Rule_Manager::Rule_Format(const Nvm_Rule_T &rule, String &out)
+{
+  out += rule_channels[rule.channel].name;
+  out += (Rule_Op_Above == rule.op) ? " > " : " < ";
+  Rule_PrintValue(out, (Rule_Channel_T)rule.channel, rule.on_thr);
+
+  if(rule.off_thr != rule.on_thr)
+  {
+    out += " off ";
+    Rule_PrintValue(out, (Rule_Channel_T)rule.channel, rule.off_thr);
+  }
+
+  if(0 != rule.window_s)
+  {
+    out += " for " + String(rule.window_s);
+  }
+
+  out += " then " + String(GpioPin[rule.pin_id]) + " " + String(rule.level);
+}
+
+
+/*
+ * Rule_Build
+ *  - This function rebuilds the channel to rule dependency masks
+ */
+void Rule_Manager::Rule_Build()
+{
+  memset(channel_rules, 0, sizeof(channel_rules));
+
+  for(uint8_t idx = 0; idx < NVM_RULES_MAX; idx++)
+  {
+    /* Entry from newer firmware or corrupted one is ignored */
+    if((Rule_Op_None == rules[idx].op) || (rules[idx].op > Rule_Op_Below) ||
+       (rules[idx].channel >= Rule_Channel_Last) || (rules[idx].pin_id >= GPIO_REMOTE_USED))
+    {
+      rules[idx].op = Rule_Op_None;
+      continue;
+    }
+
+    channel_rules[rules[idx].channel] |= (1 << idx);
+  }
+}
+
+
+/*
+ * Rule_Evaluate
+ *  - This function switches the output when the rule changes its state (after the time window)
+ */
+void Rule_Manager::Rule_Evaluate(uint8_t idx)
+{
+  const Nvm_Rule_T *r = &rules[idx];
+  Rule_State_T *st = &state[idx];
+  int16_t v = value[r->channel];
+  bool want;
+
+  if(0 == (value_valid & (1 << r->channel)))
+  {
+    return;
+  }
+
+  /* Active rule is released only after crossing the off threshold (hysteresis) */
+  if(Rule_Op_Above == r->op)
+  {
+    want = st->active ? (v >= r->off_thr) : (v > r->on_thr);
+  }
+  else
+  {
+    want = st->active ? (v <= r->off_thr) : (v < r->on_thr);
+  }
+
+  if(want == st->active)
+  {
+    pending &= ~(1 << idx);
+    return;
+  }
+
+  if(0 != r->window_s)
+  {
+    if(0 == (pending & (1 << idx)))
+    {
+      pending |= (1 << idx);
+      st->since_ms = millis();
+      return;
+    }
+
+    if((millis() - st->since_ms) < ((uint32_t)r->window_s * 1000))
+    {
+      return;
+    }
+  }
+
+  pending &= ~(1 << idx);
+  st->active = want;
+  switches++;
+
+  gpio.Gpio_SetLevel(r->pin_id, want ? r->level : 0, 0);
+  LOG_INFO(Log_Module_Rule, "%u: GPIO %u %s", idx + 1, GpioPin[r->pin_id], want ? "ON" : "OFF");
+}
+
+
+/*
+ * Rule_Scale
+ *  - This function converts the threshold text into the scaled channel value
+ */
+static bool Rule_Scale(const char *text, Rule_Channel_T channel, int16_t &scaled)
+{
+  char *end;
+  float f;
+  int32_t v;
+
+  if(NULL == text)
+  {
+    return false;
+  }
+
+  f = strtof(text, &end);
+  v = lroundf(f * rule_channels[channel].scale);
+
+  if(('\0' != *end) || (end == text) || (v < INT16_MIN) || (v > INT16_MAX))
+  {
+    return false;
+  }
+
+  scaled = (int16_t)v;
+  return true;
+}
+
+
+/*
+ * Rule_PrintValue
+ *  - This function appends the scaled channel value as decimal number to out
+ */
+static void Rule_PrintValue(String &out, Rule_Channel_T channel, int16_t scaled)
+{
+  char buf[12];
+  uint16_t scale = rule_channels[channel].scale;
+  uint16_t v = (uint16_t)abs(scaled);
+
+  if(0 == rule_channels[channel].decimals)
+  {
+    snprintf(buf, sizeof(buf), "%d", scaled);
+  }
+  else
+  {
+    snprintf(buf, sizeof(buf), "%s%u.%0*u", (scaled < 0) ? "-" : "", v / scale, rule_channels[channel].decimals, v % scale);
+  }
+
+  out += buf;
+}
+
+/* EOF */
@@ -0,0 +1,93 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       rule_manager.h
+ */
+#ifndef _RULE_MANAGER_H_
+#define _RULE_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "nvm_manager.h"
+#include "snsr_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Longest rule text ("hum > 70 off 60 for 30 then 14 255") */
+#define RULE_TEXT_MAX_SIZE          (64)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Sensor channels - descriptor table in rule_manager.cpp has to follow this order */
+typedef enum Rule_Channel_Tag
+{
+  Rule_Channel_Temperature = 0,
+  Rule_Channel_Humidity,
+  Rule_Channel_Pressure,
+  Rule_Channel_Light,
+  Rule_Channel_Last
+
+}Rule_Channel_T;
+
+/* Condition - output is ON above (below) on_thr until the value crosses back off_thr */
+typedef enum Rule_Op_Tag
+{
+  Rule_Op_None = 0,
+  Rule_Op_Above,
+  Rule_Op_Below
+
+}Rule_Op_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Runtime state of the rule */
+typedef struct Rule_State_Tag
+{
+  bool active;
+  uint32_t since_ms;
+
+}Rule_State_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Rule_Manager
+{
+  public:
+    void Rule_Init();
+    void Rule_OnSample(const Sensor::Sensor_Values_T &val);
+    int8_t Rule_Add(const char *text);
+    bool Rule_Del(uint8_t idx);
+    void Rule_Dump(String &out);
+
+  private:
+    Nvm_Rule_T rules[NVM_RULES_MAX];
+    Rule_State_T state[NVM_RULES_MAX];
+
+    /* Bit n - rule n depends on the channel */
+    uint8_t channel_rules[Rule_Channel_Last];
+    int16_t value[Rule_Channel_Last];
+    uint8_t value_valid;
+
+    /* Rules waiting for the time window - evaluated on every sample */
+    uint8_t pending;
+
+    uint32_t samples;
+    uint32_t evaluated;
+    uint32_t skipped;
+    uint32_t switches;
+
+    bool Rule_Compile(const char *text, Nvm_Rule_T &rule);
+    void Rule_Format(const Nvm_Rule_T &rule, String &out);
+    void Rule_Build();
+    void Rule_Evaluate(uint8_t idx);
+};
+
+#endif /* _RULE_MANAGER_H_ */
+
+/* EOF */
@@ -0,0 +1,333 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       sched_manager.cpp
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "sched_manager.h"
+#include "prof_manager.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define SCHED_IS_DUE(t, now)      ((int32_t)((now) - (t)->due_ms) >= 0)
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Scheduler handler */
+Sched_Manager sched;
+
+/* Task descriptors */
+static const Sched_Desc_T sched_desc[Sched_Task_Last] =
+{
+  /* name             priority  deadline_ms */
+  {"wifi",            0,        50  },
+  {"est_conn_tmr",    1,        100 },
+  {"reconnect_tmr",   1,        100 },
+  {"ap_rollback_tmr", 1,        100 },
+  {"server",          2,        250 },
+  {"prov_dns",        2,        50  },
+  {"serial",          3,        100 },
+  {"sensor",          4,        500 },
+  {"rtc",             5,        50  },
+  {"dsleep",          5,        100 },
+  {"gpio_action",     1,        100 },
+  {"input",           1,        50  },
+  {"log",             6,        50  },
+  {"telem",           2,        20  },
+  {"console",         6,        100 },
+  {"mqtt",            5,        100 },
+  {"influx",          5,        100 },
+  {"coap",            2,        50  },
+};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Sched_Init
+ *  - This function clears the task table (all tasks stopped)
+ */
+void Sched_Manager::Sched_Init()
+{
+  memset(tasks, 0, sizeof(tasks));
+  Sched_ResetStats();
+}
+
+
+/*
+ * Sched_StartPeriodic
+ *  - This function (re)starts the task, first run is one period from now
+ */
+void Sched_Manager::Sched_StartPeriodic(Sched_Task_ID_T id, uint32_t period_ms, Sched_Callback_T callback)
+{
+  Sched_Start(id, period_ms, period_ms, callback);
+}
+
+
+/*
+ * Sched_StartOnce
+ *  - This function (re)starts the task which runs only once after the delay
+ */
+void Sched_Manager::Sched_StartOnce(Sched_Task_ID_T id, uint32_t delay_ms, Sched_Callback_T callback)
+{
+  Sched_Start(id, delay_ms, 0, callback);
+}
+
+
+/*
+ * Sched_Stop
+ *  - This function stops the task, accounting is kept
+ */
+void Sched_Manager::Sched_Stop(Sched_Task_ID_T id)
+{
+  if(id < Sched_Task_Last)
+  {
+    tasks[id].active = false;
+  }
+}
+
+
+/*
+ * Sched_SetPeriod
+ *  - This function changes the period of the periodic task, the callback is kept
+ *  - Next run is one new period from now (if it is not due earlier)
+ */
+void Sched_Manager::Sched_SetPeriod(Sched_Task_ID_T id, uint32_t period_ms)
+{
+  if((id >= Sched_Task_Last) || (0 == period_ms) || (0 == tasks[id].period_ms))
+  {
+    return;
+  }
+
+  uint32_t due_ms = millis() + period_ms;
+
+  tasks[id].period_ms = period_ms;
+
+  if((int32_t)(due_ms - tasks[id].due_ms) < 0)
+  {
+    tasks[id].due_ms = due_ms;
+  }
+}
+
+
+/*
+ * Sched_IsActive
+ *  - This function returns true if the task is waiting for its next run
+ */
+bool Sched_Manager::Sched_IsActive(Sched_Task_ID_T id)
+{
+  return (id < Sched_Task_Last) && tasks[id].active;
+}
+
+
+/*
+ * Sched_GetName
+ *  - This function returns the task name
+ */
+const char *Sched_Manager::Sched_GetName(Sched_Task_ID_T id)
+{
+  return (id < Sched_Task_Last) ? sched_desc[id].name : "?";
+}
+
+
+/*
+ * Sched_Run
+ *  - This function runs one due task - the one with the highest priority (earliest due on tie)
+ *  - It returns to the loop after every task so the SDK gets its time slice in between
+ *  - This function should be called periodically in the loop
+ */
+void Sched_Manager::Sched_Run()
+{
+  uint32_t now_ms = millis();
+  Sched_Task_T *task = nullptr;
+  uint8_t id = Sched_Task_Last;
+
+  for(uint8_t i = 0; i < Sched_Task_Last; i++)
+  {
+    Sched_Task_T *t = &tasks[i];
+
+    if(!t->active || !SCHED_IS_DUE(t, now_ms))
+    {
+      continue;
+    }
+
+    if((nullptr == task) ||
+       (sched_desc[i].priority < sched_desc[id].priority) ||
+       ((sched_desc[i].priority == sched_desc[id].priority) && ((int32_t)(t->due_ms - task->due_ms) < 0)))
+    {
+      task = t;
+      id = i;
+    }
+  }
+
+  PROF_MARK(Prof_Phase_Select);
+
+  if(nullptr == task)
+  {
+    return;
+  }
+
+  PROF_TASK(id);
+
+  uint32_t latency_ms = now_ms - task->due_ms;
+
+  /* Reschedule before the run - the callback may restart or stop the task itself */
+  if(0 == task->period_ms)
+  {
+    task->active = false;
+  }
+  else
+  {
+    task->due_ms += task->period_ms;
+
+    /* Missed periods are skipped instead of being run back to back */
+    if(SCHED_IS_DUE(task, now_ms))
+    {
+      task->due_ms = now_ms + task->period_ms;
+    }
+  }
+
+  uint32_t start_us = micros();
+  task->callback();
+  uint32_t run_us = micros() - start_us;
+  PROF_MARK(Prof_Phase_Task);
+
+  task->runs++;
+  task->run_total_us += run_us;
+
+  if(run_us > task->run_max_us)
+  {
+    task->run_max_us = run_us;
+  }
+
+  if(latency_ms > task->latency_max_ms)
+  {
+    task->latency_max_ms = latency_ms;
+  }
+
+  if((latency_ms + (run_us / 1000)) > sched_desc[id].deadline_ms)
+  {
+    task->overruns++;
+  }
+}
+
+
+/*
+ * Sched_GetNextDue
+ *  - This function returns time (ms) till the next task is due (0 - task is due now)
+ *  - UINT32_MAX is returned when no task is active
+ */
+uint32_t Sched_Manager::Sched_GetNextDue()
+{
+  uint32_t now_ms = millis();
+  uint32_t next_ms = UINT32_MAX;
+
+  for(uint8_t i = 0; i < Sched_Task_Last; i++)
+  {
+    const Sched_Task_T *t = &tasks[i];
+
+    if(!t->active)
+    {
+      continue;
+    }
+
+    if(SCHED_IS_DUE(t, now_ms))
+    {
+      return 0;
+    }
+
+    next_ms = min(next_ms, t->due_ms - now_ms);
+  }
+
+  return next_ms;
+}
+
+
+/*
+ * Sched_DebugPrint
+ *  - This function prints CPU share, worst case latency and overruns of all tasks on console
+ *  - Statistics are restarted after every print
+ */
+void Sched_Manager::Sched_DebugPrint(Print &out)
+{
+  uint64_t window_us = (uint64_t)(millis() - window_start_ms) * 1000;
+  uint64_t busy_us = 0;
+
+  if(0 == window_us)
+  {
+    window_us = 1;
+  }
+
+  out.printf("SCHED -> Window: %u ms\r\n", (uint32_t)(window_us / 1000));
+  out.printf("SCHED -> %-16s %4s %7s %8s %8s %6s %8s\r\n", "task", "prio", "period", "runs", "cpu[%]", "run_max", "late_max");
+
+  for(uint8_t i = 0; i < Sched_Task_Last; i++)
+  {
+    const Sched_Task_T *t = &tasks[i];
+    uint32_t share = (uint32_t)((t->run_total_us * 1000) / window_us);
+
+    busy_us += t->run_total_us;
+
+    out.printf("SCHED -> %-16s %4u %7u %8u %4u.%u %6uus %6ums%s%s\r\n",
+               sched_desc[i].name, sched_desc[i].priority, t->period_ms, t->runs,
+               share / 10, share % 10, t->run_max_us, t->latency_max_ms,
+               t->active ? "" : " (stopped)",
+               (0 != t->overruns) ? " OVERRUN" : "");
+
+    if(0 != t->overruns)
+    {
+      out.printf("SCHED ->   %u overruns (deadline %u ms)\r\n", t->overruns, sched_desc[i].deadline_ms);
+    }
+  }
+
+  uint32_t busy = (uint32_t)((busy_us * 1000) / window_us);
+  out.printf("SCHED -> Tasks: %u.%u%%, idle and SDK: %u.%u%%\r\n",
+             busy / 10, busy % 10, (1000 - min(busy, (uint32_t)1000)) / 10, (1000 - min(busy, (uint32_t)1000)) % 10);
+
+  Sched_ResetStats();
+}
+
+
+/*
+ * Sched_Start
+ *  - This function arms the task - called by the public start methods
+ */
+void Sched_Manager::Sched_Start(Sched_Task_ID_T id, uint32_t delay_ms, uint32_t period_ms, Sched_Callback_T callback)
+{
+  if((id >= Sched_Task_Last) || (nullptr == callback))
+  {
+    return;
+  }
+
+  tasks[id].callback = callback;
+  tasks[id].period_ms = period_ms;
+  tasks[id].due_ms = millis() + delay_ms;
+  tasks[id].active = true;
+}
+
+
+/*
+ * Sched_ResetStats
+ *  - This function restarts the accounting window of all tasks
+ */
+void Sched_Manager::Sched_ResetStats()
+{
+  for(uint8_t i = 0; i < Sched_Task_Last; i++)
+  {
+    tasks[i].runs = 0;
+    tasks[i].overruns = 0;
+    tasks[i].run_max_us = 0;
+    tasks[i].latency_max_ms = 0;
+    tasks[i].run_total_us = 0;
+  }
+
+  window_start_ms = millis();
+}
+
+/* EOF */
@@ -0,0 +1,121 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       sched_manager.h
+ */
+#ifndef _SCHED_MANAGER_H_
+#define _SCHED_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Polling periods of the loop tasks */
+#define SCHED_WIFI_PERIOD_MS        (10)
+#define SCHED_SERVER_PERIOD_MS      (5)
+#define SCHED_SERIAL_PERIOD_MS      (10)
+#define SCHED_PROV_PERIOD_MS        (10)
+#define SCHED_RTC_PERIOD_MS         (1000)
+#define SCHED_DSLEEP_PERIOD_MS      (10)
+#define SCHED_ACTION_PERIOD_MS      (100)
+#define SCHED_INPUT_PERIOD_MS       (10)
+#define SCHED_LOG_PERIOD_MS         (10)
+#define SCHED_CONSOLE_PERIOD_MS     (10)
+#define SCHED_MQTT_PERIOD_MS        (10)
+#define SCHED_INFLUX_PERIOD_MS      (10)
+#define SCHED_COAP_PERIOD_MS        (10)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef void (*Sched_Callback_T)(void);
+
+/* Tasks - descriptor table in sched_manager.cpp has to follow this order */
+typedef enum Sched_Task_ID_Tag
+{
+  Sched_Task_WiFi = 0,
+  Sched_Task_EstConnection,
+  Sched_Task_Reconnect,
+  Sched_Task_ApRollback,
+  Sched_Task_Server,
+  Sched_Task_Prov,
+  Sched_Task_Serial,
+  Sched_Task_Sensor,
+  Sched_Task_Rtc,
+  Sched_Task_Dsleep,
+  Sched_Task_Action,
+  Sched_Task_Input,
+  Sched_Task_Log,
+  Sched_Task_Telem,
+  Sched_Task_Console,
+  Sched_Task_Mqtt,
+  Sched_Task_Influx,
+  Sched_Task_Coap,
+  Sched_Task_Last
+
+}Sched_Task_ID_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/*
+ * Static task properties
+ *  - priority: lower value runs first when more tasks are due
+ *  - deadline_ms: max time from being due till the end of run, longer runs are counted as overrun
+ */
+typedef struct Sched_Desc_Tag
+{
+  const char *name;
+  uint8_t priority;
+  uint32_t deadline_ms;
+
+}Sched_Desc_T;
+
+/* Runtime state and accounting of single task */
+typedef struct Sched_Task_Tag
+{
+  Sched_Callback_T callback;
+  uint32_t period_ms;       /* 0 - one shot */
+  uint32_t due_ms;
+  bool active;
+
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t run_max_us;
+  uint32_t latency_max_ms;
+  uint64_t run_total_us;
+
+}Sched_Task_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Sched_Manager
+{
+  public:
+    void Sched_Init();
+    void Sched_StartPeriodic(Sched_Task_ID_T id, uint32_t period_ms, Sched_Callback_T callback);
+    void Sched_StartOnce(Sched_Task_ID_T id, uint32_t delay_ms, Sched_Callback_T callback);
+    void Sched_Stop(Sched_Task_ID_T id);
+    void Sched_SetPeriod(Sched_Task_ID_T id, uint32_t period_ms);
+    bool Sched_IsActive(Sched_Task_ID_T id);
+    const char *Sched_GetName(Sched_Task_ID_T id);
+    void Sched_Run();
+    uint32_t Sched_GetNextDue();
+    void Sched_DebugPrint(Print &out = Serial);
+
+  private:
+    Sched_Task_T tasks[Sched_Task_Last];
+    uint32_t window_start_ms;
+
+    void Sched_Start(Sched_Task_ID_T id, uint32_t delay_ms, uint32_t period_ms, Sched_Callback_T callback);
+    void Sched_ResetStats();
+};
+
+#endif /* _SCHED_MANAGER_H_ */
+
+/* EOF */
@@ -8,13 +8,25 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "serial_event.h"
+#include "console_manager.h"
+#include "mqtt_manager.h"
+#include "influx_manager.h"
+#include "coap_manager.h"
 
 /* ==================================================================== */
 /* ============================= defines ============================== */
 /* ==================================================================== */
 #define CREDENTIALS_CHANGE_COMPLETED()  (login_state == credentials_change_completed)
 
-#define REBOOT()                        Serial.printf("REBOOT -> Reboot in progress\r\n"); \
+#define SERIAL_CMD(name)                Fnv_Hash(name), name
+
+#define SERIAL_CTRL_U                   ('\x15')
+#define SERIAL_BACKSPACE                ('\x08')
+#define SERIAL_DELETE                   ('\x7F')
+#define SERIAL_ESC                      ('\x1B')
+
+#define REBOOT()                        LOG_INFO(Log_Module_System, "Reboot in progress"); \
+                                        logger.Log_Flush();                                \
                                         WiFi.disconnect();                                 \
                                         ESP.restart();                                     \
                                         while(1)
@@ -25,46 +37,795 @@
 /* Serial Event handler */
 Serial_Event serial_e;
 
-/* NvM handler */
-extern Nvm_Manager eeprom;
+/* NvM handler */
+extern Nvm_Manager eeprom;
+
+/* Sensor handler */
+extern Sensor sensor;
+
+/* GPIO handler */
+extern Gpio_Manager gpio;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* WiFi handler */
+extern WiFi_Manager wifi;
+
+/* Web server handler */
+extern Server_Manager server;
+
+/* RTC memory handler */
+extern Rtc_Manager rtc;
+
+/* Scheduler handler */
+extern Sched_Manager sched;
+
+/* Loop profiler handler */
+extern Prof_Manager prof;
+
+/* Power handler */
+extern Pwr_Manager pwr;
+
+/* Deep sleep handler */
+extern Dsleep_Manager dsleep;
+
+/* GPIO action handler */
+extern Action_Manager action;
+
+/* Rule engine handler */
+extern Rule_Manager rule_engine;
+
+/* Input handler */
+extern Input_Manager input;
+
+/* Telemetry handler */
+extern Telem_Manager telem;
+
+/* Console handler */
+extern Console_Manager console;
+
+/* MQTT handler */
+extern Mqtt_Manager mqtt;
+
+/* Influx handler */
+extern Influx_Manager influx;
+
+/* CoAP handler */
+extern Coap_Manager coap;
+
+/* Command table - dispatched by the hash of the name, name is compared to resolve collisions */
+const Serial_Cmd_T Serial_Event::cmds[] =
+{
+  {SERIAL_CMD("help"),         &Serial_Event::Serial_CmdHelp,       Serial_Args_None,      false,  "",                            "list of commands"                    },
+  {SERIAL_CMD("history"),      &Serial_Event::Serial_CmdHistory,    Serial_Args_None,      false,  "",                            "recent commands (arrow up/down)"     },
+  {SERIAL_CMD("reboot"),       &Serial_Event::Serial_CmdReboot,     Serial_Args_None,      false,  "",                            "restart the device"                  },
+  {SERIAL_CMD("ap_login"),     &Serial_Event::Serial_CmdApLogin,    Serial_Args_Optional,  true,   "[n]",                         "change AP credentials"               },
+  {SERIAL_CMD("ap_list"),      &Serial_Event::Serial_CmdApList,     Serial_Args_None,      false,  "",                            "configured APs"                      },
+  {SERIAL_CMD("scan"),         &Serial_Event::Serial_CmdScan,       Serial_Args_None,      true,   "",                            "scan for APs"                        },
+  {SERIAL_CMD("user_login"),   &Serial_Event::Serial_CmdUserLogin,  Serial_Args_None,      true,   "",                            "change website credentials"          },
+  {SERIAL_CMD("raw_eeprom"),   &Serial_Event::Serial_CmdRawEeprom,  Serial_Args_None,      false,  "",                            "raw NvM dump"                        },
+  {SERIAL_CMD("sensor"),       &Serial_Event::Serial_CmdSensor,     Serial_Args_None,      false,  "",                            "sensor values"                       },
+  {SERIAL_CMD("gpio"),         &Serial_Event::Serial_CmdGpio,       Serial_Args_None,      false,  "",                            "output states"                       },
+  {SERIAL_CMD("dim"),          &Serial_Event::Serial_CmdDim,        Serial_Args_Required,  false,  "<gpio> <level> [fade_ms]",    "set output level"                    },
+  {SERIAL_CMD("after"),        &Serial_Event::Serial_CmdAfter,      Serial_Args_Required,  false,  "<gpio> <level> <delay_ms>",   "set output level later"              },
+  {SERIAL_CMD("pulse"),        &Serial_Event::Serial_CmdPulse,      Serial_Args_Required,  false,  "<gpio> <length_ms>",          "switch output on for length_ms"      },
+  {SERIAL_CMD("cancel"),       &Serial_Event::Serial_CmdCancel,     Serial_Args_Required,  false,  "<handle>",                    "cancel pending action"               },
+  {SERIAL_CMD("sched"),        &Serial_Event::Serial_CmdSched,      Serial_Args_None,      false,  "",                            "clock, actions and schedules"        },
+  {SERIAL_CMD("sched_add"),    &Serial_Event::Serial_CmdSchedAdd,   Serial_Args_Required,  false,  "<gpio> <HH:MM> <level>",      "add daily schedule"                  },
+  {SERIAL_CMD("sched_del"),    &Serial_Event::Serial_CmdSchedDel,   Serial_Args_Required,  false,  "<n>",                         "remove daily schedule"               },
+  {SERIAL_CMD("ntp"),          &Serial_Event::Serial_CmdNtp,        Serial_Args_Optional,  false,  "[host]",                      "set SNTP server (empty - default)"   },
+  {SERIAL_CMD("log"),          &Serial_Event::Serial_CmdLog,        Serial_Args_Optional,  false,  "[<module|all> <0..3>]",       "log levels (0 - error .. 3 - debug)" },
+  {SERIAL_CMD("syslog"),       &Serial_Event::Serial_CmdSyslog,     Serial_Args_Optional,  false,  "[host]",                      "set syslog server (empty - off)"     },
+  {SERIAL_CMD("stream"),       &Serial_Event::Serial_CmdStream,     Serial_Args_Optional,  true,   "[on|off]",                    "binary telemetry stream"             },
+  {SERIAL_CMD("console"),      &Serial_Event::Serial_CmdConsole,    Serial_Args_None,      false,  "",                            "TCP console sessions"                },
+  {SERIAL_CMD("mqtt"),         &Serial_Event::Serial_CmdMqtt,       Serial_Args_None,      false,  "",                            "MQTT connection and queue"           },
+  {SERIAL_CMD("mqtt_broker"),  &Serial_Event::Serial_CmdMqttBroker, Serial_Args_Optional,  false,  "[host]",                      "set MQTT broker (empty - off)"       },
+  {SERIAL_CMD("influx"),       &Serial_Event::Serial_CmdInflux,     Serial_Args_None,      false,  "",                            "line protocol writer and rate"       },
+  {SERIAL_CMD("influx_url"),   &Serial_Event::Serial_CmdInfluxUrl,  Serial_Args_Optional,  false,  "[url]",                       "set /write URL (empty - off)"        },
+  {SERIAL_CMD("coap"),         &Serial_Event::Serial_CmdCoap,       Serial_Args_None,      false,  "",                            "CoAP endpoint and requests"          },
+  {SERIAL_CMD("inputs"),       &Serial_Event::Serial_CmdInputs,     Serial_Args_None,      false,  "",                            "digital input states"                },
+  {SERIAL_CMD("rules"),        &Serial_Event::Serial_CmdRules,      Serial_Args_None,      false,  "",                            "sensor rules"                        },
+  {SERIAL_CMD("rule_add"),     &Serial_Event::Serial_CmdRuleAdd,    Serial_Args_Required,  false,  "<rule>",                      "add sensor rule"                     },
+  {SERIAL_CMD("rule_del"),     &Serial_Event::Serial_CmdRuleDel,    Serial_Args_Required,  false,  "<n>",                         "remove sensor rule"                  },
+  {SERIAL_CMD("boot"),         &Serial_Event::Serial_CmdBoot,       Serial_Args_None,      false,  "",                            "boot timing"                         },
+  {SERIAL_CMD("rtc"),          &Serial_Event::Serial_CmdRtc,        Serial_Args_None,      false,  "",                            "RTC memory cache"                    },
+  {SERIAL_CMD("tasks"),        &Serial_Event::Serial_CmdTasks,      Serial_Args_None,      false,  "",                            "scheduler statistics"                },
+  {SERIAL_CMD("prof"),         &Serial_Event::Serial_CmdProf,       Serial_Args_None,      false,  "",                            "loop profile (reset after print)"    },
+  {SERIAL_CMD("power"),        &Serial_Event::Serial_CmdPower,      Serial_Args_None,      false,  "",                            "power management statistics"         },
+  {SERIAL_CMD("dsleep"),       &Serial_Event::Serial_CmdDsleep,     Serial_Args_None,      false,  "",                            "deep sleep telemetry state"          },
+  {SERIAL_CMD("params"),       &Serial_Event::Serial_CmdParams,     Serial_Args_None,      false,  "",                            "runtime parameters"                  },
+  {SERIAL_CMD("get"),          &Serial_Event::Serial_CmdGet,        Serial_Args_Required,  false,  "<name>",                      "print parameter"                     },
+  {SERIAL_CMD("set"),          &Serial_Event::Serial_CmdSet,        Serial_Args_Required,  false,  "<name> <value>",              "change parameter"                    }
+};
+
+#define SERIAL_CMD_COUNT                (sizeof(Serial_Event::cmds) / sizeof(Serial_Event::cmds[0]))
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Serial_Event Ctor
+ */
+Serial_Event::Serial_Event()
+{
+  Serial.begin(SERIAL_BAUDRATE);
+  out = &Serial;
+  login_state = credentials_change_completed;
+  ap_idx = 0;
+
+  new_ssid[0] = '\0';
+  new_username[0] = '\0';
+
+  line_len = 0;
+  line_overflow = false;
+  last_char = '\0';
+  esc = Serial_Esc_None;
+
+  history_head = 0;
+  history_count = 0;
+  history_pos = 0;
+}
+
+
+/*
+ * Serial_SetBaudrate
+ *  - This function switches UART to the configured baudrate (after parameters are loaded)
+ */
+void Serial_Event::Serial_SetBaudrate(uint32_t baudrate)
+{
+  if(baudrate != Serial.baudRate())
+  {
+    logger.Log_Flush();
+    Serial.updateBaudRate(baudrate);
+  }
+}
+
+
+/*
+ * Serial_ResumeReconnectTmr
+ *  - This function restarts reconnect timer stopped by the login commands
+ *  - Timer is started only when the WiFi connection is lost
+ */
+void Serial_Event::Serial_ResumeReconnectTmr()
+{
+  wifi.WiFi_ResumeRecovery();
+}
+
+
+/*
+ * Serial_CmdHelp
+ *  - This function prints the command table
+ */
+void Serial_Event::Serial_CmdHelp(const char *args)
+{
+  for(uint8_t idx = 0; idx < SERIAL_CMD_COUNT; idx++)
+  {
+    out->printf("  %-11s %-26s %s\r\n", cmds[idx].name, cmds[idx].usage, cmds[idx].help);
+  }
+}
+
+
+/*
+ * Serial_CmdHistory
+ *  - This function prints the recent command lines, the oldest first
+ */
+void Serial_Event::Serial_CmdHistory(const char *args)
+{
+  for(uint8_t n = history_count; n > 0; n--)
+  {
+    out->printf("  %u %s\r\n", n, history[(history_head + SERIAL_HISTORY_DEPTH - n) % SERIAL_HISTORY_DEPTH]);
+  }
+}
+
+
+/*
+ * Serial_CmdReboot
+ */
+void Serial_Event::Serial_CmdReboot(const char *args)
+{
+  REBOOT();
+}
+
+
+/*
+ * Serial_CmdApLogin
+ *  - "ap_login" - primary AP, "ap_login <n>" - entry n of the AP list
+ */
+void Serial_Event::Serial_CmdApLogin(const char *args)
+{
+  ap_idx = ('\0' != args[0]) ? (uint8_t)(atoi(args) - 1) : 0;
+
+  if(ap_idx < NVM_AP_LIST_MAX)
+  {
+    /* Stop reconnect timer */
+    Stop_reconnect_tmr();
+    out->printf("LOGIN AP -> Enter SSID (empty removes the AP)\r\n");
+    
+    login_state = ap_credentials_change_request;
+  }
+  else
+  {
+    out->printf("LOGIN AP -> AP number 1..%u\r\n", NVM_AP_LIST_MAX);
+  }
+}
+
+
+/*
+ * Serial_CmdApList
+ */
+void Serial_Event::Serial_CmdApList(const char *args)
+{
+  wifi.WiFi_ApListPrint(*out);
+}
+
+
+/*
+ * Serial_CmdScan
+ */
+void Serial_Event::Serial_CmdScan(const char *args)
+{
+  wifi.WiFi_ScanPrint();
+}
+
+
+/*
+ * Serial_CmdUserLogin
+ */
+void Serial_Event::Serial_CmdUserLogin(const char *args)
+{
+  /* Stop reconnect timer */
+  Stop_reconnect_tmr();
+  out->printf("LOGIN USER -> Enter USERNAME\r\n");
+  
+  login_state = user_credentials_change_request;
+}
+
+
+/*
+ * Serial_CmdRawEeprom
+ */
+void Serial_Event::Serial_CmdRawEeprom(const char *args)
+{
+  eeprom.NvM_ReadRawData(*out);
+}
+
+
+/*
+ * Serial_CmdSensor
+ */
+void Serial_Event::Serial_CmdSensor(const char *args)
+{
+  sensor.Sensor_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdGpio
+ */
+void Serial_Event::Serial_CmdGpio(const char *args)
+{
+  gpio.Gpio_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdDim
+ *  - This function handles "dim <gpio> <level> [fade_ms]" command
+ *  - gpio is the GPIO number as printed by "gpio" command, level 0..255
+ */
+void Serial_Event::Serial_CmdDim(const char *args)
+{
+  unsigned int pin;
+  unsigned int level;
+  unsigned int fade_ms = 0;
+  uint8_t pin_id;
+
+  if((sscanf(args, "%u %u %u", &pin, &level, &fade_ms) < 2) || (level > PWM_LEVEL_MAX))
+  {
+    out->printf("GPIO -> Usage: dim <gpio> <0..%u> [fade_ms]\r\n", PWM_LEVEL_MAX);
+    return;
+  }
+
+  if(!gpio.Gpio_FindPin(pin, pin_id))
+  {
+    out->printf("GPIO -> Unknown pin\r\n");
+    return;
+  }
+
+  gpio.Gpio_SetLevel(pin_id, (uint8_t)level, fade_ms);
+  out->printf("GPIO -> %u: level %u, fade %u ms\r\n", pin, level, fade_ms);
+}
+
+
+/*
+ * Serial_Action
+ *  - This function handles "after <gpio> <level> <delay_ms>" and "pulse <gpio> <length_ms>"
+ *  - Pending action can be cancelled with "cancel <handle>"
+ */
+void Serial_Event::Serial_Action(const char *args, bool pulse)
+{
+  unsigned int pin;
+  unsigned int level = 0;
+  unsigned int delay_ms;
+  uint8_t pin_id;
+  uint32_t handle;
+  int cnt;
+
+  cnt = pulse ? sscanf(args, "%u %u", &pin, &delay_ms) : sscanf(args, "%u %u %u", &pin, &level, &delay_ms);
+
+  if((cnt != (pulse ? 2 : 3)) || (level > PWM_LEVEL_MAX))
+  {
+    out->printf("ACTION -> Usage: after <gpio> <0..%u> <delay_ms>, pulse <gpio> <length_ms>\r\n", PWM_LEVEL_MAX);
+    return;
+  }
+
+  if(!gpio.Gpio_FindPin(pin, pin_id))
+  {
+    out->printf("GPIO -> Unknown pin\r\n");
+    return;
+  }
+
+  handle = pulse ? action.Action_Pulse(pin_id, delay_ms) : action.Action_After(pin_id, (uint8_t)level, delay_ms);
+
+  if(TMR_WHEEL_INVALID == handle)
+  {
+    out->printf("ACTION -> ERROR (max delay %u ms, %u actions)\r\n", ACTION_DELAY_MAX_MS, TMR_WHEEL_NODES_MAX);
+  }
+  else
+  {
+    out->printf("ACTION -> Handle %u\r\n", handle);
+  }
+}
+
+
+/*
+ * Serial_CmdAfter
+ */
+void Serial_Event::Serial_CmdAfter(const char *args)
+{
+  Serial_Action(args, false);
+}
+
+
+/*
+ * Serial_CmdPulse
+ */
+void Serial_Event::Serial_CmdPulse(const char *args)
+{
+  Serial_Action(args, true);
+}
+
+
+/*
+ * Serial_CmdCancel
+ */
+void Serial_Event::Serial_CmdCancel(const char *args)
+{
+  out->printf("ACTION -> %s\r\n", action.Action_Cancel(strtoul(args, nullptr, 10)) ? "Cancelled" : "Not pending");
+}
+
+
+/*
+ * Serial_CmdSched
+ */
+void Serial_Event::Serial_CmdSched(const char *args)
+{
+  String dump;
+  action.Action_Dump(dump);
+  out->print(dump);
+}
+
+
+/*
+ * Serial_CmdSchedAdd
+ *  - This function handles "sched_add <gpio> <HH:MM> <level>" command (daily, local time)
+ */
+void Serial_Event::Serial_CmdSchedAdd(const char *args)
+{
+  unsigned int pin;
+  unsigned int level;
+  char hhmm[8];
+  uint16_t minute;
+  uint8_t pin_id;
+  int8_t idx;
+
+  if((3 != sscanf(args, "%u %7s %u", &pin, hhmm, &level)) || (level > PWM_LEVEL_MAX) ||
+     !action.Action_ParseTime(hhmm, minute))
+  {
+    out->printf("ACTION -> Usage: sched_add <gpio> <HH:MM> <0..%u>\r\n", PWM_LEVEL_MAX);
+    return;
+  }
+
+  if(!gpio.Gpio_FindPin(pin, pin_id))
+  {
+    out->printf("GPIO -> Unknown pin\r\n");
+    return;
+  }
+
+  idx = action.Action_ScheduleAdd(pin_id, minute, (uint8_t)level);
+
+  if(idx < 0)
+  {
+    out->printf("ACTION -> Schedule NOT ADDED (max %u)\r\n", NVM_SCHEDULES_MAX);
+  }
+  else
+  {
+    out->printf("ACTION -> Schedule %d ADDED\r\n", idx + 1);
+  }
+}
+
+
+/*
+ * Serial_CmdSchedDel
+ */
+void Serial_Event::Serial_CmdSchedDel(const char *args)
+{
+  out->printf("ACTION -> Schedule %s\r\n", action.Action_ScheduleDel((uint8_t)(atoi(args) - 1)) ? "REMOVED" : "NOT REMOVED");
+}
+
+
+/*
+ * Serial_CmdNtp
+ *  - "ntp" - default server, "ntp <host>" - host name or IP (ex. local NTP server)
+ */
+void Serial_Event::Serial_CmdNtp(const char *args)
+{
+  if(!action.Action_SetNtpServer(args))
+  {
+    out->printf("ACTION -> SNTP server NOT CHANGED (max %u chars)\r\n", NVM_NTP_SERVER_MAX_SIZE);
+  }
+}
+
+
+/*
+ * Serial_CmdLog
+ *  - "log" - levels and statistics, "log <module|all> <level>" - runtime level (not stored)
+ */
+void Serial_Event::Serial_CmdLog(const char *args)
+{
+  char module[SERIAL_LINE_MAX_SIZE + 1];
+  const char *level = strchr(args, ' ');
+
+  if('\0' == args[0])
+  {
+    String dump;
+    logger.Log_Dump(dump);
+    out->print(dump);
+    return;
+  }
+
+  if(nullptr == level)
+  {
+    out->printf("LOG -> Usage: log <module|all> <0..3>\r\n");
+    return;
+  }
+
+  memcpy(module, args, level - args);
+  module[level - args] = '\0';
+
+  while(' ' == *level)
+  {
+    level++;
+  }
+
+  if(!isdigit(level[0]) || !logger.Log_SetLevel(module, (uint8_t)atoi(level)))
+  {
+    out->printf("LOG -> Unknown module or level\r\n");
+  }
+}
+
+
+/*
+ * Serial_CmdSyslog
+ *  - "syslog" - disabled, "syslog <host>" - host name or IP, protocol and port are parameters
+ */
+void Serial_Event::Serial_CmdSyslog(const char *args)
+{
+  if(!logger.Log_SetSyslogServer(args))
+  {
+    out->printf("LOG -> Syslog server NOT CHANGED (max %u chars)\r\n", NVM_SYSLOG_SERVER_MAX_SIZE);
+  }
+}
+
+
+/*
+ * Serial_CmdStream
+ *  - "stream" - state and statistics, "stream on|off" - binary telemetry stream
+ *    (baudrate and period are parameters)
+ */
+void Serial_Event::Serial_CmdStream(const char *args)
+{
+  if(0 == strcmp(args, "on"))
+  {
+    telem.Telem_Start();
+  }
+  else if(0 == strcmp(args, "off"))
+  {
+    telem.Telem_Stop();
+  }
+  else if('\0' == args[0])
+  {
+    String dump;
+    telem.Telem_Dump(dump);
+    out->print(dump);
+  }
+  else
+  {
+    out->printf("TELEM -> Usage: stream [on|off]\r\n");
+  }
+}
+
+
+/*
+ * Serial_CmdConsole
+ */
+void Serial_Event::Serial_CmdConsole(const char *args)
+{
+  String dump;
+
+  console.Console_Dump(dump);
+  out->print(dump);
+}
+
+
+/*
+ * Serial_CmdMqtt
+ */
+void Serial_Event::Serial_CmdMqtt(const char *args)
+{
+  String dump;
+
+  mqtt.Mqtt_Dump(dump);
+  out->print(dump);
+}
+
+
+/*
+ * Serial_CmdMqttBroker
+ *  - "mqtt_broker" - disabled, "mqtt_broker <host>" - host name or IP, port and keepalive are parameters
+ */
+void Serial_Event::Serial_CmdMqttBroker(const char *args)
+{
+  if(!mqtt.Mqtt_SetBroker(args))
+  {
+    out->printf("MQTT -> Broker NOT CHANGED (max %u chars)\r\n", NVM_MQTT_BROKER_MAX_SIZE);
+  }
+}
+
+
+/*
+ * Serial_CmdInflux
+ */
+void Serial_Event::Serial_CmdInflux(const char *args)
+{
+  String dump;
+
+  influx.Influx_Dump(dump);
+  out->print(dump);
+}
+
+
+/*
+ * Serial_CmdInfluxUrl
+ *  - "influx_url" - disabled, "influx_url http://host[:port]/write?db=<name>" - port 8086 by default
+ */
+void Serial_Event::Serial_CmdInfluxUrl(const char *args)
+{
+  if(!influx.Influx_SetUrl(args))
+  {
+    out->printf("INFLUX -> URL NOT CHANGED (http:// only, max %u chars)\r\n", NVM_INFLUX_URL_MAX_SIZE);
+  }
+}
+
+
+/*
+ * Serial_CmdCoap
+ */
+void Serial_Event::Serial_CmdCoap(const char *args)
+{
+  String dump;
+
+  coap.Coap_Dump(dump);
+  out->print(dump);
+}
+
+
+/*
+ * Serial_CmdInputs
+ */
+void Serial_Event::Serial_CmdInputs(const char *args)
+{
+  String dump;
+  input.Input_Dump(dump);
+  out->print(dump);
+}
+
 
-/* Sensor handler */
-extern Sensor sensor;
+/*
+ * Serial_CmdRules
+ */
+void Serial_Event::Serial_CmdRules(const char *args)
+{
+  String dump;
+  rule_engine.Rule_Dump(dump);
+  out->print(dump);
+}
 
-/* GPIO handler */
-extern Gpio_Manager gpio;
 
-/* ==================================================================== */
-/* ============================ functions ============================= */
-/* ==================================================================== */
+/*
+ * Serial_CmdRuleAdd
+ */
+void Serial_Event::Serial_CmdRuleAdd(const char *args)
+{
+  int8_t idx = rule_engine.Rule_Add(args);
+
+  if(idx < 0)
+  {
+    out->printf("RULE -> NOT ADDED - syntax: <temp|hum|pres|light> <>|<> <on> [off <off>] [for <s>] then <gpio> [level]\r\n");
+  }
+  else
+  {
+    out->printf("RULE -> Rule %d ADDED\r\n", idx + 1);
+  }
+}
+
 
 /*
- * Serial_Event Ctor
+ * Serial_CmdRuleDel
  */
-Serial_Event::Serial_Event()
+void Serial_Event::Serial_CmdRuleDel(const char *args)
 {
-  Serial.begin(SERIAL_BAUDRATE);
-  login_state = credentials_change_completed;
+  out->printf("RULE -> Rule %s\r\n", rule_engine.Rule_Del((uint8_t)(atoi(args) - 1)) ? "REMOVED" : "NOT REMOVED");
+}
 
-  /* Reserve bytes for inputString */
-  inputString = "";
-  new_ssid = "";
-  new_password = "";
-  new_username = "";
-  
-  inputString.reserve(EEPROM_CREDENTIAL_MAX_SIZE);
-  new_ssid.reserve(EEPROM_CREDENTIAL_MAX_SIZE);
-  new_password.reserve(EEPROM_CREDENTIAL_MAX_SIZE);
-  new_username.reserve(EEPROM_CREDENTIAL_MAX_SIZE);
+
+/*
+ * Serial_CmdBoot
+ */
+void Serial_Event::Serial_CmdBoot(const char *args)
+{
+  out->printf("BOOT -> Link up: %u ms\r\n", wifi.WiFi_GetLinkUpTime());
+  out->printf("BOOT -> First sample: %u ms\r\n", sensor.Sensor_GetFirstSampleTime());
+  out->printf("BOOT -> First HTTP response: %u ms\r\n", server.Server_GetFirstResponseTime());
+}
+
+
+/*
+ * Serial_CmdRtc
+ */
+void Serial_Event::Serial_CmdRtc(const char *args)
+{
+  rtc.Rtc_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdTasks
+ */
+void Serial_Event::Serial_CmdTasks(const char *args)
+{
+  sched.Sched_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdProf
+ */
+void Serial_Event::Serial_CmdProf(const char *args)
+{
+  String dump;
+  prof.Prof_Dump(dump);
+  prof.Prof_Reset();
+  out->print(dump);
+}
+
+
+/*
+ * Serial_CmdPower
+ */
+void Serial_Event::Serial_CmdPower(const char *args)
+{
+  pwr.Pwr_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdDsleep
+ */
+void Serial_Event::Serial_CmdDsleep(const char *args)
+{
+  dsleep.Dsleep_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdParams
+ */
+void Serial_Event::Serial_CmdParams(const char *args)
+{
+  param.Param_DebugPrint(*out);
+}
+
+
+/*
+ * Serial_CmdGet
+ *  - This function prints value of the runtime parameter ("get <name>")
+ */
+void Serial_Event::Serial_CmdGet(const char *args)
+{
+  Param_ID_T id;
+
+  if(param.Param_Find(args, id))
+  {
+    out->printf("PARAM -> %s: %s\r\n", args, param.Param_ToString(id).c_str());
+  }
+  else
+  {
+    out->printf("PARAM -> Unknown parameter\r\n");
+  }
+}
+
+
+/*
+ * Serial_CmdSet
+ *  - This function changes value of the runtime parameter ("set <name> <value>")
+ */
+void Serial_Event::Serial_CmdSet(const char *args)
+{
+  char name[SERIAL_LINE_MAX_SIZE + 1];
+  const char *value = strchr(args, ' ');
+
+  if(nullptr == value)
+  {
+    out->printf("PARAM -> Usage: set <name> <value>\r\n");
+    return;
+  }
+
+  memcpy(name, args, value - args);
+  name[value - args] = '\0';
+
+  while(' ' == *value)
+  {
+    value++;
+  }
+
+  switch(param.Param_SetByName(name, value))
+  {
+    case Param_Status_OK:
+    {
+      out->printf("PARAM -> %s: %s\r\n", name, value);
+      break;
+    }
+
+    case Param_Status_Unknown:
+    {
+      out->printf("PARAM -> Unknown parameter\r\n");
+      break;
+    }
+
+    case Param_Status_Range:
+    {
+      out->printf("PARAM -> Value out of range\r\n");
+      break;
+    }
+
+    default:
+    {
+      out->printf("PARAM -> NvM write ERROR\r\n");
+      break;
+    }
+  }
 }
 
 
 /*
- * Serial_ParseString
- *  - This function performs an action according to inputString given in
- *    the Serial_RxEvent
+ * Serial_Credentials
+ *  - This function takes the line entered after "ap_login" or "user_login" command
+ *  - Credential lines are not dispatched nor kept in the history
  */
-void Serial_Event::Serial_ParseString(String s)
+void Serial_Event::Serial_Credentials(const char *s)
 { 
   /* Status value of EEPROM write operation */
   bool eep_write_stat = EEPROM_WRITE_ERROR;
@@ -76,7 +837,8 @@ void Serial_Event::Serial_ParseString(String s)
      **********************************************/
     case ap_credentials_change_request:
     {
-      new_ssid = s;      
+      strncpy(new_ssid, s, EEPROM_CREDENTIAL_MAX_SIZE);
+      new_ssid[EEPROM_CREDENTIAL_MAX_SIZE] = '\0';
       login_state = ap_credentials_ssid_stored;
       
       Serial.printf("LOGIN AP -> Enter PASSWORD\r\n");
@@ -85,25 +847,34 @@ void Serial_Event::Serial_ParseString(String s)
 
     case ap_credentials_ssid_stored:
     {
-      new_password = s;
       login_state = credentials_change_completed;
       
       /* Write new AP credentials to the NvM */
-      eep_write_stat = eeprom.Nvm_CredentialsWrite(EEPROM_AP_CREDENTIALS_START_ADDR, new_ssid.c_str(), new_password.c_str(), strlen(new_ssid.c_str()), strlen(new_password.c_str()));
+      eep_write_stat = eeprom.Nvm_ApListWrite(ap_idx, new_ssid, s, strlen(new_ssid), strlen(s));
       
-      if(EEPROM_WRITE_ERROR != eep_write_stat)
+      if((EEPROM_WRITE_ERROR != eep_write_stat) && (0 == ap_idx))
       {
         Serial.printf("LOGIN AP -> Credentials CHANGED\r\n");
 
-        /* Reboot device */
-        REBOOT();
+        /* Connect to the new AP - previous one is restored on failure */
+        wifi.WiFi_Reassociate();
+      }
+      else if(EEPROM_WRITE_ERROR != eep_write_stat)
+      {
+        Serial.printf("LOGIN AP %u -> Credentials CHANGED\r\n", ap_idx + 1);
+
+        /* Used by the next AP selection */
+        wifi.WiFi_ReloadApList();
+        
+        /* Resume reconnect timer (only if the connection is lost) */
+        Serial_ResumeReconnectTmr();
       }
       else
       {
         Serial.printf("LOGIN AP -> Credentials NOT CHANGED\r\n");
 
-        /* Resume reconnect timer */
-        Start_reconnect_tmr(TMR_RECONNECT_TIMEOUT_MS);
+        /* Resume reconnect timer (only if the connection is lost) */
+        Serial_ResumeReconnectTmr();
       }
       
       break;
@@ -114,7 +885,8 @@ void Serial_Event::Serial_ParseString(String s)
      **********************************************/
     case user_credentials_change_request:
     {
-      new_username = s;      
+      strncpy(new_username, s, EEPROM_CREDENTIAL_MAX_SIZE);
+      new_username[EEPROM_CREDENTIAL_MAX_SIZE] = '\0';
       login_state = user_credentials_username_stored;
 
       Serial.printf("LOGIN USER -> Enter PASSWORD\r\n");
@@ -123,90 +895,221 @@ void Serial_Event::Serial_ParseString(String s)
 
     case user_credentials_username_stored:
     {
-      new_password = s;
       login_state = credentials_change_completed;
 
       /* Write new USER credentials to the NvM */
-      eep_write_stat = eeprom.Nvm_CredentialsWrite(EEPROM_USER_CREDENTIALS_START_ADDR, new_username.c_str(), new_password.c_str(), strlen(new_username.c_str()), strlen(new_password.c_str()));
+      eep_write_stat = eeprom.Nvm_CredentialsWrite(Nvm_Credentials_User, new_username, s, strlen(new_username), strlen(s));
       
       if(EEPROM_WRITE_ERROR != eep_write_stat)
       {
         Serial.printf("LOGIN USER -> Credentials CHANGED\r\n");
 
-        /* Reboot device */
-        REBOOT();
+        /* Apply new credentials to the website */
+        server.Server_ReloadCredentials();
+        
+        /* Resume reconnect timer (only if the connection is lost) */
+        Serial_ResumeReconnectTmr();
       }
       else
       {
         Serial.printf("LOGIN USER -> Credentials NOT CHANGED\r\n");
 
-        /* Restore reconnect timer */
-        Start_reconnect_tmr(TMR_RECONNECT_TIMEOUT_MS);
+        /* Resume reconnect timer (only if the connection is lost) */
+        Serial_ResumeReconnectTmr();
       }
       
       break;
     }
 
-    case credentials_change_completed:
+    default:
     {
+      Serial.printf("LOGIN -> Unexpected error\r\n");
+      login_state = credentials_change_completed;
       break;
     }
+  }
+}
 
-    default:
+
+/*
+ * Serial_Find
+ *  - This function returns the descriptor of the command (nullptr - unknown command)
+ */
+const Serial_Cmd_T *Serial_Event::Serial_Find(const char *name, uint8_t len)
+{
+  uint32_t hash = Fnv_HashLen(name, len);
+
+  for(uint8_t idx = 0; idx < SERIAL_CMD_COUNT; idx++)
+  {
+    if((hash == cmds[idx].hash) && (0 == strncmp(cmds[idx].name, name, len)) && ('\0' == cmds[idx].name[len]))
     {
-      Serial.printf("LOGIN -> Unexpected error\r\n");
-      break;
+      return &cmds[idx];
     }
   }
 
-  if((String("reboot") == s) && CREDENTIALS_CHANGE_COMPLETED())
+  return nullptr;
+}
+
+
+/*
+ * Serial_ParseLine
+ *  - This function performs an action according to the line completed in the Serial_RxEvent
+ *  - Trailing spaces are removed, the line is kept in the history
+ */
+void Serial_Event::Serial_ParseLine()
+{
+  if(!CREDENTIALS_CHANGE_COMPLETED())
   {
-    REBOOT();
+    Serial_Credentials(line);
+    return;
   }
-  
-  else if((String("ap_login") == s) && CREDENTIALS_CHANGE_COMPLETED())
+
+  while((line_len > 0) && (' ' == line[line_len - 1]))
   {
-    /* Stop reconnect timer */
-    Stop_reconnect_tmr();
-    Serial.printf("LOGIN AP -> Enter SSID\r\n");
-    
-    login_state = ap_credentials_change_request;
+    line[--line_len] = '\0';
   }
 
-  else if((String("user_login") == s) && CREDENTIALS_CHANGE_COMPLETED())
+  if(0 == line_len)
   {
-    /* Stop reconnect timer */
-    Stop_reconnect_tmr();
-    Serial.printf("LOGIN USER -> Enter USERNAME\r\n");
-    
-    login_state = user_credentials_change_request;
+    return;
+  }
+
+  Serial_HistoryAdd();
+  Serial_Dispatch(line, false);
+}
+
+
+/*
+ * Serial_Execute
+ *  - This function runs the command line received by the TCP console, output goes to target
+ *  - Lines are not kept in the history, interactive commands are refused
+ */
+void Serial_Event::Serial_Execute(char *cmd_line, Print &target)
+{
+  out = &target;
+  Serial_Dispatch(cmd_line, true);
+  out = &Serial;
+}
+
+
+/*
+ * Serial_Dispatch
+ *  - This function splits the line to the command name and the arguments and runs the handler
+ */
+void Serial_Event::Serial_Dispatch(char *cmd_line, bool remote)
+{
+  const Serial_Cmd_T *cmd;
+  char *args = cmd_line;
+  uint8_t name_len;
+
+  while(' ' == *args)
+  {
+    args++;
   }
 
-  else if((String("raw_eeprom") == s) && CREDENTIALS_CHANGE_COMPLETED())
+  name_len = 0;
+  while(('\0' != args[name_len]) && (' ' != args[name_len]))
   {
-    eeprom.NvM_ReadRawData();
+    name_len++;
   }
 
-  else if((String("sensor") == s) && CREDENTIALS_CHANGE_COMPLETED())
+  cmd = Serial_Find(args, name_len);
+  args += name_len;
+
+  while(' ' == *args)
   {
-    sensor.Sensor_DebugPrint();
+    args++;
   }
 
-  else if((String("gpio") == s) && CREDENTIALS_CHANGE_COMPLETED())
+  if(nullptr == cmd)
   {
-    gpio.Gpio_DebugPrint();
+    out->printf("CLI -> Unknown command, \"help\" lists the commands\r\n");
+  }
+  else if(remote && cmd->local_only)
+  {
+    out->printf("CLI -> \"%s\" is available on the serial port only\r\n", cmd->name);
+  }
+  else if(((Serial_Args_None == cmd->args) && ('\0' != args[0])) ||
+          ((Serial_Args_Required == cmd->args) && ('\0' == args[0])))
+  {
+    out->printf("CLI -> Usage: %s %s\r\n", cmd->name, cmd->usage);
   }
-  
   else
   {
-    if(CREDENTIALS_CHANGE_COMPLETED())
-    {
-      Serial.printf("OK\r\n");
-    }
+    (this->*cmd->handler)(args);
   }
-  
-  /* Clear the string */
-  inputString = "";
+}
+
+
+/*
+ * Serial_HistoryAdd
+ *  - This function stores the completed line, repeated line is stored once
+ */
+void Serial_Event::Serial_HistoryAdd()
+{
+  uint8_t newest = (history_head + SERIAL_HISTORY_DEPTH - 1) % SERIAL_HISTORY_DEPTH;
+
+  history_pos = 0;
+
+  if((history_count > 0) && (0 == strcmp(history[newest], line)))
+  {
+    return;
+  }
+
+  memcpy(history[history_head], line, line_len + 1);
+  history_head = (history_head + 1) % SERIAL_HISTORY_DEPTH;
+
+  if(history_count < SERIAL_HISTORY_DEPTH)
+  {
+    history_count++;
+  }
+}
+
+
+/*
+ * Serial_HistoryRecall
+ *  - This function replaces the edited line with the older (arrow up) or newer (arrow down)
+ *    line of the history, the line is empty past the newest one
+ */
+void Serial_Event::Serial_HistoryRecall(bool older)
+{
+  if(older && (history_pos < history_count))
+  {
+    history_pos++;
+  }
+  else if(!older && (history_pos > 0))
+  {
+    history_pos--;
+  }
+  else
+  {
+    return;
+  }
+
+  if(0 == history_pos)
+  {
+    line_len = 0;
+  }
+  else
+  {
+    const char *entry = history[(history_head + SERIAL_HISTORY_DEPTH - history_pos) % SERIAL_HISTORY_DEPTH];
+    line_len = strlen(entry);
+    memcpy(line, entry, line_len);
+  }
+
+  line_overflow = false;
+  Serial_Redraw();
+}
+
+
+/*
+ * Serial_Redraw
+ *  - This function prints the edited line again (clears the terminal line first)
+ */
+void Serial_Event::Serial_Redraw()
+{
+  Serial.print("\r\x1B[K");
+  Serial.write((const uint8_t *)line, line_len);
 }
 
 
@@ -215,22 +1118,117 @@ void Serial_Event::Serial_ParseString(String s)
  *  - SerialEvent occurs whenever a new data comes in the hardware serial RX. This
  *    routine is called periodically in the loop() function, so using delay inside loop can
  *    delay response. Multiple bytes of data may be available.
+ *  - Line editor - CR, LF or CRLF ends the line, backspace, Ctrl+U (clear line),
+ *    arrow up/down (history), echo enabled by "serial_echo" parameter
  */
 void Serial_Event::Serial_RxEvent()
 {
+  /* Echo would be mixed into the binary stream */
+  bool echo = (0 != param.Param_Get(Param_ID_SerialEcho)) && !telem.Telem_IsActive();
+
   while(Serial.available()) 
   {
     char inChar = (char)Serial.read();
+    char prevChar = last_char;
+
+    last_char = inChar;
+
+    /* Arrow keys - ESC [ A (up), ESC [ B (down) */
+    if(Serial_Esc_None != esc)
+    {
+      if((Serial_Esc_Start == esc) && ('[' == inChar))
+      {
+        esc = Serial_Esc_Csi;
+      }
+      else
+      {
+        if(Serial_Esc_Csi == esc)
+        {
+          if('A' == inChar)
+          {
+            Serial_HistoryRecall(true);
+          }
+          else if('B' == inChar)
+          {
+            Serial_HistoryRecall(false);
+          }
+        }
+
+        esc = Serial_Esc_None;
+      }
+
+      continue;
+    }
     
-    /* If the incoming character is a newline - set a flag */
-    if(inChar == '\n') 
+    if(('\r' == inChar) || ('\n' == inChar))
+    {
+      /* LF of CRLF - line has been completed by CR */
+      if(('\n' == inChar) && ('\r' == prevChar))
+      {
+        continue;
+      }
+
+      if(echo)
+      {
+        Serial.print("\r\n");
+      }
+
+      line[line_len] = '\0';
+
+      if(line_overflow)
+      {
+        Serial.printf("CLI -> Line too long (max %u chars)\r\n", SERIAL_LINE_MAX_SIZE);
+      }
+      else
+      {
+        Serial_ParseLine();
+      }
+
+      line_len = 0;
+      line_overflow = false;
+      history_pos = 0;
+    }
+    else if((SERIAL_BACKSPACE == inChar) || (SERIAL_DELETE == inChar))
     {
-      Serial_ParseString(inputString);
+      if(line_len > 0)
+      {
+        line_len--;
+
+        if(echo)
+        {
+          Serial.print("\b \b");
+        }
+      }
+    }
+    else if(SERIAL_CTRL_U == inChar)
+    {
+      line_len = 0;
+      line_overflow = false;
+
+      if(echo)
+      {
+        Serial_Redraw();
+      }
     }
-    else
+    else if(SERIAL_ESC == inChar)
     {
-      /* Add new char to the inputString */
-      inputString += inChar;
+      esc = Serial_Esc_Start;
+    }
+    else if((inChar >= ' ') && (inChar <= '~'))
+    {
+      if(line_len < SERIAL_LINE_MAX_SIZE)
+      {
+        line[line_len++] = inChar;
+
+        if(echo)
+        {
+          Serial.write(inChar);
+        }
+      }
+      else
+      {
+        line_overflow = true;
+      }
     }
   }
 }
@@ -12,13 +12,36 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 #include "nvm_manager.h"
+#include "fnv_hash.h"
 #include "tmr_config.h"
 #include "snsr_manager.h"
+#include "param_manager.h"
+#include "wifi_manager.h"
+#include "rtc_manager.h"
+#include "sched_manager.h"
+#include "prof_manager.h"
+#include "pwr_manager.h"
+#include "dsleep_manager.h"
+#include "gpio_manager.h"
+#include "pwm_manager.h"
+#include "action_manager.h"
+#include "rule_manager.h"
+#include "input_manager.h"
+#include "log_manager.h"
+#include "telem_manager.h"
 
 /* ==================================================================== */
 /* ============================= defines ============================== */
 /* ==================================================================== */
+/* Default baudrate and echo - runtime values are kept by Param_Manager */
 #define SERIAL_BAUDRATE             (115200)
+#define SERIAL_ECHO                 (0)
+
+/* Longest command line ("rule_add <rule>", "ntp <host>") - longer lines are rejected */
+#define SERIAL_LINE_MAX_SIZE        (96)
+
+/* Number of the command lines kept for the recall (arrow up/down) */
+#define SERIAL_HISTORY_DEPTH        (4)
 
 /* ==================================================================== */
 /* ============================ typedefs ============================== */
@@ -35,6 +58,44 @@ typedef enum Credentials_State_Tag
   
 }Credentials_State_T;
 
+/* Arguments accepted by the command */
+typedef enum Serial_Args_Tag
+{
+  Serial_Args_None = 0,
+  Serial_Args_Optional,
+  Serial_Args_Required
+
+}Serial_Args_T;
+
+/* Terminal escape sequence (arrow keys) decoding */
+typedef enum Serial_Esc_Tag
+{
+  Serial_Esc_None = 0,
+  Serial_Esc_Start,
+  Serial_Esc_Csi
+
+}Serial_Esc_T;
+
+class Serial_Event;
+
+/* Command handler - args points to the arguments (empty string when none) */
+typedef void (Serial_Event::*Serial_Handler_T)(const char *args);
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Command descriptor - table in serial_event.cpp */
+typedef struct Serial_Cmd_Tag
+{
+  uint32_t hash;
+  const char *name;
+  Serial_Handler_T handler;
+  Serial_Args_T args;
+  bool local_only;          /* not available over the TCP console (interactive or UART related) */
+  const char *usage;
+  const char *help;
+
+}Serial_Cmd_T;
 
 /* ==================================================================== */
 /* ============================ classes =============================== */
@@ -42,17 +103,87 @@ typedef enum Credentials_State_Tag
 class Serial_Event
 {
   private:
+    static const Serial_Cmd_T cmds[];
+
+    /* Output of the running command - UART or the console session */
+    Print *out;
+    
     Credentials_State_T login_state;
+    uint8_t ap_idx;
   
-    String new_ssid;
-    String new_password;
-    String new_username;
-    String inputString;
-    void Serial_ParseString(String s);
+    char new_ssid[EEPROM_CREDENTIAL_MAX_SIZE + 1];
+    char new_username[EEPROM_CREDENTIAL_MAX_SIZE + 1];
+
+    /* Line editor */
+    char line[SERIAL_LINE_MAX_SIZE + 1];
+    uint8_t line_len;
+    bool line_overflow;
+    char last_char;
+    Serial_Esc_T esc;
+
+    /* History ring - index of the newest line is history_head - 1 */
+    char history[SERIAL_HISTORY_DEPTH][SERIAL_LINE_MAX_SIZE + 1];
+    uint8_t history_head;
+    uint8_t history_count;
+    uint8_t history_pos;
+    
+    void Serial_ParseLine();
+    void Serial_Dispatch(char *cmd_line, bool remote);
+    void Serial_Credentials(const char *s);
+    const Serial_Cmd_T *Serial_Find(const char *name, uint8_t len);
+    void Serial_HistoryAdd();
+    void Serial_HistoryRecall(bool older);
+    void Serial_Redraw();
+    void Serial_ResumeReconnectTmr();
+    
+    /* Command handlers */
+    void Serial_CmdHelp(const char *args);
+    void Serial_CmdHistory(const char *args);
+    void Serial_CmdReboot(const char *args);
+    void Serial_CmdApLogin(const char *args);
+    void Serial_CmdApList(const char *args);
+    void Serial_CmdScan(const char *args);
+    void Serial_CmdUserLogin(const char *args);
+    void Serial_CmdRawEeprom(const char *args);
+    void Serial_CmdSensor(const char *args);
+    void Serial_CmdGpio(const char *args);
+    void Serial_CmdDim(const char *args);
+    void Serial_CmdAfter(const char *args);
+    void Serial_CmdPulse(const char *args);
+    void Serial_CmdCancel(const char *args);
+    void Serial_CmdSched(const char *args);
+    void Serial_CmdSchedAdd(const char *args);
+    void Serial_CmdSchedDel(const char *args);
+    void Serial_CmdNtp(const char *args);
+    void Serial_CmdLog(const char *args);
+    void Serial_CmdSyslog(const char *args);
+    void Serial_CmdStream(const char *args);
+    void Serial_CmdConsole(const char *args);
+    void Serial_CmdMqtt(const char *args);
+    void Serial_CmdMqttBroker(const char *args);
+    void Serial_CmdInflux(const char *args);
+    void Serial_CmdInfluxUrl(const char *args);
+    void Serial_CmdCoap(const char *args);
+    void Serial_CmdInputs(const char *args);
+    void Serial_CmdRules(const char *args);
+    void Serial_CmdRuleAdd(const char *args);
+    void Serial_CmdRuleDel(const char *args);
+    void Serial_CmdBoot(const char *args);
+    void Serial_CmdRtc(const char *args);
+    void Serial_CmdTasks(const char *args);
+    void Serial_CmdProf(const char *args);
+    void Serial_CmdPower(const char *args);
+    void Serial_CmdDsleep(const char *args);
+    void Serial_CmdParams(const char *args);
+    void Serial_CmdGet(const char *args);
+    void Serial_CmdSet(const char *args);
+    void Serial_Action(const char *args, bool pulse);
     
   public:
     Serial_Event();
+    void Serial_SetBaudrate(uint32_t baudrate);
     void Serial_RxEvent();
+    void Serial_Execute(char *cmd_line, Print &target);
 };
 
 #endif /* _SERIAL_EVENT_H_ */
@@ -8,6 +8,20 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "server_manager.h"
+#include "wifi_manager.h"
+#include "prov_manager.h"
+#include "prof_manager.h"
+#include "pwr_manager.h"
+#include "pwm_manager.h"
+#include "action_manager.h"
+#include "rule_manager.h"
+#include "input_manager.h"
+#include "log_manager.h"
+#include "telem_manager.h"
+#include "console_manager.h"
+#include "mqtt_manager.h"
+#include "influx_manager.h"
+#include "coap_manager.h"
 
 /* ==================================================================== */
 /* ======================== global variables ========================== */
@@ -30,6 +44,51 @@ extern Sensor::Sensor_Values_T sens_val;
 /* Upadte manager handler */
 extern Update_Manager ota;
 
+/* Parameter handler */
+extern Param_Manager param;
+
+/* WiFi handler */
+extern WiFi_Manager wifi;
+
+/* Provisioning handler */
+extern Prov_Manager prov;
+
+/* Gpio handler */
+extern Gpio_Manager gpio;
+
+/* PWM handler */
+extern Pwm_Manager pwm;
+
+/* Loop profiler handler */
+extern Prof_Manager prof;
+
+/* Power handler */
+extern Pwr_Manager pwr;
+
+/* GPIO action handler */
+extern Action_Manager action;
+
+/* Rule engine handler */
+extern Rule_Manager rule_engine;
+
+/* Input handler */
+extern Input_Manager input;
+
+/* Telemetry handler */
+extern Telem_Manager telem;
+
+/* Console handler */
+extern Console_Manager console;
+
+/* MQTT handler */
+extern Mqtt_Manager mqtt;
+
+/* Influx handler */
+extern Influx_Manager influx;
+
+/* CoAP handler */
+extern Coap_Manager coap;
+
 /* SensorState struct handler */
 Server_SensorState_T sensorState;
 
@@ -37,8 +96,30 @@ Server_SensorState_T sensorState;
 String user_username;
 String user_password;
 
-/* Initialize the GpioState tab */
-String  GpioState[GPIO_REMOTE_USED] = {"OFF", "OFF"};
+/* Server started flag - handlers are registered only once */
+bool server_started = false;
+
+/* Time (ms since boot) of the first handled request */
+uint32_t first_response_time = 0;
+
+/* Handled requests and the time spent in WServer.handleClient() handling them */
+uint32_t http_requests = 0;
+uint32_t http_busy_us = 0;
+
+
+/* Provisioning page - served from flash, no external resources (no internet in the portal) */
+static const char provision_page[] PROGMEM =
+  "<!DOCTYPE html><html><head><meta charset='UTF-8'><meta name='viewport' content='width=device-width, initial-scale=1'>"
+  "<title>iBeacon provisioning</title>"
+  "<style>body{font-family:sans-serif;background:#222;color:#eee;margin:2em}input{display:block;width:100%;max-width:20em;margin:.3em 0 1em;padding:.4em}"
+  "button{padding:.5em 2em}</style></head><body>"
+  "<h2>iBeacon! <small>Access point setup</small></h2>"
+  "<form method='POST' action='/provision'>"
+  "<label>Access point SSID</label><input type='text' name='SSID' maxlength='32'>"
+  "<label>Access point password</label><input type='password' name='PASS' maxlength='64'>"
+  "<label>User</label><input type='text' name='USERNAME' placeholder='website user name'>"
+  "<label>Password</label><input type='password' name='PASSWORD' placeholder='website password'>"
+  "<button type='submit'>Save</button></form></body></html>";
 
 /* ==================================================================== */
 /* ================== local function declarations ===================== */
@@ -46,17 +127,43 @@ String  GpioState[GPIO_REMOTE_USED] = {"OFF", "OFF"};
 inline void handleControlData();
 inline void handleLogin();
 inline void handleUpdate();
+inline void handleParam();
+inline void handleMetrics();
+inline void handleProf();
+inline void handleSchedule();
+inline void handleRules();
+inline void handleInputs();
+inline void handleSensors();
+inline void handleProvision();
+inline void handleNotFound();
+inline void markResponse();
 
 /* ==================================================================== */
 /* ================== local function definitions  ===================== */
 /* ==================================================================== */
 
+/* 
+ *  markResponse()
+ *    - This functions records the time of the first handled request and counts the requests
+ */
+void markResponse()
+{
+  http_requests++;
+
+  if(0 == first_response_time)
+  {
+    first_response_time = millis();
+  }
+}
+
+
 /* 
  *  handleControlData()
  *    - This functions handles the Server's requests related to the control website
  */
 void handleControlData()
 {
+  markResponse();
   Server_Manager s;
   String header;
 
@@ -78,6 +185,16 @@ void handleControlData()
     {
       s.Server_UpdateGPIO(Gpio_ID_D5, WServer.arg("D5")); 
     } 
+
+    else if(WServer.hasArg("D4_level")) 
+    {
+      s.Server_UpdateGPIOLevel(Gpio_ID_D4, WServer.arg("D4_level")); 
+    } 
+
+    else if(WServer.hasArg("D5_level")) 
+    {
+      s.Server_UpdateGPIOLevel(Gpio_ID_D5, WServer.arg("D5_level")); 
+    } 
   
     else
     {
@@ -93,6 +210,7 @@ void handleControlData()
  */
 void handleLogin()
 {
+  markResponse();
   Server_Manager s;
   String msg = "";
   
@@ -103,7 +221,7 @@ void handleLogin()
   
   if(WServer.hasArg("DISCONNECT"))
   {
-    Serial.printf("SERVER -> LOGOUT\r\n");
+    LOG_INFO(Log_Module_Server, "LOGOUT");
     
     WServer.sendHeader("Location","/login");
     WServer.sendHeader("Cache-Control","no-cache");
@@ -124,12 +242,12 @@ void handleLogin()
         WServer.sendHeader("Set-Cookie","ESPSESSIONID=1");
         WServer.send(301);
         
-        Serial.printf("SERVER -> LOGIN OK\r\n");
+        LOG_INFO(Log_Module_Server, "LOGIN OK");
       }
       else
       {
         msg = "Wrong username or password!";
-        Serial.printf("SERVER -> LOGIN ERROR\r\n");
+        LOG_WARN(Log_Module_Server, "LOGIN ERROR");
       }    
     }
 
@@ -145,11 +263,396 @@ void handleLogin()
  */
 void handleUpdate()
 {
+  markResponse();
   /* Initialize update manager */
   ota.Update_Manager_Init();
   WServer.send(200, "text/html", "<html>For update visit: <a href=\"url\">http://esp8266-webupdate/firmware</a></html>");
 }
 
+
+/* 
+ *  handleParam()
+ *    - This functions handles the Server's requests related to the runtime parameters
+ *      /param                      - list all parameters
+ *      /param?name=x               - get single parameter
+ *      /param?name=x&value=y       - set single parameter
+ */
+void handleParam()
+{
+  markResponse();
+  Server_Manager s;
+  Param_ID_T id;
+  String response = "";
+
+  if(!s.Server_IsAuthentified())
+  { 
+    WServer.sendHeader("Location","/login");
+    WServer.sendHeader("Cache-Control","no-cache");
+    WServer.send(301);
+  }
+  else if(WServer.hasArg("name") && WServer.hasArg("value"))
+  {
+    Param_Status_T status = param.Param_SetByName(WServer.arg("name").c_str(), WServer.arg("value").c_str());
+    
+    if(Param_Status_OK == status)
+    {
+      WServer.send(200, "text/plain", "OK\n");
+    }
+    else if(Param_Status_Unknown == status)
+    {
+      WServer.send(404, "text/plain", "Unknown parameter\n");
+    }
+    else if(Param_Status_Range == status)
+    {
+      WServer.send(400, "text/plain", "Value out of range\n");
+    }
+    else
+    {
+      WServer.send(500, "text/plain", "NvM write error\n");
+    }
+  }
+  else if(WServer.hasArg("name"))
+  {
+    if(param.Param_Find(WServer.arg("name").c_str(), id))
+    {
+      WServer.send(200, "text/plain", param.Param_ToString(id) + "\n");
+    }
+    else
+    {
+      WServer.send(404, "text/plain", "Unknown parameter\n");
+    }
+  }
+  else
+  {
+    for(uint8_t idx = 0; idx < Param_ID_Last; idx++)
+    {
+      response += param.Param_GetDesc((Param_ID_T)idx)->name;
+      response += "=";
+      response += param.Param_ToString((Param_ID_T)idx);
+      response += "\n";
+    }
+    WServer.send(200, "text/plain", response);
+  }
+}
+
+
+/* 
+ *  handleMetrics()
+ *    - This functions handles the Server's requests related to the runtime statistics
+ *    - Prometheus text format, no login required (read only, no credentials exposed)
+ */
+void handleMetrics()
+{
+  markResponse();
+  const WiFi_Metrics_T &wifi_metrics = wifi.WiFi_GetMetrics();
+  String response = "";
+
+  response.reserve(512);
+
+  response += "ibeacon_uptime_ms " + String(millis()) + "\n";
+  response += "ibeacon_free_heap_bytes " + String(ESP.getFreeHeap()) + "\n";
+  response += "ibeacon_wifi_connected " + String(wifi.WiFi_IsConnected() ? 1 : 0) + "\n";
+  response += "ibeacon_wifi_outages_total " + String(wifi_metrics.outages) + "\n";
+  response += "ibeacon_wifi_recoveries_total " + String(wifi_metrics.recoveries) + "\n";
+  response += "ibeacon_wifi_retries_total " + String(wifi_metrics.retries) + "\n";
+  response += "ibeacon_wifi_radio_resets_total " + String(wifi_metrics.radio_resets) + "\n";
+  response += "ibeacon_wifi_roams_total " + String(wifi_metrics.roams) + "\n";
+  response += "ibeacon_wifi_rssi_dbm " + String(WiFi.RSSI()) + "\n";
+  response += "ibeacon_wifi_outage_current_ms " + String(wifi.WiFi_GetOutageTime()) + "\n";
+  response += "ibeacon_wifi_outage_last_ms " + String(wifi_metrics.last_outage_ms) + "\n";
+  response += "ibeacon_wifi_outage_max_ms " + String(wifi_metrics.max_outage_ms) + "\n";
+  response += "ibeacon_wifi_outage_total_ms " + String(wifi_metrics.total_outage_ms) + "\n";
+  response += "ibeacon_power_mode " + String(pwr.Pwr_GetMode()) + "\n";
+  response += "ibeacon_power_avg_current_ua " + String(pwr.Pwr_GetAvgCurrentUa()) + "\n";
+  response += "ibeacon_power_wakes_total " + String(pwr.Pwr_GetWakes()) + "\n";
+  response += "ibeacon_power_sleep_ms_total " + String(pwr.Pwr_GetSleepTime()) + "\n";
+  input.Input_Metrics(response);
+  logger.Log_Metrics(response);
+  telem.Telem_Metrics(response);
+  console.Console_Metrics(response);
+  mqtt.Mqtt_Metrics(response);
+  influx.Influx_Metrics(response);
+  coap.Coap_Metrics(response);
+  response += "ibeacon_http_requests_total " + String(http_requests) + "\n";
+  response += "ibeacon_http_busy_us_total " + String(http_busy_us) + "\n";
+
+  WServer.send(200, "text/plain", response);
+}
+
+
+/* 
+ *  handleProf()
+ *    - This functions handles the Server's requests related to the loop profiler
+ *    - Plain text dump, "?reset=1" restarts the profiling
+ */
+void handleProf()
+{
+  markResponse();
+  String response = "";
+
+  response.reserve(1024);
+  prof.Prof_Dump(response);
+
+  if(WServer.arg("reset") == "1")
+  {
+    prof.Prof_Reset();
+  }
+
+  WServer.send(200, "text/plain", response);
+}
+
+
+/* 
+ *  handleSchedule()
+ *    - This functions handles the Server's requests related to the GPIO schedules and delayed actions
+ *    - "?add=HH:MM&gpio=<n>&level=<0..255>" daily schedule, "?del=<n>" removes it
+ *    - "?after=<ms>&gpio=<n>&level=<0..255>" and "?pulse=<ms>&gpio=<n>" delayed actions,
+ *      "?cancel=<handle>" cancels the pending one, "?ntp=<host>" SNTP server (empty - default)
+ *    - Plain text dump of the clock, actions and schedules without arguments
+ */
+void handleSchedule()
+{
+  markResponse();
+  Server_Manager s;
+  String response = "";
+  uint16_t minute;
+  uint8_t pin_id;
+  uint32_t level = WServer.hasArg("level") ? (uint32_t)WServer.arg("level").toInt() : PWM_LEVEL_MAX;
+  bool pin_ok = gpio.Gpio_FindPin((uint32_t)WServer.arg("gpio").toInt(), pin_id) && (level <= PWM_LEVEL_MAX);
+
+  if(!s.Server_IsAuthentified())
+  { 
+    WServer.sendHeader("Location","/login");
+    WServer.sendHeader("Cache-Control","no-cache");
+    WServer.send(301);
+  }
+  else if(WServer.hasArg("add"))
+  {
+    if(!pin_ok || !action.Action_ParseTime(WServer.arg("add").c_str(), minute))
+    {
+      WServer.send(400, "text/plain", "Invalid time, gpio or level\n");
+    }
+    else if(action.Action_ScheduleAdd(pin_id, minute, (uint8_t)level) < 0)
+    {
+      WServer.send(507, "text/plain", "No free schedule or NvM write error\n");
+    }
+    else
+    {
+      WServer.send(200, "text/plain", "OK\n");
+    }
+  }
+  else if(WServer.hasArg("del"))
+  {
+    bool removed = action.Action_ScheduleDel((uint8_t)(WServer.arg("del").toInt() - 1));
+    WServer.send(removed ? 200 : 404, "text/plain", removed ? "OK\n" : "Unknown schedule\n");
+  }
+  else if(WServer.hasArg("after") || WServer.hasArg("pulse"))
+  {
+    uint32_t handle = TMR_WHEEL_INVALID;
+
+    if(pin_ok && WServer.hasArg("pulse"))
+    {
+      handle = action.Action_Pulse(pin_id, (uint32_t)WServer.arg("pulse").toInt());
+    }
+    else if(pin_ok)
+    {
+      handle = action.Action_After(pin_id, (uint8_t)level, (uint32_t)WServer.arg("after").toInt());
+    }
+
+    if(TMR_WHEEL_INVALID == handle)
+    {
+      WServer.send(400, "text/plain", "Invalid gpio, level or delay (or no free action)\n");
+    }
+    else
+    {
+      WServer.send(200, "text/plain", String(handle) + "\n");
+    }
+  }
+  else if(WServer.hasArg("cancel"))
+  {
+    bool cancelled = action.Action_Cancel((uint32_t)WServer.arg("cancel").toInt());
+    WServer.send(cancelled ? 200 : 404, "text/plain", cancelled ? "OK\n" : "Not pending\n");
+  }
+  else if(WServer.hasArg("ntp"))
+  {
+    bool changed = action.Action_SetNtpServer(WServer.arg("ntp").c_str());
+    WServer.send(changed ? 200 : 400, "text/plain", changed ? "OK\n" : "Invalid SNTP server\n");
+  }
+  else
+  {
+    response.reserve(1024);
+    action.Action_Dump(response);
+    WServer.send(200, "text/plain", response);
+  }
+}
+
+
+/* 
+ *  handleRules()
+ *    - This functions handles the Server's requests related to the sensor rules
+ *    - "?add=<rule>" compiles and stores the rule (ex. "hum > 70 off 60 then 14"), "?del=<n>" removes it
+ *    - Plain text list of the rules and evaluation statistics without arguments
+ */
+void handleRules()
+{
+  markResponse();
+  Server_Manager s;
+  String response = "";
+
+  if(!s.Server_IsAuthentified())
+  { 
+    WServer.sendHeader("Location","/login");
+    WServer.sendHeader("Cache-Control","no-cache");
+    WServer.send(301);
+  }
+  else if(WServer.hasArg("add"))
+  {
+    int8_t idx = rule_engine.Rule_Add(WServer.arg("add").c_str());
+
+    if(idx < 0)
+    {
+      WServer.send(400, "text/plain", "Invalid rule, no free entry or NvM write error\n");
+    }
+    else
+    {
+      WServer.send(200, "text/plain", String(idx + 1) + "\n");
+    }
+  }
+  else if(WServer.hasArg("del"))
+  {
+    bool removed = rule_engine.Rule_Del((uint8_t)(WServer.arg("del").toInt() - 1));
+    WServer.send(removed ? 200 : 404, "text/plain", removed ? "OK\n" : "Unknown rule\n");
+  }
+  else
+  {
+    response.reserve(512);
+    rule_engine.Rule_Dump(response);
+    WServer.send(200, "text/plain", response);
+  }
+}
+
+
+/* 
+ *  handleInputs()
+ *    - This functions handles the Server's requests related to the digital inputs
+ *    - Plain text states, event counts and edge statistics
+ */
+void handleInputs()
+{
+  markResponse();
+  Server_Manager s;
+  String response = "";
+
+  if(!s.Server_IsAuthentified())
+  { 
+    WServer.sendHeader("Location","/login");
+    WServer.sendHeader("Cache-Control","no-cache");
+    WServer.send(301);
+  }
+  else
+  {
+    response.reserve(256);
+    input.Input_Dump(response);
+    WServer.send(200, "text/plain", response);
+  }
+}
+
+
+/* 
+ *  handleProvision()
+ *    - This functions handles the Server's requests related to the provisioning portal
+ *    - Available only while the portal is running, website credentials are required
+ *      (if no website credentials are stored yet, any are accepted)
+ *    - New credentials of the primary AP are applied live (rollback on failure)
+ *    - Empty SSID is refused - NvM would treat it as removal of the primary AP
+ */
+void handleProvision()
+{
+  markResponse();
+  bool user_ok;
+  String ssid;
+  String pass;
+
+  if(!prov.Prov_IsActive())
+  {
+    WServer.send(404, "text/plain", "Not found\n");
+  }
+  else if(!WServer.hasArg("SSID"))
+  {
+    WServer.send_P(200, "text/html", provision_page);
+  }
+  else
+  {
+    user_ok = (0 == user_username.length()) && (0 == user_password.length());
+    user_ok = user_ok || ((WServer.arg("USERNAME") == user_username) && (WServer.arg("PASSWORD") == user_password));
+
+    ssid = WServer.arg("SSID");
+    pass = WServer.arg("PASS");
+
+    if(!user_ok)
+    {
+      LOG_WARN(Log_Module_Prov, "LOGIN ERROR");
+      WServer.send(403, "text/plain", "Wrong username or password\n");
+    }
+    else if(0 == ssid.length())
+    {
+      WServer.send(400, "text/plain", "SSID required\n");
+    }
+    else if(EEPROM_WRITE_ERROR == eeprom.Nvm_CredentialsWrite(Nvm_Credentials_AP, ssid.c_str(), pass.c_str(), ssid.length(), pass.length()))
+    {
+      WServer.send(400, "text/plain", "Invalid SSID or password\n");
+    }
+    else
+    {
+      LOG_INFO(Log_Module_Prov, "Credentials CHANGED");
+      WServer.send(200, "text/plain", "Saved - connecting to " + ssid + ". Portal closes when the link is up.\n");
+      
+      /* Portal keeps running until the station link works */
+      wifi.WiFi_Reassociate();
+    }
+  }
+}
+
+
+/* 
+ *  handleSensors()
+ *    - This functions handles the Server's requests related to the last sensor sample
+ *    - JSON snapshot of the CoAP /sensors resource, no login required (read only, as /metrics)
+ */
+void handleSensors()
+{
+  markResponse();
+  const Coap_Snapshot_T &snapshot = coap.Coap_GetSnapshot();
+
+  if(0 == snapshot.sensors_json_len)
+  {
+    WServer.send(503, "text/plain", "No sample yet\n");
+    return;
+  }
+
+  WServer.send(200, "application/json", (const char *)snapshot.sensors_json, snapshot.sensors_json_len);
+}
+
+
+/* 
+ *  handleNotFound()
+ *    - This functions handles requests of unknown pages
+ *    - Captive portal - every page (OS connectivity checks too) is redirected to the provisioning page
+ */
+void handleNotFound()
+{
+  if(prov.Prov_IsActive())
+  {
+    WServer.sendHeader("Location", String("http://") + PROV_AP_IP.toString() + "/provision");
+    WServer.sendHeader("Cache-Control","no-cache");
+    WServer.send(302);
+  }
+  else
+  {
+    WServer.send(404, "text/plain", "Not found\n");
+  }
+}
+
 /* ==================================================================== */
 /* ============================ functions ============================= */
 /* ==================================================================== */
@@ -161,13 +664,28 @@ void handleUpdate()
  */
 void Server_Manager::Server_Init()
 { 
+  if(server_started)
+  {
+    /* Server listens on all interfaces - nothing to do after reconnection */
+    return;
+  }
+  
   /* Read Username and Password for Website access from NvM */
-  eeprom.Nvm_CredentialsRead(EEPROM_USER_CREDENTIALS_START_ADDR, user_username, user_password);
+  Server_ReloadCredentials();
  
   /* Connect the callbacks */
   WServer.on("/", handleControlData);
   WServer.on("/login", handleLogin);
   WServer.on("/update", handleUpdate);
+  WServer.on("/param", handleParam);
+  WServer.on("/metrics", handleMetrics);
+  WServer.on("/prof", handleProf);
+  WServer.on("/schedule", handleSchedule);
+  WServer.on("/rules", handleRules);
+  WServer.on("/inputs", handleInputs);
+  WServer.on("/sensors", handleSensors);
+  WServer.on("/provision", handleProvision);
+  WServer.onNotFound(handleNotFound);
 
   /* List of headers to be recorded */
   const char *headerkeys[] = {"User-Agent","Cookie"};
@@ -176,11 +694,26 @@ void Server_Manager::Server_Init()
   /* Ask server to track these headers */
   WServer.collectHeaders(headerkeys, headerkeyssize);
   WServer.begin();
+  server_started = true;
   
-  Serial.printf("SERVER -> Started\r\n");
+  LOG_INFO(Log_Module_Server, "Started");
+}
+
 
-  Serial.printf("SERVER -> USERNAME: %s\r\n", user_username.c_str());
-  Serial.printf("SERVER -> PASSWORD: %s\r\n", user_password.c_str());
+/* 
+ * Server_ReloadCredentials()
+ *  - This functions reads Website access credentials from NvM
+ *  - New pair replaces the old one at once, so requests never see mixed credentials
+ */
+void Server_Manager::Server_ReloadCredentials()
+{
+  String new_username;
+  String new_password;
+  
+  eeprom.Nvm_CredentialsRead(Nvm_Credentials_User, new_username, new_password);
+
+  user_username = new_username;
+  user_password = new_password;
 }
 
 
@@ -191,7 +724,25 @@ void Server_Manager::Server_Init()
  */
 void Server_Manager::Server_HandleClient()
 {
+  uint32_t start_us = micros();
+  uint32_t handled = http_requests;
+
   WServer.handleClient();
+
+  if(handled != http_requests)
+  {
+    http_busy_us += micros() - start_us;
+  }
+}
+
+
+/* 
+ * Server_GetFirstResponseTime()
+ *  - This function returns time (ms since boot) of the first handled request (0 - none yet)
+ */
+uint32_t Server_Manager::Server_GetFirstResponseTime()
+{
+  return first_response_time;
 }
 
 
@@ -213,7 +764,7 @@ bool Server_Manager::Server_IsAuthentified()
     }
     else
     {
-      Serial.printf("SERVER -> Authentication Failed\r\n");
+      LOG_WARN(Log_Module_Server, "Authentication Failed");
     }
   }
   return success_status;
@@ -226,34 +777,53 @@ bool Server_Manager::Server_IsAuthentified()
  */
 void Server_Manager::Server_UpdateGPIO(Gpio_ID_T gpio_id, String gpio_state)
 {
-  Serial.printf("GPIO -> %d: ", GpioPin[gpio_id]); 
-   
   if(gpio_state == "1") 
   {
-    Serial.printf("ON\r\n");
-    digitalWrite(GpioPin[gpio_id], HIGH);
+    LOG_INFO(Log_Module_Gpio, "%d: ON", GpioPin[gpio_id]);
+    gpio.Gpio_Set(gpio_id, true);
 
-    /* Change span's value */
-    GpioState[gpio_id] = "On";
     WServer.send(200, "text/html", Server_GetControlPage());
   } 
   
   else if(gpio_state == "0")
   {
-    Serial.printf("OFF\r\n");
-    digitalWrite(GpioPin[gpio_id], LOW);
+    LOG_INFO(Log_Module_Gpio, "%d: OFF", GpioPin[gpio_id]);
+    gpio.Gpio_Set(gpio_id, false);
 
-    /* Change span's value */
-    GpioState[gpio_id] = "Off";
     WServer.send(200, "text/html", Server_GetControlPage());
   } 
   else 
   {
-    Serial.printf("GPIO -> Unknown request\r\n");
+    LOG_WARN(Log_Module_Gpio, "Unknown request");
   }  
 }
 
 
+/* 
+ * Server_UpdateGPIOLevel()
+ *  - This functions sets the output brightness (with fade) and updates the website
+ *  - Level has to be a decimal number 0..PWM_LEVEL_MAX, anything else is answered with 400
+ */
+void Server_Manager::Server_UpdateGPIOLevel(Gpio_ID_T gpio_id, String level)
+{
+  char *end = nullptr;
+  unsigned long value = strtoul(level.c_str(), &end, 10);
+
+  /* strtoul alone would accept signs, spaces and an empty string */
+  if(!isdigit((uint8_t)level[0]) || ('\0' != *end) || (value > PWM_LEVEL_MAX))
+  {
+    LOG_WARN(Log_Module_Gpio, "Unknown request");
+    WServer.send(400, "text/plain", "Invalid level\n");
+    return;
+  }
+
+  LOG_INFO(Log_Module_Gpio, "%d: level %lu", GpioPin[gpio_id], value);
+  gpio.Gpio_SetLevel(gpio_id, (uint8_t)value, PWM_WEB_FADE_MS);
+
+  WServer.send(200, "text/html", Server_GetControlPage());
+}
+
+
 /* 
  *  Server_Update_SensorsState()
  *  - This functions updates the environment sensors status on the website
@@ -302,7 +872,7 @@ String Server_Manager::Server_GetControlPage()
   webpage +=                      "<li class='active'>";
   webpage +=                         "<a href='#'>";
   webpage +=                            "<span class='badge pull-right'>";
-  webpage +=                               GpioState[Gpio_ID_D4];
+  webpage +=                               (gpio.Gpio_Get(Gpio_ID_D4) ? "On" : "Off");
   webpage +=                            "</span>";
   webpage +=                            "D4 output";
   webpage +=                         "</a>";
@@ -327,6 +897,17 @@ String Server_Manager::Server_GetControlPage()
   webpage +=                  "</form>";
   webpage +=                "</div>";
   webpage +=             "</div>";
+
+                            /* D4 dimming - perceptual brightness 0..255 */
+  webpage +=             "<div class='row'>";
+  webpage +=                "<div class='col-md-12'>";
+  webpage +=                  "<form action='/' method='POST'>";
+  webpage +=                    "<input type='range' name='D4_level' min='0' max='255' onchange='this.form.submit()' value='";
+  webpage +=                      String(pwm.Pwm_GetTarget(Gpio_ID_D4));
+  webpage +=                    "'>";
+  webpage +=                  "</form>";
+  webpage +=                "</div>";
+  webpage +=             "</div>";
   
   
   webpage +=             "<div class='row'><div class='col-md-12'></div></div>";
@@ -337,7 +918,7 @@ String Server_Manager::Server_GetControlPage()
   webpage +=                      "<li class='active'>";
   webpage +=                         "<a href='#'>";
   webpage +=                            "<span class='badge pull-right'>";
-  webpage +=                               GpioState[Gpio_ID_D5];
+  webpage +=                               (gpio.Gpio_Get(Gpio_ID_D5) ? "On" : "Off");
   webpage +=                            "</span>";
   webpage +=                            "D5 output";
   webpage +=                         "</a>";
@@ -361,6 +942,17 @@ String Server_Manager::Server_GetControlPage()
   webpage +=                    "</button>";
   webpage +=                  "</form>";
   webpage +=                "</div>";
+  webpage +=             "</div>";
+
+                            /* D5 dimming - perceptual brightness 0..255 */
+  webpage +=             "<div class='row'>";
+  webpage +=                "<div class='col-md-12'>";
+  webpage +=                  "<form action='/' method='POST'>";
+  webpage +=                    "<input type='range' name='D5_level' min='0' max='255' onchange='this.form.submit()' value='";
+  webpage +=                      String(pwm.Pwm_GetTarget(Gpio_ID_D5));
+  webpage +=                    "'>";
+  webpage +=                  "</form>";
+  webpage +=                "</div>";
   webpage +=             "</div>";
   
   webpage +=             "<div class='page-header'> <h1><small>Sensors</small></h1></div>";
@@ -411,6 +1003,27 @@ String Server_Manager::Server_GetControlPage()
   webpage +=                      "</td>";
   webpage +=                   "</tr>";
   
+  webpage +=                "</tbody>";
+  webpage +=             "</table>";
+  
+  webpage +=             "<div class='page-header'> <h1><small>Inputs</small></h1></div>";
+  
+  webpage +=             "<table class='table'>";
+  webpage +=                "<thead>";
+  webpage +=                   "<tr><th>GPIO</th><th>State</th><th>Events</th></tr>";
+  webpage +=                "</thead>";
+  
+  webpage +=                "<tbody>";
+  for(uint8_t id = 0; id < INPUT_USED; id++)
+  {
+    webpage +=                 "<tr class='active'><td>";
+    webpage +=                    InputPin[id];
+    webpage +=                    "</td><td>";
+    webpage +=                    (input.Input_Get(id) ? "Closed" : "Open");
+    webpage +=                    "</td><td>";
+    webpage +=                    input.Input_GetEvents(id);
+    webpage +=                 "</td></tr>";
+  }
   webpage +=                "</tbody>";
   webpage +=             "</table>";
   webpage +=          "</div>";
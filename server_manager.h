@@ -14,6 +14,7 @@
 #include "snsr_manager.h"
 #include "nvm_manager.h"
 #include "update_manager.h"
+#include "param_manager.h"
 
 /* ==================================================================== */
 /* ============================ typedefs ============================== */
@@ -47,11 +48,14 @@ class Server_Manager
 {   
   public:
     void Server_Init();
+    void Server_ReloadCredentials();
     void Server_HandleClient();
     String Server_GetControlPage();
     String Server_GetLoginPage(String info_msg);
     void Server_UpdateGPIO(Gpio_ID_T gpio_id, String gpio_state);
+    void Server_UpdateGPIOLevel(Gpio_ID_T gpio_id, String level);
     bool Server_IsAuthentified();
+    uint32_t Server_GetFirstResponseTime();
     
     void Server_Update_SensorsState(String t_status, String p_status, String h_status, String l_status);
 };
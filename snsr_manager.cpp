@@ -8,6 +8,11 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "snsr_manager.h"
+#include "rule_manager.h"
+#include "mqtt_manager.h"
+#include "influx_manager.h"
+#include "coap_manager.h"
+#include "log_manager.h"
 
 /* ==================================================================== */
 /* ======================== global variables ========================== */
@@ -21,6 +26,21 @@ Sensor::Sensor_Values_T sens_val;
 /* Server Manager handler */
 extern Server_Manager server;
 
+/* Parameter handler */
+extern Param_Manager param;
+
+/* Rule engine handler */
+extern Rule_Manager rule_engine;
+
+/* MQTT handler */
+extern Mqtt_Manager mqtt;
+
+/* Influx handler */
+extern Influx_Manager influx;
+
+/* CoAP handler */
+extern Coap_Manager coap;
+
 /* ==================================================================== */
 /* ============================ functions ============================= */
 /* ==================================================================== */
@@ -28,14 +48,16 @@ extern Server_Manager server;
 /*
  * Sensor_Init
  *  - This function configures and initializes BME280 and ADC light sensor
- *  - Configured with suggested parameters for indoor monitoring
+ *  - Sampling is configured with runtime parameters (see Sensor_ApplySampling)
  */
 bool Sensor::Sensor_Init()
 {
   bool sensor_init_ok = sensor.begin();
 
   /* Print BME280 I2C address in hex */
-  Serial.printf("SENSOR -> BME280 I2C addr: 0x%.2X\r\n", BME280_ADDRESS);
+  LOG_INFO(Log_Module_Sensor, "BME280 I2C addr: 0x%.2X", BME280_ADDRESS);
+  
+  first_sample_time = 0;
   
   /* Init values structure */
   sens_val.temperature = 0.0F;
@@ -44,33 +66,54 @@ bool Sensor::Sensor_Init()
   
   if(sensor_init_ok) 
   {
-    /* 
-     * Indoor Navigation Scenario
-     * 
-     *  - normal mode 
-     *  - 16x pressure 
-     *  - 2x temperature
-     *  - 1x humidity oversampling
-     *  - 0.5ms standby period
-     *  - filter 16x
-     */
-     sensor.setSampling(Adafruit_BME280::MODE_NORMAL,
-                        Adafruit_BME280::SAMPLING_X2,     /* temperature */
-                        Adafruit_BME280::SAMPLING_X16,    /* pressure */
-                        Adafruit_BME280::SAMPLING_X1,     /* humidity */
-                        Adafruit_BME280::FILTER_X16,
-                        Adafruit_BME280::STANDBY_MS_0_5);
-
-    Serial.printf("SENSOR -> Init OK\r\n");
+    Sensor_ApplySampling();
+    LOG_INFO(Log_Module_Sensor, "Init OK");
   }
   else
   {
-    Serial.printf("SENSOR -> Init ERROR\r\n");
+    LOG_ERROR(Log_Module_Sensor, "Init ERROR");
   }
   return sensor_init_ok;
 }
 
 
+/*
+ * Sensor_ApplySampling
+ *  - This function configures BME280 sampling with runtime parameters
+ *  - Defaults are suggested parameters for indoor monitoring (Indoor Navigation Scenario)
+ *  
+ *    - normal mode 
+ *    - 16x pressure 
+ *    - 2x temperature
+ *    - 1x humidity oversampling
+ *    - 0.5ms standby period
+ *    - filter 16x
+ */
+void Sensor::Sensor_ApplySampling()
+{
+  uint32_t mode = forced_mode ? (uint32_t)Adafruit_BME280::MODE_FORCED : param.Param_Get(Param_ID_BmeMode);
+
+  sensor.setSampling((Adafruit_BME280::sensor_mode)mode,
+                     (Adafruit_BME280::sensor_sampling)param.Param_Get(Param_ID_BmeOsTemp),
+                     (Adafruit_BME280::sensor_sampling)param.Param_Get(Param_ID_BmeOsPres),
+                     (Adafruit_BME280::sensor_sampling)param.Param_Get(Param_ID_BmeOsHumid),
+                     (Adafruit_BME280::sensor_filter)param.Param_Get(Param_ID_BmeFilter),
+                     (Adafruit_BME280::standby_duration)param.Param_Get(Param_ID_BmeStandby));
+}
+
+
+/*
+ * Sensor_SetForcedMode
+ *  - This function switches BME280 to forced mode regardless of "bme_mode" parameter
+ *  - Used by the deep sleep cycle - single measurement, the sensor sleeps otherwise
+ *  - This function has to be called before Sensor_Init()
+ */
+void Sensor::Sensor_SetForcedMode()
+{
+  forced_mode = true;
+}
+
+
 /*
  * Sensor_UpdateValues
  *  - This function updates the Sensor_Values_T structure
@@ -82,6 +125,12 @@ void Sensor::Sensor_UpdateValues()
   String pres_status;
   String humid_status;
   String light_status;
+
+  /* In forced mode BME280 sleeps between the measurements */
+  if(forced_mode || (Adafruit_BME280::MODE_FORCED == param.Param_Get(Param_ID_BmeMode)))
+  {
+    sensor.takeForcedMeasurement();
+  }
   
   sens_val.temperature = sensor.readTemperature();
   sens_val.pressure = sensor.readPressure() / 100.0F;
@@ -122,6 +171,38 @@ void Sensor::Sensor_UpdateValues()
   light_status = "OK";
   
   server.Server_Update_SensorsState(temp_status, pres_status, humid_status, light_status);
+
+  /* Local automation - works without the network */
+  rule_engine.Rule_OnSample(sens_val);
+
+  /* Queued also while the broker is not reachable */
+  mqtt.Mqtt_OnSample(sens_val);
+  influx.Influx_OnSample(sens_val);
+
+  /* Polled resources are serialized once per sample */
+  coap.Coap_OnSample(sens_val);
+
+  if(0 == first_sample_time)
+  {
+    first_sample_time = millis();
+  }
+}
+
+
+/*
+ * Sensor_Read
+ *  - This function reads the light ADC and (bme - true) the last BME280 result into values
+ *  - No forced measurement, status update or rule evaluation - used by the telemetry stream
+ */
+void Sensor::Sensor_Read(Sensor_Values_T &values, bool bme)
+{
+  if(bme)
+  {
+    values.temperature = sensor.readTemperature();
+    values.pressure = sensor.readPressure() / 100.0F;
+    values.humidity = sensor.readHumidity();
+  }
+  values.light = analogRead(SENSOR_ANALOG_PIN);
 }
 
 
@@ -129,12 +210,21 @@ void Sensor::Sensor_UpdateValues()
  * Sensor_DebugPrint
  *  - This function prints measured values on console
  */
-void Sensor::Sensor_DebugPrint()
+void Sensor::Sensor_DebugPrint(Print &out)
+{
+  out.printf("SENSOR -> TEMP: %.2f\r\n", sens_val.temperature);
+  out.printf("SENSOR -> PRES: %.2f\r\n", sens_val.pressure);
+  out.printf("SENSOR -> HUMI: %.2f\r\n", sens_val.humidity);
+  out.printf("SENSOR -> LIGHT: %d\r\n", sens_val.light);
+}
+
+/*
+ * Sensor_GetFirstSampleTime
+ *  - This function returns time (ms since boot) of the first measurement (0 - not measured yet)
+ */
+uint32_t Sensor::Sensor_GetFirstSampleTime()
 {
-  Serial.printf("SENSOR -> TEMP: %.2f\r\n", sens_val.temperature);
-  Serial.printf("SENSOR -> PRES: %.2f\r\n", sens_val.pressure);
-  Serial.printf("SENSOR -> HUMI: %.2f\r\n", sens_val.humidity);
-  Serial.printf("SENSOR -> LIGHT: %d\r\n", sens_val.light);
+  return first_sample_time;
 }
 
 /* EOF */
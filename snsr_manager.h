@@ -12,6 +12,7 @@
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BME280.h>
 #include "server_manager.h"
+#include "param_manager.h"
 
 /* ==================================================================== */
 /* ============================ defines =============================== */
@@ -26,11 +27,16 @@ class Sensor
 {
   private:
     Adafruit_BME280 sensor;
+    uint32_t first_sample_time;
+    bool forced_mode;
         
   public:
     bool Sensor_Init();
+    void Sensor_ApplySampling();
+    void Sensor_SetForcedMode();
     void Sensor_UpdateValues();
-    void Sensor_DebugPrint();
+    void Sensor_DebugPrint(Print &out = Serial);
+    uint32_t Sensor_GetFirstSampleTime();
     
     typedef struct Sensor_Values_Tag
     {
@@ -39,6 +45,8 @@ class Sensor
       float humidity;
       int light;
     }Sensor_Values_T;
+
+    void Sensor_Read(Sensor_Values_T &values, bool bme);
 };
 
 #endif /* _SNSR_MANAGER_H_ */
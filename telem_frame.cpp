@@ -0,0 +1,279 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       telem_frame.cpp
+ *
+ *  Binary telemetry frames:
+ *    - fixed-point values with channel IDs, sequence number (gaps show lost frames)
+ *      and the sample time in microseconds (wraps every ~71 minutes)
+ *    - CRC16 (CCITT-FALSE) over the whole frame
+ *    - COBS encoding - 0x00 never appears inside a frame, so the receiver resynchronizes
+ *      at the next delimiter after any garbage (ex. text printed on the same UART)
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/telem_decode
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "telem_frame.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define TELEM_CRC16_POLY            ((uint16_t)0x1021)
+
+/* COBS block of 254 data bytes is not followed by an implicit zero */
+#define TELEM_COBS_BLOCK_MAX        (0xFF)
+
+static_assert(TELEM_FRAME_MAX_SIZE < 254, "Frame is encoded in a single COBS block");
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Channel descriptions - Telem_Channel_T order, ID 0 is not used */
+static const Telem_Channel_Desc_T telem_channels[Telem_Channel_Last] =
+{
+  /* name           unit    divisor */
+  {"",              "",     1       },
+  {"temperature",   "C",    100     },
+  {"humidity",      "%",    100     },
+  {"pressure",      "hPa",  100     },
+  {"light",         "adc",  1       },
+};
+
+/* ==================================================================== */
+/* ==================== function prototypes =========================== */
+/* ==================================================================== */
+static size_t Telem_Put(uint8_t *buf, size_t pos, uint32_t value, uint8_t size);
+static uint32_t Telem_Get(const uint8_t *buf, size_t pos, uint8_t size);
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Telem_Crc16
+ *  - This function calculates CRC16 (CCITT-FALSE, poly 0x1021, init 0xFFFF) of the given buffer
+ */
+uint16_t Telem_Crc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+  while(len--)
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+
+    for(uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ TELEM_CRC16_POLY) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+/*
+ * Telem_CobsEncode
+ *  - This function COBS encodes len bytes of src into dst (at most TELEM_COBS_MAX_SIZE(len) bytes)
+ *  - Returns the encoded length, the delimiter is not added
+ */
+size_t Telem_CobsEncode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+  size_t code_pos = 0;
+  size_t out = 1;
+  uint8_t code = 1;
+
+  for(size_t idx = 0; idx < len; idx++)
+  {
+    if(0 != src[idx])
+    {
+      dst[out++] = src[idx];
+      code++;
+    }
+
+    if((0 == src[idx]) || (TELEM_COBS_BLOCK_MAX == code))
+    {
+      dst[code_pos] = code;
+      code_pos = out++;
+      code = 1;
+    }
+  }
+
+  dst[code_pos] = code;
+  return out;
+}
+
+
+/*
+ * Telem_CobsDecode
+ *  - This function decodes len bytes of COBS data (without the delimiter) into dst (at most len bytes)
+ *  - Returns the decoded length, 0 - malformed data
+ */
+size_t Telem_CobsDecode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+  size_t in = 0;
+  size_t out = 0;
+
+  while(in < len)
+  {
+    uint8_t code = src[in++];
+
+    if((0 == code) || ((in + code - 1) > len))
+    {
+      return 0;
+    }
+
+    for(uint8_t idx = 1; idx < code; idx++)
+    {
+      if(0 == src[in])
+      {
+        return 0;
+      }
+      dst[out++] = src[in++];
+    }
+
+    if((TELEM_COBS_BLOCK_MAX != code) && (in < len))
+    {
+      dst[out++] = 0;
+    }
+  }
+  return out;
+}
+
+
+/*
+ * Telem_FrameAdd
+ *  - This function appends the channel value to the frame (false - frame is full)
+ */
+bool Telem_FrameAdd(Telem_Frame_T *frame, Telem_Channel_T channel, int32_t value)
+{
+  if(frame->count >= TELEM_FRAME_CHANNELS_MAX)
+  {
+    return false;
+  }
+
+  frame->values[frame->count].channel = (uint8_t)channel;
+  frame->values[frame->count].value = value;
+  frame->count++;
+  return true;
+}
+
+
+/*
+ * Telem_FrameEncode
+ *  - This function serializes the frame, adds CRC16, COBS encodes it and appends the delimiter
+ *  - wire has to hold TELEM_WIRE_MAX_SIZE bytes, returns the number of bytes to send
+ */
+size_t Telem_FrameEncode(const Telem_Frame_T *frame, uint8_t *wire)
+{
+  uint8_t raw[TELEM_FRAME_MAX_SIZE];
+  size_t len = 0;
+
+  raw[len++] = TELEM_FRAME_TYPE_SAMPLES;
+  raw[len++] = frame->count;
+  len = Telem_Put(raw, len, frame->seq, 2);
+  len = Telem_Put(raw, len, frame->time_us, 4);
+
+  for(uint8_t idx = 0; idx < frame->count; idx++)
+  {
+    raw[len++] = frame->values[idx].channel;
+    len = Telem_Put(raw, len, (uint32_t)frame->values[idx].value, 4);
+  }
+
+  len = Telem_Put(raw, len, Telem_Crc16(raw, len), 2);
+  len = Telem_CobsEncode(raw, len, wire);
+  wire[len++] = TELEM_FRAME_DELIMITER;
+
+  return len;
+}
+
+
+/*
+ * Telem_FrameDecode
+ *  - This function decodes one received frame (bytes between two delimiters)
+ *  - Returns false when COBS, CRC, type or length does not match
+ */
+bool Telem_FrameDecode(const uint8_t *cobs, size_t len, Telem_Frame_T *frame)
+{
+  uint8_t raw[TELEM_COBS_MAX_SIZE(TELEM_FRAME_MAX_SIZE)];
+  size_t size;
+  size_t pos = 2;
+
+  if(len > sizeof(raw))
+  {
+    return false;
+  }
+
+  size = Telem_CobsDecode(cobs, len, raw);
+
+  if((size < (TELEM_FRAME_HEADER_SIZE + TELEM_FRAME_CRC_SIZE)) ||
+     (Telem_Crc16(raw, size - TELEM_FRAME_CRC_SIZE) != Telem_Get(raw, size - TELEM_FRAME_CRC_SIZE, 2)))
+  {
+    return false;
+  }
+
+  if((TELEM_FRAME_TYPE_SAMPLES != raw[0]) || (raw[1] > TELEM_FRAME_CHANNELS_MAX) ||
+     (size != (size_t)(TELEM_FRAME_HEADER_SIZE + (raw[1] * TELEM_FRAME_VALUE_SIZE) + TELEM_FRAME_CRC_SIZE)))
+  {
+    return false;
+  }
+
+  frame->count = raw[1];
+  frame->seq = (uint16_t)Telem_Get(raw, pos, 2);
+  pos += 2;
+  frame->time_us = Telem_Get(raw, pos, 4);
+  pos += 4;
+
+  for(uint8_t idx = 0; idx < frame->count; idx++)
+  {
+    frame->values[idx].channel = raw[pos++];
+    frame->values[idx].value = (int32_t)Telem_Get(raw, pos, 4);
+    pos += 4;
+  }
+  return true;
+}
+
+
+/*
+ * Telem_ChannelDesc
+ *  - This function returns the name, unit and divisor of the channel (nullptr - unknown channel)
+ */
+const Telem_Channel_Desc_T *Telem_ChannelDesc(uint8_t channel)
+{
+  if((0 == channel) || (channel >= Telem_Channel_Last))
+  {
+    return nullptr;
+  }
+  return &telem_channels[channel];
+}
+
+
+/*
+ * Telem_Put
+ *  - This function stores size bytes of value (little endian) at pos, returns the next position
+ */
+static size_t Telem_Put(uint8_t *buf, size_t pos, uint32_t value, uint8_t size)
+{
+  for(uint8_t idx = 0; idx < size; idx++)
+  {
+    buf[pos++] = (uint8_t)(value >> (8 * idx));
+  }
+  return pos;
+}
+
+
+/*
+ * Telem_Get
+ *  - This function loads size bytes (little endian) from pos
+ */
+static uint32_t Telem_Get(const uint8_t *buf, size_t pos, uint8_t size)
+{
+  uint32_t value = 0;
+
+  for(uint8_t idx = 0; idx < size; idx++)
+  {
+    value |= (uint32_t)buf[pos + idx] << (8 * idx);
+  }
+  return value;
+}
+
+/* EOF */
@@ -0,0 +1,92 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       telem_frame.h
+ */
+#ifndef _TELEM_FRAME_H_
+#define _TELEM_FRAME_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Frame types */
+#define TELEM_FRAME_TYPE_SAMPLES    (0x01)
+
+/* Values carried by one frame */
+#define TELEM_FRAME_CHANNELS_MAX    (8)
+
+/* Frame layout (little endian): type, count, seq (2), time_us (4), count x [channel, value (4)], CRC16 (2) */
+#define TELEM_FRAME_HEADER_SIZE     (8)
+#define TELEM_FRAME_VALUE_SIZE      (5)
+#define TELEM_FRAME_CRC_SIZE        (2)
+#define TELEM_FRAME_MAX_SIZE        (TELEM_FRAME_HEADER_SIZE + (TELEM_FRAME_CHANNELS_MAX * TELEM_FRAME_VALUE_SIZE) + TELEM_FRAME_CRC_SIZE)
+
+/* COBS adds one byte per started 254 bytes, frames are delimited by 0x00 */
+#define TELEM_COBS_MAX_SIZE(n)      ((n) + ((n) / 254) + 1)
+#define TELEM_WIRE_MAX_SIZE         (TELEM_COBS_MAX_SIZE(TELEM_FRAME_MAX_SIZE) + 1)
+#define TELEM_FRAME_DELIMITER       (0x00)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Channel IDs are part of the wire format - append only */
+typedef enum Telem_Channel_Tag
+{
+  Telem_Channel_Temperature = 1,
+  Telem_Channel_Humidity,
+  Telem_Channel_Pressure,
+  Telem_Channel_Light,
+  Telem_Channel_Last
+
+}Telem_Channel_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Fixed-point value of one channel */
+typedef struct Telem_Value_Tag
+{
+  uint8_t channel;
+  int32_t value;
+
+}Telem_Value_T;
+
+/* Decoded frame */
+typedef struct Telem_Frame_Tag
+{
+  uint16_t seq;
+  uint32_t time_us;
+  uint8_t count;
+  Telem_Value_T values[TELEM_FRAME_CHANNELS_MAX];
+
+}Telem_Frame_T;
+
+/* Channel description - value / divisor gives the value in unit */
+typedef struct Telem_Channel_Desc_Tag
+{
+  const char *name;
+  const char *unit;
+  uint16_t divisor;
+
+}Telem_Channel_Desc_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+uint16_t Telem_Crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+size_t Telem_CobsEncode(const uint8_t *src, size_t len, uint8_t *dst);
+size_t Telem_CobsDecode(const uint8_t *src, size_t len, uint8_t *dst);
+bool Telem_FrameAdd(Telem_Frame_T *frame, Telem_Channel_T channel, int32_t value);
+size_t Telem_FrameEncode(const Telem_Frame_T *frame, uint8_t *wire);
+bool Telem_FrameDecode(const uint8_t *cobs, size_t len, Telem_Frame_T *frame);
+const Telem_Channel_Desc_T *Telem_ChannelDesc(uint8_t channel);
+
+#endif /* _TELEM_FRAME_H_ */
+
+/* EOF */
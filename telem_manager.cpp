@@ -0,0 +1,185 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       telem_manager.cpp
+ *
+ *  Binary telemetry stream:
+ *    - "stream on" switches the UART to the stream baudrate and sends one COBS frame
+ *      (telem_frame.cpp) every stream period, "stream off" goes back to the text console
+ *    - light ADC is sampled every period, BME280 result every TELEM_BME_PERIOD_MS,
+ *      a frame carries only the channels sampled in that period
+ *    - frame is dropped (sequence number still advances) when the TX FIFO has no room,
+ *      the loop never waits for the UART
+ *    - log lines are not written to the UART while streaming (syslog still gets them),
+ *      command input works, but replies printed while streaming corrupt one frame
+ *    - host side: tools/telem_decode
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include "telem_manager.h"
+#include "tmr_config.h"
+#include "snsr_manager.h"
+#include "param_manager.h"
+#include "log_manager.h"
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+/* Telemetry handler */
+Telem_Manager telem;
+
+/* Sensor handler */
+extern Sensor sensor;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Telem_Start
+ *  - This function switches the UART to the stream baudrate and starts the stream task
+ */
+void Telem_Manager::Telem_Start()
+{
+  uint32_t baudrate = param.Param_Get(Param_ID_StreamBaudrate);
+
+  if(!active)
+  {
+    frames = 0;
+    dropped = 0;
+    bytes = 0;
+
+    Serial.printf("TELEM -> Binary stream at %u baud, \"stream off\" returns to the console\r\n", baudrate);
+    logger.Log_Flush();
+    logger.Log_SetUart(false);
+  }
+
+  Serial.flush();
+  Serial.updateBaudRate(baudrate);
+
+  active = true;
+  bme_ms = millis() - TELEM_BME_PERIOD_MS;
+  started_ms = millis();
+  Start_telem_tmr(param.Param_Get(Param_ID_StreamPeriod));
+}
+
+
+/*
+ * Telem_Stop
+ *  - This function stops the stream and switches the UART back to the console baudrate
+ */
+void Telem_Manager::Telem_Stop()
+{
+  if(!active)
+  {
+    return;
+  }
+
+  Stop_telem_tmr();
+  active = false;
+
+  Serial.flush();
+  Serial.updateBaudRate(param.Param_Get(Param_ID_SerialBaudrate));
+  logger.Log_SetUart(true);
+
+  LOG_INFO(Log_Module_Telem, "Stream stopped, frames: %u, dropped: %u", frames, dropped);
+}
+
+
+/*
+ * Telem_Apply
+ *  - This function restarts the running stream with changed parameters
+ */
+void Telem_Manager::Telem_Apply()
+{
+  if(active)
+  {
+    Telem_Start();
+  }
+}
+
+
+/*
+ * Telem_Process
+ *  - This function samples the channels and sends one frame
+ *  - This function is the stream task (started by Telem_Start)
+ */
+void Telem_Manager::Telem_Process()
+{
+  Sensor::Sensor_Values_T values;
+  Telem_Frame_T frame;
+  uint8_t wire[TELEM_WIRE_MAX_SIZE];
+  uint32_t now_ms = millis();
+  bool bme = ((uint32_t)(now_ms - bme_ms) >= TELEM_BME_PERIOD_MS);
+  size_t len;
+
+  if(bme)
+  {
+    bme_ms = now_ms;
+  }
+
+  sensor.Sensor_Read(values, bme);
+
+  frame.seq = seq++;
+  frame.time_us = micros();
+  frame.count = 0;
+
+  /* NaN - BME280 not responding, channel is left out */
+  if(bme && (values.temperature == values.temperature))
+  {
+    (void)Telem_FrameAdd(&frame, Telem_Channel_Temperature, (int32_t)lroundf(values.temperature * 100.0F));
+    (void)Telem_FrameAdd(&frame, Telem_Channel_Humidity, (int32_t)lroundf(values.humidity * 100.0F));
+    (void)Telem_FrameAdd(&frame, Telem_Channel_Pressure, (int32_t)lroundf(values.pressure * 100.0F));
+  }
+  (void)Telem_FrameAdd(&frame, Telem_Channel_Light, values.light);
+
+  len = Telem_FrameEncode(&frame, wire);
+
+  if((size_t)Serial.availableForWrite() < len)
+  {
+    dropped++;
+    return;
+  }
+
+  Serial.write(wire, len);
+  frames++;
+  bytes += len;
+}
+
+
+/*
+ * Telem_Dump
+ *  - This function appends the stream state and statistics to out
+ */
+void Telem_Manager::Telem_Dump(String &out)
+{
+  char line[128];
+  uint32_t time_s = active ? ((millis() - started_ms) / 1000) : 0;
+
+  snprintf(line, sizeof(line), "TELEM -> Stream: %s, %u baud, period: %u ms\r\n", active ? "on" : "off",
+           param.Param_Get(Param_ID_StreamBaudrate), param.Param_Get(Param_ID_StreamPeriod));
+  out += line;
+
+  snprintf(line, sizeof(line), "TELEM -> Frames: %u, dropped: %u, bytes: %u (%u B/s)\r\n",
+           frames, dropped, bytes, (0 != time_s) ? (bytes / time_s) : 0);
+  out += line;
+}
+
+
+/*
+ * Telem_Metrics
+ *  - This function appends the stream metrics (Prometheus text format) to out
+ */
+void Telem_Manager::Telem_Metrics(String &out)
+{
+  out += "ibeacon_telem_active " + String(active ? 1 : 0) + "\n";
+  out += "ibeacon_telem_frames_total " + String(frames) + "\n";
+  out += "ibeacon_telem_dropped_total " + String(dropped) + "\n";
+}
+
+/* EOF */
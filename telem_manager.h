@@ -0,0 +1,52 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       telem_manager.h
+ */
+#ifndef _TELEM_MANAGER_H_
+#define _TELEM_MANAGER_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <Arduino.h>
+#include "telem_frame.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Default values - runtime values are kept by Param_Manager */
+#define TELEM_BAUDRATE              (921600)
+#define TELEM_PERIOD_MS             (10)
+
+/* BME280 result is read at most this often (one measurement takes ~40ms with the default oversampling) */
+#define TELEM_BME_PERIOD_MS         (40)
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Telem_Manager
+{
+  public:
+    void Telem_Start();
+    void Telem_Stop();
+    void Telem_Apply();
+    void Telem_Process();
+    void Telem_Dump(String &out);
+    void Telem_Metrics(String &out);
+
+    inline bool Telem_IsActive() { return active; }
+
+  private:
+    bool active;
+    uint16_t seq;
+    uint32_t bme_ms;
+    uint32_t frames;
+    uint32_t dropped;
+    uint32_t bytes;
+    uint32_t started_ms;
+};
+
+#endif /* _TELEM_MANAGER_H_ */
+
+/* EOF */
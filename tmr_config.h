@@ -9,24 +9,41 @@
 /* ==================================================================== */
 /* ========================== include files =========================== */
 /* ==================================================================== */
-#include <Ticker.h>
+#include <Arduino.h>
 
 /* ==================================================================== */
 /* ============================= defines ============================== */
 /* ==================================================================== */
+/* Default values - runtime values are kept by Param_Manager */
 #define TMR_ESTABLISH_CONNECTION_TIMEOUT_MS   (16000)
-#define TMR_RECONNECT_TIMEOUT_MS              (20000)
+#define TMR_RECONNECT_TIMEOUT_MS              (2000)
 #define TMR_SENSOR_MEASUREMENT_PERIOD_MS      (2000)
+#define TMR_AP_ROLLBACK_TIMEOUT_MS            (20000)
+#define TMR_FAST_CONNECT_TIMEOUT_MS           (1500)
+#define TMR_IP_LEASE_REUSE_MS                 (3600000)
+
+/* Link recovery - retry delay doubles up to the max, radio reset every N retries,
+ * MCU reset after the outage ceiling (0 - never) */
+#define TMR_RECONNECT_BACKOFF_MAX_MS          (300000)
+#define TMR_RADIO_RESET_RETRIES               (4)
+#define TMR_MCU_RESET_OUTAGE_MS               (3600000)
+
+/* Provisioning portal is started after this outage (0 - only when no AP is configured) */
+#define TMR_PORTAL_START_MS                   (120000)
 
 /* ==================================================================== */
 /* ===================== function declarations ======================== */
 /* ==================================================================== */
 
 /* Functions are defined in WebSockerServer main file */
-void Start_est_connection_tmr(uint16_t tmout);
-void Start_sensor_measurement_tmr(uint16_t tmout);
-void Start_reconnect_tmr(uint16_t tmout);
+void Start_est_connection_tmr(uint32_t tmout);
+void Start_sensor_measurement_tmr(uint32_t tmout);
+void Start_reconnect_tmr(uint32_t tmout);
 void Stop_reconnect_tmr();
+void Start_ap_rollback_tmr(uint32_t tmout);
+void Stop_ap_rollback_tmr();
+void Start_telem_tmr(uint32_t tmout);
+void Stop_telem_tmr();
 
 #endif /* _TIMER_H_ */
 
@@ -0,0 +1,266 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       tmr_wheel.cpp
+ *
+ *  Hierarchical timer wheel:
+ *    - TMR_WHEEL_LEVELS levels of TMR_WHEEL_SLOTS slots, level n slot spans 64^n ticks
+ *    - timers are kept in intrusive doubly linked slot lists, insert and cancel are O(1)
+ *    - every tick runs the level 0 slot, when a level wraps the next level slot is
+ *      cascaded (its timers are moved to the lower levels)
+ *    - timers come from the static pool, handle carries the generation of the node,
+ *      so a stale handle (timer expired or cancelled already) is rejected
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/tmr_wheel_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <string.h>
+#include "tmr_wheel.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Handle is the node index and the generation - odd generation marks a pending timer */
+#define TMR_WHEEL_HANDLE(idx, gen)  (((uint32_t)(gen) << 16) | (idx))
+#define TMR_WHEEL_HANDLE_IDX(h)     ((uint16_t)((h) & 0xFFFF))
+#define TMR_WHEEL_HANDLE_GEN(h)     ((uint8_t)((h) >> 16))
+#define TMR_WHEEL_GEN_PENDING(gen)  (0 != ((gen) & 1))
+
+static_assert(TMR_WHEEL_NODES_MAX < TMR_WHEEL_NIL, "Node index must fit 16 bits");
+static_assert((TMR_WHEEL_LEVELS * TMR_WHEEL_SLOTS) <= 256, "Slot number must fit 8 bits");
+static_assert((TMR_WHEEL_LEVELS * TMR_WHEEL_SLOT_BITS) < 32, "Wheel must not cover the tick counter wrap");
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * Tmr_WheelInit
+ *  - This function drops all timers, expiry_cb is called for every expired timer
+ */
+void Tmr_Wheel::Tmr_WheelInit(Tmr_Wheel_Cb_T expiry_cb)
+{
+  cb = expiry_cb;
+  now = 0;
+  pending = 0;
+  pending_max = 0;
+
+  memset(heads, 0xFF, sizeof(heads));
+
+  for(uint16_t idx = 0; idx < TMR_WHEEL_NODES_MAX; idx++)
+  {
+    nodes[idx].next = (idx + 1 < TMR_WHEEL_NODES_MAX) ? (idx + 1) : TMR_WHEEL_NIL;
+    nodes[idx].gen = 0;
+  }
+
+  free_head = 0;
+}
+
+
+/*
+ * Tmr_WheelAdd
+ *  - This function starts the timer expiring after delay_ticks (1..TMR_WHEEL_DELAY_MAX)
+ *  - It returns the handle or TMR_WHEEL_INVALID when the pool is full
+ */
+uint32_t Tmr_Wheel::Tmr_WheelAdd(uint32_t delay_ticks, uint16_t data)
+{
+  uint16_t idx = free_head;
+
+  if((TMR_WHEEL_NIL == idx) || (0 == delay_ticks) || (delay_ticks > TMR_WHEEL_DELAY_MAX))
+  {
+    return TMR_WHEEL_INVALID;
+  }
+
+  Tmr_Wheel_Node_T *n = &nodes[idx];
+
+  free_head = n->next;
+  n->gen++;
+  n->expiry = now + delay_ticks;
+  n->data = data;
+  Tmr_WheelPlace(idx);
+
+  pending++;
+  if(pending > pending_max)
+  {
+    pending_max = pending;
+  }
+
+  return TMR_WHEEL_HANDLE(idx, n->gen);
+}
+
+
+/*
+ * Tmr_WheelCancel
+ *  - This function stops the timer (false - it has expired or was cancelled already)
+ */
+bool Tmr_Wheel::Tmr_WheelCancel(uint32_t handle)
+{
+  if(NULL == Tmr_WheelNode(handle))
+  {
+    return false;
+  }
+
+  Tmr_WheelUnlink(TMR_WHEEL_HANDLE_IDX(handle));
+  Tmr_WheelFree(TMR_WHEEL_HANDLE_IDX(handle));
+  return true;
+}
+
+
+/*
+ * Tmr_WheelIsPending
+ *  - This function returns true if the timer has not expired yet
+ */
+bool Tmr_Wheel::Tmr_WheelIsPending(uint32_t handle)
+{
+  return (NULL != Tmr_WheelNode(handle));
+}
+
+
+/*
+ * Tmr_WheelAdvance
+ *  - This function advances the wheel by the given number of ticks and calls the callback
+ *    for every expired timer (order of timers expiring at the same tick is not defined)
+ *  - It returns the number of expired timers
+ */
+uint32_t Tmr_Wheel::Tmr_WheelAdvance(uint32_t ticks)
+{
+  uint32_t expired = 0;
+
+  while(ticks--)
+  {
+    uint32_t t = ++now;
+
+    /* Level n wraps when the lower levels wrap together */
+    for(uint8_t level = 1; (level < TMR_WHEEL_LEVELS) && (0 == (t & TMR_WHEEL_SLOT_MASK)); level++)
+    {
+      t >>= TMR_WHEEL_SLOT_BITS;
+      Tmr_WheelCascade(level, t & TMR_WHEEL_SLOT_MASK);
+    }
+
+    uint16_t *head = &heads[now & TMR_WHEEL_SLOT_MASK];
+
+    /* Head is taken again after every callback - it may add or cancel timers */
+    while(TMR_WHEEL_NIL != *head)
+    {
+      uint16_t idx = *head;
+      uint16_t data = nodes[idx].data;
+
+      Tmr_WheelUnlink(idx);
+      Tmr_WheelFree(idx);
+      expired++;
+
+      cb(data);
+    }
+  }
+
+  return expired;
+}
+
+
+/*
+ * Tmr_WheelNode
+ *  - This function returns the pending timer of the handle (NULL - stale or invalid handle)
+ */
+Tmr_Wheel_Node_T *Tmr_Wheel::Tmr_WheelNode(uint32_t handle)
+{
+  uint16_t idx = TMR_WHEEL_HANDLE_IDX(handle);
+  uint8_t gen = TMR_WHEEL_HANDLE_GEN(handle);
+
+  if((idx >= TMR_WHEEL_NODES_MAX) || !TMR_WHEEL_GEN_PENDING(gen) || (nodes[idx].gen != gen))
+  {
+    return NULL;
+  }
+
+  return &nodes[idx];
+}
+
+
+/*
+ * Tmr_WheelPlace
+ *  - This function links the timer to the slot of the lowest level covering its expiry
+ *  - Timer due at the current tick (cascade) goes to the slot which runs right after
+ */
+void Tmr_Wheel::Tmr_WheelPlace(uint16_t idx)
+{
+  Tmr_Wheel_Node_T *n = &nodes[idx];
+  uint32_t delta = n->expiry - now;
+  uint8_t level = 0;
+
+  while((level < (TMR_WHEEL_LEVELS - 1)) && (delta >> ((level + 1) * TMR_WHEEL_SLOT_BITS)))
+  {
+    level++;
+  }
+
+  n->slot = (uint8_t)((level * TMR_WHEEL_SLOTS) + ((n->expiry >> (level * TMR_WHEEL_SLOT_BITS)) & TMR_WHEEL_SLOT_MASK));
+  n->prev = TMR_WHEEL_NIL;
+  n->next = heads[n->slot];
+
+  if(TMR_WHEEL_NIL != n->next)
+  {
+    nodes[n->next].prev = idx;
+  }
+
+  heads[n->slot] = idx;
+}
+
+
+/*
+ * Tmr_WheelUnlink
+ *  - This function removes the timer from its slot list
+ */
+void Tmr_Wheel::Tmr_WheelUnlink(uint16_t idx)
+{
+  Tmr_Wheel_Node_T *n = &nodes[idx];
+
+  if(TMR_WHEEL_NIL != n->prev)
+  {
+    nodes[n->prev].next = n->next;
+  }
+  else
+  {
+    heads[n->slot] = n->next;
+  }
+
+  if(TMR_WHEEL_NIL != n->next)
+  {
+    nodes[n->next].prev = n->prev;
+  }
+}
+
+
+/*
+ * Tmr_WheelFree
+ *  - This function returns the unlinked timer to the pool (its handle becomes stale)
+ */
+void Tmr_Wheel::Tmr_WheelFree(uint16_t idx)
+{
+  nodes[idx].gen++;
+  nodes[idx].next = free_head;
+  free_head = idx;
+  pending--;
+}
+
+
+/*
+ * Tmr_WheelCascade
+ *  - This function moves all timers of the higher level slot to the lower levels
+ */
+void Tmr_Wheel::Tmr_WheelCascade(uint8_t level, uint8_t slot)
+{
+  uint16_t idx = heads[(level * TMR_WHEEL_SLOTS) + slot];
+
+  heads[(level * TMR_WHEEL_SLOTS) + slot] = TMR_WHEEL_NIL;
+
+  while(TMR_WHEEL_NIL != idx)
+  {
+    uint16_t next = nodes[idx].next;
+
+    Tmr_WheelPlace(idx);
+    idx = next;
+  }
+}
+
+/* EOF */
@@ -0,0 +1,90 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       tmr_wheel.h
+ */
+#ifndef _TMR_WHEEL_H_
+#define _TMR_WHEEL_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* Wheel geometry - 4 levels of 64 slots cover 2^24 ticks */
+#define TMR_WHEEL_LEVELS            (4)
+#define TMR_WHEEL_SLOT_BITS         (6)
+#define TMR_WHEEL_SLOTS             (1 << TMR_WHEEL_SLOT_BITS)
+#define TMR_WHEEL_SLOT_MASK         (TMR_WHEEL_SLOTS - 1)
+#define TMR_WHEEL_DELAY_MAX         (((uint32_t)1 << (TMR_WHEEL_LEVELS * TMR_WHEEL_SLOT_BITS)) - 1)
+
+/* Timer pool - 12 bytes per timer */
+#ifndef TMR_WHEEL_NODES_MAX
+#define TMR_WHEEL_NODES_MAX         (1024)
+#endif
+
+/* Returned when the pool is full or the delay is out of range, never a valid handle */
+#define TMR_WHEEL_INVALID           ((uint32_t)0)
+
+#define TMR_WHEEL_NIL               ((uint16_t)0xFFFF)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Expiry callback - data given to Tmr_WheelAdd, the wheel may be modified from the callback */
+typedef void (*Tmr_Wheel_Cb_T)(uint16_t data);
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Pending timer - member of the slot list (or of the free list) */
+typedef struct Tmr_Wheel_Node_Tag
+{
+  uint32_t expiry;
+  uint16_t next;
+  uint16_t prev;
+  uint16_t data;
+  uint8_t slot;
+  uint8_t gen;
+
+}Tmr_Wheel_Node_T;
+
+/* ==================================================================== */
+/* ============================ classes =============================== */
+/* ==================================================================== */
+class Tmr_Wheel
+{
+  public:
+    void Tmr_WheelInit(Tmr_Wheel_Cb_T expiry_cb);
+    uint32_t Tmr_WheelAdd(uint32_t delay_ticks, uint16_t data);
+    bool Tmr_WheelCancel(uint32_t handle);
+    bool Tmr_WheelIsPending(uint32_t handle);
+    uint32_t Tmr_WheelAdvance(uint32_t ticks);
+
+    inline uint32_t Tmr_WheelGetTick() { return now; }
+    inline uint16_t Tmr_WheelGetPending() { return pending; }
+    inline uint16_t Tmr_WheelGetPendingMax() { return pending_max; }
+
+  private:
+    Tmr_Wheel_Node_T nodes[TMR_WHEEL_NODES_MAX];
+    uint16_t heads[TMR_WHEEL_LEVELS * TMR_WHEEL_SLOTS];
+    uint16_t free_head;
+    uint16_t pending;
+    uint16_t pending_max;
+    uint32_t now;
+    Tmr_Wheel_Cb_T cb;
+
+    Tmr_Wheel_Node_T *Tmr_WheelNode(uint32_t handle);
+    void Tmr_WheelPlace(uint16_t idx);
+    void Tmr_WheelUnlink(uint16_t idx);
+    void Tmr_WheelFree(uint16_t idx);
+    void Tmr_WheelCascade(uint8_t level, uint8_t slot);
+};
+
+#endif /* _TMR_WHEEL_H_ */
+
+/* EOF */
@@ -0,0 +1,949 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       coap_bench.cpp
+ *
+ *  Host-side CoAP collector - discovery and latency benchmark of the CoAP endpoint
+ *  (coap_manager.cpp) against the HTTP path
+ *
+ *    - -d sends GET /.well-known/core to the "All CoAP Nodes" group and lists the nodes answering
+ *      within 2 s
+ *    - -h <node> polls /sensors n times over CoAP (CON, retransmitted after 1 s) and n times over
+ *      HTTP (GET /sensors, new connection per request - as a collector polling hundreds of nodes),
+ *      prints min/avg/p50/p99/max round trip and the bytes per request of both
+ *    - node CPU per request: /metrics is read before and after every run, busy time / requests
+ *      (ibeacon_coap_busy_us_total, ibeacon_http_busy_us_total) - the HTTP figure includes the
+ *      /metrics request read after the run
+ *    - -b asks for the binary record (Accept: 42) instead of JSON
+ *    - -S runs a stand-in node (same resource code as the firmware, coap_packet.cpp) with HTTP
+ *      /sensors and /metrics on -P - the benchmark can be tried without hardware
+ *    - -t runs the self test of the message and resource code and exits
+ *
+ *  Status of the measurements:
+ *    - only the stand-in node on the host loopback has been run so far - its round trip and busy
+ *      times show the host build of the resource code, they are NOT ESP8266 figures
+ *    - the on-device comparison (-h against a flashed node over WiFi) is still missing, CoAP vs
+ *      HTTP on the node must not be quoted from the stand-in runs
+ *
+ *  Build & run (from this directory):
+ *    g++ -std=c++11 -O2 -I../.. coap_bench.cpp ../../coap_packet.cpp ../../mqtt_packet.cpp -o coap_bench
+ *    ./coap_bench -t
+ *    ./coap_bench -d
+ *    ./coap_bench -h 192.168.1.50 -n 500
+ *    ./coap_bench -S -p 15683 -P 18080 & ./coap_bench -h 127.0.0.1 -p 15683 -P 18080 -n 1000
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "coap_packet.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define BENCH_HTTP_PORT         (80)
+#define BENCH_RETRANSMIT_MS     (1000)
+#define BENCH_RETRANSMIT_MAX    (3)
+#define BENCH_DISCOVERY_MS      (2000)
+#define BENCH_HTTP_TIMEOUT_MS   (3000)
+#define BENCH_HTTP_RX_SIZE      (8192)
+#define BENCH_COUNT_MAX         (100000)
+#define BENCH_SAMPLE_MS         (1000)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+typedef enum Bench_Mode_Tag
+{
+  Bench_Mode_None = 0,
+  Bench_Mode_Discover,
+  Bench_Mode_Poll,
+  Bench_Mode_Node
+
+}Bench_Mode_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+typedef struct Bench_Config_Tag
+{
+  Bench_Mode_T mode;
+  const char *host;
+  uint16_t coap_port;
+  uint16_t http_port;
+  unsigned long count;
+  bool binary;
+
+}Bench_Config_T;
+
+/* Node counters read from /metrics */
+typedef struct Bench_Metrics_Tag
+{
+  bool valid;
+  unsigned long coap_requests;
+  unsigned long coap_busy_us;
+  unsigned long http_requests;
+  unsigned long http_busy_us;
+
+}Bench_Metrics_T;
+
+/* Round trips of one run */
+typedef struct Bench_Run_Tag
+{
+  unsigned long *rtt_us;
+  unsigned long done;
+  unsigned long failed;
+  unsigned long retransmits;
+  unsigned long bytes;
+
+}Bench_Run_T;
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static volatile sig_atomic_t bench_stop = 0;
+
+static Bench_Config_T bench_cfg = {Bench_Mode_None, NULL, COAP_PORT, BENCH_HTTP_PORT, 100, false};
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+static void Bench_Signal(int sig)
+{
+  (void)sig;
+  bench_stop = 1;
+}
+
+
+static unsigned long Bench_NowUs()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000UL + (unsigned long)(ts.tv_nsec / 1000L);
+}
+
+
+static int Bench_Compare(const void *a, const void *b)
+{
+  unsigned long va = *(const unsigned long *)a;
+  unsigned long vb = *(const unsigned long *)b;
+
+  return (va > vb) - (va < vb);
+}
+
+
+static bool Bench_Address(const char *host, uint16_t port, struct sockaddr_in *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  return 1 == inet_pton(AF_INET, host, &addr->sin_addr);
+}
+
+
+/*
+ * Bench_Wait
+ *  - waits up to timeout_ms for the socket to become readable
+ */
+static bool Bench_Wait(int fd, unsigned long timeout_ms)
+{
+  struct pollfd pfd = {fd, POLLIN, 0};
+
+  return poll(&pfd, 1, (int)timeout_ms) > 0;
+}
+
+
+/*
+ * Bench_HttpGet
+ *  - GET over a new connection, whole response in rx (NUL terminated), returns its length (0 - failed)
+ */
+static size_t Bench_HttpGet(const char *path, char *rx, size_t size, size_t *tx_len)
+{
+  struct sockaddr_in addr;
+  char request[128];
+  size_t len = 0;
+  int fd;
+
+  *tx_len = (size_t)snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                             path, bench_cfg.host);
+
+  (void)Bench_Address(bench_cfg.host, bench_cfg.http_port, &addr);
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if((fd < 0) || (0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr))) ||
+     (send(fd, request, *tx_len, MSG_NOSIGNAL) != (ssize_t)*tx_len))
+  {
+    if(fd >= 0)
+    {
+      close(fd);
+    }
+    return 0;
+  }
+
+  while((len < (size - 1)) && Bench_Wait(fd, BENCH_HTTP_TIMEOUT_MS))
+  {
+    ssize_t got = recv(fd, &rx[len], size - 1 - len, 0);
+
+    if(got <= 0)
+    {
+      break;
+    }
+    len += (size_t)got;
+  }
+  close(fd);
+
+  rx[len] = '\0';
+  return (0 == strncmp(rx, "HTTP/1.", 7)) ? len : 0;
+}
+
+
+/*
+ * Bench_Metrics
+ *  - reads the request counters and busy time of both paths from /metrics
+ */
+static Bench_Metrics_T Bench_Metrics()
+{
+  static char rx[BENCH_HTTP_RX_SIZE];
+  Bench_Metrics_T metrics;
+  const char *const names[] = {"ibeacon_coap_requests_total ", "ibeacon_coap_busy_us_total ",
+                               "ibeacon_http_requests_total ", "ibeacon_http_busy_us_total "};
+  unsigned long *const values[] = {&metrics.coap_requests, &metrics.coap_busy_us,
+                                   &metrics.http_requests, &metrics.http_busy_us};
+  size_t tx_len;
+
+  memset(&metrics, 0, sizeof(metrics));
+  metrics.valid = (0 != Bench_HttpGet("/metrics", rx, sizeof(rx), &tx_len)) && (NULL != strstr(rx, " 200 "));
+
+  for(size_t idx = 0; metrics.valid && (idx < (sizeof(names) / sizeof(names[0]))); idx++)
+  {
+    const char *line = strstr(rx, names[idx]);
+
+    metrics.valid = (NULL != line);
+    *values[idx] = (NULL != line) ? strtoul(line + strlen(names[idx]), NULL, 10) : 0;
+  }
+  return metrics;
+}
+
+
+/*
+ * Bench_Report
+ *  - prints the round trip statistics, bytes and node time per request of one run
+ */
+static void Bench_Report(const char *name, Bench_Run_T *run, unsigned long busy_us, unsigned long requests)
+{
+  unsigned long long sum = 0;
+
+  printf("%-5s %lu ok, %lu failed, %lu retransmitted", name, run->done, run->failed, run->retransmits);
+
+  if(0 == run->done)
+  {
+    printf("\n");
+    return;
+  }
+
+  qsort(run->rtt_us, run->done, sizeof(run->rtt_us[0]), Bench_Compare);
+  for(unsigned long idx = 0; idx < run->done; idx++)
+  {
+    sum += run->rtt_us[idx];
+  }
+
+  printf("\n      rtt us: min %lu, avg %llu, p50 %lu, p99 %lu, max %lu\n", run->rtt_us[0], sum / run->done,
+         run->rtt_us[run->done / 2], run->rtt_us[(run->done * 99) / 100], run->rtt_us[run->done - 1]);
+  printf("      bytes/request (request + response payload of UDP/TCP): %lu\n", run->bytes / run->done);
+
+  if(0 != requests)
+  {
+    printf("      node busy: %lu us/request (%lu requests)\n", busy_us / requests, requests);
+  }
+  else
+  {
+    printf("      node busy: - (no /metrics)\n");
+  }
+}
+
+
+/*
+ * Bench_CoapGet
+ *  - one confirmable GET, retransmitted until the matching ACK arrives, returns the response length
+ */
+static size_t Bench_CoapGet(int fd, const struct sockaddr_in *addr, uint16_t msg_id, const char *path,
+                            uint8_t *rx, size_t size, Bench_Run_T *run, Coap_Message_T *resp)
+{
+  uint8_t tx[COAP_RX_MAX_SIZE];
+  uint8_t token[4] = {(uint8_t)(msg_id >> 8), (uint8_t)msg_id, 0xC0, 0xA9};
+  size_t tx_len = Coap_EncodeRequest(tx, sizeof(tx), Coap_Type_Con, msg_id, token, sizeof(token), path,
+                                     bench_cfg.binary ? COAP_FORMAT_BINARY : COAP_FORMAT_JSON);
+
+  for(uint8_t attempt = 0; (attempt <= BENCH_RETRANSMIT_MAX) && !bench_stop; attempt++)
+  {
+    unsigned long sent_us = Bench_NowUs();
+
+    run->retransmits += (0 != attempt) ? 1 : 0;
+    (void)sendto(fd, tx, tx_len, 0, (const struct sockaddr *)addr, sizeof(*addr));
+
+    while(Bench_Wait(fd, BENCH_RETRANSMIT_MS))
+    {
+      ssize_t len = recv(fd, rx, size, 0);
+
+      /* Late answers of earlier requests are skipped */
+      if((len > 0) && Coap_Parse(rx, (size_t)len, resp) && (Coap_Type_Ack == resp->type) &&
+         (msg_id == resp->msg_id) && (sizeof(token) == resp->token_len) &&
+         (0 == memcmp(token, resp->token, sizeof(token))))
+      {
+        run->rtt_us[run->done++] = Bench_NowUs() - sent_us;
+        run->bytes += tx_len + (size_t)len;
+        return (size_t)len;
+      }
+    }
+  }
+
+  run->failed++;
+  return 0;
+}
+
+
+/*
+ * Bench_Poll
+ *  - CoAP run and HTTP run against the node, node counters from /metrics around each run
+ */
+static int Bench_Poll()
+{
+  static char http_rx[BENCH_HTTP_RX_SIZE];
+  struct sockaddr_in addr;
+  uint8_t rx[COAP_TX_MAX_SIZE + 64];
+  Coap_Message_T resp;
+  Bench_Run_T coap_run;
+  Bench_Run_T http_run;
+  Bench_Metrics_T before;
+  Bench_Metrics_T after;
+  uint16_t msg_id = (uint16_t)(Bench_NowUs() & 0xFFFF);
+  int fd;
+
+  if(!Bench_Address(bench_cfg.host, bench_cfg.coap_port, &addr))
+  {
+    fprintf(stderr, "Address %s not valid (IPv4 only)\n", bench_cfg.host);
+    return 2;
+  }
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&coap_run, 0, sizeof(coap_run));
+  memset(&http_run, 0, sizeof(http_run));
+  coap_run.rtt_us = (unsigned long *)calloc(bench_cfg.count, sizeof(unsigned long));
+  http_run.rtt_us = (unsigned long *)calloc(bench_cfg.count, sizeof(unsigned long));
+  if((fd < 0) || (NULL == coap_run.rtt_us) || (NULL == http_run.rtt_us))
+  {
+    return 2;
+  }
+
+  /* First answer shows the resource, 5.03 - no sample measured yet */
+  if(0 != Bench_CoapGet(fd, &addr, msg_id++, "sensors", rx, sizeof(rx), &coap_run, &resp))
+  {
+    printf("coap://%s:%u/sensors -> %u.%02u, %u B: ", bench_cfg.host, bench_cfg.coap_port, resp.code >> 5,
+           resp.code & 0x1F, (unsigned)resp.payload_len);
+    if(COAP_FORMAT_JSON == resp.content_format)
+    {
+      printf("%.*s\n", (int)resp.payload_len, (const char *)resp.payload);
+    }
+    else
+    {
+      for(size_t idx = 0; idx < resp.payload_len; idx++)
+      {
+        printf("%02x", resp.payload[idx]);
+      }
+      printf("\n");
+    }
+  }
+  memset(coap_run.rtt_us, 0, bench_cfg.count * sizeof(unsigned long));
+  coap_run.done = 0;
+  coap_run.failed = 0;
+  coap_run.retransmits = 0;
+  coap_run.bytes = 0;
+
+  /* CoAP */
+  before = Bench_Metrics();
+  for(unsigned long idx = 0; (idx < bench_cfg.count) && !bench_stop; idx++)
+  {
+    (void)Bench_CoapGet(fd, &addr, msg_id++, (0 == (idx & 1)) ? "sensors" : "gpio", rx, sizeof(rx), &coap_run, &resp);
+  }
+  after = Bench_Metrics();
+
+  Bench_Report("CoAP", &coap_run, after.coap_busy_us - before.coap_busy_us,
+               (before.valid && after.valid) ? (after.coap_requests - before.coap_requests) : 0);
+
+  /* HTTP - what a collector without CoAP does, connection per request */
+  before = Bench_Metrics();
+  for(unsigned long idx = 0; (idx < bench_cfg.count) && !bench_stop; idx++)
+  {
+    unsigned long start_us = Bench_NowUs();
+    size_t tx_len;
+    size_t len = Bench_HttpGet("/sensors", http_rx, sizeof(http_rx), &tx_len);
+
+    if((0 == len) || (NULL == strstr(http_rx, " 200 ")))
+    {
+      http_run.failed++;
+      continue;
+    }
+    http_run.rtt_us[http_run.done++] = Bench_NowUs() - start_us;
+    http_run.bytes += tx_len + len;
+  }
+  after = Bench_Metrics();
+
+  Bench_Report("HTTP", &http_run, after.http_busy_us - before.http_busy_us,
+               (before.valid && after.valid) ? (after.http_requests - before.http_requests) : 0);
+
+  close(fd);
+  free(coap_run.rtt_us);
+  free(http_run.rtt_us);
+  return (bench_stop || (0 != coap_run.failed) || (0 != http_run.failed)) ? 1 : 0;
+}
+
+
+/*
+ * Bench_Discover
+ *  - multicast GET /.well-known/core, lists every node answering within BENCH_DISCOVERY_MS
+ */
+static int Bench_Discover()
+{
+  struct sockaddr_in addr;
+  uint8_t tx[COAP_RX_MAX_SIZE];
+  uint8_t rx[512];
+  uint8_t token[4] = {0xD1, 0x5C, 0x00, 0x01};
+  unsigned char ttl = 1;
+  unsigned char loop = 1;
+  unsigned long start_us = Bench_NowUs();
+  unsigned long nodes = 0;
+  size_t tx_len;
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+  if(fd < 0)
+  {
+    return 2;
+  }
+
+  /* Link-local only, a stand-in node on this host answers too */
+  (void)setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  (void)setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+  (void)Bench_Address("224.0.1.187", bench_cfg.coap_port, &addr);
+  tx_len = Coap_EncodeRequest(tx, sizeof(tx), Coap_Type_Non, (uint16_t)start_us, token, sizeof(token),
+                              ".well-known/core", COAP_FORMAT_NONE);
+
+  if(sendto(fd, tx, tx_len, 0, (struct sockaddr *)&addr, sizeof(addr)) != (ssize_t)tx_len)
+  {
+    perror("Discovery not sent");
+    close(fd);
+    return 1;
+  }
+
+  while(!bench_stop && ((Bench_NowUs() - start_us) < (BENCH_DISCOVERY_MS * 1000UL)))
+  {
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    Coap_Message_T resp;
+    ssize_t len;
+
+    if(!Bench_Wait(fd, BENCH_DISCOVERY_MS - ((Bench_NowUs() - start_us) / 1000UL)))
+    {
+      break;
+    }
+
+    len = recvfrom(fd, rx, sizeof(rx), 0, (struct sockaddr *)&from, &from_len);
+    if((len > 0) && Coap_Parse(rx, (size_t)len, &resp) && (COAP_CODE_CONTENT == resp.code) &&
+       (sizeof(token) == resp.token_len) && (0 == memcmp(token, resp.token, sizeof(token))))
+    {
+      printf("%s:%u  %4lu ms  %.*s\n", inet_ntoa(from.sin_addr), ntohs(from.sin_port),
+             (Bench_NowUs() - start_us) / 1000UL, (int)resp.payload_len, (const char *)resp.payload);
+      nodes++;
+    }
+  }
+
+  printf("%lu node(s) found\n", nodes);
+  close(fd);
+  return (0 != nodes) ? 0 : 1;
+}
+
+
+/*
+ * Bench_NodeSample
+ *  - synthetic sample in the snapshot (changes every BENCH_SAMPLE_MS as the sensor task)
+ */
+static void Bench_NodeSample(Coap_Snapshot_T *snapshot, uint32_t seq)
+{
+  Mqtt_Sample_T sample;
+
+  sample.seq = seq;
+  sample.time_ms = seq * BENCH_SAMPLE_MS;
+  sample.epoch = (uint32_t)time(NULL);
+  sample.temperature_cdeg = (int16_t)(2150 + (seq % 50));
+  sample.humidity_cpct = 4012;
+  sample.pressure_pa = 101325;
+  sample.light = (uint16_t)(512 + (seq % 16));
+  Coap_SnapshotSensors(snapshot, &sample);
+}
+
+
+/*
+ * Bench_NodeHttp
+ *  - answers one HTTP request (/sensors, /metrics) and closes the connection
+ */
+static void Bench_NodeHttp(int fd, const Coap_Snapshot_T *snapshot, unsigned long *requests, unsigned long *busy_us,
+                           unsigned long coap_requests, unsigned long coap_busy_us)
+{
+  unsigned long start_us = Bench_NowUs();
+  char rx[1024];
+  char body[512];
+  char header[160];
+  size_t len = 0;
+  size_t body_len;
+  unsigned status = 200;
+  const char *type = "text/plain";
+
+  while((len < (sizeof(rx) - 1)) && Bench_Wait(fd, BENCH_HTTP_TIMEOUT_MS))
+  {
+    ssize_t got = recv(fd, &rx[len], sizeof(rx) - 1 - len, 0);
+
+    if(got <= 0)
+    {
+      break;
+    }
+    len += (size_t)got;
+    rx[len] = '\0';
+
+    if(NULL != strstr(rx, "\r\n\r\n"))
+    {
+      break;
+    }
+  }
+  rx[len] = '\0';
+
+  /* As markResponse() - counted before the answer is built */
+  (*requests)++;
+
+  if(0 == strncmp(rx, "GET /sensors ", 13))
+  {
+    type = "application/json";
+    body_len = snapshot->sensors_json_len;
+    memcpy(body, snapshot->sensors_json, body_len);
+  }
+  else if(0 == strncmp(rx, "GET /metrics ", 13))
+  {
+    body_len = (size_t)snprintf(body, sizeof(body),
+                                "ibeacon_coap_requests_total %lu\nibeacon_coap_busy_us_total %lu\n"
+                                "ibeacon_http_requests_total %lu\nibeacon_http_busy_us_total %lu\n",
+                                coap_requests, coap_busy_us, *requests, *busy_us);
+  }
+  else
+  {
+    status = 404;
+    body_len = (size_t)snprintf(body, sizeof(body), "Not found\n");
+  }
+
+  len = (size_t)snprintf(header, sizeof(header), "HTTP/1.1 %u %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n"
+                         "Connection: close\r\n\r\n", status, (200 == status) ? "OK" : "Not Found", type,
+                         (unsigned)body_len);
+  (void)send(fd, header, len, MSG_NOSIGNAL);
+  (void)send(fd, body, body_len, MSG_NOSIGNAL);
+  close(fd);
+
+  *busy_us += Bench_NowUs() - start_us;
+}
+
+
+/*
+ * Bench_Node
+ *  - stand-in node: CoAP on the unicast port and the group (answers at once), HTTP next to it
+ */
+static int Bench_Node()
+{
+  Coap_Snapshot_T snapshot;
+  struct sockaddr_in addr;
+  struct ip_mreq mreq;
+  const uint8_t pins[] = {2, 14};
+  const uint8_t levels[] = {255, 0};
+  unsigned long coap_requests = 0;
+  unsigned long coap_busy_us = 0;
+  unsigned long http_requests = 0;
+  unsigned long http_busy_us = 0;
+  unsigned long sample_us = Bench_NowUs();
+  uint32_t seq = 0;
+  uint16_t msg_id = 0x4000;
+  int one = 1;
+  int udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  Coap_SnapshotInit(&snapshot);
+  Coap_SnapshotGpio(&snapshot, pins, levels, sizeof(pins));
+  Bench_NodeSample(&snapshot, seq++);
+
+  (void)setsockopt(udp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  (void)setsockopt(udp_fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+  (void)setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  (void)Bench_Address("0.0.0.0", bench_cfg.coap_port, &addr);
+  if((0 != bind(udp_fd, (struct sockaddr *)&addr, sizeof(addr))))
+  {
+    fprintf(stderr, "UDP port %u not available\n", bench_cfg.coap_port);
+    return 2;
+  }
+
+  (void)Bench_Address("0.0.0.0", bench_cfg.http_port, &addr);
+  if((0 != bind(tcp_fd, (struct sockaddr *)&addr, sizeof(addr))) || (0 != listen(tcp_fd, 16)))
+  {
+    fprintf(stderr, "TCP port %u not available\n", bench_cfg.http_port);
+    return 2;
+  }
+
+  (void)inet_pton(AF_INET, "224.0.1.187", &mreq.imr_multiaddr);
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  if(0 != setsockopt(udp_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)))
+  {
+    perror("Group not joined (unicast only)");
+  }
+
+  printf("Stand-in node: coap udp/%u, http tcp/%u (host timings - not an ESP8266 benchmark)\n",
+         bench_cfg.coap_port, bench_cfg.http_port);
+  fflush(stdout);
+
+  while(!bench_stop)
+  {
+    struct pollfd pfds[2] = {{udp_fd, POLLIN, 0}, {tcp_fd, POLLIN, 0}};
+
+    if((Bench_NowUs() - sample_us) >= (BENCH_SAMPLE_MS * 1000UL))
+    {
+      sample_us += BENCH_SAMPLE_MS * 1000UL;
+      Bench_NodeSample(&snapshot, seq++);
+    }
+
+    if(poll(pfds, 2, 100) <= 0)
+    {
+      continue;
+    }
+
+    if(0 != (pfds[0].revents & POLLIN))
+    {
+      unsigned long start_us = Bench_NowUs();
+      uint8_t rx[COAP_RX_MAX_SIZE + 1];
+      uint8_t tx[COAP_TX_MAX_SIZE];
+      uint8_t control[64];
+      struct sockaddr_in from;
+      struct iovec iov = {rx, sizeof(rx)};
+      struct msghdr msg;
+      Coap_Message_T req;
+      bool multicast = false;
+      ssize_t len;
+      size_t tx_len;
+
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &from;
+      msg.msg_namelen = sizeof(from);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      len = recvmsg(udp_fd, &msg, 0);
+
+      /* Destination address tells the group request from the unicast one (as destinationIP()) */
+      for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+        if((IPPROTO_IP == cmsg->cmsg_level) && (IP_PKTINFO == cmsg->cmsg_type))
+        {
+          struct in_pktinfo info;
+
+          memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+          multicast = IN_MULTICAST(ntohl(info.ipi_addr.s_addr));
+        }
+      }
+
+      if((len > 0) && (len <= COAP_RX_MAX_SIZE) && Coap_Parse(rx, (size_t)len, &req))
+      {
+        tx_len = Coap_Respond(&snapshot, &req, multicast, msg_id, tx, sizeof(tx));
+        if(0 != tx_len)
+        {
+          msg_id++;
+          coap_requests++;
+          (void)sendto(udp_fd, tx, tx_len, 0, (struct sockaddr *)&from, sizeof(from));
+        }
+      }
+      coap_busy_us += Bench_NowUs() - start_us;
+    }
+
+    if(0 != (pfds[1].revents & POLLIN))
+    {
+      int fd = accept(tcp_fd, NULL, NULL);
+
+      if(fd >= 0)
+      {
+        Bench_NodeHttp(fd, &snapshot, &http_requests, &http_busy_us, coap_requests, coap_busy_us);
+      }
+    }
+  }
+
+  printf("Stand-in node: %lu CoAP, %lu HTTP requests\n", coap_requests, http_requests);
+  close(udp_fd);
+  close(tcp_fd);
+  return 0;
+}
+
+
+/*
+ * Bench_Check
+ *  - encodes the request, answers it from the snapshot and parses the response
+ */
+static bool Bench_Check(const Coap_Snapshot_T *snapshot, uint8_t type, const char *path, int16_t accept,
+                        bool multicast, uint8_t code, Coap_Message_T *resp)
+{
+  uint8_t req_buf[COAP_RX_MAX_SIZE];
+  uint8_t resp_buf[COAP_TX_MAX_SIZE];
+  uint8_t token[3] = {0x01, 0x02, 0x03};
+  Coap_Message_T req;
+  size_t len = Coap_EncodeRequest(req_buf, sizeof(req_buf), type, 0x1234, token, sizeof(token), path, accept);
+
+  if((0 == len) || !Coap_Parse(req_buf, len, &req))
+  {
+    return false;
+  }
+
+  len = Coap_Respond(snapshot, &req, multicast, 0x7700, resp_buf, sizeof(resp_buf));
+  if(0 == code)
+  {
+    return 0 == len;
+  }
+
+  static uint8_t keep[COAP_TX_MAX_SIZE];
+
+  /* Payload of the parsed response points into the buffer */
+  memcpy(keep, resp_buf, len);
+  return (0 != len) && Coap_Parse(keep, len, resp) && (code == resp->code) && (3 == resp->token_len) &&
+         (0 == memcmp(token, resp->token, sizeof(token))) &&
+         (((Coap_Type_Con == type) && (Coap_Type_Ack == resp->type) && (0x1234 == resp->msg_id)) ||
+          ((Coap_Type_Non == type) && (Coap_Type_Non == resp->type) && (0x7700 == resp->msg_id)));
+}
+
+
+static uint32_t Bench_Get32(const uint8_t *buf)
+{
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+
+static int Bench_SelfTest()
+{
+  Coap_Snapshot_T snapshot;
+  Coap_Message_T msg;
+  Mqtt_Sample_T sample;
+  uint8_t buf[COAP_TX_MAX_SIZE];
+  char json[MQTT_SAMPLE_JSON_MAX_SIZE];
+  const uint8_t pins[] = {2, 14};
+  const uint8_t levels[] = {255, 0};
+  unsigned long failures = 0;
+  size_t len;
+
+  /* Request encoding */
+  len = Coap_EncodeRequest(buf, sizeof(buf), Coap_Type_Con, 0xBEEF, (const uint8_t *)"ab", 2, "/.well-known/core/",
+                           COAP_FORMAT_LINK);
+  if((0 == len) || !Coap_Parse(buf, len, &msg) || (0 != strcmp(msg.path, ".well-known/core")) ||
+     (COAP_FORMAT_LINK != msg.accept) || (0xBEEF != msg.msg_id) || (COAP_CODE_GET != msg.code) ||
+     (2 != msg.token_len) || msg.bad_option || (0 != msg.payload_len))
+  {
+    printf("FAIL request encoding\n");
+    failures++;
+  }
+
+  /* Resources before the first sample */
+  Coap_SnapshotInit(&snapshot);
+  if(!Bench_Check(&snapshot, Coap_Type_Con, "sensors", COAP_FORMAT_NONE, false, COAP_CODE_UNAVAILABLE, &msg) ||
+     !Bench_Check(&snapshot, Coap_Type_Con, "sensors", COAP_FORMAT_NONE, true, 0, &msg))
+  {
+    printf("FAIL no sample\n");
+    failures++;
+  }
+
+  /* Sensors */
+  memset(&sample, 0, sizeof(sample));
+  sample.seq = 42;
+  sample.time_ms = 123456;
+  sample.epoch = 1700000000;
+  sample.temperature_cdeg = -512;
+  sample.humidity_cpct = 4012;
+  sample.pressure_pa = 101325;
+  sample.light = 777;
+  Coap_SnapshotSensors(&snapshot, &sample);
+  len = Mqtt_SampleFormat(json, sizeof(json), &sample);
+
+  if(!Bench_Check(&snapshot, Coap_Type_Con, "sensors", COAP_FORMAT_NONE, false, COAP_CODE_CONTENT, &msg) ||
+     (COAP_FORMAT_JSON != msg.content_format) || (len != msg.payload_len) || (0 != memcmp(json, msg.payload, len)))
+  {
+    printf("FAIL sensors JSON\n");
+    failures++;
+  }
+
+  if(!Bench_Check(&snapshot, Coap_Type_Non, "sensors", COAP_FORMAT_BINARY, false, COAP_CODE_CONTENT, &msg) ||
+     (COAP_FORMAT_BINARY != msg.content_format) || (24 != msg.payload_len) || (1 != msg.payload[0]) ||
+     (1 != msg.payload[1]) || (42 != Bench_Get32(&msg.payload[2])) || (123456 != Bench_Get32(&msg.payload[6])) ||
+     (1700000000 != Bench_Get32(&msg.payload[10])) ||
+     (-512 != (int16_t)(msg.payload[14] | (msg.payload[15] << 8))) || (101325 != Bench_Get32(&msg.payload[18])) ||
+     (777 != (msg.payload[22] | (msg.payload[23] << 8))))
+  {
+    printf("FAIL sensors binary\n");
+    failures++;
+  }
+
+  /* GPIO */
+  Coap_SnapshotGpio(&snapshot, pins, levels, sizeof(pins));
+  if(!Bench_Check(&snapshot, Coap_Type_Con, "gpio", COAP_FORMAT_JSON, false, COAP_CODE_CONTENT, &msg) ||
+     (16 != msg.payload_len) || (0 != memcmp(msg.payload, "{\"2\":255,\"14\":0}", 16)) ||
+     !Bench_Check(&snapshot, Coap_Type_Con, "gpio", COAP_FORMAT_BINARY, false, COAP_CODE_CONTENT, &msg) ||
+     (6 != msg.payload_len) || (0 != memcmp(msg.payload, "\x01\x02\x02\xff\x0e\x00", 6)))
+  {
+    printf("FAIL gpio\n");
+    failures++;
+  }
+
+  /* Discovery - answered to the group, errors are not */
+  if(!Bench_Check(&snapshot, Coap_Type_Non, ".well-known/core", COAP_FORMAT_NONE, true, COAP_CODE_CONTENT, &msg) ||
+     (COAP_FORMAT_LINK != msg.content_format) ||
+     (0 != strncmp((const char *)msg.payload, "</sensors>;", 11)) ||
+     !Bench_Check(&snapshot, Coap_Type_Non, "missing", COAP_FORMAT_NONE, true, 0, &msg) ||
+     !Bench_Check(&snapshot, Coap_Type_Non, ".well-known/core", COAP_FORMAT_JSON, true, 0, &msg))
+  {
+    printf("FAIL discovery\n");
+    failures++;
+  }
+
+  /* Errors */
+  if(!Bench_Check(&snapshot, Coap_Type_Con, "missing", COAP_FORMAT_NONE, false, COAP_CODE_NOT_FOUND, &msg) ||
+     !Bench_Check(&snapshot, Coap_Type_Con, "sensors", COAP_FORMAT_TEXT, false, COAP_CODE_NOT_ACCEPTABLE, &msg) ||
+     !Bench_Check(&snapshot, Coap_Type_Con, "sensors/a/very/long/path/over/the/limit", COAP_FORMAT_NONE, false,
+                  COAP_CODE_NOT_FOUND, &msg))
+  {
+    printf("FAIL errors\n");
+    failures++;
+  }
+
+  /* POST, unknown critical option (9), elective options with 8 and 16 bit deltas, ping */
+  const uint8_t post[] = {0x40, 0x02, 0x00, 0x01, 0xB7, 's', 'e', 'n', 's', 'o', 'r', 's'};
+  const uint8_t critical[] = {0x40, 0x01, 0x00, 0x02, 0x90, 0x24, 'g', 'p', 'i', 'o'};
+  const uint8_t elective[] = {0x40, 0x01, 0x00, 0x03, 0xB4, 'g', 'p', 'i', 'o', 0xD1, 0x24, 0x05, 0xE0, 0x00, 0x09};
+  const uint8_t ping[] = {0x40, 0x00, 0x00, 0x04};
+  const struct {const uint8_t *data; size_t len; uint8_t code;} raw[] =
+  {
+    {post, sizeof(post), COAP_CODE_NOT_ALLOWED},
+    {critical, sizeof(critical), COAP_CODE_BAD_OPTION},
+    {elective, sizeof(elective), COAP_CODE_CONTENT},
+  };
+
+  for(size_t idx = 0; idx < (sizeof(raw) / sizeof(raw[0])); idx++)
+  {
+    len = Coap_Parse(raw[idx].data, raw[idx].len, &msg) ? Coap_Respond(&snapshot, &msg, false, 1, buf, sizeof(buf)) : 0;
+
+    if((len < 4) || (raw[idx].code != buf[1]) || (0x60 != buf[0]) || (0 != memcmp(&buf[2], &raw[idx].data[2], 2)))
+    {
+      printf("FAIL raw request %u (code %02x)\n", (unsigned)idx, (len >= 4) ? buf[1] : 0);
+      failures++;
+    }
+  }
+
+  len = Coap_Parse(ping, sizeof(ping), &msg) ? Coap_Respond(&snapshot, &msg, false, 1, buf, sizeof(buf)) : 0;
+  if((4 != len) || (0x70 != buf[0]) || (COAP_CODE_EMPTY != buf[1]) || (0 != buf[2]) || (4 != buf[3]))
+  {
+    printf("FAIL ping\n");
+    failures++;
+  }
+
+  /* Malformed - version, token length, truncated option, marker without payload, reserved nibble */
+  const uint8_t bad_version[] = {0x80, 0x01, 0x00, 0x01};
+  const uint8_t bad_token[] = {0x49, 0x01, 0x00, 0x01, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  const uint8_t bad_option[] = {0x40, 0x01, 0x00, 0x01, 0xB7, 's', 'e', 'n'};
+  const uint8_t bad_marker[] = {0x40, 0x01, 0x00, 0x01, 0xFF};
+  const uint8_t bad_nibble[] = {0x40, 0x01, 0x00, 0x01, 0xF1, 0x00};
+  const struct {const uint8_t *data; size_t len;} malformed[] =
+  {
+    {bad_version, sizeof(bad_version)},
+    {bad_token, sizeof(bad_token)},
+    {bad_option, sizeof(bad_option)},
+    {bad_marker, sizeof(bad_marker)},
+    {bad_nibble, sizeof(bad_nibble)},
+    {bad_version, 3},
+  };
+
+  for(size_t idx = 0; idx < (sizeof(malformed) / sizeof(malformed[0])); idx++)
+  {
+    if(Coap_Parse(malformed[idx].data, malformed[idx].len, &msg))
+    {
+      printf("FAIL malformed %u accepted\n", (unsigned)idx);
+      failures++;
+    }
+  }
+
+  /* ACK and responses are not answered */
+  const uint8_t ack[] = {0x60, 0x45, 0x00, 0x01};
+
+  if(!Coap_Parse(ack, sizeof(ack), &msg) || (0 != Coap_Respond(&snapshot, &msg, false, 1, buf, sizeof(buf))))
+  {
+    printf("FAIL response answered\n");
+    failures++;
+  }
+
+  printf("Self test: %s (%lu failures)\n", (0 == failures) ? "PASSED" : "FAILED", failures);
+  return (0 == failures) ? 0 : 1;
+}
+
+
+static void Bench_Usage()
+{
+  fprintf(stderr, "Usage: coap_bench -t\n"
+                  "       coap_bench -d [-p coap_port]\n"
+                  "       coap_bench -h node_ip [-n count] [-b] [-p coap_port] [-P http_port]\n"
+                  "       coap_bench -S [-p coap_port] [-P http_port]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  int opt;
+
+  while(-1 != (opt = getopt(argc, argv, "tdSh:n:bp:P:")))
+  {
+    switch(opt)
+    {
+      case 't': return Bench_SelfTest();
+      case 'd': bench_cfg.mode = Bench_Mode_Discover; break;
+      case 'S': bench_cfg.mode = Bench_Mode_Node; break;
+      case 'h': bench_cfg.mode = Bench_Mode_Poll; bench_cfg.host = optarg; break;
+      case 'n': bench_cfg.count = strtoul(optarg, NULL, 10); break;
+      case 'b': bench_cfg.binary = true; break;
+      case 'p': bench_cfg.coap_port = (uint16_t)strtoul(optarg, NULL, 10); break;
+      case 'P': bench_cfg.http_port = (uint16_t)strtoul(optarg, NULL, 10); break;
+      default: Bench_Usage(); return 2;
+    }
+  }
+
+  if((Bench_Mode_None == bench_cfg.mode) || (0 == bench_cfg.count) || (bench_cfg.count > BENCH_COUNT_MAX))
+  {
+    Bench_Usage();
+    return 2;
+  }
+
+  signal(SIGINT, Bench_Signal);
+  signal(SIGTERM, Bench_Signal);
+
+  switch(bench_cfg.mode)
+  {
+    case Bench_Mode_Discover: return Bench_Discover();
+    case Bench_Mode_Node: return Bench_Node();
+    default: return Bench_Poll();
+  }
+}
+
+/* EOF */
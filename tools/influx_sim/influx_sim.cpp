@@ -0,0 +1,968 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       influx_sim.cpp
+ *
+ *  Host-side stand-in of an InfluxDB /write endpoint and simulator of the line protocol writer
+ *  (influx_manager.cpp)
+ *
+ *    - stand-in server: HTTP/1.1 keep-alive, counts the lines of every POST, 204 on success
+ *    - simulated node: the same line, buffer, request and response code as the firmware
+ *      (influx_line.cpp), two buffers, one request at a time, doubling retry delay
+ *    - both run in one process, every sample is checked at the server - lost samples and samples
+ *      sharing a timestamp (the database keeps only one of them) fail the run
+ *      (duplicates of the batches sent again after a failed response are counted, not errors)
+ *    - -e answers every n-th request with 503, -k closes the connection after every n-th
+ *      response, -d delays the responses - the writer retries, reconnects and batches grow
+ *    - -s runs the stand-in server only (for a real node, "influx_url http://<host>:8086/write?db=x"),
+ *      statistics every 10 s
+ *    - -t runs the self test of the line and HTTP code and exits
+ *    - samples/s and bytes per sample (body and with HTTP header) are printed at the end
+ *
+ *  Build & run (from this directory):
+ *    g++ -std=c++11 -O2 -I../.. influx_sim.cpp ../../influx_line.cpp -o influx_sim
+ *    ./influx_sim -t
+ *    ./influx_sim -n 2000 -r 20 -a 1000 -e 7 -k 5 -d 50
+ *    ./influx_sim -s -p 8086
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "influx_line.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define SIM_SERVER_CONN_MAX     (8)
+#define SIM_SERVER_RX_SIZE      (16384)
+#define SIM_RESPONSE_TIMEOUT_MS (10000)
+#define SIM_RETRY_MIN_MS        (100)
+#define SIM_RETRY_MAX_MS        (6000)
+#define SIM_SAMPLES_MAX         (1000000)
+#define SIM_REPORT_MS           (10000)
+#define SIM_SERIES              "ibeacon,node=000sim"
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+typedef struct Sim_Config_Tag
+{
+  bool server_only;
+  uint16_t port;
+  unsigned long samples;
+  unsigned long period_ms;
+  unsigned long age_ms;
+  unsigned long error_every;
+  unsigned long close_every;
+  unsigned long delay_ms;
+
+}Sim_Config_T;
+
+/* One connection of the stand-in server */
+typedef struct Sim_Conn_Tag
+{
+  int fd;
+  size_t len;
+  bool reply_due;
+  bool reply_close;
+  unsigned reply_status;
+  unsigned long reply_ms;
+  char rx[SIM_SERVER_RX_SIZE];
+
+}Sim_Conn_T;
+
+typedef struct Sim_Server_Tag
+{
+  int listen_fd;
+  Sim_Conn_T conns[SIM_SERVER_CONN_MAX];
+  unsigned long requests;
+  unsigned long errors;
+  unsigned long closes;
+  unsigned long lines;
+  unsigned long received;
+  unsigned long duplicates;
+  unsigned long body_bytes;
+  unsigned long wire_bytes;
+  unsigned long first_ms;
+  unsigned long last_ms;
+
+}Sim_Server_T;
+
+/* Simulated node - the state of Influx_Manager */
+typedef struct Sim_Node_Tag
+{
+  int fd;
+  bool waiting;
+  Influx_Url_T url;
+  Influx_Buffer_T buffers[2];
+  uint8_t fill;
+  bool pending;
+  uint8_t attempt;
+  unsigned long retry_start_ms;
+  unsigned long retry_delay_ms;
+  unsigned long request_ms;
+  Influx_Response_T response;
+  unsigned long generated;
+  unsigned long written;
+  unsigned long requests;
+  unsigned long retries;
+  unsigned long connects;
+  unsigned long dropped;
+  unsigned long batch_max;
+
+}Sim_Node_T;
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static volatile sig_atomic_t sim_stop = 0;
+
+static Sim_Config_T sim_cfg = {false, 0, 1000, 10, 1000, 0, 0, 0};
+static Sim_Server_T sim_server;
+static Sim_Node_T sim_node;
+static uint8_t *sim_seen;
+
+/* Timestamp of every received sample - points with the same timestamp overwrite each other */
+static unsigned long long *sim_stamp;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+static void Sim_Signal(int sig)
+{
+  (void)sig;
+  sim_stop = 1;
+}
+
+
+static unsigned long Sim_Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
+
+static bool Sim_Write(int fd, const void *data, size_t len)
+{
+  const uint8_t *pos = (const uint8_t *)data;
+
+  while(0 != len)
+  {
+    ssize_t sent = send(fd, pos, len, MSG_NOSIGNAL);
+
+    if(sent <= 0)
+    {
+      return false;
+    }
+    pos += sent;
+    len -= (size_t)sent;
+  }
+  return true;
+}
+
+
+/*
+ * Sim_ServerInit
+ *  - opens the listening socket (loopback only unless -s)
+ */
+static bool Sim_ServerInit()
+{
+  struct sockaddr_in addr;
+  int one = 1;
+
+  sim_server.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(sim_server.listen_fd < 0)
+  {
+    return false;
+  }
+  (void)setsockopt(sim_server.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(sim_cfg.port);
+  addr.sin_addr.s_addr = htonl(sim_cfg.server_only ? INADDR_ANY : INADDR_LOOPBACK);
+
+  if((0 != bind(sim_server.listen_fd, (struct sockaddr *)&addr, sizeof(addr))) ||
+     (0 != listen(sim_server.listen_fd, 4)))
+  {
+    fprintf(stderr, "Port %u not available\n", sim_cfg.port);
+    return false;
+  }
+
+  for(int idx = 0; idx < SIM_SERVER_CONN_MAX; idx++)
+  {
+    sim_server.conns[idx].fd = -1;
+  }
+  return true;
+}
+
+
+/*
+ * Sim_ServerLines
+ *  - counts the lines of one body, seq and timestamp of every line are checked in the node simulation
+ */
+static void Sim_ServerLines(const char *body, size_t len)
+{
+  const char *end = body + len;
+
+  for(const char *line = body; line < end; )
+  {
+    const char *eol = (const char *)memchr(line, '\n', (size_t)(end - line));
+    const char *seq;
+    const char *stamp;
+
+    eol = (NULL != eol) ? eol : end;
+
+    /* Timestamp follows the second space (measurement and tags, fields) */
+    stamp = (const char *)memchr(line, ' ', (size_t)(eol - line));
+    stamp = (NULL != stamp) ? (const char *)memchr(stamp + 1, ' ', (size_t)(eol - stamp - 1)) : NULL;
+    sim_server.lines++;
+
+    for(seq = line; (seq + 4) < eol; seq++)
+    {
+      if(0 == memcmp(seq, ",seq=", 5))
+      {
+        break;
+      }
+    }
+
+    if(!sim_cfg.server_only && ((seq + 4) < eol))
+    {
+      unsigned long value = strtoul(seq + 5, NULL, 10);
+
+      if(value < sim_cfg.samples)
+      {
+        if(0 != sim_seen[value])
+        {
+          sim_server.duplicates++;
+        }
+        else
+        {
+          sim_server.received++;
+          sim_stamp[value] = (NULL != stamp) ? strtoull(stamp + 1, NULL, 10) : 0;
+        }
+        sim_seen[value] = 1;
+      }
+    }
+
+    line = eol + 1;
+  }
+}
+
+
+/*
+ * Sim_ServerRequest
+ *  - handles every complete request in the connection buffer, the response waits -d ms
+ */
+static bool Sim_ServerRequest(Sim_Conn_T &conn, unsigned long now_ms)
+{
+  char *header_end;
+  char *length;
+  size_t header_len;
+  size_t body_len = 0;
+
+  conn.rx[conn.len] = '\0';
+  header_end = strstr(conn.rx, "\r\n\r\n");
+  if((NULL == header_end) || conn.reply_due)
+  {
+    return (conn.len < (SIM_SERVER_RX_SIZE - 1));
+  }
+
+  header_len = (size_t)(header_end - conn.rx) + 4;
+  length = strstr(conn.rx, "Content-Length:");
+  if((NULL != length) && (length < header_end))
+  {
+    body_len = strtoul(length + 15, NULL, 10);
+  }
+
+  if((header_len + body_len) >= SIM_SERVER_RX_SIZE)
+  {
+    return false;
+  }
+  if(conn.len < (header_len + body_len))
+  {
+    return true;
+  }
+
+  sim_server.requests++;
+  conn.reply_status = 204;
+  conn.reply_close = (0 != sim_cfg.close_every) && (0 == (sim_server.requests % sim_cfg.close_every));
+
+  if((0 != sim_cfg.error_every) && (0 == (sim_server.requests % sim_cfg.error_every)))
+  {
+    conn.reply_status = 503;
+    sim_server.errors++;
+  }
+  else if(0 != strncmp(conn.rx, "POST /write?", 12))
+  {
+    conn.reply_status = 404;
+  }
+  else
+  {
+    Sim_ServerLines(&conn.rx[header_len], body_len);
+    sim_server.body_bytes += body_len;
+    sim_server.wire_bytes += header_len + body_len;
+    sim_server.first_ms = (0 == sim_server.first_ms) ? now_ms : sim_server.first_ms;
+    sim_server.last_ms = now_ms;
+  }
+
+  memmove(conn.rx, &conn.rx[header_len + body_len], conn.len - header_len - body_len);
+  conn.len -= header_len + body_len;
+  conn.reply_due = true;
+  conn.reply_ms = now_ms + sim_cfg.delay_ms;
+  return true;
+}
+
+
+static void Sim_ServerClose(Sim_Conn_T &conn)
+{
+  close(conn.fd);
+  conn.fd = -1;
+  conn.len = 0;
+  conn.reply_due = false;
+}
+
+
+/*
+ * Sim_ServerProcess
+ *  - accepts, receives the requests and sends the due responses
+ */
+static void Sim_ServerProcess(unsigned long now_ms)
+{
+  struct pollfd pfd = {sim_server.listen_fd, POLLIN, 0};
+
+  if(poll(&pfd, 1, 0) > 0)
+  {
+    int fd = accept(sim_server.listen_fd, NULL, NULL);
+    int idx;
+
+    for(idx = 0; (idx < SIM_SERVER_CONN_MAX) && (sim_server.conns[idx].fd >= 0); idx++)
+    {
+    }
+
+    if((fd >= 0) && (idx < SIM_SERVER_CONN_MAX))
+    {
+      (void)fcntl(fd, F_SETFL, O_NONBLOCK);
+      sim_server.conns[idx].fd = fd;
+    }
+    else if(fd >= 0)
+    {
+      close(fd);
+    }
+  }
+
+  for(int idx = 0; idx < SIM_SERVER_CONN_MAX; idx++)
+  {
+    Sim_Conn_T &conn = sim_server.conns[idx];
+
+    if(conn.fd < 0)
+    {
+      continue;
+    }
+
+    ssize_t len = recv(conn.fd, &conn.rx[conn.len], SIM_SERVER_RX_SIZE - 1 - conn.len, 0);
+
+    if((0 == len) || ((len < 0) && (EAGAIN != errno) && (EWOULDBLOCK != errno)))
+    {
+      Sim_ServerClose(conn);
+      continue;
+    }
+    conn.len += (len > 0) ? (size_t)len : 0;
+
+    if(!Sim_ServerRequest(conn, now_ms))
+    {
+      Sim_ServerClose(conn);
+      continue;
+    }
+
+    if(conn.reply_due && ((long)(now_ms - conn.reply_ms) >= 0))
+    {
+      char reply[160];
+      const char *body = (204 == conn.reply_status) ? "" : "{\"error\":\"stand-in\"}";
+      int reply_len = snprintf(reply, sizeof(reply), "HTTP/1.1 %u %s\r\n%sContent-Length: %zu\r\n\r\n%s",
+                               conn.reply_status, (204 == conn.reply_status) ? "No Content" : "Error",
+                               conn.reply_close ? "Connection: close\r\n" : "",
+                               (204 == conn.reply_status) ? (size_t)0 : strlen(body),
+                               (204 == conn.reply_status) ? "" : body);
+
+      conn.reply_due = false;
+      if(!Sim_Write(conn.fd, reply, (size_t)reply_len) || conn.reply_close)
+      {
+        sim_server.closes += conn.reply_close ? 1 : 0;
+        Sim_ServerClose(conn);
+      }
+    }
+  }
+}
+
+
+/*
+ * Sim_NodeRetry
+ *  - closes the connection, the pending batch is sent again after the doubling delay
+ */
+static void Sim_NodeRetry(const char *reason, unsigned long now_ms)
+{
+  sim_node.retry_delay_ms = SIM_RETRY_MIN_MS << ((sim_node.attempt < 6) ? sim_node.attempt : 6);
+  sim_node.retry_delay_ms = (sim_node.retry_delay_ms > SIM_RETRY_MAX_MS) ? SIM_RETRY_MAX_MS : sim_node.retry_delay_ms;
+  sim_node.retry_delay_ms += (unsigned long)rand() % (sim_node.retry_delay_ms / 4 + 1);
+
+  if(NULL != reason)
+  {
+    printf("Node: %s, retry in %lu ms\n", reason, sim_node.retry_delay_ms);
+  }
+
+  if(sim_node.fd >= 0)
+  {
+    close(sim_node.fd);
+    sim_node.fd = -1;
+  }
+
+  sim_node.waiting = false;
+  sim_node.retry_start_ms = now_ms;
+  sim_node.attempt++;
+  sim_node.retries++;
+}
+
+
+static bool Sim_NodeConnect()
+{
+  struct sockaddr_in addr;
+  int one = 1;
+
+  sim_node.fd = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(sim_node.url.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  /* Server runs in the same loop - connect completes in the backlog */
+  if((sim_node.fd < 0) || (0 != connect(sim_node.fd, (struct sockaddr *)&addr, sizeof(addr))))
+  {
+    if(sim_node.fd >= 0)
+    {
+      close(sim_node.fd);
+      sim_node.fd = -1;
+    }
+    return false;
+  }
+
+  (void)setsockopt(sim_node.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  (void)fcntl(sim_node.fd, F_SETFL, O_NONBLOCK);
+  sim_node.connects++;
+  return true;
+}
+
+
+/*
+ * Sim_NodeSample
+ *  - appends one synthetic sample, as Influx_OnSample()
+ *  - samples catching up after a stall wait for the next millisecond (the sensor period is 100 ms at least),
+ *    returns false when the sample was not taken yet
+ */
+static bool Sim_NodeSample(unsigned long now_ms)
+{
+  static unsigned long long last_stamp = 0;
+  Mqtt_Sample_T sample;
+  char line[INFLUX_LINE_MAX_SIZE];
+  struct timeval now;
+  unsigned long long stamp;
+  size_t len;
+
+  gettimeofday(&now, NULL);
+  stamp = ((unsigned long long)now.tv_sec * 1000ULL) + (unsigned long long)(now.tv_usec / 1000);
+  if(stamp == last_stamp)
+  {
+    return false;
+  }
+  last_stamp = stamp;
+
+  sample.seq = (uint32_t)sim_node.generated++;
+  sample.time_ms = (uint32_t)now_ms;
+  sample.epoch = (uint32_t)now.tv_sec;
+  sample.temperature_cdeg = (int16_t)(2150 - (int)(sample.seq % 3000));
+  sample.humidity_cpct = (uint16_t)(4000 + (sample.seq % 100));
+  sample.pressure_pa = 101325;
+  sample.light = (uint16_t)(sample.seq & 0x3FF);
+
+  len = Influx_LineFormat(line, sizeof(line), SIM_SERIES, &sample, (uint16_t)(now.tv_usec / 1000));
+
+  if(Influx_BufferAppend(&sim_node.buffers[sim_node.fill], line, len, (uint32_t)now_ms))
+  {
+    return true;
+  }
+
+  if(!sim_node.pending)
+  {
+    sim_node.pending = true;
+    sim_node.fill ^= 1;
+    sim_node.attempt = 0;
+    sim_node.retry_delay_ms = 0;
+
+    if(Influx_BufferAppend(&sim_node.buffers[sim_node.fill], line, len, (uint32_t)now_ms))
+    {
+      return true;
+    }
+  }
+
+  sim_node.dropped++;
+  return true;
+}
+
+
+/*
+ * Sim_NodeProcess
+ *  - flush by size or age, one request at a time, as Influx_Process()
+ */
+static void Sim_NodeProcess(unsigned long now_ms)
+{
+  if(!sim_node.pending && Influx_BufferDue(&sim_node.buffers[sim_node.fill], (uint32_t)now_ms, (uint32_t)sim_cfg.age_ms))
+  {
+    sim_node.pending = true;
+    sim_node.fill ^= 1;
+    sim_node.attempt = 0;
+    sim_node.retry_delay_ms = 0;
+  }
+
+  Influx_Buffer_T &buffer = sim_node.buffers[sim_node.fill ^ 1];
+
+  if(sim_node.waiting)
+  {
+    uint8_t rx[256];
+    ssize_t len = recv(sim_node.fd, rx, sizeof(rx), 0);
+
+    if((0 == len) || ((len < 0) && (EAGAIN != errno) && (EWOULDBLOCK != errno)))
+    {
+      Sim_NodeRetry("Connection lost", now_ms);
+      return;
+    }
+
+    for(ssize_t idx = 0; idx < len; idx++)
+    {
+      Influx_Feed_T result = Influx_ResponseFeed(&sim_node.response, rx[idx]);
+
+      if(Influx_Feed_Error == result)
+      {
+        Sim_NodeRetry("Malformed response", now_ms);
+        return;
+      }
+
+      if(Influx_Feed_Done != result)
+      {
+        continue;
+      }
+
+      /* The stand-in server sends one response at a time - nothing follows it */
+      sim_node.waiting = false;
+      if(sim_node.response.close)
+      {
+        close(sim_node.fd);
+        sim_node.fd = -1;
+      }
+
+      if((sim_node.response.status < 200) || (sim_node.response.status >= 300))
+      {
+        char reason[24];
+
+        snprintf(reason, sizeof(reason), "HTTP %u", sim_node.response.status);
+        Sim_NodeRetry(reason, now_ms);
+        return;
+      }
+
+      sim_node.written += buffer.count;
+      sim_node.batch_max = (buffer.count > sim_node.batch_max) ? buffer.count : sim_node.batch_max;
+      Influx_BufferInit(&buffer);
+      sim_node.pending = false;
+      return;
+    }
+
+    if((now_ms - sim_node.request_ms) >= SIM_RESPONSE_TIMEOUT_MS)
+    {
+      Sim_NodeRetry("No response", now_ms);
+    }
+    return;
+  }
+
+  if(!sim_node.pending || ((now_ms - sim_node.retry_start_ms) < sim_node.retry_delay_ms))
+  {
+    return;
+  }
+
+  if((sim_node.fd < 0) && !Sim_NodeConnect())
+  {
+    Sim_NodeRetry("Not connected", now_ms);
+    return;
+  }
+
+  char header[INFLUX_HEADER_MAX_SIZE];
+  size_t header_len = Influx_RequestFormat(header, sizeof(header), &sim_node.url, buffer.len);
+
+  if(!Sim_Write(sim_node.fd, header, header_len) || !Sim_Write(sim_node.fd, buffer.data, buffer.len))
+  {
+    Sim_NodeRetry("Request not sent", now_ms);
+    return;
+  }
+
+  Influx_ResponseReset(&sim_node.response);
+  sim_node.waiting = true;
+  sim_node.request_ms = now_ms;
+  sim_node.requests++;
+}
+
+
+/*
+ * Sim_Rate
+ *  - prints samples/s and bytes per sample of the received lines
+ */
+static void Sim_Rate(unsigned long lines, unsigned long body_bytes, unsigned long wire_bytes, unsigned long elapsed_ms)
+{
+  printf("Rate: %.2f samples/s, %.1f bytes/sample (%.1f with HTTP header)\n",
+         (0 != elapsed_ms) ? ((double)lines * 1000.0 / elapsed_ms) : 0.0,
+         (0 != lines) ? ((double)body_bytes / lines) : 0.0,
+         (0 != lines) ? ((double)wire_bytes / lines) : 0.0);
+}
+
+
+static int Sim_RunServer()
+{
+  unsigned long report_ms = Sim_Now();
+  unsigned long lines = 0;
+  unsigned long body_bytes = 0;
+  unsigned long wire_bytes = 0;
+
+  printf("Stand-in /write server on port %u\n", sim_cfg.port);
+
+  while(!sim_stop)
+  {
+    unsigned long now_ms = Sim_Now();
+
+    Sim_ServerProcess(now_ms);
+
+    if((now_ms - report_ms) >= SIM_REPORT_MS)
+    {
+      printf("Requests: %lu, lines: %lu, errors injected: %lu\n", sim_server.requests, sim_server.lines, sim_server.errors);
+      Sim_Rate(sim_server.lines - lines, sim_server.body_bytes - body_bytes, sim_server.wire_bytes - wire_bytes,
+               now_ms - report_ms);
+      lines = sim_server.lines;
+      body_bytes = sim_server.body_bytes;
+      wire_bytes = sim_server.wire_bytes;
+      report_ms = now_ms;
+    }
+    usleep(1000);
+  }
+
+  printf("Total requests: %lu, lines: %lu\n", sim_server.requests, sim_server.lines);
+  Sim_Rate(sim_server.lines, sim_server.body_bytes, sim_server.wire_bytes, sim_server.last_ms - sim_server.first_ms);
+  return 0;
+}
+
+
+static int Sim_CompareStamp(const void *a, const void *b)
+{
+  unsigned long long va = *(const unsigned long long *)a;
+  unsigned long long vb = *(const unsigned long long *)b;
+
+  return (va > vb) - (va < vb);
+}
+
+
+static int Sim_Run()
+{
+  char url[64];
+  unsigned long start_ms = Sim_Now();
+  unsigned long next_sample_ms = start_ms;
+  unsigned long lost = 0;
+  unsigned long overwritten = 0;
+
+  snprintf(url, sizeof(url), "http://127.0.0.1:%u/write?db=sim", sim_cfg.port);
+  if(!Influx_ParseUrl(url, &sim_node.url))
+  {
+    return 1;
+  }
+
+  sim_node.fd = -1;
+  Influx_BufferInit(&sim_node.buffers[0]);
+  Influx_BufferInit(&sim_node.buffers[1]);
+  sim_seen = (uint8_t *)calloc(sim_cfg.samples, 1);
+  sim_stamp = (unsigned long long *)calloc(sim_cfg.samples, sizeof(unsigned long long));
+  srand(1);
+
+  while(!sim_stop)
+  {
+    unsigned long now_ms = Sim_Now();
+
+    if((sim_node.generated < sim_cfg.samples) && ((long)(now_ms - next_sample_ms) >= 0) && Sim_NodeSample(now_ms))
+    {
+      next_sample_ms += sim_cfg.period_ms;
+    }
+
+    Sim_NodeProcess(now_ms);
+    Sim_ServerProcess(now_ms);
+
+    if((sim_node.generated == sim_cfg.samples) && !sim_node.pending && (0 == sim_node.buffers[sim_node.fill].count))
+    {
+      break;
+    }
+    usleep(500);
+  }
+
+  for(unsigned long seq = 0; seq < sim_cfg.samples; seq++)
+  {
+    lost += (0 == sim_seen[seq]) ? 1 : 0;
+  }
+  lost -= (sim_node.dropped < lost) ? sim_node.dropped : lost;
+
+  /* The server keeps one point per timestamp - samples sharing one are lost too */
+  qsort(sim_stamp, sim_cfg.samples, sizeof(sim_stamp[0]), Sim_CompareStamp);
+  for(unsigned long idx = 1; idx < sim_cfg.samples; idx++)
+  {
+    overwritten += ((0 != sim_stamp[idx]) && (sim_stamp[idx] == sim_stamp[idx - 1])) ? 1 : 0;
+  }
+
+  printf("Samples: %lu, written: %lu, dropped (buffers full): %lu, received: %lu, duplicates: %lu, lost: %lu, overwritten (same timestamp): %lu\n",
+         sim_node.generated, sim_node.written, sim_node.dropped, sim_server.received, sim_server.duplicates, lost,
+         overwritten);
+  printf("Requests: %lu (%.1f samples avg, %lu max), retries: %lu, connects: %lu, errors injected: %lu, closed by server: %lu\n",
+         sim_node.requests, (0 != sim_node.requests) ? ((double)sim_node.written / sim_node.requests) : 0.0,
+         sim_node.batch_max, sim_node.retries, sim_node.connects, sim_server.errors, sim_server.closes);
+  Sim_Rate(sim_server.lines, sim_server.body_bytes, sim_server.wire_bytes, Sim_Now() - start_ms);
+
+  free(sim_seen);
+  free(sim_stamp);
+  return (sim_stop || (0 != lost) || (0 != overwritten)) ? 1 : 0;
+}
+
+
+/*
+ * Sim_Response
+ *  - feeds the whole text, returns the last result
+ */
+static Influx_Feed_T Sim_Response(Influx_Response_T *resp, const char *text)
+{
+  Influx_Feed_T result = Influx_Feed_More;
+
+  Influx_ResponseReset(resp);
+  for(; ('\0' != *text) && (Influx_Feed_More == result); text++)
+  {
+    result = Influx_ResponseFeed(resp, (uint8_t)*text);
+  }
+  return ('\0' == *text) ? result : Influx_Feed_Error;
+}
+
+
+static int Sim_SelfTest()
+{
+  Influx_Url_T url;
+  Influx_Buffer_T buffer;
+  Influx_Response_T resp;
+  Mqtt_Sample_T sample;
+  char text[INFLUX_HEADER_MAX_SIZE];
+  unsigned long failures = 0;
+  size_t len;
+
+  /* URL */
+  if(!Influx_ParseUrl("http://db.local/write?db=env", &url) || (0 != strcmp(url.host, "db.local")) ||
+     (INFLUX_DEFAULT_PORT != url.port) || (0 != strcmp(url.path, "/write?db=env&precision=ms")))
+  {
+    printf("FAIL url default port\n");
+    failures++;
+  }
+
+  if(!Influx_ParseUrl("http://10.0.0.2:9999", &url) || (9999 != url.port) ||
+     (0 != strcmp(url.path, "/write?precision=ms")))
+  {
+    printf("FAIL url default path\n");
+    failures++;
+  }
+
+  const char *const bad_urls[] = {"https://db/write", "http://", "http://db:0/write", "http://db:70000/",
+                                  "http://db:x/write", "db:8086/write"};
+
+  for(size_t idx = 0; idx < (sizeof(bad_urls) / sizeof(bad_urls[0])); idx++)
+  {
+    if(Influx_ParseUrl(bad_urls[idx], &url))
+    {
+      printf("FAIL url %s accepted\n", bad_urls[idx]);
+      failures++;
+    }
+  }
+
+  /* Line */
+  memset(&sample, 0, sizeof(sample));
+  sample.seq = 7;
+  sample.temperature_cdeg = -5;
+  sample.humidity_cpct = 4012;
+  sample.pressure_pa = 101325;
+  sample.light = 512;
+
+  len = Influx_LineFormat(text, sizeof(text), SIM_SERIES, &sample, 0);
+  if((len != strlen(text)) ||
+     (0 != strcmp(text, SIM_SERIES " temp=-0.05,hum=40.12,pres=1013.25,light=512i,seq=7i\n")))
+  {
+    printf("FAIL line: %s", text);
+    failures++;
+  }
+
+  sample.epoch = 1700000000;
+  sample.temperature_cdeg = 2153;
+  len = Influx_LineFormat(text, sizeof(text), SIM_SERIES, &sample, 5);
+  if((len > INFLUX_LINE_MAX_SIZE) || (NULL == strstr(text, "temp=21.53,") || (NULL == strstr(text, "i 1700000000005\n"))))
+  {
+    printf("FAIL line with time: %s", text);
+    failures++;
+  }
+
+  /* Buffer - flush by size and age */
+  Influx_BufferInit(&buffer);
+  if(Influx_BufferDue(&buffer, 100000, 0))
+  {
+    printf("FAIL empty buffer due\n");
+    failures++;
+  }
+
+  for(uint32_t count = 0; Influx_BufferAppend(&buffer, text, len, 1000 + count); count++)
+  {
+    if((buffer.len < INFLUX_FLUSH_SIZE) && Influx_BufferDue(&buffer, 1000 + count, 5000))
+    {
+      printf("FAIL buffer due before size\n");
+      failures++;
+      break;
+    }
+  }
+
+  if(!Influx_BufferDue(&buffer, 1000, 5000) || (buffer.len > INFLUX_BUFFER_SIZE) ||
+     (buffer.count != (buffer.len / len)) || (1000 != buffer.first_ms))
+  {
+    printf("FAIL buffer full\n");
+    failures++;
+  }
+
+  Influx_BufferInit(&buffer);
+  (void)Influx_BufferAppend(&buffer, text, len, 0xFFFFFF00UL);
+  if(Influx_BufferDue(&buffer, 4999 - 0x100, 5000) || !Influx_BufferDue(&buffer, 5000 - 0x100, 5000))
+  {
+    printf("FAIL buffer age over millis() overflow\n");
+    failures++;
+  }
+
+  /* Request */
+  (void)Influx_ParseUrl("http://db.local:8086/write?db=env&u=node&p=secret", &url);
+  len = Influx_RequestFormat(text, sizeof(text), &url, 1000);
+  if((0 == len) || (0 != strncmp(text, "POST /write?db=env&u=node&p=secret&precision=ms HTTP/1.1\r\nHost: db.local:8086\r\n", 79)) ||
+     (NULL == strstr(text, "\r\nContent-Length: 1000\r\n\r\n")))
+  {
+    printf("FAIL request: %s\n", text);
+    failures++;
+  }
+
+  /* Response */
+  if((Influx_Feed_Done != Sim_Response(&resp, "HTTP/1.1 204 No Content\r\nX-Influxdb-Version: 1.8\r\n\r\n")) ||
+     (204 != resp.status) || resp.close)
+  {
+    printf("FAIL response 204\n");
+    failures++;
+  }
+
+  if((Influx_Feed_Done != Sim_Response(&resp, "HTTP/1.1 400 Bad Request\r\ncontent-length: 5\r\n\r\n{...}")) ||
+     (400 != resp.status) || resp.close)
+  {
+    printf("FAIL response with body\n");
+    failures++;
+  }
+
+  if((Influx_Feed_Done != Sim_Response(&resp, "HTTP/1.1 503 Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n")) ||
+     (503 != resp.status) || !resp.close)
+  {
+    printf("FAIL response close\n");
+    failures++;
+  }
+
+  if((Influx_Feed_Done != Sim_Response(&resp, "HTTP/1.0 204 No Content\r\n\r\n")) || !resp.close ||
+     (Influx_Feed_Done != Sim_Response(&resp, "HTTP/1.0 204 No Content\r\nConnection: keep-alive\r\n\r\n")) || resp.close)
+  {
+    printf("FAIL response HTTP/1.0\n");
+    failures++;
+  }
+
+  if((Influx_Feed_Done != Sim_Response(&resp, "HTTP/1.1 500 Error\r\nTransfer-Encoding: chunked\r\n\r\n")) || !resp.close)
+  {
+    printf("FAIL response chunked\n");
+    failures++;
+  }
+
+  if(Influx_Feed_Error != Sim_Response(&resp, "SSH-2.0-OpenSSH\r\n"))
+  {
+    printf("FAIL response not HTTP\n");
+    failures++;
+  }
+
+  printf("Self test: %s (%lu failures)\n", (0 == failures) ? "PASSED" : "FAILED", failures);
+  return (0 == failures) ? 0 : 1;
+}
+
+
+static void Sim_Usage()
+{
+  fprintf(stderr, "Usage: influx_sim -t\n"
+                  "       influx_sim -s [-p port] [-e error_every] [-k close_every] [-d delay_ms]\n"
+                  "       influx_sim [-p port] [-n samples] [-r period_ms] [-a flush_age_ms]\n"
+                  "                  [-e error_every] [-k close_every] [-d delay_ms]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  int opt;
+
+  while(-1 != (opt = getopt(argc, argv, "tsp:n:r:a:e:k:d:")))
+  {
+    switch(opt)
+    {
+      case 't': return Sim_SelfTest();
+      case 's': sim_cfg.server_only = true; break;
+      case 'p': sim_cfg.port = (uint16_t)strtoul(optarg, NULL, 10); break;
+      case 'n': sim_cfg.samples = strtoul(optarg, NULL, 10); break;
+      case 'r': sim_cfg.period_ms = strtoul(optarg, NULL, 10); break;
+      case 'a': sim_cfg.age_ms = strtoul(optarg, NULL, 10); break;
+      case 'e': sim_cfg.error_every = strtoul(optarg, NULL, 10); break;
+      case 'k': sim_cfg.close_every = strtoul(optarg, NULL, 10); break;
+      case 'd': sim_cfg.delay_ms = strtoul(optarg, NULL, 10); break;
+      default: Sim_Usage(); return 2;
+    }
+  }
+
+  /* Stand-in server on the InfluxDB port, the simulation next to it */
+  if(0 == sim_cfg.port)
+  {
+    sim_cfg.port = sim_cfg.server_only ? INFLUX_DEFAULT_PORT : (INFLUX_DEFAULT_PORT + 10000);
+  }
+
+  if((0 == sim_cfg.samples) || (sim_cfg.samples > SIM_SAMPLES_MAX) || !Sim_ServerInit())
+  {
+    Sim_Usage();
+    return 2;
+  }
+
+  signal(SIGINT, Sim_Signal);
+  signal(SIGTERM, Sim_Signal);
+
+  return sim_cfg.server_only ? Sim_RunServer() : Sim_Run();
+}
+
+/* EOF */
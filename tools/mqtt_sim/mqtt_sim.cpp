@@ -0,0 +1,881 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       mqtt_sim.cpp
+ *
+ *  Host-side node simulator of the MQTT client (mqtt_manager.cpp) for tests against a local broker
+ *
+ *    - the same packet, queue and batch code as the firmware (mqtt_packet.cpp), one batch waits
+ *      for PUBACK at a time
+ *    - synthetic samples every period, commands gpio/<n>/set and gpio/<n>/level/set are printed
+ *      and the output level is published back (retained)
+ *    - second connection (the backend) subscribes to the samples topic and checks every sample
+ *      arrived (duplicates of the batches sent again after reconnect are counted, not errors)
+ *    - -d holds the received bytes (slow link / broker latency) - batches grow
+ *    - -k closes the connection after every n-th batch before its PUBACK, -x keeps it closed
+ *      for the given time - samples wait in the queue (the oldest are dropped when it is full)
+ *    - -t runs the self test of the packet codec and the queue and exits
+ *
+ *  Build & run (from this directory) - the monitor receives whole batches:
+ *    g++ -std=c++11 -O2 -DMQTT_RX_MAX_SIZE=2048 -I../.. mqtt_sim.cpp ../../mqtt_packet.cpp -o mqtt_sim
+ *    ./mqtt_sim -t
+ *    mosquitto -p 1883 &
+ *    ./mqtt_sim -n 500 -r 20 -d 100 -k 7 -x 300
+ *    mosquitto_pub -t ibeacon/000sim/gpio/2/level/set -m 128     (while the simulator runs)
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "mqtt_packet.h"
+
+#if (MQTT_RX_MAX_SIZE < 1460)
+#error "Build with -DMQTT_RX_MAX_SIZE=2048 - own batches of samples are received back"
+#endif
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define SIM_TX_MAX_SIZE         (1460)
+#define SIM_TOPIC_MAX_SIZE      (64)
+#define SIM_PREFIX_MAX_SIZE     (32)
+#define SIM_KEEPALIVE_S         (60)
+#define SIM_ACK_TIMEOUT_MS      (10000)
+#define SIM_SAMPLES_MAX         (1000000)
+
+/* Own samples still on the way after the last PUBACK */
+#define SIM_DRAIN_MS            (1000)
+
+/* Outputs of the simulated node (GPIO numbers as D4, D5) */
+#define SIM_GPIO_COUNT          (2)
+
+/* Frames encoded by the self test */
+#define SIM_TEST_ROUNDS         (20000)
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+typedef struct Sim_Config_Tag
+{
+  const char *host;
+  const char *port;
+  const char *id;
+  unsigned long samples;
+  unsigned long period_ms;
+  unsigned long delay_ms;
+  unsigned long kill_every;
+  unsigned long offline_ms;
+
+}Sim_Config_T;
+
+typedef struct Sim_Stats_Tag
+{
+  unsigned long generated;
+  unsigned long batches;
+  unsigned long acked;
+  unsigned long received;
+  unsigned long duplicates;
+  unsigned long connects;
+  unsigned long kills;
+  unsigned long commands;
+  unsigned long batch_max;
+
+}Sim_Stats_T;
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static volatile sig_atomic_t sim_stop = 0;
+
+static Sim_Config_T sim_cfg = {"127.0.0.1", "1883", "000sim", 200, 20, 0, 0, 0};
+static Sim_Stats_T sim_stats;
+
+static Mqtt_Queue_T sim_queue;
+static Mqtt_Parser_T sim_parser;
+static Mqtt_Parser_T sim_monitor_parser;
+static uint8_t sim_tx[SIM_TX_MAX_SIZE];
+static char sim_prefix[SIM_PREFIX_MAX_SIZE];
+/* Per sample - received by the monitor, dropped from the full queue */
+#define SIM_SEEN                (0x01)
+#define SIM_DROPPED             (0x02)
+static uint8_t *sim_seen;
+
+static const unsigned sim_gpio_pins[SIM_GPIO_COUNT] = {2, 14};
+static int sim_gpio_levels[SIM_GPIO_COUNT];
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+static void Sim_Signal(int sig)
+{
+  (void)sig;
+  sim_stop = 1;
+}
+
+
+static unsigned long Sim_Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
+
+static int Sim_Connect()
+{
+  struct addrinfo hints;
+  struct addrinfo *res;
+  int fd = -1;
+  int one = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if(0 != getaddrinfo(sim_cfg.host, sim_cfg.port, &hints, &res))
+  {
+    fprintf(stderr, "Broker %s not resolved\n", sim_cfg.host);
+    return -1;
+  }
+
+  for(struct addrinfo *ai = res; (NULL != ai) && (fd < 0); ai = ai->ai_next)
+  {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+    if((fd >= 0) && (0 != connect(fd, ai->ai_addr, ai->ai_addrlen)))
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+
+  if(fd >= 0)
+  {
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+
+static bool Sim_Send(int fd, size_t len)
+{
+  size_t pos = 0;
+
+  if(0 == len)
+  {
+    return false;
+  }
+
+  while(pos < len)
+  {
+    ssize_t sent = send(fd, &sim_tx[pos], len - pos, MSG_NOSIGNAL);
+
+    if(sent <= 0)
+    {
+      return false;
+    }
+    pos += (size_t)sent;
+  }
+  return true;
+}
+
+
+static bool Sim_Publish(int fd, const char *suffix, const char *text, bool retain)
+{
+  char topic[SIM_TOPIC_MAX_SIZE];
+
+  snprintf(topic, sizeof(topic), "%s%s", sim_prefix, suffix);
+  return Sim_Send(fd, Mqtt_EncodePublish(sim_tx, sizeof(sim_tx), topic, (const uint8_t *)text, strlen(text),
+                                         0, retain, false, 0));
+}
+
+
+/*
+ * Sim_NextPacketId
+ *  - Next packet identifier, 0 is not allowed by MQTT 3.1.1 and skipped (same as the node)
+ */
+static uint16_t Sim_NextPacketId(uint16_t &packet_id)
+{
+  packet_id = (0xFFFF == packet_id) ? 1 : (packet_id + 1);
+  return packet_id;
+}
+
+
+/*
+ * Sim_Session
+ *  - CONNECT and subscriptions, node session also the will and the status,
+ *    monitor session (the backend) only the samples, returns false when the broker refused
+ */
+static bool Sim_Session(int fd, Mqtt_Parser_T &parser, bool node, uint16_t &packet_id)
+{
+  char client_id[32];
+  char will_topic[SIM_TOPIC_MAX_SIZE];
+  char topic[SIM_TOPIC_MAX_SIZE];
+  Mqtt_Connect_T conn;
+  uint8_t return_code = 0xFF;
+  uint8_t byte;
+
+  snprintf(client_id, sizeof(client_id), node ? "iBeacon-%s" : "iBeacon-%s-monitor", sim_cfg.id);
+  snprintf(will_topic, sizeof(will_topic), "%s/status", sim_prefix);
+
+  memset(&conn, 0, sizeof(conn));
+  conn.client_id = client_id;
+  conn.will_topic = node ? will_topic : NULL;
+  conn.will_payload = "offline";
+  conn.will_retain = true;
+  conn.keepalive_s = SIM_KEEPALIVE_S;
+
+  if(!Sim_Send(fd, Mqtt_EncodeConnect(sim_tx, sizeof(sim_tx), &conn)))
+  {
+    return false;
+  }
+
+  /* CONNACK is the first packet from the broker */
+  Mqtt_ParserReset(&parser);
+  while(recv(fd, &byte, 1, 0) == 1)
+  {
+    Mqtt_Feed_T result = Mqtt_ParserFeed(&parser, byte);
+
+    if(Mqtt_Feed_Error == result)
+    {
+      return false;
+    }
+    if(Mqtt_Feed_Packet == result)
+    {
+      break;
+    }
+  }
+
+  if(!Mqtt_DecodeConnack(&parser, &return_code) || (0 != return_code))
+  {
+    fprintf(stderr, "Broker refused the connection (code %u)\n", return_code);
+    return false;
+  }
+
+  const char *const filters[] = {"/samples", "/gpio/+/set", "/gpio/+/level/set"};
+
+  for(size_t idx = (node ? 1 : 0); idx < (node ? (sizeof(filters) / sizeof(filters[0])) : 1); idx++)
+  {
+    snprintf(topic, sizeof(topic), "%s%s", sim_prefix, filters[idx]);
+    if(!Sim_Send(fd, Mqtt_EncodeSubscribe(sim_tx, sizeof(sim_tx), Sim_NextPacketId(packet_id), topic, 0)))
+    {
+      return false;
+    }
+  }
+
+  if(!node)
+  {
+    return true;
+  }
+
+  for(uint8_t pin_id = 0; pin_id < SIM_GPIO_COUNT; pin_id++)
+  {
+    sim_gpio_levels[pin_id] = -1;
+  }
+
+  sim_stats.connects++;
+  return Sim_Publish(fd, "/status", "online", true);
+}
+
+
+/*
+ * Sim_Samples
+ *  - checks the samples received back from the broker
+ */
+static void Sim_Samples(const Mqtt_Message_T &msg)
+{
+  const char *text = (const char *)msg.payload;
+  const char *end = text + msg.payload_len;
+
+  for(const char *pos = text; pos < end; pos++)
+  {
+    unsigned long seq;
+
+    if((size_t)(end - pos) < 7 || (0 != memcmp(pos, "\"seq\":", 6)))
+    {
+      continue;
+    }
+
+    seq = strtoul(pos + 6, NULL, 10);
+    if(seq < sim_cfg.samples)
+    {
+      if(0 != (sim_seen[seq] & SIM_SEEN))
+      {
+        sim_stats.duplicates++;
+      }
+      else
+      {
+        sim_stats.received++;
+      }
+      sim_seen[seq] |= SIM_SEEN;
+    }
+  }
+}
+
+
+/*
+ * Sim_Command
+ *  - gpio/<n>/set (1/0/ON/OFF) and gpio/<n>/level/set (0..255), as Mqtt_Command()
+ */
+static void Sim_Command(const char *topic, const char *payload)
+{
+  size_t prefix_len = strlen(sim_prefix);
+  char *end;
+  unsigned long pin;
+
+  if((0 != strncmp(topic, sim_prefix, prefix_len)) || (0 != strncmp(&topic[prefix_len], "/gpio/", 6)))
+  {
+    return;
+  }
+
+  pin = strtoul(&topic[prefix_len + 6], &end, 10);
+
+  for(uint8_t pin_id = 0; pin_id < SIM_GPIO_COUNT; pin_id++)
+  {
+    if(sim_gpio_pins[pin_id] != pin)
+    {
+      continue;
+    }
+
+    sim_stats.commands++;
+
+    if(0 == strcmp(end, "/set"))
+    {
+      bool on = (0 == strcmp(payload, "1")) || (0 == strcasecmp(payload, "ON"));
+      printf("GPIO %lu -> %s\n", pin, on ? "ON" : "OFF");
+      sim_gpio_levels[pin_id] = on ? 255 : 0;
+    }
+    else if(0 == strcmp(end, "/level/set"))
+    {
+      long level = strtol(payload, NULL, 10);
+      printf("GPIO %lu -> level %ld\n", pin, level);
+      sim_gpio_levels[pin_id] = ((level >= 0) && (level <= 255)) ? (int)level : sim_gpio_levels[pin_id];
+    }
+    return;
+  }
+}
+
+
+/*
+ * Sim_Run
+ *  - generates the samples and runs the client till every sample is acknowledged
+ */
+static int Sim_Run()
+{
+  unsigned long next_sample_ms = Sim_Now();
+  unsigned long retry_ms = 0;
+  unsigned long hold_ms = 0;
+  unsigned long inflight_ms = 0;
+  unsigned long done_ms = 0;
+  uint32_t inflight_last_seq = 0;
+  uint16_t inflight_id = 0;
+  uint16_t packet_id = 0;
+  bool inflight = false;
+  int published_levels[SIM_GPIO_COUNT] = {-1, -1};
+  int fd = -1;
+  int monitor_fd = Sim_Connect();
+
+  /* Monitor stays connected - samples lost with the node connection are not counted as lost */
+  if((monitor_fd < 0) || !Sim_Session(monitor_fd, sim_monitor_parser, false, packet_id))
+  {
+    fprintf(stderr, "Broker %s:%s not reachable\n", sim_cfg.host, sim_cfg.port);
+    return 1;
+  }
+
+  Mqtt_QueueInit(&sim_queue);
+  sim_seen = (uint8_t *)calloc(sim_cfg.samples, 1);
+
+  while(!sim_stop)
+  {
+    unsigned long now_ms = Sim_Now();
+    struct pollfd monitor_pfd = {monitor_fd, POLLIN, 0};
+
+    /* Backend */
+    while(poll(&monitor_pfd, 1, 0) > 0)
+    {
+      uint8_t rx[512];
+      ssize_t len = recv(monitor_fd, rx, sizeof(rx), 0);
+
+      if(len <= 0)
+      {
+        fprintf(stderr, "Monitor connection lost\n");
+        sim_stop = 1;
+        break;
+      }
+
+      for(ssize_t idx = 0; idx < len; idx++)
+      {
+        Mqtt_Message_T msg;
+
+        if((Mqtt_Feed_Packet == Mqtt_ParserFeed(&sim_monitor_parser, rx[idx])) &&
+           Mqtt_DecodePublish(&sim_monitor_parser, &msg))
+        {
+          Sim_Samples(msg);
+        }
+      }
+    }
+
+    /* Sensor */
+    if((sim_stats.generated < sim_cfg.samples) && ((long)(now_ms - next_sample_ms) >= 0))
+    {
+      Mqtt_Sample_T sample;
+
+      sample.seq = (uint32_t)sim_stats.generated++;
+      sample.time_ms = (uint32_t)now_ms;
+      sample.epoch = (uint32_t)time(NULL);
+      sample.temperature_cdeg = (int16_t)(2150 + (sample.seq % 50));
+      sample.humidity_cpct = (uint16_t)(4000 + (sample.seq % 100));
+      sample.pressure_pa = 101325;
+      sample.light = (uint16_t)(sample.seq & 0x3FF);
+
+      /* Oldest sample leaves the full queue (it may have come through in a batch without PUBACK) */
+      if(MQTT_QUEUE_SIZE == sim_queue.count)
+      {
+        sim_seen[Mqtt_QueuePeek(&sim_queue, 0)->seq] |= SIM_DROPPED;
+      }
+      (void)Mqtt_QueuePush(&sim_queue, &sample);
+      next_sample_ms += sim_cfg.period_ms;
+    }
+
+    /* Connection */
+    if(fd < 0)
+    {
+      if((long)(now_ms - retry_ms) >= 0)
+      {
+        fd = Sim_Connect();
+        if((fd < 0) || !Sim_Session(fd, sim_parser, true, packet_id))
+        {
+          if(fd >= 0)
+          {
+            close(fd);
+            fd = -1;
+          }
+          retry_ms = now_ms + 1000;
+        }
+        inflight = false;
+        memset(published_levels, 0xFF, sizeof(published_levels));
+      }
+      usleep(1000);
+      continue;
+    }
+
+    /* Received bytes wait -d ms (slow link) */
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    if((poll(&pfd, 1, 1) > 0) && ((long)(now_ms - hold_ms) >= 0))
+    {
+      uint8_t rx[512];
+      ssize_t len = recv(fd, rx, sizeof(rx), 0);
+
+      if(len <= 0)
+      {
+        fprintf(stderr, "Connection lost\n");
+        close(fd);
+        fd = -1;
+        continue;
+      }
+
+      for(ssize_t idx = 0; idx < len; idx++)
+      {
+        Mqtt_Message_T msg;
+        uint16_t ack_id;
+        Mqtt_Feed_T result = Mqtt_ParserFeed(&sim_parser, rx[idx]);
+
+        if(Mqtt_Feed_Packet != result)
+        {
+          continue;
+        }
+
+        if(((sim_parser.header >> 4) == Mqtt_Packet_Puback) && inflight &&
+           Mqtt_DecodeAck(&sim_parser, &ack_id) && (ack_id == inflight_id))
+        {
+          for(const Mqtt_Sample_T *sample = Mqtt_QueuePeek(&sim_queue, 0);
+              (NULL != sample) && ((int32_t)(sample->seq - inflight_last_seq) <= 0);
+              sample = Mqtt_QueuePeek(&sim_queue, 0))
+          {
+            Mqtt_QueueDrop(&sim_queue, 1);
+            sim_stats.acked++;
+          }
+          inflight = false;
+        }
+        else if(Mqtt_DecodePublish(&sim_parser, &msg))
+        {
+          char topic[SIM_TOPIC_MAX_SIZE];
+          char payload[16];
+
+          if(msg.topic_len >= sizeof(topic))
+          {
+            continue;
+          }
+          memcpy(topic, msg.topic, msg.topic_len);
+          topic[msg.topic_len] = '\0';
+
+          if(msg.payload_len < sizeof(payload))
+          {
+            memcpy(payload, msg.payload, msg.payload_len);
+            payload[msg.payload_len] = '\0';
+            Sim_Command(topic, payload);
+          }
+        }
+      }
+      hold_ms = now_ms + sim_cfg.delay_ms;
+    }
+
+    if(inflight && ((now_ms - inflight_ms) >= (SIM_ACK_TIMEOUT_MS + sim_cfg.delay_ms)))
+    {
+      fprintf(stderr, "No PUBACK\n");
+      close(fd);
+      fd = -1;
+      continue;
+    }
+
+    /* Output levels */
+    for(uint8_t pin_id = 0; pin_id < SIM_GPIO_COUNT; pin_id++)
+    {
+      char suffix[16];
+      char level[8];
+
+      if((sim_gpio_levels[pin_id] < 0) || (sim_gpio_levels[pin_id] == published_levels[pin_id]))
+      {
+        continue;
+      }
+      snprintf(suffix, sizeof(suffix), "/gpio/%u", sim_gpio_pins[pin_id]);
+      snprintf(level, sizeof(level), "%d", sim_gpio_levels[pin_id]);
+      if(Sim_Publish(fd, suffix, level, true))
+      {
+        published_levels[pin_id] = sim_gpio_levels[pin_id];
+      }
+    }
+
+    /* Batch */
+    if(!inflight && (0 != sim_queue.count))
+    {
+      char topic[SIM_TOPIC_MAX_SIZE];
+      size_t headroom;
+      size_t len;
+      uint8_t count;
+
+      snprintf(topic, sizeof(topic), "%s/samples", sim_prefix);
+      headroom = MQTT_PUBLISH_HEADROOM(strlen(topic));
+      count = Mqtt_BatchFormat(&sim_queue, MQTT_BATCH_MAX, (char *)&sim_tx[headroom], sizeof(sim_tx) - headroom, &len);
+
+      if((0 != count) &&
+         Sim_Send(fd, Mqtt_EncodePublish(sim_tx, sizeof(sim_tx), topic, &sim_tx[headroom], len,
+                                         1, false, false, Sim_NextPacketId(packet_id))))
+      {
+        inflight = true;
+        inflight_id = packet_id;
+        inflight_last_seq = Mqtt_QueuePeek(&sim_queue, count - 1)->seq;
+        inflight_ms = now_ms;
+        sim_stats.batches++;
+        sim_stats.batch_max = (count > sim_stats.batch_max) ? count : sim_stats.batch_max;
+
+        /* Connection lost before the PUBACK - batch is sent again after reconnect */
+        if((0 != sim_cfg.kill_every) && (0 == (sim_stats.batches % sim_cfg.kill_every)))
+        {
+          close(fd);
+          fd = -1;
+          sim_stats.kills++;
+          retry_ms = now_ms + sim_cfg.offline_ms;
+          continue;
+        }
+      }
+    }
+
+    /* Done - every sample acknowledged, own samples had time to come back */
+    if((sim_stats.generated == sim_cfg.samples) && (0 == sim_queue.count) && !inflight)
+    {
+      if(0 == done_ms)
+      {
+        done_ms = now_ms;
+      }
+      else if((now_ms - done_ms) >= (SIM_DRAIN_MS + sim_cfg.delay_ms))
+      {
+        break;
+      }
+    }
+  }
+
+  if(fd >= 0)
+  {
+    (void)Sim_Publish(fd, "/status", "offline", true);
+    (void)Sim_Send(fd, Mqtt_EncodeEmpty(sim_tx, sizeof(sim_tx), Mqtt_Packet_Disconnect));
+    close(fd);
+  }
+  close(monitor_fd);
+
+  unsigned long lost = 0;
+
+  for(unsigned long seq = 0; seq < sim_cfg.samples; seq++)
+  {
+    lost += (0 == sim_seen[seq]) ? 1 : 0;
+  }
+
+  printf("Samples: %lu, acknowledged: %lu, dropped (queue full): %lu\n",
+         sim_stats.generated, sim_stats.acked, (unsigned long)sim_queue.dropped);
+  printf("Batches: %lu (%.1f samples avg, %lu max), connects: %lu, forced disconnects: %lu, commands: %lu\n",
+         sim_stats.batches, (0 != sim_stats.batches) ? ((double)sim_stats.acked / sim_stats.batches) : 0.0,
+         sim_stats.batch_max, sim_stats.connects, sim_stats.kills, sim_stats.commands);
+  printf("Received by the monitor: %lu, duplicates: %lu, lost: %lu\n", sim_stats.received, sim_stats.duplicates, lost);
+
+  free(sim_seen);
+  return (sim_stop || (0 != lost)) ? 1 : 0;
+}
+
+
+/*
+ * Sim_ParseAll
+ *  - feeds the buffer byte by byte, returns the number of received PUBLISH packets or -1
+ */
+static int Sim_ParseAll(const uint8_t *buf, size_t len, Mqtt_Parser_T *parser, Mqtt_Message_T *msg)
+{
+  int packets = 0;
+
+  for(size_t idx = 0; idx < len; idx++)
+  {
+    Mqtt_Feed_T result = Mqtt_ParserFeed(parser, buf[idx]);
+
+    if(Mqtt_Feed_Error == result)
+    {
+      return -1;
+    }
+    if((Mqtt_Feed_Packet == result) && (NULL != msg) && Mqtt_DecodePublish(parser, msg))
+    {
+      packets++;
+    }
+  }
+  return packets;
+}
+
+
+static int Sim_SelfTest()
+{
+  static uint8_t buf[SIM_TX_MAX_SIZE * 13];
+  static uint8_t payload[SIM_TX_MAX_SIZE * 12];
+  Mqtt_Parser_T parser;
+  Mqtt_Message_T msg;
+  Mqtt_Queue_T queue;
+  Mqtt_Sample_T sample;
+  char text[SIM_TX_MAX_SIZE];
+  unsigned long failures = 0;
+  size_t len;
+  size_t sample_len;
+  uint8_t count;
+  uint8_t code;
+
+  srand(1);
+  Mqtt_ParserReset(&parser);
+
+  /* PUBLISH of every length class of the remaining length, QoS 0 and 1 */
+  /* Remaining length 127/128 and 16383/16384 with QoS 0 - 1 and 2 bytes longer with QoS 1 */
+  const size_t lengths[] = {0, 1, 100, 122, 123, 200, 240, 16378, 16379};
+
+  for(size_t idx = 0; idx < (sizeof(lengths) / sizeof(lengths[0])); idx++)
+  {
+    for(uint8_t qos = 0; qos < 2; qos++)
+    {
+      for(size_t pos = 0; pos < lengths[idx]; pos++)
+      {
+        payload[pos] = (uint8_t)rand();
+      }
+
+      size_t remaining = 2 + 3 + ((0 != qos) ? 2 : 0) + lengths[idx];
+      size_t header = 1 + ((remaining < 128) ? 1 : ((remaining < 16384) ? 2 : 3));
+      int packets;
+
+      len = Mqtt_EncodePublish(buf, sizeof(buf), "a/b", payload, lengths[idx], qos, true, false, 0x1234);
+      packets = Sim_ParseAll(buf, len, &parser, &msg);
+
+      if((len != (header + remaining)) || (packets < 0))
+      {
+        printf("FAIL publish %zu qos %u\n", lengths[idx], qos);
+        failures++;
+        continue;
+      }
+
+      /* Longer than MQTT_RX_MAX_SIZE - skipped by the receiver */
+      if(remaining > MQTT_RX_MAX_SIZE)
+      {
+        if(0 != packets)
+        {
+          printf("FAIL long publish %zu qos %u\n", lengths[idx], qos);
+          failures++;
+        }
+        continue;
+      }
+
+      if((3 != msg.topic_len) || (0 != memcmp(msg.topic, "a/b", 3)) || (msg.payload_len != lengths[idx]) ||
+         (0 != memcmp(msg.payload, payload, lengths[idx])) || (msg.qos != qos) || !msg.retain ||
+         ((0 != qos) && (0x1234 != msg.packet_id)))
+      {
+        printf("FAIL publish content %zu qos %u\n", lengths[idx], qos);
+        failures++;
+      }
+    }
+  }
+
+  /* Packet after a skipped one is received */
+  len = Mqtt_EncodePublish(buf, sizeof(buf), "t", payload, MQTT_RX_MAX_SIZE + 100, 0, false, false, 0);
+  len += Mqtt_EncodePublish(&buf[len], sizeof(buf) - len, "t", payload, 5, 0, false, false, 0);
+  if(1 != Sim_ParseAll(buf, len, &parser, &msg) || (5 != msg.payload_len))
+  {
+    printf("FAIL resync after long packet\n");
+    failures++;
+  }
+
+  /* CONNACK, PUBACK, buffer too small, malformed length */
+  const uint8_t connack[] = {0x20, 0x02, 0x00, 0x05};
+  (void)Sim_ParseAll(connack, sizeof(connack), &parser, NULL);
+  if(!Mqtt_DecodeConnack(&parser, &code) || (5 != code))
+  {
+    printf("FAIL connack\n");
+    failures++;
+  }
+
+  uint16_t ack_id = 0;
+  len = Mqtt_EncodeAck(buf, sizeof(buf), Mqtt_Packet_Puback, 0xBEEF);
+  (void)Sim_ParseAll(buf, len, &parser, NULL);
+  if(!Mqtt_DecodeAck(&parser, &ack_id) || (0xBEEF != ack_id) || ((parser.header >> 4) != Mqtt_Packet_Puback))
+  {
+    printf("FAIL puback\n");
+    failures++;
+  }
+
+  if(0 != Mqtt_EncodePublish(buf, 20, "topic", payload, 20, 1, false, false, 1))
+  {
+    printf("FAIL size check\n");
+    failures++;
+  }
+
+  const uint8_t malformed[] = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  if(-1 != Sim_ParseAll(malformed, sizeof(malformed), &parser, NULL))
+  {
+    printf("FAIL malformed length\n");
+    failures++;
+  }
+  Mqtt_ParserReset(&parser);
+
+  /* Queue - oldest samples dropped, batches are valid JSON arrays taken from the front */
+  Mqtt_QueueInit(&queue);
+  memset(&sample, 0, sizeof(sample));
+
+  for(uint32_t seq = 0; seq < (MQTT_QUEUE_SIZE + 10); seq++)
+  {
+    sample.seq = seq;
+    sample.temperature_cdeg = (int16_t)((seq & 1) ? -(int)seq : (int)seq);
+    sample.pressure_pa = 100000 + seq;
+    (void)Mqtt_QueuePush(&queue, &sample);
+  }
+
+  if((MQTT_QUEUE_SIZE != queue.count) || (10 != queue.dropped) || (10 != Mqtt_QueuePeek(&queue, 0)->seq))
+  {
+    printf("FAIL queue overflow\n");
+    failures++;
+  }
+
+  for(uint32_t round = 0; (round < SIM_TEST_ROUNDS) && (0 != queue.count); round++)
+  {
+    size_t size = MQTT_SAMPLE_JSON_MAX_SIZE + 2 + (size_t)(rand() % 1200);
+    uint32_t first = Mqtt_QueuePeek(&queue, 0)->seq;
+
+    count = Mqtt_BatchFormat(&queue, MQTT_BATCH_MAX, text, size, &len);
+    if((0 == count) || (len >= size) || ('[' != text[0]) || (']' != text[len - 1]))
+    {
+      printf("FAIL batch format\n");
+      failures++;
+      break;
+    }
+
+    text[len] = '\0';
+    sample_len = 0;
+    for(const char *pos = strstr(text, "\"seq\":"); NULL != pos; pos = strstr(pos + 1, "\"seq\":"))
+    {
+      if(strtoul(pos + 6, NULL, 10) != (first + sample_len))
+      {
+        printf("FAIL batch order\n");
+        failures++;
+      }
+      sample_len++;
+    }
+
+    if(sample_len != count)
+    {
+      printf("FAIL batch count %zu/%u: %s\n", sample_len, count, text);
+      failures++;
+    }
+    Mqtt_QueueDrop(&queue, count);
+  }
+
+  sample.temperature_cdeg = -5;
+  sample.humidity_cpct = 4007;
+  sample.pressure_pa = 101325;
+  sample.epoch = 0;
+  sample_len = Mqtt_SampleFormat(text, sizeof(text), &sample);
+  if((0 == sample_len) || (NULL == strstr(text, "\"temp\":-0.05,\"hum\":40.07,\"pres\":1013.25")) ||
+     (NULL != strstr(text, "\"time\"")))
+  {
+    printf("FAIL sample format: %s\n", text);
+    failures++;
+  }
+
+  printf("Self test: %s (%lu failures)\n", (0 == failures) ? "PASSED" : "FAILED", failures);
+  return (0 == failures) ? 0 : 1;
+}
+
+
+static void Sim_Usage()
+{
+  fprintf(stderr, "Usage: mqtt_sim -t\n"
+                  "       mqtt_sim [-h host] [-p port] [-i id] [-n samples] [-r period_ms] [-d delay_ms]\n"
+                  "                [-k kill_every_n_batches] [-x offline_ms]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  int opt;
+
+  while(-1 != (opt = getopt(argc, argv, "th:p:i:n:r:d:k:x:")))
+  {
+    switch(opt)
+    {
+      case 't': return Sim_SelfTest();
+      case 'h': sim_cfg.host = optarg; break;
+      case 'p': sim_cfg.port = optarg; break;
+      case 'i': sim_cfg.id = optarg; break;
+      case 'n': sim_cfg.samples = strtoul(optarg, NULL, 10); break;
+      case 'r': sim_cfg.period_ms = strtoul(optarg, NULL, 10); break;
+      case 'd': sim_cfg.delay_ms = strtoul(optarg, NULL, 10); break;
+      case 'k': sim_cfg.kill_every = strtoul(optarg, NULL, 10); break;
+      case 'x': sim_cfg.offline_ms = strtoul(optarg, NULL, 10); break;
+      default: Sim_Usage(); return 2;
+    }
+  }
+
+  if((0 == sim_cfg.samples) || (sim_cfg.samples > SIM_SAMPLES_MAX))
+  {
+    Sim_Usage();
+    return 2;
+  }
+
+  snprintf(sim_prefix, sizeof(sim_prefix), "ibeacon/%s", sim_cfg.id);
+  signal(SIGINT, Sim_Signal);
+  signal(SIGTERM, Sim_Signal);
+
+  return Sim_Run();
+}
+
+/* EOF */
@@ -0,0 +1,370 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       nvm_bank_sim.cpp
+ *
+ *  Host-side simulation of the wear-leveled configuration banks (nvm_bank.cpp)
+ *
+ *    - NOR flash model: erase sets the sector to 0xFF, programming can only clear bits
+ *    - power loss is injected at every byte offset of a slot write and inside erase
+ *    - after every injected power loss the banks are mounted again and the loaded
+ *      record must be either the previous or the new one
+ *    - erase count per sector is reported for 10k writes and compared with the
+ *      EEPROM emulation (one sector erase per commit)
+ *    - storage written with the legacy slot geometry must not be mounted by the
+ *      current one, but has to stay readable for migration
+ *    - migration from both legacy geometries (newest legacy record in bank 0 and 1) is
+ *      interrupted as above - the new record or the legacy one has to survive
+ *
+ *  Build & run (from this directory):
+ *    g++ -std=c++11 -O2 -I../.. nvm_bank_sim.cpp ../../nvm_bank.cpp -o nvm_bank_sim && ./nvm_bank_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <string.h>
+#include "nvm_bank.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define SIM_FLASH_SIZE_BYTE     (NVM_BANK_COUNT * NVM_BANK_SECTOR_SIZE_BYTE)
+#define SIM_RECORD_SIZE_BYTE    (208)
+#define SIM_WRITES_WEAR_TEST    (10000)
+
+/* Power budget disabled - every flash operation succeeds */
+#define SIM_BUDGET_UNLIMITED    (-1)
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static uint8_t  sim_flash[SIM_FLASH_SIZE_BYTE];
+static uint32_t sim_erase_cnt[NVM_BANK_COUNT];
+
+/* Number of bytes which can still be programmed before the power is lost */
+static long sim_budget = SIM_BUDGET_UNLIMITED;
+
+/* Erase is interrupted when set, sector is left partially erased */
+static bool sim_fail_erase = false;
+static bool sim_powered = true;
+
+/* ==================================================================== */
+/* ======================= flash model functions ====================== */
+/* ==================================================================== */
+static bool Sim_FlashErase(uint32_t addr)
+{
+  uint32_t sector = addr / NVM_BANK_SECTOR_SIZE_BYTE;
+
+  if(!sim_powered)
+  {
+    return false;
+  }
+
+  if(sim_fail_erase)
+  {
+    /* Only the first part of the sector is erased, the rest keeps stale bytes */
+    memset(&sim_flash[sector * NVM_BANK_SECTOR_SIZE_BYTE], 0xFF, NVM_BANK_SECTOR_SIZE_BYTE / 3);
+    sim_powered = false;
+    return false;
+  }
+
+  memset(&sim_flash[sector * NVM_BANK_SECTOR_SIZE_BYTE], 0xFF, NVM_BANK_SECTOR_SIZE_BYTE);
+  sim_erase_cnt[sector]++;
+  return true;
+}
+
+
+static bool Sim_FlashWrite(uint32_t addr, const uint32_t *data, uint32_t size)
+{
+  const uint8_t *src = (const uint8_t *)data;
+
+  for(uint32_t idx = 0; idx < size; idx++)
+  {
+    if(!sim_powered || (0 == sim_budget))
+    {
+      sim_powered = false;
+      return false;
+    }
+
+    sim_flash[addr + idx] &= src[idx];
+
+    if(sim_budget > 0)
+    {
+      sim_budget--;
+    }
+  }
+  return true;
+}
+
+
+static bool Sim_FlashRead(uint32_t addr, uint32_t *data, uint32_t size)
+{
+  memcpy(data, &sim_flash[addr], size);
+  return true;
+}
+
+static const Nvm_Flash_Ops_T sim_flash_ops = {Sim_FlashErase, Sim_FlashWrite, Sim_FlashRead};
+
+/* ==================================================================== */
+/* ========================= helper functions ========================= */
+/* ==================================================================== */
+static void Sim_MakeRecord(uint32_t *record, uint32_t generation)
+{
+  uint8_t *raw = (uint8_t *)record;
+
+  for(uint16_t idx = 0; idx < SIM_RECORD_SIZE_BYTE; idx++)
+  {
+    raw[idx] = (uint8_t)((generation * 31) + (idx * 7));
+  }
+  memcpy(raw, &generation, sizeof(generation));
+}
+
+
+static void Sim_PowerOn()
+{
+  sim_budget = SIM_BUDGET_UNLIMITED;
+  sim_fail_erase = false;
+  sim_powered = true;
+}
+
+
+/* Mount banks and return generation of the loaded record (-1 if none or damaged) */
+static long Sim_MountGeneration(Nvm_Bank &bank)
+{
+  uint32_t record[SIM_RECORD_SIZE_BYTE / 4];
+  uint32_t expected[SIM_RECORD_SIZE_BYTE / 4];
+  uint32_t generation;
+
+  bank.Nvm_BankInit(&sim_flash_ops, 0);
+
+  if(!bank.Nvm_BankMount(record, SIM_RECORD_SIZE_BYTE))
+  {
+    return -1;
+  }
+
+  memcpy(&generation, record, sizeof(generation));
+  Sim_MakeRecord(expected, generation);
+
+  return (0 == memcmp(record, expected, SIM_RECORD_SIZE_BYTE)) ? (long)generation : -1;
+}
+
+
+/* Write generations 1..count to the fresh flash */
+static void Sim_Prepare(Nvm_Bank &bank, uint32_t count)
+{
+  uint32_t record[SIM_RECORD_SIZE_BYTE / 4];
+
+  Sim_PowerOn();
+  memset(sim_flash, 0xFF, sizeof(sim_flash));
+  memset(sim_erase_cnt, 0, sizeof(sim_erase_cnt));
+  (void)Sim_MountGeneration(bank);
+
+  for(uint32_t gen = 1; gen <= count; gen++)
+  {
+    Sim_MakeRecord(record, gen);
+    (void)bank.Nvm_BankWrite(record, SIM_RECORD_SIZE_BYTE);
+  }
+}
+
+
+/* Interrupt write of generation prev+1 and verify recovery, returns number of failures */
+static uint32_t Sim_PowerLossCase(uint32_t prev, long budget, bool fail_erase)
+{
+  Nvm_Bank bank;
+  uint32_t record[SIM_RECORD_SIZE_BYTE / 4];
+  long gen;
+  uint32_t failures = 0;
+
+  Sim_Prepare(bank, prev);
+
+  sim_budget = budget;
+  sim_fail_erase = fail_erase;
+  Sim_MakeRecord(record, prev + 1);
+  (void)bank.Nvm_BankWrite(record, SIM_RECORD_SIZE_BYTE);
+
+  /* Reboot */
+  Sim_PowerOn();
+  gen = Sim_MountGeneration(bank);
+
+  /* Generation 0 means empty storage - nothing to load */
+  if((gen != ((0 == prev) ? -1 : (long)prev)) && (gen != (long)(prev + 1)))
+  {
+    printf("  FAIL: prev %u, budget %ld, erase %d -> loaded %ld\r\n", prev, budget, fail_erase, gen);
+    failures++;
+  }
+
+  /* Storage must stay writable after recovery */
+  Sim_MakeRecord(record, prev + 2);
+
+  if(!bank.Nvm_BankWrite(record, SIM_RECORD_SIZE_BYTE) || ((long)(prev + 2) != Sim_MountGeneration(bank)))
+  {
+    printf("  FAIL: prev %u, budget %ld, erase %d -> not writable after recovery\r\n", prev, budget, fail_erase);
+    failures++;
+  }
+  return failures;
+}
+
+
+/* Migrate storage holding legacy generations 1..prev (the steps of Nvm_BankLegacyMigrate), interrupt the
+   first write in the current geometry and verify the new or the legacy record survives */
+static uint32_t Sim_MigrationCase(uint16_t legacy_size, uint32_t legacy_magic, uint32_t prev, long budget, bool fail_erase)
+{
+  Nvm_Bank bank;
+  uint32_t record[SIM_RECORD_SIZE_BYTE / 4];
+  uint8_t legacy_bank;
+  uint32_t legacy_seq;
+  uint32_t failures = 0;
+  long gen;
+
+  Sim_PowerOn();
+  memset(sim_flash, 0xFF, sizeof(sim_flash));
+  bank.Nvm_BankInit(&sim_flash_ops, 0, legacy_size, legacy_magic);
+  (void)bank.Nvm_BankMount(NULL, 0);
+
+  for(uint32_t gen_idx = 1; gen_idx <= prev; gen_idx++)
+  {
+    Sim_MakeRecord(record, gen_idx);
+    (void)bank.Nvm_BankWrite(record, SIM_RECORD_SIZE_BYTE);
+  }
+
+  /* Migration */
+  bank.Nvm_BankInit(&sim_flash_ops, 0, legacy_size, legacy_magic);
+  (void)bank.Nvm_BankMount(record, SIM_RECORD_SIZE_BYTE);
+  legacy_bank = bank.Nvm_BankGetActiveBank();
+  legacy_seq = bank.Nvm_BankGetSequence();
+
+  bank.Nvm_BankInit(&sim_flash_ops, 0);
+  bank.Nvm_BankResume(legacy_bank, legacy_seq);
+
+  sim_budget = budget;
+  sim_fail_erase = fail_erase;
+  Sim_MakeRecord(record, prev + 1);
+  (void)bank.Nvm_BankWrite(record, SIM_RECORD_SIZE_BYTE);
+
+  /* Reboot - current geometry first, legacy one (migration again) when it is empty */
+  Sim_PowerOn();
+  gen = Sim_MountGeneration(bank);
+
+  if(-1 == gen)
+  {
+    bank.Nvm_BankInit(&sim_flash_ops, 0, legacy_size, legacy_magic);
+    gen = (bank.Nvm_BankMount(record, SIM_RECORD_SIZE_BYTE) && (prev == record[0])) ? (long)prev : -1;
+  }
+
+  if((gen != (long)prev) && (gen != (long)(prev + 1)))
+  {
+    printf("  FAIL: legacy %u byte slots, prev %u in bank %u, budget %ld, erase %d -> loaded %ld\r\n",
+           legacy_size, prev, legacy_bank, budget, fail_erase, gen);
+    failures++;
+  }
+  return failures;
+}
+
+/* ==================================================================== */
+/* =============================== main =============================== */
+/* ==================================================================== */
+int main()
+{
+  Nvm_Bank bank;
+  uint32_t cases = 0;
+  uint32_t failures = 0;
+  uint32_t slot_bytes = sizeof(Nvm_Slot_Header_T) + SIM_RECORD_SIZE_BYTE;
+
+  printf("NVM bank simulation: %u banks, %u slots of %u bytes, record %u bytes\r\n",
+         NVM_BANK_COUNT, NVM_SLOTS_TOTAL, NVM_SLOT_SIZE_BYTE, SIM_RECORD_SIZE_BYTE);
+
+  /* Power loss at every byte offset - mid bank, at bank entry (after erase) and at the wrap */
+  const uint32_t prev_gens[] = {0, 3, NVM_SLOTS_PER_BANK, NVM_SLOTS_TOTAL, NVM_SLOTS_TOTAL + 5};
+
+  for(uint32_t p = 0; p < sizeof(prev_gens) / sizeof(prev_gens[0]); p++)
+  {
+    for(long budget = 0; budget <= (long)slot_bytes; budget++)
+    {
+      failures += Sim_PowerLossCase(prev_gens[p], budget, false);
+      cases++;
+    }
+
+    failures += Sim_PowerLossCase(prev_gens[p], SIM_BUDGET_UNLIMITED, true);
+    cases++;
+  }
+
+  printf("Power loss: %u cases, %u failures\r\n", cases, failures);
+
+  /* Legacy geometry - newest record is in the slot not aligned to the current slot size */
+  Sim_PowerOn();
+  memset(sim_flash, 0xFF, sizeof(sim_flash));
+  bank.Nvm_BankInit(&sim_flash_ops, 0, NVM_SLOT_LEGACY_SIZE_BYTE, NVM_SLOT_LEGACY_MAGIC);
+  (void)bank.Nvm_BankMount(NULL, 0);
+
+  for(uint32_t gen = 1; gen <= 4; gen++)
+  {
+    uint32_t record[SIM_RECORD_SIZE_BYTE / 4];
+
+    Sim_MakeRecord(record, gen);
+    (void)bank.Nvm_BankWrite(record, SIM_RECORD_SIZE_BYTE);
+  }
+
+  if(-1 != Sim_MountGeneration(bank))
+  {
+    printf("  FAIL: legacy slots mounted with the current geometry\r\n");
+    failures++;
+  }
+  else
+  {
+    uint32_t record[SIM_RECORD_SIZE_BYTE / 4];
+
+    bank.Nvm_BankInit(&sim_flash_ops, 0, NVM_SLOT_LEGACY_SIZE_BYTE, NVM_SLOT_LEGACY_MAGIC);
+
+    if(!bank.Nvm_BankMount(record, SIM_RECORD_SIZE_BYTE) || (4 != record[0]))
+    {
+      printf("  FAIL: legacy slots not readable for migration\r\n");
+      failures++;
+    }
+  }
+  printf("Legacy geometry: %s\r\n", (0 == failures) ? "OK" : "FAILED");
+
+  /* Migration power loss - newest legacy record in bank 0 (fresh and wrapped storage) and in bank 1 */
+  const struct {uint16_t size; uint32_t magic;} legacy[] =
+  {
+    {NVM_SLOT_LEGACY_V1_SIZE_BYTE, NVM_SLOT_LEGACY_V1_MAGIC},
+    {NVM_SLOT_LEGACY_SIZE_BYTE, NVM_SLOT_LEGACY_MAGIC},
+  };
+  uint32_t migration_cases = 0;
+  uint32_t migration_failures = 0;
+
+  for(uint32_t l = 0; l < sizeof(legacy) / sizeof(legacy[0]); l++)
+  {
+    uint32_t per_bank = NVM_BANK_SECTOR_SIZE_BYTE / legacy[l].size;
+    const uint32_t legacy_gens[] = {1, per_bank / 2, per_bank + 1, (per_bank * NVM_BANK_COUNT) + 1};
+
+    for(uint32_t p = 0; p < sizeof(legacy_gens) / sizeof(legacy_gens[0]); p++)
+    {
+      for(long budget = 0; budget <= (long)slot_bytes; budget++)
+      {
+        migration_failures += Sim_MigrationCase(legacy[l].size, legacy[l].magic, legacy_gens[p], budget, false);
+        migration_cases++;
+      }
+
+      migration_failures += Sim_MigrationCase(legacy[l].size, legacy[l].magic, legacy_gens[p], SIM_BUDGET_UNLIMITED, true);
+      migration_cases++;
+    }
+  }
+
+  printf("Migration power loss: %u cases, %u failures\r\n", migration_cases, migration_failures);
+  failures += migration_failures;
+
+  /* Wear statistics */
+  Sim_Prepare(bank, SIM_WRITES_WEAR_TEST);
+
+  for(uint32_t sector = 0; sector < NVM_BANK_COUNT; sector++)
+  {
+    printf("Wear: sector %u erased %u times per %u writes\r\n", sector, sim_erase_cnt[sector], SIM_WRITES_WEAR_TEST);
+  }
+  printf("Wear: EEPROM emulation erases its single sector %u times per %u writes\r\n", SIM_WRITES_WEAR_TEST, SIM_WRITES_WEAR_TEST);
+
+  return (0 == failures) ? 0 : 1;
+}
+
+/* EOF */
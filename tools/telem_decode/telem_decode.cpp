@@ -0,0 +1,552 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       telem_decode.cpp
+ *
+ *  Host-side recorder of the binary telemetry stream ("stream on", telem_frame.cpp)
+ *
+ *    - reads the serial device (set to the given baudrate), a captured file or stdin
+ *    - splits the input at 0x00 delimiters, frames failing COBS or CRC16 are counted and skipped
+ *      (text printed on the same UART ends up there too)
+ *    - lost frames are counted from the gaps of the sequence number
+ *    - 32-bit microsecond time is extended to 64 bits (wraps every ~71 minutes)
+ *    - CSV output: one row per frame, empty cell for the channel not present in the frame
+ *    - column output (-c <dir>): one little endian file per column - time_us.i64, seq.u32 and
+ *      <channel>.f64 (NaN when not present), columns.txt lists them; rows are aligned by index
+ *      (load ex. with numpy.fromfile)
+ *    - -t runs the self test of the frame codec and exits
+ *
+ *  Build & run (from this directory):
+ *    g++ -std=c++11 -O2 -I../.. telem_decode.cpp ../../telem_frame.cpp -o telem_decode
+ *    ./telem_decode -t
+ *    ./telem_decode -b 921600 -o capture.csv /dev/ttyUSB0      (Ctrl+C stops the capture)
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "telem_frame.h"
+
+/* termios2 (any baudrate) cannot be included together with termios.h */
+#ifdef __linux__
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#else
+#include <termios.h>
+#endif
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define DEC_READ_SIZE           (4096)
+#define DEC_PATH_MAX            (512)
+
+/* Frames encoded by the self test */
+#define DEC_TEST_FRAMES         (100000)
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+typedef struct Dec_Stats_Tag
+{
+  unsigned long frames;
+  unsigned long bad;
+  unsigned long lost;
+  unsigned long bytes;
+
+}Dec_Stats_T;
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static volatile sig_atomic_t dec_stop = 0;
+
+static FILE *dec_csv = NULL;
+static FILE *dec_col_time = NULL;
+static FILE *dec_col_seq = NULL;
+static FILE *dec_col[Telem_Channel_Last];
+
+static Dec_Stats_T dec_stats;
+static bool dec_first = true;
+static uint16_t dec_last_seq;
+static uint32_t dec_last_time;
+static uint64_t dec_time_high;
+
+/* Self test - decoded frames are recorded for the comparison with the sent ones */
+static Telem_Frame_T *dec_record = NULL;
+static unsigned long dec_record_max = 0;
+static unsigned long dec_record_count = 0;
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+static void Dec_Signal(int sig)
+{
+  (void)sig;
+  dec_stop = 1;
+}
+
+
+/*
+ * Dec_OpenSerial
+ *  - raw 8N1, any baudrate supported by the adapter (Linux), standard rates elsewhere
+ */
+static int Dec_OpenSerial(const char *path, unsigned long baudrate)
+{
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+
+  if((fd < 0) || !isatty(fd) || (0 == baudrate))
+  {
+    return fd;
+  }
+
+#ifdef __linux__
+  struct termios2 tio;
+
+  if(0 == ioctl(fd, TCGETS2, &tio))
+  {
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+    tio.c_ispeed = baudrate;
+    tio.c_ospeed = baudrate;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    if(0 != ioctl(fd, TCSETS2, &tio))
+    {
+      fprintf(stderr, "Cannot set %lu baud\r\n", baudrate);
+    }
+  }
+#else
+  struct termios tio;
+
+  if(0 == tcgetattr(fd, &tio))
+  {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, (speed_t)baudrate);
+    (void)tcsetattr(fd, TCSANOW, &tio);
+  }
+#endif
+
+  return fd;
+}
+
+
+static bool Dec_OpenColumns(const char *dir)
+{
+  char path[DEC_PATH_MAX];
+  FILE *list;
+
+  snprintf(path, sizeof(path), "%s/columns.txt", dir);
+  list = fopen(path, "w");
+  if(NULL == list)
+  {
+    return false;
+  }
+
+  snprintf(path, sizeof(path), "%s/time_us.i64", dir);
+  dec_col_time = fopen(path, "wb");
+  snprintf(path, sizeof(path), "%s/seq.u32", dir);
+  dec_col_seq = fopen(path, "wb");
+  fprintf(list, "time_us.i64 int64 us\nseq.u32 uint32 -\n");
+
+  for(uint8_t ch = 1; ch < Telem_Channel_Last; ch++)
+  {
+    const Telem_Channel_Desc_T *desc = Telem_ChannelDesc(ch);
+
+    snprintf(path, sizeof(path), "%s/%s.f64", dir, desc->name);
+    dec_col[ch] = fopen(path, "wb");
+    fprintf(list, "%s.f64 float64 %s\n", desc->name, desc->unit);
+
+    if(NULL == dec_col[ch])
+    {
+      fclose(list);
+      return false;
+    }
+  }
+
+  fclose(list);
+  return (NULL != dec_col_time) && (NULL != dec_col_seq);
+}
+
+
+static void Dec_CsvHeader()
+{
+  fprintf(dec_csv, "seq,time_us");
+
+  for(uint8_t ch = 1; ch < Telem_Channel_Last; ch++)
+  {
+    const Telem_Channel_Desc_T *desc = Telem_ChannelDesc(ch);
+    fprintf(dec_csv, ",%s_%s", desc->name, desc->unit);
+  }
+  fprintf(dec_csv, "\n");
+}
+
+
+/*
+ * Dec_Frame
+ *  - statistics, time extension and output of one decoded frame
+ */
+static void Dec_Frame(const Telem_Frame_T *frame)
+{
+  double values[Telem_Channel_Last];
+  bool present[Telem_Channel_Last];
+  uint64_t time_us;
+  uint32_t seq;
+
+  if(!dec_first)
+  {
+    dec_stats.lost += (uint16_t)(frame->seq - dec_last_seq - 1);
+
+    if(frame->time_us < dec_last_time)
+    {
+      dec_time_high += ((uint64_t)1 << 32);
+    }
+  }
+
+  dec_first = false;
+  dec_last_seq = frame->seq;
+  dec_last_time = frame->time_us;
+  dec_stats.frames++;
+
+  if((NULL != dec_record) && (dec_record_count < dec_record_max))
+  {
+    dec_record[dec_record_count++] = *frame;
+  }
+
+  time_us = dec_time_high + frame->time_us;
+  seq = frame->seq;
+  memset(present, 0, sizeof(present));
+
+  for(uint8_t idx = 0; idx < frame->count; idx++)
+  {
+    const Telem_Channel_Desc_T *desc = Telem_ChannelDesc(frame->values[idx].channel);
+
+    /* Channels added by newer firmware are skipped */
+    if(NULL != desc)
+    {
+      values[frame->values[idx].channel] = (double)frame->values[idx].value / desc->divisor;
+      present[frame->values[idx].channel] = true;
+    }
+  }
+
+  if(NULL != dec_csv)
+  {
+    fprintf(dec_csv, "%u,%llu", seq, (unsigned long long)time_us);
+
+    for(uint8_t ch = 1; ch < Telem_Channel_Last; ch++)
+    {
+      if(present[ch])
+      {
+        fprintf(dec_csv, (1 == Telem_ChannelDesc(ch)->divisor) ? ",%.0f" : ",%.2f", values[ch]);
+      }
+      else
+      {
+        fprintf(dec_csv, ",");
+      }
+    }
+    fprintf(dec_csv, "\n");
+  }
+
+  if(NULL != dec_col_time)
+  {
+    int64_t time_col = (int64_t)time_us;
+
+    fwrite(&time_col, sizeof(time_col), 1, dec_col_time);
+    fwrite(&seq, sizeof(seq), 1, dec_col_seq);
+
+    for(uint8_t ch = 1; ch < Telem_Channel_Last; ch++)
+    {
+      double value = present[ch] ? values[ch] : NAN;
+      fwrite(&value, sizeof(value), 1, dec_col[ch]);
+    }
+  }
+}
+
+
+/*
+ * Dec_Feed
+ *  - splits the received bytes at the delimiters, the frame in progress is kept in acc
+ */
+static void Dec_Feed(const uint8_t *data, size_t len, uint8_t *acc, size_t &acc_len, bool &overflow)
+{
+  Telem_Frame_T frame;
+
+  for(size_t idx = 0; idx < len; idx++)
+  {
+    if(TELEM_FRAME_DELIMITER != data[idx])
+    {
+      if(acc_len < TELEM_WIRE_MAX_SIZE)
+      {
+        acc[acc_len++] = data[idx];
+      }
+      else
+      {
+        overflow = true;
+      }
+      continue;
+    }
+
+    if(0 != acc_len)
+    {
+      if(!overflow && Telem_FrameDecode(acc, acc_len, &frame))
+      {
+        Dec_Frame(&frame);
+      }
+      else
+      {
+        dec_stats.bad++;
+      }
+    }
+
+    acc_len = 0;
+    overflow = false;
+  }
+}
+
+
+static bool Dec_FrameEqual(const Telem_Frame_T *a, const Telem_Frame_T *b)
+{
+  if((a->seq != b->seq) || (a->time_us != b->time_us) || (a->count != b->count))
+  {
+    return false;
+  }
+
+  for(uint8_t idx = 0; idx < a->count; idx++)
+  {
+    if((a->values[idx].channel != b->values[idx].channel) || (a->values[idx].value != b->values[idx].value))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/*
+ * Dec_SelfTest
+ *  - random frames are encoded, garbage is injected between some of them and every frame
+ *    has to be decoded back unchanged (the damaged ones have to be rejected)
+ *  - frames decoded from the stream are compared with the sent ones in order, the text
+ *    printed after frame n damages frame n + 1
+ */
+static int Dec_SelfTest()
+{
+  static uint8_t stream[DEC_TEST_FRAMES * (TELEM_WIRE_MAX_SIZE + 8)];
+  static Telem_Frame_T sent[DEC_TEST_FRAMES];
+  static Telem_Frame_T received[DEC_TEST_FRAMES];
+  unsigned long received_idx = 0;
+  unsigned long mismatched = 0;
+  uint8_t acc[TELEM_WIRE_MAX_SIZE];
+  size_t acc_len = 0;
+  size_t len = 0;
+  bool overflow = false;
+  unsigned long damaged = 0;
+  unsigned long failures = 0;
+  unsigned long undetected = 0;
+  Telem_Frame_T frame;
+
+  memset(sent, 0, sizeof(sent));
+  srand(1);
+
+  for(uint32_t n = 0; n < DEC_TEST_FRAMES; n++)
+  {
+    sent[n].seq = (uint16_t)n;
+    sent[n].time_us = (uint32_t)n * 100000u;
+    sent[n].count = 0;
+
+    for(uint8_t idx = rand() % (TELEM_FRAME_CHANNELS_MAX + 1); idx > 0; idx--)
+    {
+      int32_t value = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+
+      /* Zero bytes in the payload are the interesting case for COBS */
+      if(0 == (rand() % 4))
+      {
+        value &= 0xFF00FF00;
+      }
+      (void)Telem_FrameAdd(&sent[n], (Telem_Channel_T)(1 + (rand() % (Telem_Channel_Last - 1))), value);
+    }
+
+    len += Telem_FrameEncode(&sent[n], &stream[len]);
+
+    /* Text line printed between the frames */
+    if(0 == (n % 1000))
+    {
+      len += (size_t)sprintf((char *)&stream[len], "LOG -> text\r\n");
+      damaged++;
+    }
+  }
+
+  dec_record = received;
+  dec_record_max = DEC_TEST_FRAMES;
+  dec_record_count = 0;
+
+  /* Reads return random chunks of the stream */
+  for(size_t idx = 0; idx < len; )
+  {
+    size_t chunk = 1 + (rand() % 512);
+
+    chunk = ((len - idx) < chunk) ? (len - idx) : chunk;
+    Dec_Feed(&stream[idx], chunk, acc, acc_len, overflow);
+    idx += chunk;
+  }
+
+  dec_record = NULL;
+
+  for(uint32_t n = 0; n < DEC_TEST_FRAMES; n++)
+  {
+    if(1 == (n % 1000))
+    {
+      continue;
+    }
+
+    if((received_idx >= dec_record_count) || !Dec_FrameEqual(&received[received_idx], &sent[n]))
+    {
+      mismatched++;
+    }
+    received_idx++;
+  }
+  mismatched += (received_idx < dec_record_count) ? (dec_record_count - received_idx) : 0;
+
+  /* Re-decode every frame directly and compare */
+  for(uint32_t n = 0; n < DEC_TEST_FRAMES; n++)
+  {
+    uint8_t wire[TELEM_WIRE_MAX_SIZE];
+    size_t wire_len = Telem_FrameEncode(&sent[n], wire);
+
+    if(!Telem_FrameDecode(wire, wire_len - 1, &frame) || !Dec_FrameEqual(&frame, &sent[n]))
+    {
+      failures++;
+    }
+
+    /* Single corrupted byte has to be rejected */
+    wire[rand() % (wire_len - 1)] ^= (uint8_t)(1 + (rand() % 255));
+    if(Telem_FrameDecode(wire, wire_len - 1, &frame))
+    {
+      undetected++;
+    }
+  }
+
+  printf("Self test: %lu frames decoded, %lu rejected (%lu damaged by text), %lu lost, %lu failures\r\n",
+         dec_stats.frames, dec_stats.bad, damaged, dec_stats.lost, failures);
+  printf("Self test: %lu of %u corrupted frames not detected\r\n", undetected, DEC_TEST_FRAMES);
+  printf("Self test: %lu streamed frames differ from the sent ones\r\n", mismatched);
+
+  if((dec_stats.frames + damaged != DEC_TEST_FRAMES) || (dec_stats.bad != damaged) ||
+     (dec_stats.lost != damaged) || (0 != failures) || (0 != undetected) || (0 != mismatched))
+  {
+    printf("Self test FAILED\r\n");
+    return 1;
+  }
+
+  printf("Self test OK\r\n");
+  return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  static uint8_t buf[DEC_READ_SIZE];
+  uint8_t acc[TELEM_WIRE_MAX_SIZE];
+  size_t acc_len = 0;
+  bool overflow = false;
+  unsigned long baudrate = 921600;
+  const char *csv_path = NULL;
+  const char *col_dir = NULL;
+  const char *input = NULL;
+  int fd;
+  int opt;
+
+  while(-1 != (opt = getopt(argc, argv, "b:o:c:t")))
+  {
+    switch(opt)
+    {
+      case 'b': baudrate = strtoul(optarg, NULL, 0); break;
+      case 'o': csv_path = optarg; break;
+      case 'c': col_dir = optarg; break;
+      case 't': return Dec_SelfTest();
+      default:  optind = argc + 1; break;
+    }
+  }
+
+  if(optind != (argc - 1))
+  {
+    fprintf(stderr, "Usage: %s [-b baudrate] [-o file.csv | -c dir] <device|file|->\r\n", argv[0]);
+    fprintf(stderr, "       %s -t (self test)\r\n", argv[0]);
+    return 2;
+  }
+  input = argv[optind];
+
+  fd = (0 == strcmp(input, "-")) ? STDIN_FILENO : Dec_OpenSerial(input, baudrate);
+  if(fd < 0)
+  {
+    fprintf(stderr, "Cannot open %s\r\n", input);
+    return 2;
+  }
+
+  if(NULL != col_dir)
+  {
+    if(!Dec_OpenColumns(col_dir))
+    {
+      fprintf(stderr, "Cannot create column files in %s\r\n", col_dir);
+      return 2;
+    }
+  }
+  else
+  {
+    dec_csv = (NULL != csv_path) ? fopen(csv_path, "w") : stdout;
+    if(NULL == dec_csv)
+    {
+      fprintf(stderr, "Cannot create %s\r\n", csv_path);
+      return 2;
+    }
+    Dec_CsvHeader();
+  }
+
+  signal(SIGINT, Dec_Signal);
+  signal(SIGTERM, Dec_Signal);
+
+  while(!dec_stop)
+  {
+    ssize_t len = read(fd, buf, sizeof(buf));
+
+    if(len <= 0)
+    {
+      break;
+    }
+
+    dec_stats.bytes += len;
+    Dec_Feed(buf, (size_t)len, acc, acc_len, overflow);
+  }
+
+  fprintf(stderr, "Frames: %lu, lost: %lu, rejected: %lu, bytes: %lu\r\n",
+          dec_stats.frames, dec_stats.lost, dec_stats.bad, dec_stats.bytes);
+
+  if((NULL != dec_csv) && (stdout != dec_csv))
+  {
+    fclose(dec_csv);
+  }
+
+  if(NULL != dec_col_time)
+  {
+    fclose(dec_col_time);
+    fclose(dec_col_seq);
+
+    for(uint8_t ch = 1; ch < Telem_Channel_Last; ch++)
+    {
+      fclose(dec_col[ch]);
+    }
+  }
+  return 0;
+}
+
+/* EOF */
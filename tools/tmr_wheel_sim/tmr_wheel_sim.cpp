@@ -0,0 +1,245 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       tmr_wheel_sim.cpp
+ *
+ *  Host-side simulation of the hierarchical timer wheel (tmr_wheel.cpp)
+ *
+ *    - the pool is filled with timers spread over all wheel levels, random timers
+ *      are cancelled, every other timer has to expire exactly at its tick
+ *    - timers are re-armed from the expiry callback (as daily schedules are)
+ *    - stale handles (expired, cancelled, reused node) must be rejected
+ *    - the wheel is advanced over the 32-bit tick counter wrap
+ *    - add and cancel time is reported for a full and for an empty wheel
+ *
+ *  Build & run (from this directory):
+ *    g++ -std=c++11 -O2 -I../.. tmr_wheel_sim.cpp ../../tmr_wheel.cpp -o tmr_wheel_sim && ./tmr_wheel_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "tmr_wheel.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define SIM_SEED                (12345)
+#define SIM_REARM_DATA          ((uint16_t)0x8000)
+#define SIM_REARM_PERIOD        (1000)
+#define SIM_REARM_COUNT         (50)
+#define SIM_TIMING_LOOPS        (1000000)
+
+/* ==================================================================== */
+/* ======================== global variables ========================== */
+/* ==================================================================== */
+static Tmr_Wheel wheel;
+
+/* Expected expiry tick and handle of the timer with data n */
+static uint32_t sim_expiry[TMR_WHEEL_NODES_MAX];
+static bool sim_pending[TMR_WHEEL_NODES_MAX];
+static uint32_t sim_handle[TMR_WHEEL_NODES_MAX];
+
+static uint32_t sim_errors = 0;
+static uint32_t sim_expired = 0;
+static uint32_t sim_rearmed = 0;
+static uint32_t sim_rearm_next = 0;
+
+/* ==================================================================== */
+/* ========================== sim functions =========================== */
+/* ==================================================================== */
+static void Sim_Expired(uint16_t data)
+{
+  if(SIM_REARM_DATA == data)
+  {
+    if(wheel.Tmr_WheelGetTick() != sim_rearm_next)
+    {
+      printf("  FAIL: re-armed timer at %u, expected %u\r\n", wheel.Tmr_WheelGetTick(), sim_rearm_next);
+      sim_errors++;
+    }
+
+    if(++sim_rearmed < SIM_REARM_COUNT)
+    {
+      sim_rearm_next = wheel.Tmr_WheelGetTick() + SIM_REARM_PERIOD;
+      (void)wheel.Tmr_WheelAdd(SIM_REARM_PERIOD, SIM_REARM_DATA);
+    }
+    return;
+  }
+
+  if((data >= TMR_WHEEL_NODES_MAX) || !sim_pending[data] || (sim_expiry[data] != wheel.Tmr_WheelGetTick()))
+  {
+    printf("  FAIL: timer %u expired at %u, expected %u\r\n", data, wheel.Tmr_WheelGetTick(),
+           (data < TMR_WHEEL_NODES_MAX) ? sim_expiry[data] : 0);
+    sim_errors++;
+    return;
+  }
+
+  sim_pending[data] = false;
+  sim_expired++;
+}
+
+
+static uint32_t Sim_RandomDelay()
+{
+  /* Spread over all levels - exponent first, then the value */
+  uint32_t bits = 1 + (rand() % (TMR_WHEEL_LEVELS * TMR_WHEEL_SLOT_BITS));
+  uint32_t delay = ((uint32_t)rand() << 8 ^ (uint32_t)rand()) & ((1u << bits) - 1);
+
+  return (0 == delay) ? 1 : delay;
+}
+
+
+static uint32_t Sim_Run(uint32_t start_tick, const char *name)
+{
+  uint32_t errors_before = sim_errors;
+  uint32_t cancelled = 0;
+  uint32_t max_expiry = 0;
+  uint16_t cnt = 0;
+
+  wheel.Tmr_WheelInit(Sim_Expired);
+  (void)wheel.Tmr_WheelAdvance(start_tick);
+  memset(sim_pending, 0, sizeof(sim_pending));
+  sim_expired = 0;
+  sim_rearmed = 0;
+
+  /* Re-armed timer takes one node */
+  sim_rearm_next = wheel.Tmr_WheelGetTick() + SIM_REARM_PERIOD;
+  (void)wheel.Tmr_WheelAdd(SIM_REARM_PERIOD, SIM_REARM_DATA);
+
+  for(uint16_t n = 0; n < (TMR_WHEEL_NODES_MAX - 1); n++)
+  {
+    uint32_t delay = Sim_RandomDelay();
+
+    sim_handle[n] = wheel.Tmr_WheelAdd(delay, n);
+    sim_expiry[n] = wheel.Tmr_WheelGetTick() + delay;
+    sim_pending[n] = (TMR_WHEEL_INVALID != sim_handle[n]);
+    cnt += sim_pending[n] ? 1 : 0;
+
+    if(delay > max_expiry)
+    {
+      max_expiry = delay;
+    }
+  }
+
+  if((cnt != (TMR_WHEEL_NODES_MAX - 1)) || (TMR_WHEEL_INVALID != wheel.Tmr_WheelAdd(1, 0)))
+  {
+    printf("  FAIL: pool size\r\n");
+    sim_errors++;
+  }
+
+  for(uint16_t n = 0; n < (TMR_WHEEL_NODES_MAX - 1); n += 3)
+  {
+    if(!wheel.Tmr_WheelCancel(sim_handle[n]))
+    {
+      printf("  FAIL: cancel of pending timer %u\r\n", n);
+      sim_errors++;
+    }
+
+    if(wheel.Tmr_WheelCancel(sim_handle[n]))
+    {
+      printf("  FAIL: second cancel of timer %u\r\n", n);
+      sim_errors++;
+    }
+
+    sim_pending[n] = false;
+    cancelled++;
+  }
+
+  /* Advance in uneven steps (loop catching up) */
+  for(uint32_t done = 0; done <= max_expiry; )
+  {
+    uint32_t step = 1 + (rand() % 37);
+
+    (void)wheel.Tmr_WheelAdvance(step);
+    done += step;
+  }
+
+  for(uint16_t n = 0; n < (TMR_WHEEL_NODES_MAX - 1); n++)
+  {
+    if(sim_pending[n] || wheel.Tmr_WheelIsPending(sim_handle[n]))
+    {
+      printf("  FAIL: timer %u did not expire\r\n", n);
+      sim_errors++;
+    }
+  }
+
+  while(sim_rearmed < SIM_REARM_COUNT)
+  {
+    (void)wheel.Tmr_WheelAdvance(SIM_REARM_PERIOD);
+  }
+
+  /* Freed node is reused first - handle from the previous use has to stay stale */
+  uint32_t stale = wheel.Tmr_WheelAdd(10, 0);
+  (void)wheel.Tmr_WheelCancel(stale);
+  uint32_t handle = wheel.Tmr_WheelAdd(10, 0);
+
+  if((handle == stale) || wheel.Tmr_WheelCancel(stale) || !wheel.Tmr_WheelCancel(handle) ||
+     wheel.Tmr_WheelCancel(sim_handle[0]))
+  {
+    printf("  FAIL: stale handle accepted\r\n");
+    sim_errors++;
+  }
+
+  printf("%s: %u timers, %u cancelled, %u expired, %u re-armed, max delay %u ticks - %s\r\n", name,
+         TMR_WHEEL_NODES_MAX - 1, cancelled, sim_expired, sim_rearmed, max_expiry,
+         (errors_before == sim_errors) ? "OK" : "FAILED");
+
+  return sim_errors - errors_before;
+}
+
+
+static void Sim_Timing(bool full)
+{
+  using clk = std::chrono::steady_clock;
+  uint32_t handle;
+
+  wheel.Tmr_WheelInit(Sim_Expired);
+
+  if(full)
+  {
+    for(uint16_t n = 0; n < (TMR_WHEEL_NODES_MAX - 1); n++)
+    {
+      (void)wheel.Tmr_WheelAdd(Sim_RandomDelay(), n);
+    }
+  }
+
+  clk::time_point start = clk::now();
+
+  for(uint32_t i = 0; i < SIM_TIMING_LOOPS; i++)
+  {
+    handle = wheel.Tmr_WheelAdd(1 + (i & 0xFFFFF), 0);
+    (void)wheel.Tmr_WheelCancel(handle);
+  }
+
+  double ns = std::chrono::duration<double, std::nano>(clk::now() - start).count() / SIM_TIMING_LOOPS;
+
+  printf("Timing: add + cancel with %u pending timers: %.1f ns\r\n", wheel.Tmr_WheelGetPending(), ns);
+}
+
+/* ==================================================================== */
+/* =============================== main =============================== */
+/* ==================================================================== */
+int main()
+{
+  uint32_t failures = 0;
+
+  srand(SIM_SEED);
+
+  printf("Timer wheel simulation: %u levels of %u slots, %u timers, max delay %u ticks\r\n",
+         TMR_WHEEL_LEVELS, TMR_WHEEL_SLOTS, TMR_WHEEL_NODES_MAX, TMR_WHEEL_DELAY_MAX);
+
+  failures += Sim_Run(0, "Start");
+  failures += Sim_Run(123457, "Unaligned");
+  failures += Sim_Run(0xFFFFFFFF - (TMR_WHEEL_DELAY_MAX / 2), "Tick wrap");
+
+  Sim_Timing(false);
+  Sim_Timing(true);
+
+  return (0 == failures) ? 0 : 1;
+}
+
+/* EOF */
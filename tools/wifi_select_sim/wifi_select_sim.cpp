@@ -0,0 +1,204 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       wifi_select_sim.cpp
+ *
+ *  Host-side replay of recorded scan results through the AP selection (wifi_select.cpp)
+ *
+ *    - scan file lists known SSIDs, hysteresis and consecutive scans with the expected result
+ *    - selected BSSID of every scan becomes the current one for the next scan, so the file
+ *      describes a node walking through the site (roaming)
+ *    - scan lines have the format printed by the "scan" serial command
+ *
+ *  Scan file format:
+ *    # comment
+ *    known <ssid>                       - known list entry (in priority order)
+ *    hyst <dB>                          - roaming hysteresis
+ *    scan                               - start of the scan, followed by entries:
+ *    <ssid>,<bssid>,<channel>,<rssi>
+ *    expect <bssid>|none                - end of the scan and expected selection
+ *
+ *  Build & run (from this directory):
+ *    g++ -std=c++11 -O2 -I../.. wifi_select_sim.cpp ../../wifi_select.cpp -o wifi_select_sim && ./wifi_select_sim scans.txt
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wifi_select.h"
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+#define SIM_KNOWN_MAX           (8)
+#define SIM_SCAN_MAX            (32)
+#define SIM_LINE_MAX            (128)
+
+/* ==================================================================== */
+/* ========================= helper functions ========================= */
+/* ==================================================================== */
+static bool Sim_ParseBssid(const char *str, uint8_t *bssid)
+{
+  unsigned int byte[WIFI_SELECT_BSSID_SIZE];
+
+  if(WIFI_SELECT_BSSID_SIZE != sscanf(str, "%x:%x:%x:%x:%x:%x", &byte[0], &byte[1], &byte[2], &byte[3], &byte[4], &byte[5]))
+  {
+    return false;
+  }
+
+  for(uint8_t idx = 0; idx < WIFI_SELECT_BSSID_SIZE; idx++)
+  {
+    bssid[idx] = (uint8_t)byte[idx];
+  }
+  return true;
+}
+
+
+/* Parse "<ssid>,<bssid>,<channel>,<rssi>" - SSID may contain commas, fields are taken from the end */
+static bool Sim_ParseEntry(char *line, WiFi_Scan_Entry_T *entry)
+{
+  char *rssi = strrchr(line, ',');
+  char *channel;
+  char *bssid;
+
+  if(NULL == rssi)
+  {
+    return false;
+  }
+  *rssi++ = '\0';
+
+  channel = strrchr(line, ',');
+  if(NULL == channel)
+  {
+    return false;
+  }
+  *channel++ = '\0';
+
+  bssid = strrchr(line, ',');
+  if((NULL == bssid) || ((size_t)(bssid - line) > WIFI_SELECT_SSID_MAX_SIZE))
+  {
+    return false;
+  }
+  *bssid++ = '\0';
+
+  strcpy(entry->ssid, line);
+  entry->channel = (uint8_t)atoi(channel);
+  entry->rssi = (int8_t)atoi(rssi);
+
+  return Sim_ParseBssid(bssid, entry->bssid);
+}
+
+/* ==================================================================== */
+/* =============================== main =============================== */
+/* ==================================================================== */
+int main(int argc, char **argv)
+{
+  static char known_buf[SIM_KNOWN_MAX][WIFI_SELECT_SSID_MAX_SIZE + 1];
+  const char *known[SIM_KNOWN_MAX];
+  WiFi_Scan_Entry_T scan[SIM_SCAN_MAX];
+  uint8_t current[WIFI_SELECT_BSSID_SIZE];
+  uint8_t expected[WIFI_SELECT_BSSID_SIZE];
+  bool associated = false;
+  uint8_t known_cnt = 0;
+  uint8_t known_idx = 0;
+  uint8_t hysteresis = 0;
+  uint16_t scan_cnt = 0;
+  uint32_t scans = 0;
+  uint32_t failures = 0;
+  char line[SIM_LINE_MAX];
+  FILE *file;
+
+  if(argc < 2)
+  {
+    printf("Usage: %s <scan file>\r\n", argv[0]);
+    return 2;
+  }
+
+  file = fopen(argv[1], "r");
+  if(NULL == file)
+  {
+    printf("Cannot open %s\r\n", argv[1]);
+    return 2;
+  }
+
+  while(NULL != fgets(line, sizeof(line), file))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if(('\0' == line[0]) || ('#' == line[0]))
+    {
+      continue;
+    }
+    else if((0 == strncmp(line, "known ", 6)) && (known_cnt < SIM_KNOWN_MAX))
+    {
+      snprintf(known_buf[known_cnt], sizeof(known_buf[0]), "%.*s", WIFI_SELECT_SSID_MAX_SIZE, &line[6]);
+      known[known_cnt] = known_buf[known_cnt];
+      known_cnt++;
+    }
+    else if(0 == strncmp(line, "hyst ", 5))
+    {
+      hysteresis = (uint8_t)atoi(&line[5]);
+    }
+    else if(0 == strcmp(line, "scan"))
+    {
+      scan_cnt = 0;
+    }
+    else if(0 == strncmp(line, "expect ", 7))
+    {
+      int16_t selected = WiFi_SelectAp(scan, scan_cnt, known, known_cnt, associated ? current : NULL, hysteresis, &known_idx);
+      bool expect_none = (0 == strcmp(&line[7], "none"));
+      bool pass;
+
+      scans++;
+
+      if(expect_none)
+      {
+        pass = (WIFI_SELECT_NONE == selected);
+      }
+      else
+      {
+        pass = Sim_ParseBssid(&line[7], expected) && (WIFI_SELECT_NONE != selected) &&
+               (0 == memcmp(scan[selected].bssid, expected, WIFI_SELECT_BSSID_SIZE));
+      }
+
+      if(WIFI_SELECT_NONE != selected)
+      {
+        printf("Scan %u: %s %02X:%02X:%02X:%02X:%02X:%02X %d dBm (known %u) %s\r\n", scans, scan[selected].ssid,
+               scan[selected].bssid[0], scan[selected].bssid[1], scan[selected].bssid[2],
+               scan[selected].bssid[3], scan[selected].bssid[4], scan[selected].bssid[5],
+               scan[selected].rssi, known_idx, pass ? "OK" : "FAIL");
+
+        memcpy(current, scan[selected].bssid, WIFI_SELECT_BSSID_SIZE);
+        associated = true;
+      }
+      else
+      {
+        printf("Scan %u: none %s\r\n", scans, pass ? "OK" : "FAIL");
+        associated = false;
+      }
+
+      failures += pass ? 0 : 1;
+    }
+    else if(scan_cnt < SIM_SCAN_MAX)
+    {
+      if(Sim_ParseEntry(line, &scan[scan_cnt]))
+      {
+        scan_cnt++;
+      }
+      else
+      {
+        printf("Malformed line: %s\r\n", line);
+        failures++;
+      }
+    }
+  }
+  fclose(file);
+
+  printf("AP selection: %u scans, %u failures\r\n", scans, failures);
+  return (0 == failures) ? 0 : 1;
+}
+
+/* EOF */
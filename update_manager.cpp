@@ -8,6 +8,7 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "update_manager.h"
+#include "log_manager.h"
 
 /* ==================================================================== */
 /* ======================== global variables ========================== */
@@ -31,18 +32,18 @@ extern ESP8266WebServer WServer;
  */
 void Update_Manager::Update_Manager_Init()
 {
-  Serial.printf("OTA -> Update request\r\n");
+  LOG_INFO(Log_Module_Ota, "Update request");
  
   MDNS.begin(host);
-  Serial.printf("OTA -> MDNS host started\r\n");
+  LOG_INFO(Log_Module_Ota, "MDNS host started");
   
   httpUpdater.setup(&WServer, update_path, update_username, update_password);
-  Serial.printf("OTA -> Update Server setup complete\r\n");
+  LOG_INFO(Log_Module_Ota, "Update Server setup complete");
   
   MDNS.addService("http", "tcp", 80);
-  Serial.printf("OTA -> MDNS service added\r\n");
+  LOG_INFO(Log_Module_Ota, "MDNS service added");
   
-  Serial.printf("OTA -> Update server: http://%s.local%s\r\n", host, update_path);
+  LOG_INFO(Log_Module_Ota, "Update server: http://%s.local%s", host, update_path);
 }
 
 
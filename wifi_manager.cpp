@@ -8,6 +8,7 @@
 /* ========================== include files =========================== */
 /* ==================================================================== */
 #include "wifi_manager.h"
+#include "log_manager.h"
 
 /* ==================================================================== */
 /* ======================== global variables ========================== */
@@ -21,15 +22,85 @@ extern Nvm_Manager eeprom;
 /* Web server handler */
 extern Server_Manager server;
 
+/* RTC memory handler */
+extern Rtc_Manager rtc;
+
+/* Provisioning handler */
+extern Prov_Manager prov;
+
 /* SSID and Password of the AP */
 String ap_ssid;
 String ap_pass;
 
-/* WiFi establishing connection related flag */
-bool establish_failed = false;
+/* Known access points (entry 0 is the primary AP) */
+String ap_list_ssid[NVM_AP_LIST_MAX];
+String ap_list_pass[NVM_AP_LIST_MAX];
+
+/* Previous SSID and Password of the AP - restored if the new AP fails */
+String rollback_ssid;
+String rollback_pass;
+
+/* Events set by the WiFi event callbacks and timers, consumed in WiFi_Process() */
+volatile bool evt_got_ip = false;
+volatile bool evt_disconnected = false;
+volatile bool evt_establish_timeout = false;
+volatile bool evt_rollback_timeout = false;
+volatile bool evt_retry_timeout = false;
+
+/* Time (ms since boot) when the link came up for the first time */
+uint32_t link_up_time = WIFI_TIME_NOT_SET;
+
+/* Parameter handler */
+extern Param_Manager param;
+
+/* ==================================================================== */
+/* ================== local function definitions  ===================== */
+/* ==================================================================== */
+
+/*
+ * WiFi_ScanIsKnown
+ *  - This function checks whether the SSID is in the known AP list (empty entries are unused)
+ */
+static bool WiFi_ScanIsKnown(const char *ssid, const char *const *known)
+{
+  for(uint8_t idx = 0; idx < NVM_AP_LIST_MAX; idx++)
+  {
+    if(('\0' != known[idx][0]) && (0 == strcmp(known[idx], ssid)))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/*
+ * WiFi_ScanKeep
+ *  - This function adds the scan result to the list, the weakest entry is replaced when the list is full
+ */
+static void WiFi_ScanKeep(WiFi_Scan_Entry_T *results, uint8_t *cnt, const WiFi_Scan_Entry_T *entry)
+{
+  uint8_t weakest = 0;
+
+  if(*cnt < WIFI_SCAN_RESULTS_MAX)
+  {
+    results[(*cnt)++] = *entry;
+    return;
+  }
+
+  for(uint8_t idx = 1; idx < *cnt; idx++)
+  {
+    if(results[idx].rssi < results[weakest].rssi)
+    {
+      weakest = idx;
+    }
+  }
 
-/* WiFi connection lost related flag */
-bool connection_lost = false;
+  if(entry->rssi > results[weakest].rssi)
+  {
+    results[weakest] = *entry;
+  }
+}
 
 /* ==================================================================== */
 /* ============================ functions ============================= */
@@ -37,54 +108,662 @@ bool connection_lost = false;
 
 /*
  * WiFi connect function
- *  - This function connects using the credentials stored in EEPROM
- *  - This function starts the websocket whec connection is estabilished
+ *  - This function starts connecting using the credentials stored in EEPROM
+ *  - It does not wait for the connection - WiFi_Process() handles the result
+ *  - Cached association is tried first (see WiFi_Begin())
+ *  - Server is started when the link comes up
  */
 void WiFi_Manager::WiFi_Connect()
 { 
-  /* Read SSID and PASSWORD for AP from NvM */
-  eeprom.Nvm_CredentialsRead(EEPROM_AP_CREDENTIALS_START_ADDR, ap_ssid, ap_pass);
+  /* Read SSIDs and PASSWORDs of known APs from NvM */
+  WiFi_ReloadApList();
+  
+  /* Register WiFi events - callbacks only set flags */
+  got_ip_handler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP &evt)
+  {
+    (void)evt;
+    evt_got_ip = true;
+  });
+  
+  disconnected_handler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected &evt)
+  {
+    (void)evt;
+    evt_disconnected = true;
+  });
   
   /* Connect to the access point 
    *  
-   *    clear WIFI Credentials
    *    avoid to store WIFI configuration in Flash
    *    ensure WiFi mode is Station 
+   *    (station config is not cleared - WiFi.begin() overrides it anyway)
    */
-  WiFi.disconnect(true);
   WiFi.persistent(false);
   WiFi.mode(WIFI_STA);
 
-  Serial.printf("WIFI -> SSID: %s\r\n", ap_ssid.c_str());
-  Serial.printf("WIFI -> PASSWORD: %s\r\n", ap_pass.c_str());
+  WiFi_ApListPrint();
   
-  WiFi.begin(ap_ssid.c_str(), ap_pass.c_str());
-  Serial.printf("WIFI -> Connecting\r\n");
+  WiFi_Begin();
+  LOG_INFO(Log_Module_Wifi, "Connecting");
 
   WiFi.setAutoReconnect(true);
- 
-  while(WIFI_IS_DISCONNECTED())
+  WiFi_SetState(WiFi_State_Connecting);
+}
+
+
+/*
+ * WiFi link only function
+ *  - Server is not started when the link comes up (deep sleep telemetry cycle)
+ *  - This function has to be called before WiFi_Connect()
+ */
+void WiFi_Manager::WiFi_SetLinkOnly()
+{
+  link_only = true;
+}
+
+
+/*
+ * WiFi begin function
+ *  - This function starts association with one of the known APs
+ *  - If the last good association of a known SSID is cached in RTC memory, direct association
+ *    (known BSSID and channel - no scan) with reused IP lease (no DHCP) is tried first
+ *  - Otherwise the strongest known AP is selected from scan results (see WiFi_ScanDone())
+ *  - Reused lease is kept only till its reuse window ends (see WiFi_LeaseCheck())
+ */
+void WiFi_Manager::WiFi_Begin()
+{
+  Rtc_WiFi_Cache_T cache;
+
+  fast_connect = false;
+  connect_start_ms = millis();
+
+  for(uint8_t idx = 0; (idx < NVM_AP_LIST_MAX) && (0 != param.Param_Get(Param_ID_FastConnTimeout)); idx++)
+  {
+    if((0 != ap_list_ssid[idx].length()) && rtc.Rtc_WiFiCacheGet(ap_list_ssid[idx], cache))
+    {
+      fast_connect = true;
+      ap_idx = idx;
+      break;
+    }
+  }
+
+  if(fast_connect)
+  {
+    ap_ssid = ap_list_ssid[ap_idx];
+    ap_pass = ap_list_pass[ap_idx];
+    LOG_INFO(Log_Module_Wifi, "Fast connect: %s, channel %u, IP %s", ap_ssid.c_str(), cache.channel, IPAddress(cache.ip).toString().c_str());
+    
+    static_lease = true;
+    lease_expiry_ms = cache.lease_expiry_ms;
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.mask), IPAddress(cache.dns));
+    WiFi.begin(ap_ssid.c_str(), ap_pass.c_str(), cache.channel, cache.bssid);
+  }
+  else
+  {
+    WiFi_ScanStart(WiFi_Scan_Connect);
+  }
+}
+
+
+/*
+ * WiFi begin AP function
+ *  - This function starts association with the given entry of the AP list using DHCP
+ *  - channel 0 and bssid NULL - SDK searches for the SSID itself
+ */
+void WiFi_Manager::WiFi_BeginAp(uint8_t idx, int32_t channel, const uint8_t *bssid)
+{
+  ap_idx = idx;
+  ap_ssid = ap_list_ssid[idx];
+  ap_pass = ap_list_pass[idx];
+
+  /* Zero addresses enable DHCP again */
+  static_lease = false;
+  WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  WiFi.begin(ap_ssid.c_str(), ap_pass.c_str(), channel, bssid);
+}
+
+
+/*
+ * WiFi lease check function
+ *  - This function moves the station from the reused IP lease (static config) back to DHCP
+ *    when the reuse window ends, the new lease comes as got IP event while connected
+ */
+void WiFi_Manager::WiFi_LeaseCheck()
+{
+  if(!static_lease || ((int32_t)(lease_expiry_ms - rtc.Rtc_GetTimeMs()) > 0))
+  {
+    return;
+  }
+
+  static_lease = false;
+  LOG_INFO(Log_Module_Wifi, "Reused IP lease expired: DHCP");
+
+  /* Zero addresses restart the DHCP client without leaving the AP */
+  WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+}
+
+
+/*
+ * WiFi scan start function
+ *  - This function starts asynchronous scan, results are handled in WiFi_Process()
+ *  - Printed scan requested while another scan runs is started after it (see WiFi_Process())
+ */
+void WiFi_Manager::WiFi_ScanStart(WiFi_Scan_T purpose)
+{
+  if(WiFi_Scan_None != scan)
+  {
+    if((WiFi_Scan_Print == purpose) && (WiFi_Scan_Print != scan))
+    {
+      /* Results of the running scan are filtered for the AP selection */
+      scan_print_queued = true;
+      Serial.printf("SCAN -> Another scan in progress, queued\r\n");
+    }
+    else if(purpose < scan)
+    {
+      /* Scan in progress - results are used for the more important purpose (connect first) */
+      scan_print_queued = scan_print_queued || (WiFi_Scan_Print == scan);
+      scan = purpose;
+    }
+    return;
+  }
+  
+  scan = purpose;
+  (void)WiFi.scanNetworks(true, false);
+}
+
+
+/*
+ * WiFi scan done function
+ *  - This function selects the AP from the scan results according to the scan purpose
+ *  - Only known networks are kept for the selection, the strongest WIFI_SCAN_RESULTS_MAX of them
+ */
+void WiFi_Manager::WiFi_ScanDone(int8_t scan_cnt)
+{
+  WiFi_Scan_Entry_T results[WIFI_SCAN_RESULTS_MAX];
+  const char *known[NVM_AP_LIST_MAX];
+  WiFi_Scan_T purpose = scan;
+  uint8_t cnt = 0;
+  uint8_t known_idx = 0;
+  int16_t selected;
+
+  scan = WiFi_Scan_None;
+
+  for(uint8_t idx = 0; idx < NVM_AP_LIST_MAX; idx++)
+  {
+    known[idx] = ap_list_ssid[idx].c_str();
+  }
+
+  /* Busy sites report more networks than the list holds - unknown ones must not push the known out */
+  for(int8_t idx = 0; idx < scan_cnt; idx++)
+  {
+    WiFi_Scan_Entry_T entry;
+
+    snprintf(entry.ssid, sizeof(entry.ssid), "%s", WiFi.SSID(idx).c_str());
+
+    if((WiFi_Scan_Print != purpose) && !WiFi_ScanIsKnown(entry.ssid, known))
+    {
+      continue;
+    }
+
+    memcpy(entry.bssid, WiFi.BSSID(idx), WIFI_SELECT_BSSID_SIZE);
+    entry.channel = (uint8_t)WiFi.channel(idx);
+    entry.rssi = (int8_t)WiFi.RSSI(idx);
+    WiFi_ScanKeep(results, &cnt, &entry);
+  }
+  WiFi.scanDelete();
+
+  if(WiFi_Scan_Print == purpose)
+  {
+    /* Format accepted by tools/wifi_select_sim */
+    Serial.printf("SCAN -> START\r\n");
+    for(uint8_t idx = 0; idx < cnt; idx++)
+    {
+      Serial.printf("%s,%02X:%02X:%02X:%02X:%02X:%02X,%u,%d\r\n", results[idx].ssid,
+                    results[idx].bssid[0], results[idx].bssid[1], results[idx].bssid[2],
+                    results[idx].bssid[3], results[idx].bssid[4], results[idx].bssid[5],
+                    results[idx].channel, results[idx].rssi);
+    }
+    Serial.printf("SCAN -> END\r\n");
+    return;
+  }
+
+  if(WiFi_Scan_Roam == purpose)
+  {
+    if(WiFi_State_Connected != state)
+    {
+      /* Link went down during the scan - recovery takes care of it */
+      return;
+    }
+    
+    selected = WiFi_SelectAp(results, cnt, known, NVM_AP_LIST_MAX, WiFi.BSSID(),
+                             (uint8_t)param.Param_Get(Param_ID_RoamHysteresis), &known_idx);
+
+    if((WIFI_SELECT_NONE != selected) && (0 != memcmp(results[selected].bssid, WiFi.BSSID(), WIFI_SELECT_BSSID_SIZE)))
+    {
+      LOG_INFO(Log_Module_Wifi, "Roaming to %s (channel %u, %d dBm)", results[selected].ssid, results[selected].channel, results[selected].rssi);
+      metrics.roams++;
+
+      /* Establish timeout moves to the link recovery if the new AP does not answer */
+      WiFi_SetState(WiFi_State_Connecting);
+      WiFi_BeginAp(known_idx, results[selected].channel, results[selected].bssid);
+      Start_est_connection_tmr(param.Param_Get(Param_ID_EstConnTimeout));
+    }
+    return;
+  }
+
+  if(WiFi_State_Connected == state)
+  {
+    /* Link came up during the scan - restarting the association would only drop it */
+    return;
+  }
+
+  /* Connect - strongest known AP, or the primary one when nothing known is visible (hidden SSID) */
+  selected = WiFi_SelectAp(results, cnt, known, NVM_AP_LIST_MAX, NULL, 0, &known_idx);
+
+  if(WIFI_SELECT_NONE != selected)
+  {
+    LOG_INFO(Log_Module_Wifi, "Selected %s (channel %u, %d dBm)", results[selected].ssid, results[selected].channel, results[selected].rssi);
+    WiFi_BeginAp(known_idx, results[selected].channel, results[selected].bssid);
+  }
+  else
+  {
+    LOG_WARN(Log_Module_Wifi, "No known AP visible");
+    WiFi_BeginAp(0, 0, NULL);
+  }
+}
+
+
+/*
+ * WiFi portal check function
+ *  - This function starts the provisioning portal when no AP is configured
+ *    or the link is down longer than "portal_ms" (0 - only when no AP is configured)
+ */
+void WiFi_Manager::WiFi_PortalCheck()
+{
+  uint32_t portal_ms = param.Param_Get(Param_ID_PortalStart);
+
+  if(prov.Prov_IsActive())
+  {
+    return;
+  }
+
+  if(WiFi_ApListEmpty() || ((0 != portal_ms) && (WiFi_GetOutageTime() >= portal_ms)))
+  {
+    prov.Prov_Start();
+  }
+}
+
+
+/*
+ * WiFi AP list empty function
+ *  - This function returns true when no AP credentials are configured
+ */
+bool WiFi_Manager::WiFi_ApListEmpty()
+{
+  for(uint8_t idx = 0; idx < NVM_AP_LIST_MAX; idx++)
+  {
+    if(0 != ap_list_ssid[idx].length())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/*
+ * WiFi roam check function
+ *  - This function starts roaming scan when the signal of the current AP drops below "roam_rssi"
+ */
+void WiFi_Manager::WiFi_RoamCheck()
+{
+  int32_t roam_rssi = (int32_t)param.Param_Get(Param_ID_RoamRssi);
+  int32_t rssi;
+
+  if((0 == roam_rssi) || (WiFi_Scan_None != scan) || ((millis() - roam_check_ms) < WIFI_ROAM_CHECK_PERIOD_MS))
+  {
+    return;
+  }
+  roam_check_ms = millis();
+
+  rssi = WiFi.RSSI();
+  if(rssi < roam_rssi)
+  {
+    LOG_WARN(Log_Module_Wifi, "Weak signal (%d dBm): roaming scan", rssi);
+    WiFi_ScanStart(WiFi_Scan_Roam);
+  }
+}
+
+
+/*
+ * WiFi fast connect failed function
+ *  - This function drops the cached association and falls back to full scan and DHCP
+ */
+void WiFi_Manager::WiFi_FastConnectFailed()
+{
+  LOG_WARN(Log_Module_Wifi, "Fast connect FAILED: full scan");
+
+  rtc.Rtc_WiFiCacheInvalidate();
+  WiFi.disconnect();
+  WiFi_Begin();
+}
+
+
+/*
+ * WiFi cache association function
+ *  - This function stores BSSID, channel and IP lease obtained from DHCP in RTC memory
+ */
+void WiFi_Manager::WiFi_CacheAssociation()
+{
+  Rtc_WiFi_Cache_T cache;
+
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = (uint8_t)WiFi.channel();
+  cache.ip = (uint32_t)WiFi.localIP();
+  cache.gateway = (uint32_t)WiFi.gatewayIP();
+  cache.mask = (uint32_t)WiFi.subnetMask();
+  cache.dns = (uint32_t)WiFi.dnsIP();
+  
+  /* Lease time is not reported by the DHCP client - reuse it only for the configured time */
+  cache.lease_expiry_ms = rtc.Rtc_GetTimeMs() + param.Param_Get(Param_ID_LeaseReuse);
+
+  rtc.Rtc_WiFiCacheSet(ap_ssid, cache);
+}
+
+
+/*
+ * WiFi process function
+ *  - This function runs the connection state machine on events from WiFi and timers
+ *  - This function should be called periodically in the loop
+ */
+void WiFi_Manager::WiFi_Process()
+{
+  bool got_ip = evt_got_ip;
+  bool disconnected = evt_disconnected;
+  bool establish_timeout = evt_establish_timeout;
+  bool rollback_timeout = evt_rollback_timeout;
+  bool retry_timeout = evt_retry_timeout;
+  int8_t scan_cnt;
+
+  /* Scan results are polled - scan callback would run in the SDK context */
+  if(WiFi_Scan_None != scan)
+  {
+    scan_cnt = WiFi.scanComplete();
+
+    if(WIFI_SCAN_RUNNING != scan_cnt)
+    {
+      WiFi_ScanDone((WIFI_SCAN_FAILED == scan_cnt) ? 0 : scan_cnt);
+
+      if(scan_print_queued)
+      {
+        scan_print_queued = false;
+        WiFi_ScanStart(WiFi_Scan_Print);
+      }
+    }
+  }
+
+  if(WiFi_State_Connected == state)
+  {
+    WiFi_RoamCheck();
+    WiFi_LeaseCheck();
+  }
+  else
+  {
+    WiFi_PortalCheck();
+  }
+
+  /* Cached association did not come up in time - go the full path
+   * (disconnect events are not used - WiFi.disconnect() itself reports one) */
+  if(fast_connect && !got_ip && ((millis() - connect_start_ms) >= param.Param_Get(Param_ID_FastConnTimeout)))
+  {
+    WiFi_FastConnectFailed();
+  }
+
+  if(!(got_ip || disconnected || establish_timeout || rollback_timeout || retry_timeout))
+  {
+    /* Nothing happened */
+    return;
+  }
+  
+  evt_got_ip = false;
+  evt_disconnected = false;
+  evt_establish_timeout = false;
+  evt_rollback_timeout = false;
+  evt_retry_timeout = false;
+
+  switch(state)
   {
-    /* Wait for establishing the connection */
-    if(false != establish_failed)
+    case WiFi_State_Connecting:
+    {
+      if(got_ip)
+      {
+        LOG_INFO(Log_Module_Wifi, "Connected");
+        WiFi_LinkUp();
+      }
+      else if(establish_timeout)
+      {
+        /* Connecting broken due to timeout occurred */
+        LOG_WARN(Log_Module_Wifi, "Connection timeout");
+        WiFi_LinkDown();
+      }
+      break;
+    }
+
+    case WiFi_State_Connected:
+    {
+      if(disconnected && !got_ip)
+      {
+        LOG_ERROR(Log_Module_Wifi, "Connection ERROR");
+        WiFi_LinkDown();
+      }
+      else if(got_ip)
+      {
+        /* DHCP lease after the reused one expired - cached for the next reconnect */
+        LOG_INFO(Log_Module_Wifi, "DHCP lease: IP %s", WiFi.localIP().toString().c_str());
+        WiFi_CacheAssociation();
+      }
+      break;
+    }
+
+    case WiFi_State_Lost:
+    {
+      if(got_ip)
+      {
+        LOG_INFO(Log_Module_Wifi, "Connected after error");
+        WiFi_LinkUp();
+      }
+      else if(retry_timeout)
+      {
+        WiFi_Recover();
+      }
+      break;
+    }
+
+    case WiFi_State_Reassociating:
+    {
+      if(got_ip)
+      {
+        LOG_INFO(Log_Module_Wifi, "Reassociation OK");
+        
+        Stop_ap_rollback_tmr();
+        rollback_ssid = "";
+        rollback_pass = "";
+        WiFi_LinkUp();
+      }
+      else if(rollback_timeout)
+      {
+        WiFi_Rollback();
+      }
+      break;
+    }
+
+    default:
     {
-      /* Timeout occurred */
       break;
     }
-    delay(5);
   }
+}
+
 
-  if(WIFI_IS_DISCONNECTED())
+/*
+ * WiFi link up function
+ *  - This function is called when the station got IP address
+ */
+void WiFi_Manager::WiFi_LinkUp()
+{
+  if(WIFI_TIME_NOT_SET == link_up_time)
+  {
+    link_up_time = millis();
+    LOG_INFO(Log_Module_Wifi, "Link up after %u ms", link_up_time);
+  }
+  
+  /* Cache the association obtained by full scan and DHCP for the next reconnect */
+  if(!fast_connect)
   {
-    /* Connecting broken due to timeout occurred */
-    Serial.printf("WIFI -> Connection timeout\r\n");
+    WiFi_CacheAssociation();
+  }
+  fast_connect = false;
+  
+  /* Disable and reset "try reconnect" timer */
+  Stop_reconnect_tmr();
+
+  /* Station works - provisioning is not needed anymore */
+  prov.Prov_Stop();
+
+  if(outage)
+  {
+    outage = false;
+    metrics.recoveries++;
+    metrics.last_outage_ms = millis() - outage_start_ms;
+    metrics.total_outage_ms += metrics.last_outage_ms;
+    metrics.max_outage_ms = max(metrics.max_outage_ms, metrics.last_outage_ms);
+
+    LOG_INFO(Log_Module_Wifi, "Recovered after %u ms (%u retries)", metrics.last_outage_ms, retry_attempt);
+  }
+
+  WiFi_SetState(WiFi_State_Connected);
+  
+  /* Start Server */
+  WiFi_Restore();
+}
+
+
+/*
+ * WiFi link down function
+ *  - This function is called when the connection could not be established or was lost
+ */
+void WiFi_Manager::WiFi_LinkDown()
+{
+  if(!outage)
+  {
+    outage = true;
+    outage_start_ms = millis();
+    metrics.outages++;
+    
+    retry_attempt = 0;
+  }
+  
+  WiFi_SetState(WiFi_State_Lost);
+
+  /* Try the cached association first - auto reconnect would stick to the last BSSID */
+  WiFi_Begin();
+  
+  /* Start "try reconnect" timer */
+  retry_delay_ms = WiFi_NextRetryDelay();
+  Start_reconnect_tmr(retry_delay_ms);
+}
+
+
+/*
+ * WiFi recover function
+ *  - This function is called on every retry timeout while the link is down
+ *  - Recovery tiers:
+ *      1. association retry - delay grows exponentially up to "backoff_max_ms" (with jitter)
+ *      2. radio reset - every "radio_reset_n" retries (0 - never)
+ *      3. MCU reset - when the outage exceeds "mcu_reset_ms" (0 - never)
+ *  - Radio and MCU resets are skipped while a station is connected to the provisioning portal
+ *  - Sensor sampling and the serial console keep running in the meantime
+ */
+void WiFi_Manager::WiFi_Recover()
+{
+  uint32_t mcu_reset_ms = param.Param_Get(Param_ID_McuResetOutage);
+  uint32_t radio_reset_n = param.Param_Get(Param_ID_RadioResetRetries);
+  bool portal_in_use = prov.Prov_IsActive() && (0 != WiFi.softAPgetStationNum());
+
+  /* Never reset while somebody is connected to the provisioning portal */
+  if((0 != mcu_reset_ms) && (WiFi_GetOutageTime() >= mcu_reset_ms) && !portal_in_use)
+  {
+    LOG_ERROR(Log_Module_Wifi, "Reconnect failed: RESET");
+    logger.Log_Flush();
+    
+    WiFi.disconnect();
+    ESP.restart();
+
+    /* Wait until the reset occurs */
+    while(1);
+  }
+
+  retry_attempt++;
+  metrics.retries++;
+
+  if((0 != radio_reset_n) && (0 == (retry_attempt % radio_reset_n)) && !portal_in_use)
+  {
+    WiFi_RadioReset();
   }
   else
   {
-    /* WiFi is connected */
-    Serial.printf("WIFI -> Connected\r\n");
-    WiFi_Restore();
+    WiFi.disconnect();
   }
+
+  LOG_INFO(Log_Module_Wifi, "Reconnect retry %u", retry_attempt);
+  WiFi_Begin();
+
+  retry_delay_ms = WiFi_NextRetryDelay();
+  Start_reconnect_tmr(retry_delay_ms);
+}
+
+
+/*
+ * WiFi radio reset function
+ *  - This function switches the radio off and on again (clears the SDK station state)
+ *  - SoftAP of the provisioning portal is brought up again with the station
+ */
+void WiFi_Manager::WiFi_RadioReset()
+{
+  LOG_WARN(Log_Module_Wifi, "Radio reset");
+  metrics.radio_resets++;
+
+  WiFi.mode(WIFI_OFF);
+  WiFi.mode(prov.Prov_IsActive() ? WIFI_AP_STA : WIFI_STA);
+}
+
+
+/*
+ * WiFi next retry delay function
+ *  - This function returns "reconnect_ms" doubled for every retry, limited to "backoff_max_ms"
+ *  - Random jitter (up to half of the delay) spreads reconnects of many nodes after AP restart
+ */
+uint32_t WiFi_Manager::WiFi_NextRetryDelay()
+{
+  uint32_t backoff_max_ms = param.Param_Get(Param_ID_BackoffMax);
+  uint32_t delay_ms = param.Param_Get(Param_ID_ReconnectTimeout);
+
+  for(uint32_t idx = 0; (idx < retry_attempt) && (delay_ms < backoff_max_ms); idx++)
+  {
+    delay_ms <<= 1;
+  }
+  delay_ms = min(delay_ms, backoff_max_ms);
+
+  return (delay_ms / 2) + (uint32_t)random((long)(delay_ms / 2) + 1);
+}
+
+
+/*
+ * WiFi set state function
+ *  - This function changes state of the connection state machine
+ */
+void WiFi_Manager::WiFi_SetState(WiFi_State_T new_state)
+{
+  state = new_state;
 }
 
 
@@ -95,7 +774,6 @@ void WiFi_Manager::WiFi_Connect()
  */
 void WiFi_Manager::WiFi_Restore()
 {
-  /* No timeout -> WiFi.status() == WL_CONNECTED */
   char buf[16];
 
   /* Get IP address */
@@ -104,68 +782,218 @@ void WiFi_Manager::WiFi_Restore()
   /* Convert ip addres to char* and store it in the 'buf' */
   sprintf(buf, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
   
-  printf("WIFI -> IP address: %s\r\n\r\n", buf);
+  LOG_INFO(Log_Module_Wifi, "IP address: %s", buf);
   
   /* Start server */
-  server.Server_Init();
+  if(!link_only)
+  {
+    server.Server_Init();
+  }
 }
 
 
 /*
  * Establish connection failed event
  *  - This function is called when establishing wifi connection is failed (only when wifi is initialized)
- *  - Time for establishing is declared in tmr_manager.h (TMR_ESTABLISH_CONNECTION_TIMEOUT_MS)
+ *  - Time for establishing is the "est_conn_ms" runtime parameter
  */
 void WiFi_Manager::WiFi_establish_connection_timeout_event()
 {
-  establish_failed = true;
+  evt_establish_timeout = true;
 }
 
 
 /*
  * Reconnect failed event
- *  - This function is called when wifi reconnecting is failed
- *  - Time for reconnection is declared in tmr_manager.h (TMR_RECONNECT_TIMEOUT_MS)
+ *  - This function is called when wifi reconnecting is failed (timer context)
+ *  - Next recovery step is taken in WiFi_Process() (see WiFi_Recover())
  */
 void WiFi_Manager::WiFi_reconnect_failed_timeout_event()
 {
-  Serial.printf("WIFI -> Reconnect failed: RESET\r\n");
-  
+  evt_retry_timeout = true;
+}
+
+
+/*
+ * Reassociate function
+ *  - This function switches to the AP credentials just written to NvM without reboot
+ *  - Old credentials are kept and restored when the new AP does not connect in time
+ */
+void WiFi_Manager::WiFi_Reassociate()
+{
+  rollback_ssid = ap_list_ssid[0];
+  rollback_pass = ap_list_pass[0];
+
+  WiFi_ReloadApList();
+  LOG_INFO(Log_Module_Wifi, "Reassociating: %s", ap_list_ssid[0].c_str());
+
+  Stop_reconnect_tmr();
+  evt_rollback_timeout = false;
+  WiFi_SetState(WiFi_State_Reassociating);
+
+  /* New primary AP is used directly - other known APs must not hide its failure */
   WiFi.disconnect();
-  ESP.restart();
+  fast_connect = false;
+  WiFi_BeginAp(0, 0, NULL);
 
-  /* Wait until the reset occurs */
-  while(1);
+  Start_ap_rollback_tmr(param.Param_Get(Param_ID_ApRollbackTimeout));
 }
 
 
 /*
- * Set Connection lost flag
- *  - This function should be called to indicate lost WiFi connection
+ * Rollback function
+ *  - This function restores previous AP credentials when the new AP failed
+ *  - Without previous credentials (fresh node) the new ones are kept and retried by the link recovery
  */
-void WiFi_Manager::WiFi_set_connection_lost_flag()
+void WiFi_Manager::WiFi_Rollback()
 {
-  connection_lost = true;
+  if(0 == rollback_ssid.length())
+  {
+    LOG_ERROR(Log_Module_Wifi, "Reassociation FAILED: no previous AP, retrying %s", ap_list_ssid[0].c_str());
+    WiFi_LinkDown();
+    return;
+  }
+
+  LOG_ERROR(Log_Module_Wifi, "Reassociation FAILED: rollback to %s", rollback_ssid.c_str());
+  
+  /* Restore previous credentials in NvM and RAM */
+  (void)eeprom.Nvm_CredentialsWrite(Nvm_Credentials_AP, rollback_ssid.c_str(), rollback_pass.c_str(), rollback_ssid.length(), rollback_pass.length());
+  ap_list_ssid[0] = rollback_ssid;
+  ap_list_pass[0] = rollback_pass;
+
+  /* Connection lost handling takes over from now */
+  WiFi_LinkDown();
+}
+
+
+/*
+ * Reassociation pending function
+ *  - This function returns true while the AP change is in progress
+ */
+bool WiFi_Manager::WiFi_ReassociationPending()
+{
+  return (WiFi_State_Reassociating == state);
 }
 
 
 /*
- * Clear Connection lost flag
- *  - This function should be called to indicate restore WiFi connection
+ * AP rollback timeout event
+ *  - This function is called when the new AP was not connected in time (timer context)
+ *  - Time for reassociation is the "ap_rollback_ms" runtime parameter
  */
-void WiFi_Manager::WiFi_clear_connection_lost_flag()
+void WiFi_Manager::WiFi_ap_rollback_timeout_event()
 {
-  connection_lost = false;
+  evt_rollback_timeout = true;
+}
+
+
+/*
+ * Get state function
+ *  - This function returns state of the connection state machine
+ */
+WiFi_State_T WiFi_Manager::WiFi_GetState()
+{
+  return state;
+}
+
+
+/*
+ * Is connected function
+ *  - This function returns true when the station has IP address
+ */
+bool WiFi_Manager::WiFi_IsConnected()
+{
+  return (WiFi_State_Connected == state);
 }
 
 
 /*
  * Get Connection lost flag
- *  - This function returns WiFi connection lost flag
+ *  - This function returns true when the connection could not be established or was lost
  */
 bool WiFi_Manager::WiFi_get_connection_lost_flag()
 {
-  return connection_lost;
+  return (WiFi_State_Lost == state);
+}
+
+
+/*
+ * Get link up time
+ *  - This function returns time (ms since boot) of the first successful connection
+ */
+uint32_t WiFi_Manager::WiFi_GetLinkUpTime()
+{
+  return link_up_time;
+}
+
+
+/*
+ * Resume recovery function
+ *  - This function restarts the retry timer stopped by the login commands
+ *  - Timer is started only when the WiFi connection is lost
+ */
+void WiFi_Manager::WiFi_ResumeRecovery()
+{
+  if(WiFi_State_Lost == state)
+  {
+    Start_reconnect_tmr(retry_delay_ms);
+  }
+}
+
+
+/*
+ * Reload AP list function
+ *  - This function reads the list of known APs from NvM (used from the next selection)
+ */
+void WiFi_Manager::WiFi_ReloadApList()
+{
+  for(uint8_t idx = 0; idx < NVM_AP_LIST_MAX; idx++)
+  {
+    eeprom.Nvm_ApListRead(idx, ap_list_ssid[idx], ap_list_pass[idx]);
+  }
+}
+
+
+/*
+ * AP list print function
+ *  - This function prints SSIDs of known APs on console
+ */
+void WiFi_Manager::WiFi_ApListPrint(Print &out)
+{
+  for(uint8_t idx = 0; idx < NVM_AP_LIST_MAX; idx++)
+  {
+    out.printf("WIFI -> AP %u: %s\r\n", idx + 1, (0 != ap_list_ssid[idx].length()) ? ap_list_ssid[idx].c_str() : "-");
+  }
+}
+
+
+/*
+ * Scan print function
+ *  - This function starts scan, results are printed on console when ready
+ */
+void WiFi_Manager::WiFi_ScanPrint()
+{
+  WiFi_ScanStart(WiFi_Scan_Print);
+}
+
+
+/*
+ * Get metrics function
+ *  - This function returns link outage and recovery statistics
+ */
+const WiFi_Metrics_T &WiFi_Manager::WiFi_GetMetrics()
+{
+  return metrics;
+}
+
+
+/*
+ * Get outage time function
+ *  - This function returns duration of the current outage (0 - link is up)
+ */
+uint32_t WiFi_Manager::WiFi_GetOutageTime()
+{
+  return outage ? (millis() - outage_start_ms) : 0;
 }
 
 /* EOF */
@@ -12,6 +12,11 @@
 #include <ESP8266WiFi.h>
 #include "nvm_manager.h"
 #include "server_manager.h"
+#include "param_manager.h"
+#include "rtc_manager.h"
+#include "wifi_select.h"
+#include "prov_manager.h"
+#include "tmr_config.h"
 
 /* ==================================================================== */
 /* ============================= defines ============================== */
@@ -19,6 +24,62 @@
 #define WIFI_IS_CONNECTED()     (WL_CONNECTED == WiFi.status())
 #define WIFI_IS_DISCONNECTED()  (WL_CONNECTED != WiFi.status())
 
+/* Link up time not measured yet */
+#define WIFI_TIME_NOT_SET       ((uint32_t)0)
+
+/* Scan results taken into account by the AP selection - the strongest ones are kept */
+#define WIFI_SCAN_RESULTS_MAX   (16)
+
+/* Signal check period while connected (roaming scan is started below "roam_rssi") */
+#define WIFI_ROAM_CHECK_PERIOD_MS   (30000)
+
+/* Default values - runtime values are kept by Param_Manager
+ *  - scan when RSSI drops below the threshold (0 - roaming disabled)
+ *  - switch AP only when another one is stronger by the hysteresis */
+#define WIFI_ROAM_RSSI_DBM          (-75)
+#define WIFI_ROAM_HYSTERESIS_DB     (8)
+
+/* ==================================================================== */
+/* ============================ typedefs ============================== */
+/* ==================================================================== */
+/* Station connection states */
+typedef enum WiFi_State_Tag
+{
+  WiFi_State_Idle = 0,
+  WiFi_State_Connecting,
+  WiFi_State_Connected,
+  WiFi_State_Lost,
+  WiFi_State_Reassociating
+  
+}WiFi_State_T;
+
+/* Purpose of the running scan - ordered by importance */
+typedef enum WiFi_Scan_Tag
+{
+  WiFi_Scan_None = 0,
+  WiFi_Scan_Connect,
+  WiFi_Scan_Roam,
+  WiFi_Scan_Print
+  
+}WiFi_Scan_T;
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Link outage and recovery statistics (since boot) */
+typedef struct WiFi_Metrics_Tag
+{
+  uint32_t outages;
+  uint32_t recoveries;
+  uint32_t retries;
+  uint32_t radio_resets;
+  uint32_t roams;
+  uint32_t last_outage_ms;
+  uint32_t max_outage_ms;
+  uint32_t total_outage_ms;
+
+}WiFi_Metrics_T;
+
 /* ==================================================================== */
 /* ============================ classes =============================== */
 /* ==================================================================== */
@@ -26,14 +87,79 @@ class WiFi_Manager
 {
   public:
     void WiFi_Connect();
+    void WiFi_SetLinkOnly();
+    void WiFi_Process();
     void WiFi_Restore();
     void WiFi_establish_connection_timeout_event();
     void WiFi_reconnect_failed_timeout_event();
 
-    /* Connection lost related methods */
-    void WiFi_set_connection_lost_flag();
-    void WiFi_clear_connection_lost_flag();
+    /* Live AP credentials change related methods */
+    void WiFi_Reassociate();
+    bool WiFi_ReassociationPending();
+    void WiFi_ap_rollback_timeout_event();
+
+    /* Connection state related methods */
+    WiFi_State_T WiFi_GetState();
+    bool WiFi_IsConnected();
     bool WiFi_get_connection_lost_flag();
+    uint32_t WiFi_GetLinkUpTime();
+
+    /* Link recovery related methods */
+    void WiFi_ResumeRecovery();
+    const WiFi_Metrics_T &WiFi_GetMetrics();
+    uint32_t WiFi_GetOutageTime();
+
+    /* Access point list related methods */
+    void WiFi_ReloadApList();
+    void WiFi_ScanPrint();
+    void WiFi_ApListPrint(Print &out = Serial);
+
+  private:
+    WiFi_State_T state;
+    bool link_only;
+    
+    /* Fast connect (cached BSSID, channel and IP lease) in progress */
+    bool fast_connect;
+    uint32_t connect_start_ms;
+
+    /* Reused IP lease (static config) in use and the end of its reuse window (RTC time) */
+    bool static_lease;
+    uint32_t lease_expiry_ms;
+
+    /* Link recovery state */
+    bool outage;
+    uint32_t outage_start_ms;
+    uint32_t retry_attempt;
+    uint32_t retry_delay_ms;
+    WiFi_Metrics_T metrics;
+
+    /* Access point selection state */
+    WiFi_Scan_T scan;
+    bool scan_print_queued;
+    uint8_t ap_idx;
+    uint32_t roam_check_ms;
+    
+    /* Event handlers have to be kept alive to stay registered */
+    WiFiEventHandler got_ip_handler;
+    WiFiEventHandler disconnected_handler;
+
+    void WiFi_SetState(WiFi_State_T new_state);
+    void WiFi_Begin();
+    void WiFi_BeginAp(uint8_t idx, int32_t channel, const uint8_t *bssid);
+    void WiFi_ScanStart(WiFi_Scan_T purpose);
+    void WiFi_ScanDone(int8_t scan_cnt);
+    void WiFi_RoamCheck();
+    void WiFi_PortalCheck();
+    bool WiFi_ApListEmpty();
+    void WiFi_FastConnectFailed();
+    void WiFi_CacheAssociation();
+    void WiFi_LeaseCheck();
+    void WiFi_Recover();
+    void WiFi_RadioReset();
+    uint32_t WiFi_NextRetryDelay();
+    void WiFi_LinkUp();
+    void WiFi_LinkDown();
+    void WiFi_Rollback();
 };
 
 #endif /* _WIFI_MANAGER_H_ */
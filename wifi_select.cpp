@@ -0,0 +1,100 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       wifi_select.cpp
+ *
+ *  Access point selection:
+ *    - only networks from the known list (non-empty SSID) are considered
+ *    - the strongest BSSID wins, equal RSSI prefers the earlier list entry
+ *    - the current BSSID is kept unless another one is stronger by the hysteresis,
+ *      so nodes between two APs of similar strength do not flip back and forth
+ *
+ *  Module has no Arduino dependencies - it is also built by tools/wifi_select_sim
+ */
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <string.h>
+#include "wifi_select.h"
+
+/* ==================================================================== */
+/* ================== local function definitions  ===================== */
+/* ==================================================================== */
+
+/*
+ * WiFi_SelectKnownIdx
+ *  - This function returns index of the SSID in the known list (WIFI_SELECT_NONE if unknown)
+ */
+static int16_t WiFi_SelectKnownIdx(const char *ssid, const char *const *known_ssid, uint8_t known_cnt)
+{
+  for(uint8_t idx = 0; idx < known_cnt; idx++)
+  {
+    if((NULL != known_ssid[idx]) && ('\0' != known_ssid[idx][0]) && (0 == strcmp(known_ssid[idx], ssid)))
+    {
+      return idx;
+    }
+  }
+  return WIFI_SELECT_NONE;
+}
+
+/* ==================================================================== */
+/* ============================ functions ============================= */
+/* ==================================================================== */
+
+/*
+ * WiFi_SelectAp
+ *  - This function selects the access point to associate with from the scan results
+ *  - current_bssid is NULL when the station is not associated
+ *  - It returns index of the selected scan entry (WIFI_SELECT_NONE if no known network is visible),
+ *    index of the matching known list entry is stored in known_idx
+ */
+int16_t WiFi_SelectAp(const WiFi_Scan_Entry_T *scan, uint16_t scan_cnt,
+                      const char *const *known_ssid, uint8_t known_cnt,
+                      const uint8_t *current_bssid, uint8_t hysteresis_db, uint8_t *known_idx)
+{
+  int16_t best = WIFI_SELECT_NONE;
+  int16_t best_known = WIFI_SELECT_NONE;
+  int16_t current = WIFI_SELECT_NONE;
+  int16_t current_known = WIFI_SELECT_NONE;
+  int16_t entry_known;
+
+  for(uint16_t idx = 0; idx < scan_cnt; idx++)
+  {
+    entry_known = WiFi_SelectKnownIdx(scan[idx].ssid, known_ssid, known_cnt);
+
+    if(WIFI_SELECT_NONE == entry_known)
+    {
+      continue;
+    }
+
+    if((NULL != current_bssid) && (0 == memcmp(scan[idx].bssid, current_bssid, WIFI_SELECT_BSSID_SIZE)))
+    {
+      current = idx;
+      current_known = entry_known;
+    }
+
+    if((WIFI_SELECT_NONE == best) ||
+       (scan[idx].rssi > scan[best].rssi) ||
+       ((scan[idx].rssi == scan[best].rssi) && (entry_known < best_known)))
+    {
+      best = idx;
+      best_known = entry_known;
+    }
+  }
+
+  /* Stay with the current AP unless the best one is stronger by the hysteresis */
+  if((WIFI_SELECT_NONE != current) && ((int16_t)scan[best].rssi < ((int16_t)scan[current].rssi + hysteresis_db)))
+  {
+    best = current;
+    best_known = current_known;
+  }
+
+  if((WIFI_SELECT_NONE != best) && (NULL != known_idx))
+  {
+    *known_idx = (uint8_t)best_known;
+  }
+  return best;
+}
+
+/* EOF */
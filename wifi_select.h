@@ -0,0 +1,47 @@
+/*
+ *  @Author:          Jakub Witowski
+ *  @Project name:    iBeacon
+ *  @File name:       wifi_select.h
+ */
+#ifndef _WIFI_SELECT_H_
+#define _WIFI_SELECT_H_
+
+/* ==================================================================== */
+/* ========================== include files =========================== */
+/* ==================================================================== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ==================================================================== */
+/* ============================= defines ============================== */
+/* ==================================================================== */
+/* SSID is limited to 32 chars by 802.11 */
+#define WIFI_SELECT_SSID_MAX_SIZE   (32)
+#define WIFI_SELECT_BSSID_SIZE      (6)
+
+/* No known network visible */
+#define WIFI_SELECT_NONE            ((int16_t)-1)
+
+/* ==================================================================== */
+/* =========================== structures ============================= */
+/* ==================================================================== */
+/* Single scan result */
+typedef struct WiFi_Scan_Entry_Tag
+{
+  char ssid[WIFI_SELECT_SSID_MAX_SIZE + 1];
+  uint8_t bssid[WIFI_SELECT_BSSID_SIZE];
+  uint8_t channel;
+  int8_t rssi;
+
+}WiFi_Scan_Entry_T;
+
+/* ==================================================================== */
+/* ===================== function declarations ======================== */
+/* ==================================================================== */
+int16_t WiFi_SelectAp(const WiFi_Scan_Entry_T *scan, uint16_t scan_cnt,
+                      const char *const *known_ssid, uint8_t known_cnt,
+                      const uint8_t *current_bssid, uint8_t hysteresis_db, uint8_t *known_idx);
+
+#endif /* _WIFI_SELECT_H_ */
+
+/* EOF */